@@ -15,11 +15,13 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <string.h>
 #include <math.h>
 
 #include <chimaera.h>
 #include <debug.h>
 #include <eeprom.h>
+#include <journal.h>
 #include <linalg.h>
 #include "../cmc/cmc_private.h"
 
@@ -35,6 +37,37 @@ float curve [0x800];
 static Calibration_Array *arr =(Calibration_Array *)curve;
 static Calibration_Point point;
 
+// curve-fit parameters the lookup table has been computed for
+static float curve_C [3];
+static uint_fast8_t curve_valid = 0;
+
+static void
+_range_saved(EEPROM_Image *image)
+{
+	(void)image;
+	config_touch("/calibration/saving"); // notify subscribers about finished save
+}
+
+// records rotate through frames, hashing pages would not pay off
+static EEPROM_Image range_image = {
+	.valid = 0,
+	.n = 0,
+	.hash = NULL,
+	.cb = _range_saved
+};
+
+// slots are journaled with CRC, the newest valid record of a slot is loaded
+static Journal range_journal;
+
+// journal records are checked by a CRC computed when the save is pushed,
+// thus range must not change before the pending record has been written
+static void
+_range_settle(void)
+{
+	if(range_image.status == EEPROM_STATUS_PENDING)
+		eeprom_queue_flush();
+}
+
 static float
 _as(uint16_t qui, uint16_t out_s, uint16_t out_n, uint16_t b)
 {
@@ -58,17 +91,35 @@ range_load(uint_fast8_t pos)
 		range_save(pos);
 	}
 	*/
-	eeprom_bulk_read(eeprom_24LC64, EEPROM_RANGE_OFFSET + pos*EEPROM_RANGE_SIZE,(uint8_t *)&range, sizeof(range));
+	uint_fast8_t loaded = 1;
+
+	_range_settle();
+
+	if(!range_journal.frames) // scan journal on first access
+		journal_init(&range_journal, eeprom_24LC64, EEPROM_RANGE_OFFSET, EEPROM_RANGE_JOURNAL_SIZE, sizeof(range));
+
+	if(!journal_read(&range_journal, pos, (uint8_t *)&range, sizeof(range)))
+	{
+		if(journal_empty(&range_journal)) // legacy layout, import until next save
+			eeprom_bulk_read(eeprom_24LC64, EEPROM_RANGE_OFFSET + pos*EEPROM_RANGE_SIZE,(uint8_t *)&range, sizeof(range));
+		else // no valid record of this slot, rather use factory settings than garbage
+		{
+			range_reset();
+			loaded = 0;
+		}
+	}
 	
 	range_curve_update();
 
-	return 1;
+	return loaded;
 }
 
 uint_fast8_t
 range_reset(void)
 {
 	uint_fast8_t i;
+
+	_range_settle();
 	for(i=0; i<SENSOR_N; i++)
 	{
 		range.thresh[i] = 0;
@@ -87,23 +138,34 @@ range_reset(void)
 uint_fast8_t
 range_save(uint_fast8_t pos)
 {
-	eeprom_bulk_write(eeprom_24LC64, EEPROM_RANGE_OFFSET + pos*EEPROM_RANGE_SIZE,(uint8_t *)&range, sizeof(range));
+	if(!range_journal.frames) // scan journal on first access
+		journal_init(&range_journal, eeprom_24LC64, EEPROM_RANGE_OFFSET, EEPROM_RANGE_JOURNAL_SIZE, sizeof(range));
 
-	return 1;
+	if(journal_empty(&range_journal)) // first save overwrites the legacy layout, carry its slots over
+	{
+		if(calibrating) // curve buffer holds the calibration arrays
+			return 0;
+
+		journal_import(&range_journal, EEPROM_RANGE_SIZE, EEPROM_RANGE_MAX + 1, (uint8_t *)curve, sizeof(range), &range_image);
+
+		curve_valid = 0; // curve buffer was used as temporary memory
+		range_curve_update();
+	}
+
+	// pages are written in the background by eeprom_queue_step
+	return journal_write(&range_journal, pos, (uint8_t *)&range, sizeof(range), &range_image);
 }
 
 void
 range_curve_update(void)
 {
-	uint32_t i;
+	if(curve_valid && !memcmp(curve_C, range.C, sizeof(curve_C))) // lookup table is up-to-date
+		return;
 
-	for(i=0; i<0x800; i++)
-	{
-		float x =(float)i /(float)0x7ff;
-		float y = range.C[0]*cbrtf(x) + range.C[1]*sqrtf(x) + range.C[2]*x;
-		y = y < 0.f ? 0.f :(y > 1.f ? 1.f : y);
-		curve[i] = y;
-	}
+	range_curve_fill(curve, range.C);
+
+	memcpy(curve_C, range.C, sizeof(curve_C));
+	curve_valid = 1;
 }
 
 void
@@ -168,6 +230,10 @@ void
 range_init(void)
 {
 	uint_fast8_t i;
+
+	_range_settle();
+
+	curve_valid = 0; // lookup table is used as temporary memory while calibrating
 	for(i=0; i<SENSOR_N; i++)
 	{
 		// moving average over 16 samples
@@ -714,8 +780,27 @@ _calibration_save(const char *path, const char *fmt, uint_fast8_t argc, osc_data
 	buf_ptr = osc_get_int32(buf_ptr, &uuid);
 	buf_ptr = osc_get_int32(buf_ptr, &pos);
 
-	range_save(pos);
-	size = CONFIG_SUCCESS("is", uuid, path);
+	if(range_save(pos))
+		size = CONFIG_SUCCESS("is", uuid, path);
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "saving calibration to EEPROM failed");
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_calibration_saving(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("issi", uuid, path, config_saving_args_values[range_image.status].s, range_image.written);
 	CONFIG_SEND(size);
 
 	return 1;
@@ -734,8 +819,10 @@ _calibration_load(const char *path, const char *fmt, uint_fast8_t argc, osc_data
 	buf_ptr = osc_get_int32(buf_ptr, &uuid);
 	buf_ptr = osc_get_int32(buf_ptr, &pos);
 
-	range_load(pos);
-	size = CONFIG_SUCCESS("is", uuid, path);
+	if(range_load(pos))
+		size = CONFIG_SUCCESS("is", uuid, path);
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "no valid calibration in slot, reset to factory settings");
 	CONFIG_SEND(size);
 
 	return 1;
@@ -754,6 +841,7 @@ _calibration_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_dat
 
 	// reset calibration range
 	range_reset();
+	range_curve_update();
 
 	size = CONFIG_SUCCESS("is", uuid, path);
 	CONFIG_SEND(size);
@@ -800,6 +888,7 @@ static const OSC_Query_Argument calibration_curve_args [] = {
 const OSC_Query_Item calibration_tree [] = {
 	OSC_QUERY_ITEM_METHOD("load", "Load calibration from EEPROM", _calibration_load, calibration_load_args),
 	OSC_QUERY_ITEM_METHOD("save", "Save calibration to EEPROM", _calibration_save, calibration_save_args),
+	OSC_QUERY_ITEM_METHOD("saving", "Status of last calibration save to EEPROM", _calibration_saving, config_saving_args),
 	OSC_QUERY_ITEM_METHOD("reset", "Reset calibration to factory settings", _calibration_reset, NULL),
 
 	OSC_QUERY_ITEM_METHOD("start", "Start calibration procedure", _calibration_start, NULL),
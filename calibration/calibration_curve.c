@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <math.h>
+
+#include <chimaera.h>
+#include <oscquery.h>
+
+#include "calibration_private.h"
+
+#define CURVE_HALLEY 0x40 // below, one step from the previous root would not reach float precision
+
+// samples y = C0*cbrt(x) + C1*sqrt(x) + C2*x for x in [0, 1], clipped to [0, 1],
+// cube roots of the sample index continue by one Halley step from the previous one instead of cbrtf
+void
+range_curve_fill(float *table, const float *C)
+{
+	const float dx = 1.f /(float)0x7ff;
+	const float C0 = C[0]*cbrtf(dx); // cbrt(x) = cbrt(i) * cbrt(dx)
+	float c = 0.f; // cbrt(i)
+	uint32_t i;
+
+	for(i=0; i<0x800; i++)
+	{
+		float fi =(float)i;
+		float x = fi*dx;
+
+		if(i < CURVE_HALLEY)
+			c = cbrtf(fi);
+		else
+		{
+			float c3 = c*c*c;
+			c *=(c3 + 2.f*fi) /(2.f*c3 + fi);
+		}
+
+		float y = C0*c + C[1]*sqrtf(x) + C[2]*x;
+		table[i] = y < 0.f ? 0.f :(y > 1.f ? 1.f : y);
+	}
+}
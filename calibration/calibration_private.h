@@ -34,4 +34,6 @@ struct _Calibration_Point {
 	float B0, B1, B2, B3;
 };
 
+void range_curve_fill(float *table, const float *C); // 0x800 samples of the curve-fit
+
 #endif // _CALIBRATION_PRIVATE_H_
@@ -23,3 +23,28 @@ const uint_fast8_t buf_i_ptr = 0;
 // the buffers should be aligned to 32bit, as most we write to it is a multiple of 32bit(OSC, SNTP, DHCP, ARP, etc.)
 uint8_t buf_o [2][CHIMAERA_BUFSIZE] __attribute__((aligned(4))); // general purpose output buffer
 uint8_t buf_i [1][CHIMAERA_BUFSIZE] __attribute__((aligned(4))); // general purpose input buffer;
+uint8_t buf_r [BUF_R_NUM][CHIMAERA_BUFSIZE] __attribute__((aligned(4))); // reply buffer pool
+uint8_t buf_r_owner [BUF_R_NUM] = {BUF_R_FREE};
+uint16_t buf_r_dropped = 0;
+
+uint8_t *
+buf_r_acquire(Buf_R_Owner owner)
+{
+	uint_fast8_t i;
+	for(i=0; i<BUF_R_NUM; i++)
+		if(buf_r_owner[i] == BUF_R_FREE)
+		{
+			buf_r_owner[i] = owner;
+			return buf_r[i];
+		}
+
+	buf_r_dropped++; // pool exhausted, reply is dropped
+	return NULL;
+}
+
+void
+buf_r_release(uint8_t *base)
+{
+	uint_fast8_t i = (base - buf_r[0]) / CHIMAERA_BUFSIZE;
+	buf_r_owner[i] = BUF_R_FREE;
+}
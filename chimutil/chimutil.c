@@ -32,6 +32,7 @@
 #include <sntp.h>
 #include <ptp.h>
 #include <debug.h>
+#include <rtpmidi.h>
 
 uint_fast8_t
 ip_part_of_subnet(uint8_t *ip)
@@ -188,6 +189,16 @@ debug_enable(uint8_t b)
 {
 	Socket_Config *socket = &config.debug.osc.socket;
 
+	if(config.rtpmidi.socket.enabled) // shares socket with rtpmidi
+	{
+		if(!b) // leave socket to rtpmidi
+		{
+			socket->enabled = 0;
+			return;
+		}
+		rtpmidi_enable(0); // automatically disable rtpmidi
+	}
+
 	socket->enabled = b;
 
 	if(!config.debug.osc.mode)
@@ -210,6 +221,35 @@ debug_enable(uint8_t b)
 	}
 }
 
+void
+rtpmidi_enable(uint8_t b)
+{
+	Socket_Config *socket = &config.rtpmidi.socket;
+
+	if(!b && !socket->enabled) // leave socket to debug
+		return;
+
+	if(b && config.debug.osc.socket.enabled) // shares socket with debug
+		debug_enable(0); // automatically disable debug
+
+	if(socket->enabled)
+		rtpmidi_reset(0); // end session
+
+	socket->enabled = b;
+	udp_end(socket->sock);
+
+	if(socket->enabled)
+	{
+		udp_set_remote(socket->sock, socket->ip, socket->port[DST_PORT]);
+		udp_begin(socket->sock, socket->port[SRC_PORT],
+			wiz_is_multicast(socket->ip));
+
+		rtpmidi_reset(1); // start session
+	}
+
+	cmc_engines_update();
+}
+
 void 
 mdns_enable(uint8_t b)
 {
@@ -33,6 +33,7 @@
 #include <tuio1.h>
 #include <scsynth.h>
 #include <oscmidi.h>
+#include <rtpmidi.h>
 #include <dummy.h>
 #include <custom.h>
 
@@ -41,16 +42,19 @@ CMC_Engine *engines [ENGINE_MAX+1];
 uint_fast8_t cmc_engines_active = 0;
 CMC_Group *cmc_groups = config.groups;
 uint16_t cmc_groups_n = GROUP_MAX;
+uint_fast8_t cmc_n_aoi = 0;
 
 #ifdef BENCHMARK
 Stop_Watch sw_engine_process = {.id = "engine_process", .thresh=3000};
 #endif
 
 // locals
+static uint_fast8_t defer = 0; // nesting depth of deferred engine updates
+static uint_fast8_t deferred = 0; // CMC_DEFER_GROUP | CMC_DEFER_ENGINES
+static uint_fast8_t deferred_engines = 0; // bitmask into engines_all
 static uint16_t idle_word = 0;
 static uint8_t idle_bit = 0;
 
-static uint_fast8_t n_aoi;
 static uint8_t aoi[BLOB_MAX*13]; //TODO how big? BLOB_MAX * 5,7,9 ?
 
 static uint_fast8_t n_peaks;
@@ -191,7 +195,7 @@ cmc_process(OSC_Timetag now, OSC_Timetag offset, int16_t *rela, osc_data_t *buf,
 	/*
 	 * find areas of interest
 	 */
-	n_aoi = 0;
+	cmc_n_aoi = 0;
 	uint_fast8_t pos;
 	for(pos=0; pos<SENSOR_N; pos++)
 	{
@@ -200,7 +204,7 @@ cmc_process(OSC_Timetag now, OSC_Timetag offset, int16_t *rela, osc_data_t *buf,
 		uint16_t aval = abs(val);
 		if( (aval << 1) > range.thresh[pos] ) // aval > thresh / 2?
 		{
-			aoi[n_aoi++] = newpos;
+			aoi[cmc_n_aoi++] = newpos;
 
 			vn[newpos] = val < 0 ? POLE_NORTH : POLE_SOUTH;
 			va[newpos] = aval > range.thresh[pos];
@@ -219,7 +223,7 @@ cmc_process(OSC_Timetag now, OSC_Timetag offset, int16_t *rela, osc_data_t *buf,
 	uint_fast8_t up = 1;
 	uint_fast8_t a;
 	uint_fast8_t p1 = aoi[0];
-	for(a=1; a<n_aoi; a++)
+	for(a=1; a<cmc_n_aoi; a++)
 	{
 		uint_fast8_t p0 = p1;
 		p1 = aoi[a];
@@ -795,31 +799,82 @@ cmc_group_reset(void)
 	cmc_group_update();
 }
 
+static CMC_Engine *const engines_all [ENGINE_MAX] = {
+	&oscmidi_engine,
+	&dummy_engine,
+	&scsynth_engine,
+	&tuio2_engine,
+	&tuio1_engine,
+	&custom_engine,
+	&rtpmidi_engine
+};
+
 static void
 cmc_engines_init(void)
 {
-	if(oscmidi_engine.init_cb)
-		oscmidi_engine.init_cb();
+	uint_fast8_t e;
+	for(e=0; e<ENGINE_MAX; e++)
+		if(engines_all[e]->init_cb)
+			engines_all[e]->init_cb();
+}
 
-	if(dummy_engine.init_cb)
-		dummy_engine.init_cb();
+void
+cmc_engine_init(CMC_Engine *engine)
+{
+	if(defer)
+	{
+		uint_fast8_t e;
+		for(e=0; e<ENGINE_MAX; e++)
+			if(engines_all[e] == engine)
+				deferred_engines |= 1 << e;
+		return;
+	}
 
-	if(scsynth_engine.init_cb)
-		scsynth_engine.init_cb();
+	if(engine->init_cb)
+		engine->init_cb();
+}
 
-	if(tuio2_engine.init_cb)
-		tuio2_engine.init_cb();
+void
+cmc_defer_begin(void)
+{
+	defer++;
+}
 
-	if(tuio1_engine.init_cb)
-		tuio1_engine.init_cb();
+void
+cmc_defer_end(void)
+{
+	if(!defer || --defer) // not deferring or still nested
+		return;
 
-	if(custom_engine.init_cb)
-		custom_engine.init_cb();
+	if(deferred & CMC_DEFER_GROUP) // reinitializes all engines
+	{
+		cmc_group_update();
+		deferred_engines = 0;
+	}
+	else if(deferred_engines)
+	{
+		uint_fast8_t e;
+		for(e=0; e<ENGINE_MAX; e++)
+			if(deferred_engines & (1 << e))
+				cmc_engine_init(engines_all[e]);
+		deferred_engines = 0;
+	}
+
+	if(deferred & CMC_DEFER_ENGINES)
+		cmc_engines_update();
+
+	deferred = 0;
 }
 
 void
 cmc_group_update(void)
 {
+	if(defer)
+	{
+		deferred |= CMC_DEFER_GROUP;
+		return;
+	}
+
 	uint16_t gid;
 	for(gid=0; gid<GROUP_MAX; gid++)
 	{
@@ -836,6 +891,12 @@ cmc_group_update(void)
 void
 cmc_engines_update(void)
 {
+	if(defer)
+	{
+		deferred |= CMC_DEFER_ENGINES;
+		return;
+	}
+
 	cmc_engines_active = 0;
 
 	if(config.oscmidi.enabled)
@@ -856,5 +917,8 @@ cmc_engines_update(void)
 	if(config.custom.enabled)
 		engines[cmc_engines_active++] = &custom_engine;
 
+	if(config.rtpmidi.socket.enabled)
+		engines[cmc_engines_active++] = &rtpmidi_engine;
+
 	engines[cmc_engines_active] = NULL;
 }
@@ -23,7 +23,10 @@
 #define POLE_NORTH 1
 #define POLE_SOUTH 0
 
-#define ENGINE_MAX 6 // tuio1, tuio2, scsynth, oscmidi, dummy, custom
+#define ENGINE_MAX 7 // tuio1, tuio2, scsynth, oscmidi, dummy, custom, rtpmidi
+
+#define CMC_DEFER_GROUP 0x1
+#define CMC_DEFER_ENGINES 0x2
 
 typedef enum {
 	CMC_BLOB_INVALID,
@@ -17,9 +17,11 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <math.h>
 
 #include <libmaple/bkp.h> // backup register
+#include <libmaple/systick.h> // notification rate limit
 
 #include <chimaera.h>
 #include <config.h>
@@ -32,6 +34,7 @@
 #include <sntp.h>
 #include <ptp.h>
 #include <engines.h>
+#include <preset.h>
 #include <ipv4ll.h>
 #include <dhcpc.h>
 #include <mdns-sd.h>
@@ -41,6 +44,7 @@
 static char string_buf [64];
 const char *success_str = "/success";
 const char *fail_str = "/fail";
+static const char *notify_str = "/notify";
 static const char *local_str = ".local";
 
 #define IP_BROADCAST {255, 255, 255, 255}
@@ -52,10 +56,19 @@ static const Socket_Enable_Cb socket_callbacks [WIZ_MAX_SOCK_NUM] = {
 	[SOCK_PTP_GE]	= NULL,
 	[SOCK_OUTPUT]	= output_enable,
 	[SOCK_CONFIG]	= config_enable,
-	[SOCK_DEBUG]	= debug_enable,
+	[SOCK_DEBUG]	= debug_enable, // = SOCK_RTPMIDI
 	[SOCK_MDNS]		= mdns_enable,
 };
 
+static Socket_Enable_Cb
+_socket_callback(Socket_Config *socket)
+{
+	if(socket == &config.rtpmidi.socket) // shares its socket with debug
+		return rtpmidi_enable;
+
+	return socket_callbacks[socket->sock];
+}
+
 Config config = {
 	.version = {
 		.revision = REVISION,
@@ -98,7 +111,19 @@ Config config = {
 		.multi = 1,
 		.format = OSC_MIDI_FORMAT_MIDI,
 		.mpe = 0,
-		.path = {'/', 'm', 'i', 'd', 'i', '\0'}
+		.path = {'/', 'm', 'i', 'd', 'i', '\0'},
+		.allocation = MIDI_SELECT_LEAST_RECENT,
+		.stealing = MIDI_STEAL_STACK,
+		.coalesce = 0
+	},
+
+	.rtpmidi = {
+		.socket = {
+			.sock = SOCK_RTPMIDI,
+			.enabled = 0,
+			.port = {5004, 5004}, // control port, data port is one above
+			.ip = IP_BROADCAST // first responder to answer is latched
+		}
 	},
 
 	.dummy = {
@@ -115,7 +140,7 @@ Config config = {
 				.dest = RPN_NONE,
 				.path = {'\0'},
 				.fmt = {'\0'},
-				.vm = { .inst = { RPN_TERMINATOR } }
+				.vm = { .code = { RPN_TERMINATOR } }
 			}
 		}
 		*/
@@ -220,7 +245,12 @@ Config config = {
 		.movingaverage_bitshift = 3,
 		.interpolation_mode = INTERPOLATION_QUADRATIC,
 		.velocity_stiffness = 32,
-		.rate = 2000
+		.sample_time = ADC_SMPR_181_5,
+		.mux_settle = 0,
+		.health = 1,
+		.rate = 2000,
+		.idle_rate = 0,
+		.idle_timeout = 1000
 	},
 
 	// we only define attributes for two groups for factory settings
@@ -285,11 +315,52 @@ Config config = {
 #undef MIDI_DEF
 };
 
+static uint8_t *config_buf = NULL; // reply buffer, owned until sent
+
+// transaction log of staged write messages
+#define CONFIG_TXN_SIZE 512
+#define CONFIG_TXN_TIMEOUT (SNTP_SYSTICK_RATE * 10) // 10s of owner inactivity
+
+static uint_fast8_t txn_open = 0;
+static uint_fast8_t txn_replay = 0; // replies are muted while committing
+static uint_fast8_t txn_n = 0;
+static uint_fast8_t txn_failed = 0;
+static uint16_t txn_used = 0;
+static uint32_t txn_tick = 0; // last activity of owner
+static uint8_t txn_ip [4]; // owner of open transaction
+static uint16_t txn_port;
+static osc_data_t txn_log [CONFIG_TXN_SIZE] __attribute__((aligned(4)));
+
+// subscriptions and paths changed since last notification
+#define CONFIG_SUBSCRIBE_MAX 8
+#define CONFIG_NOTIFY_MAX 8
+#define CONFIG_NOTIFY_INTERVAL (SNTP_SYSTICK_RATE / 50) // 20ms
+
+static uint_fast8_t notifying = 0; // replies are sent as notifications
+static uint_fast8_t subscribe_n = 0;
+static uint_fast8_t notify_n = 0;
+static uint32_t notify_tick = 0;
+static char subscribe_paths [CONFIG_SUBSCRIBE_MAX][OSC_QUERY_PATH_MAX];
+static uint8_t subscribe_ips [CONFIG_SUBSCRIBE_MAX][4]; // subscriber of each path
+static uint16_t subscribe_ports [CONFIG_SUBSCRIBE_MAX];
+static char notify_paths [CONFIG_NOTIFY_MAX][OSC_QUERY_PATH_MAX];
+
+static uint8_t *
+_config_buf(void)
+{
+	if(!config_buf)
+		config_buf = buf_r_acquire(BUF_R_CONFIG);
+	return config_buf;
+}
+
 uint16_t
 CONFIG_SUCCESS(const char *fmt, ...)
 {
-	osc_data_t *buf = BUF_O_OFFSET(buf_o_ptr);
-	osc_data_t *end = BUF_O_MAX(buf_o_ptr);
+	if(!_config_buf())
+		return 0;
+
+	osc_data_t *buf = BUF_R_OFFSET(config_buf);
+	osc_data_t *end = BUF_R_MAX(config_buf);
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *preamble = NULL;
 
@@ -298,7 +369,7 @@ CONFIG_SUCCESS(const char *fmt, ...)
 
   va_list args;
   va_start(args, fmt);
-	buf_ptr = osc_set_varlist(buf_ptr, end, success_str, fmt, args);
+	buf_ptr = osc_set_varlist(buf_ptr, end, notifying ? notify_str : success_str, fmt, args);
   va_end(args);
 	
 	if(config.config.osc.mode == OSC_MODE_TCP)
@@ -314,11 +385,17 @@ CONFIG_SUCCESS(const char *fmt, ...)
 uint16_t
 CONFIG_FAIL(const char *fmt, ...)
 {
-	osc_data_t *buf = BUF_O_OFFSET(buf_o_ptr);
-	osc_data_t *end = BUF_O_MAX(buf_o_ptr);
+	if(!_config_buf())
+		return 0;
+
+	osc_data_t *buf = BUF_R_OFFSET(config_buf);
+	osc_data_t *end = BUF_R_MAX(config_buf);
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *preamble = NULL;
 
+	if(txn_replay)
+		txn_failed++;
+
 	if(config.config.osc.mode == OSC_MODE_TCP)
 		buf_ptr = osc_start_bundle_item(buf_ptr, end, &preamble);
 
@@ -339,7 +416,14 @@ CONFIG_FAIL(const char *fmt, ...)
 void
 CONFIG_SEND(uint16_t size)
 {
-	osc_send(&config.config.osc, BUF_O_BASE(buf_o_ptr), size);
+	if(!config_buf)
+		return;
+
+	if(size && !txn_replay)
+		osc_send(&config.config.osc, config_buf, size);
+
+	buf_r_release(config_buf);
+	config_buf = NULL;
 }
 
 uint_fast8_t
@@ -355,13 +439,95 @@ version_match()
 		&& (version.patch == config.version.patch);
 }
 
+#define CONFIG_FIELD_N (sizeof(config_fields) / sizeof(Config_Field))
+#define CONFIG_LEGACY_FIELD_N (sizeof(config_legacy_fields) / sizeof(Config_Field))
+
+static Config_Schema config_schema;
+uint32_t config_load_ticks = 0;
+
+static uint32_t config_schema_hash [EEPROM_IMAGE_PAGES(sizeof(Config_Schema), EEPROM_24LC64_PAGE_SIZE)];
+static EEPROM_Image config_schema_image = {
+	.valid = 0,
+	.n = EEPROM_IMAGE_PAGES(sizeof(Config_Schema), EEPROM_24LC64_PAGE_SIZE),
+	.hash = config_schema_hash
+};
+
+static uint32_t config_hash [EEPROM_IMAGE_PAGES(sizeof(Config), EEPROM_24LC64_PAGE_SIZE)];
+static void
+_config_saved(EEPROM_Image *image)
+{
+	(void)image;
+	config_touch("/config/saving"); // notify subscribers about finished save
+}
+
+static EEPROM_Image config_image = {
+	.valid = 0,
+	.n = EEPROM_IMAGE_PAGES(sizeof(Config), EEPROM_24LC64_PAGE_SIZE),
+	.hash = config_hash,
+	.cb = _config_saved
+};
+
+static void
+_config_schema_init(void)
+{
+	memset(&config_schema, 0, sizeof(Config_Schema));
+	config_schema.magic = CONFIG_SCHEMA_MAGIC;
+	config_schema.n = CONFIG_FIELD_N;
+	config_schema.version = config.version;
+	memcpy(config_schema.fields, config_fields, sizeof(config_fields));
+}
+
 uint_fast8_t
 config_load()
 {
-	if(version_match())
-		eeprom_bulk_read(eeprom_24LC64, EEPROM_CONFIG_OFFSET,(uint8_t *)&config, sizeof(config));
-	else // EEPROM and FLASH config version do not match, overwrite old with new default one
+	uint32_t t0 = systick_uptime();
+	uint_fast8_t migrate = 0;
+
+	eeprom_bulk_read(eeprom_24LC64, EEPROM_CONFIG_OFFSET, (uint8_t *)&config_schema, offsetof(Config_Schema, fields));
+
+	if( (config_schema.magic != CONFIG_SCHEMA_MAGIC) || (config_schema.n > CONFIG_SCHEMA_MAX) ) // legacy layout
+	{
+		if(version_match()) // import sections of the raw configuration that kept their layout
+			schema_import(eeprom_24LC64, EEPROM_CONFIG_OFFSET, CONFIG_LEGACY_SIZE,
+				config_legacy_fields, CONFIG_LEGACY_FIELD_N, config_fields, CONFIG_FIELD_N, (uint8_t *)&config);
+		// else EEPROM and FLASH config version do not match, overwrite old with new default one
+
+		migrate = 1;
+	}
+	else
+	{
+		eeprom_bulk_read(eeprom_24LC64, EEPROM_CONFIG_OFFSET + offsetof(Config_Schema, fields),
+			(uint8_t *)config_schema.fields, config_schema.n * sizeof(Config_Field));
+
+		migrate = (config_schema.n != CONFIG_FIELD_N)
+			|| memcmp(config_schema.fields, config_fields, sizeof(config_fields));
+
+		if(!migrate) // same layout, fast path with a single sequential read
+		{
+			Firmware_Version version = config.version;
+			eeprom_bulk_read(eeprom_24LC64, EEPROM_CONFIG_DATA_OFFSET, (uint8_t *)&config, sizeof(config));
+			config.version = version; // is read-only
+		}
+		else // unknown or incompatible sections keep their defaults
+			schema_import(eeprom_24LC64, EEPROM_CONFIG_DATA_OFFSET, EEPROM_RANGE_OFFSET - EEPROM_CONFIG_DATA_OFFSET,
+				config_schema.fields, config_schema.n, config_fields, CONFIG_FIELD_N, (uint8_t *)&config);
+	}
+
+	_config_schema_init();
+
+	if(migrate) // write back in current layout
+	{
+		config_schema_image.valid = 0;
+		config_image.valid = 0;
 		config_save();
+	}
+	else // EEPROM mirrors RAM now, only dirty pages need to be written on next save
+	{
+		eeprom_image_hash(eeprom_24LC64, &config_schema_image, EEPROM_CONFIG_OFFSET, (uint8_t *)&config_schema, sizeof(Config_Schema));
+		eeprom_image_hash(eeprom_24LC64, &config_image, EEPROM_CONFIG_DATA_OFFSET, (uint8_t *)&config, sizeof(Config));
+	}
+
+	config_load_ticks = systick_uptime() - t0;
 
 	return 1;
 }
@@ -369,9 +535,12 @@ config_load()
 uint_fast8_t
 config_save()
 {
-	eeprom_bulk_write(eeprom_24LC64, EEPROM_CONFIG_OFFSET,(uint8_t *)&config, sizeof(config));
+	if(config_schema.magic != CONFIG_SCHEMA_MAGIC) // not loaded before, e.g. after hard reset
+		_config_schema_init();
 
-	return 1;
+	// pages are written in the background by eeprom_queue_step
+	return eeprom_queue_push(eeprom_24LC64, &config_schema_image, EEPROM_CONFIG_OFFSET, (uint8_t *)&config_schema, sizeof(Config_Schema))
+		&& eeprom_queue_push(eeprom_24LC64, &config_image, EEPROM_CONFIG_DATA_OFFSET, (uint8_t *)&config, sizeof(config));
 }
 
 uint_fast8_t
@@ -514,6 +683,23 @@ _info_uid(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 	return 1;
 }
 
+static uint_fast8_t
+_info_dropped(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("isi", uuid, path, buf_r_dropped);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
 static uint_fast8_t
 _info_name(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -556,7 +742,10 @@ _config_load(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *b
 	buf_ptr = osc_get_int32(buf_ptr, &uuid);
 
 	if(config_load())
+	{
+		cmc_engine_init(&custom_engine); // verifies loaded custom programs
 		size = CONFIG_SUCCESS("is", uuid, path);
+	}
 	else
 		size = CONFIG_FAIL("iss", uuid, path, "loading of configuration from EEPROM failed");
 
@@ -586,6 +775,377 @@ _config_save(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *b
 	return 1;
 }
 
+static uint_fast8_t
+_config_saving(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("issi", uuid, path, config_saving_args_values[config_image.status].s, config_image.written);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static osc_data_t *
+_config_skip(osc_data_t *buf, const char *fmt)
+{
+	for( ; *fmt; fmt++)
+		switch(*fmt)
+		{
+			case OSC_INT32:
+			case OSC_FLOAT:
+			case OSC_MIDI:
+			case OSC_CHAR:
+				buf += 4;
+				break;
+			case OSC_INT64:
+			case OSC_DOUBLE:
+			case OSC_TIMETAG:
+				buf += 8;
+				break;
+			case OSC_STRING:
+			case OSC_SYMBOL:
+				buf += osc_strlen((const char *)buf);
+				break;
+			case OSC_BLOB:
+				buf += osc_bloblen(buf);
+				break;
+			default: // T, F, N, I have no payload
+				break;
+		}
+
+	return buf;
+}
+
+// copy whole message (path, format and arguments) to transaction log
+static uint_fast8_t
+_config_stage(const char *path, const char *fmt, osc_data_t *buf)
+{
+	osc_data_t *msg = (osc_data_t *)path;
+	uint32_t len = _config_skip(buf, fmt) - msg;
+
+	if(txn_used + sizeof(uint32_t) + len > CONFIG_TXN_SIZE)
+		return 0;
+
+	memcpy(&txn_log[txn_used], &len, sizeof(uint32_t));
+	txn_used += sizeof(uint32_t);
+	memcpy(&txn_log[txn_used], msg, len);
+	txn_used += len;
+	txn_n++;
+
+	return 1;
+}
+
+// is the sender of the current message the owner of the open transaction?
+static uint_fast8_t
+_config_owner(void)
+{
+	Socket_Config *socket = &config.config.osc.socket;
+
+	return !memcmp(socket->ip, txn_ip, 4) && (socket->port[DST_PORT] == txn_port);
+}
+
+// abort transaction whose owner has gone silent
+static void
+_config_expire(void)
+{
+	if(txn_open && (systick_uptime() - txn_tick > CONFIG_TXN_TIMEOUT) )
+		txn_open = 0;
+}
+
+static uint_fast8_t
+_config_begin(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	_config_expire();
+
+	if(!txn_open)
+	{
+		Socket_Config *socket = &config.config.osc.socket;
+
+		txn_open = 1;
+		txn_n = 0;
+		txn_used = 0;
+		txn_tick = systick_uptime();
+		memcpy(txn_ip, socket->ip, 4);
+		txn_port = socket->port[DST_PORT];
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+	else if(!_config_owner())
+		size = CONFIG_FAIL("iss", uuid, path, "transaction owned by another client");
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "transaction already open");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_config_commit(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	_config_expire();
+
+	if(txn_open && !_config_owner())
+		size = CONFIG_FAIL("iss", uuid, path, "transaction owned by another client");
+	else if(txn_open)
+	{
+		txn_open = 0;
+		txn_replay = 1;
+		txn_failed = 0;
+
+		// apply all staged writes at once with a single engine reinitialization,
+		// writes are checked when staged, a handler that still fails does not
+		// undo the writes replayed before it
+		const char *first = NULL; // path of first failed write
+		cmc_defer_begin();
+		osc_data_t *ptr = txn_log;
+		while(ptr < txn_log + txn_used)
+		{
+			uint_fast8_t failed = txn_failed;
+			uint32_t len;
+			memcpy(&len, ptr, sizeof(uint32_t));
+			ptr += sizeof(uint32_t);
+			osc_dispatch_method(ptr, len, config_serv);
+			if(!first && (txn_failed > failed) )
+				first = (const char *)ptr; // message starts with its path
+			ptr += len;
+		}
+		cmc_defer_end();
+
+		txn_replay = 0;
+
+		if(!txn_failed)
+			size = CONFIG_SUCCESS("isi", uuid, path, txn_n);
+		else
+		{
+			sprintf(string_buf, "%u of %u staged writes failed, others applied", txn_failed, txn_n);
+			size = CONFIG_FAIL("isss", uuid, path, string_buf, first);
+		}
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "no open transaction");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_config_abort(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	_config_expire();
+
+	if(txn_open && !_config_owner())
+		size = CONFIG_FAIL("iss", uuid, path, "transaction owned by another client");
+	else if(txn_open)
+	{
+		txn_open = 0;
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "no open transaction");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+// a subscription is a path, an OSC pattern or a node prefix with trailing slash
+static uint_fast8_t
+_subscribe_match(const char *sub, const char *path)
+{
+	size_t len = strlen(sub);
+
+	if(sub[len-1] == '/')
+		return !strncmp(sub, path, len);
+	else if(osc_check_pattern(sub))
+		return osc_match_pattern(sub, path);
+	else
+		return !strcmp(sub, path);
+}
+
+// remember written path for notification when somebody subscribed to it
+static void
+_subscribe_touch(const OSC_Query_Item *item, const char *path)
+{
+	uint_fast8_t i;
+
+	if(!subscribe_n || !item->item.method.argc
+			|| !(item->item.method.args[0].mode & OSC_QUERY_MODE_R) ) // nothing to read back
+		return;
+
+	for(i=0; i<notify_n; i++)
+		if(!strcmp(notify_paths[i], path)) // coalesce
+			return;
+
+	if( (notify_n >= CONFIG_NOTIFY_MAX) || (strlen(path) >= OSC_QUERY_PATH_MAX) )
+		return;
+
+	for(i=0; i<subscribe_n; i++)
+		if(_subscribe_match(subscribe_paths[i], path))
+		{
+			strcpy(notify_paths[notify_n++], path);
+			return;
+		}
+}
+
+// a change while the config is being saved restarts the save, thus EEPROM never
+// ends up with a mix of old and new values, only dirty pages are rewritten
+static void
+_config_changed(const OSC_Query_Item *item, const char *path)
+{
+	if( (config_schema_image.status == EEPROM_STATUS_PENDING) || (config_image.status == EEPROM_STATUS_PENDING) )
+		config_save();
+
+	_subscribe_touch(item, path);
+}
+
+// is the sender of the current message the subscriber of subscription i?
+static uint_fast8_t
+_subscribe_owner(uint_fast8_t i)
+{
+	Socket_Config *socket = &config.config.osc.socket;
+
+	return !memcmp(subscribe_ips[i], socket->ip, 4) && (subscribe_ports[i] == socket->port[DST_PORT]);
+}
+
+// move last subscription into gap
+static void
+_subscribe_remove(uint_fast8_t i)
+{
+	if(i < --subscribe_n)
+	{
+		strcpy(subscribe_paths[i], subscribe_paths[subscribe_n]);
+		memcpy(subscribe_ips[i], subscribe_ips[subscribe_n], 4);
+		subscribe_ports[i] = subscribe_ports[subscribe_n];
+	}
+
+	if(!subscribe_n)
+		notify_n = 0;
+}
+
+static uint_fast8_t
+_subscribe(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	uint_fast8_t i;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc == 1) // query
+	{
+		int32_t n = 0;
+		for(i=0; i<subscribe_n; i++)
+			if(_subscribe_owner(i))
+				n++;
+		size = CONFIG_SUCCESS("isi", uuid, path, n);
+	}
+	else
+	{
+		const char *sub;
+		buf_ptr = osc_get_string(buf_ptr, &sub);
+
+		for(i=0; i<subscribe_n; i++)
+			if(_subscribe_owner(i) && !strcmp(subscribe_paths[i], sub))
+				break;
+
+		if( (sub[0] != '/') || (strlen(sub) >= OSC_QUERY_PATH_MAX) )
+			size = CONFIG_FAIL("iss", uuid, path, "invalid path");
+		else if(i < subscribe_n) // already subscribed
+			size = CONFIG_SUCCESS("is", uuid, path);
+		else if(subscribe_n < CONFIG_SUBSCRIBE_MAX)
+		{
+			Socket_Config *socket = &config.config.osc.socket;
+
+			strcpy(subscribe_paths[subscribe_n], sub);
+			memcpy(subscribe_ips[subscribe_n], socket->ip, 4);
+			subscribe_ports[subscribe_n] = socket->port[DST_PORT];
+			subscribe_n++;
+			size = CONFIG_SUCCESS("is", uuid, path);
+		}
+		else
+			size = CONFIG_FAIL("iss", uuid, path, "maximal number of subscriptions reached");
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_unsubscribe(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	uint_fast8_t i;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc == 1) // remove all subscriptions of sender
+	{
+		for(i=subscribe_n; i>0; i--)
+			if(_subscribe_owner(i-1))
+				_subscribe_remove(i-1);
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+	else
+	{
+		const char *sub;
+		buf_ptr = osc_get_string(buf_ptr, &sub);
+
+		for(i=0; i<subscribe_n; i++)
+			if(_subscribe_owner(i) && !strcmp(subscribe_paths[i], sub))
+				break;
+
+		if(i < subscribe_n)
+		{
+			_subscribe_remove(i);
+			size = CONFIG_SUCCESS("is", uuid, path);
+		}
+		else
+			size = CONFIG_FAIL("iss", uuid, path, "no such subscription");
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
 static uint_fast8_t
 _comm_mac(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -736,7 +1296,7 @@ config_socket_enabled(Socket_Config *socket, const char *path, const char *fmt,
 		size = CONFIG_SUCCESS("isi", uuid, path, socket->enabled ? 1 : 0);
 	else
 	{
-		Socket_Enable_Cb cb = socket_callbacks[socket->sock];
+		Socket_Enable_Cb cb = _socket_callback(socket);
 		int32_t i;
 		buf_ptr = osc_get_int32(buf_ptr, &i);
 		cb(i);
@@ -772,6 +1332,8 @@ _output_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *
 	config.oscmidi.enabled = 0;
 	config.dummy.enabled = 0;
 	config.custom.enabled = 0;
+	if(config.rtpmidi.socket.enabled)
+		rtpmidi_enable(0);
 
 	cmc_engines_update();
 
@@ -851,7 +1413,7 @@ _address_dns_cb(uint8_t *ip, void *data)
 	{
 		socket->port[DST_PORT] = address_cb->port;
 		memcpy(socket->ip, ip, 4);
-		Socket_Enable_Cb cb = socket_callbacks[socket->sock];
+		Socket_Enable_Cb cb = _socket_callback(socket);
 		cb(socket->enabled);
 
 		ip2str(ip, string_buf);
@@ -1165,6 +1727,18 @@ const OSC_Query_Value config_mode_args_values [] = {
 	[OSC_MODE_SLIP]	= { .s = "osc.slip.tcp" }
 };
 
+const OSC_Query_Value config_saving_args_values [] = {
+	[EEPROM_STATUS_IDLE]		= { .s = "idle" },
+	[EEPROM_STATUS_PENDING]	= { .s = "pending" },
+	[EEPROM_STATUS_DONE]		= { .s = "done" },
+	[EEPROM_STATUS_FAILED]	= { .s = "failed" }
+};
+
+const OSC_Query_Argument config_saving_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("Status", OSC_QUERY_MODE_R, config_saving_args_values),
+	OSC_QUERY_ARGUMENT_INT32("Pages written", OSC_QUERY_MODE_R, 0, 0x100, 1)
+};
+
 const OSC_Query_Argument config_mode_args [] = {
 	OSC_QUERY_ARGUMENT_STRING_VALUES("mode", OSC_QUERY_MODE_RW, config_mode_args_values)
 };
@@ -1201,9 +1775,17 @@ const OSC_Query_Item comm_tree [] = {
 	OSC_QUERY_ITEM_METHOD("gateway", "IPv4 gateway address", _comm_gateway, comm_gateway_args),
 };
 
+static const OSC_Query_Argument subscribe_args [] = {
+	OSC_QUERY_ARGUMENT_STRING("Path, pattern or node prefix", OSC_QUERY_MODE_W, OSC_QUERY_PATH_MAX)
+};
+
 const OSC_Query_Item config_tree [] = {
 	OSC_QUERY_ITEM_METHOD("save", "Save to EEPROM", _config_save, NULL),
 	OSC_QUERY_ITEM_METHOD("load", "Load from EEPROM", _config_load, NULL),
+	OSC_QUERY_ITEM_METHOD("saving", "Status of last save to EEPROM", _config_saving, config_saving_args),
+	OSC_QUERY_ITEM_METHOD("begin", "Begin transaction, stage own writes, aborted after 10s idle", _config_begin, NULL),
+	OSC_QUERY_ITEM_METHOD("commit", "Commit transaction, apply staged writes, reports first failed path", _config_commit, NULL),
+	OSC_QUERY_ITEM_METHOD("abort", "Abort transaction, discard staged writes", _config_abort, NULL),
 	OSC_QUERY_ITEM_METHOD("enabled", "Enable/disable socket", _config_enabled, config_boolean_args),
 	OSC_QUERY_ITEM_METHOD("mode", "Enable/disable UDP/TCP mode", _config_mode, config_mode_args)
 };
@@ -1222,6 +1804,10 @@ static const OSC_Query_Argument info_uid_args [] = {
 	OSC_QUERY_ARGUMENT_STRING("Hexadecimal hyphen", OSC_QUERY_MODE_R, 32)
 };
 
+static const OSC_Query_Argument info_dropped_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Number", OSC_QUERY_MODE_R, 0, 0xffff, 1)
+};
+
 static const OSC_Query_Argument info_name_args [] = {
 	OSC_QUERY_ARGUMENT_STRING("ASCII", OSC_QUERY_MODE_RW, NAME_LENGTH)
 };
@@ -1229,6 +1815,7 @@ static const OSC_Query_Argument info_name_args [] = {
 static const OSC_Query_Item info_tree [] = { //FIXME merge with comm?
 	OSC_QUERY_ITEM_METHOD("version", "Firmware version", _info_version, info_version_args),
 	OSC_QUERY_ITEM_METHOD("uid", "96-bit universal device identifier", _info_uid, info_uid_args),
+	OSC_QUERY_ITEM_METHOD("dropped", "Replies dropped for lack of reply buffers", _info_dropped, info_dropped_args),
 
 	OSC_QUERY_ITEM_METHOD("name", "Device name", _info_name, info_name_args),
 };
@@ -1256,6 +1843,7 @@ static const OSC_Query_Item engines_tree [] = {
 	OSC_QUERY_ITEM_NODE("dump/", "Dump output engine", dump_tree),
 	OSC_QUERY_ITEM_NODE("dummy/", "Dummy output engine", dummy_tree),
 	OSC_QUERY_ITEM_NODE("oscmidi/", "OSC MIDI output engine", oscmidi_tree),
+	OSC_QUERY_ITEM_NODE("rtpmidi/", "RTP-MIDI output engine", rtpmidi_tree),
 	OSC_QUERY_ITEM_NODE("scsynth/", "SuperCollider output engine", scsynth_tree),
 	OSC_QUERY_ITEM_NODE("tuio2/", "TUIO 2.0 output engine", tuio2_tree),
 	OSC_QUERY_ITEM_NODE("tuio1/", "TUIO 1.0 output engine", tuio1_tree),
@@ -1280,10 +1868,99 @@ static const OSC_Query_Item root_tree [] = {
 	// output engines
 	OSC_QUERY_ITEM_NODE("engines/", "Output engines", engines_tree),
 	OSC_QUERY_ITEM_NODE("sensors/", "Sensor array", sensors_tree),
+	OSC_QUERY_ITEM_NODE("presets/", "Scene presets", preset_tree),
+
+	// change notifications
+	OSC_QUERY_ITEM_METHOD("subscribe", "Subscribe sender to changes, query its number of subscriptions", _subscribe, subscribe_args),
+	OSC_QUERY_ITEM_METHOD("unsubscribe", "Unsubscribe, all of sender without argument", _unsubscribe, subscribe_args)
 };
 
 static const OSC_Query_Item root = OSC_QUERY_ITEM_NODE("/", "Root node", root_tree);
 
+#ifdef BENCHMARK
+static Stop_Watch sw_query_lookup = {.id = "query_lookup", .thresh=100};
+#endif
+
+typedef struct _Query_Match Query_Match;
+
+struct _Query_Match {
+	const char *fmt;
+	uint_fast8_t argc;
+	osc_data_t *buf; // at uuid
+	osc_data_t *args; // after uuid
+};
+
+static uint_fast8_t
+_query_match(const OSC_Query_Item *item, const char *path, void *data)
+{
+	Query_Match *match = data;
+	OSC_Method_Cb cb = item->item.method.cb;
+
+	if(!cb || !osc_query_check(item, match->fmt+1, match->args))
+		return 0;
+
+	if(match->argc > 1) // write access
+		osc_query_cache_invalidate();
+	cb(path, match->fmt, match->argc, match->buf);
+	if(match->argc > 1)
+		_config_changed(item, path);
+
+	return 1;
+}
+
+#define QUERY_CHUNK_SIZE 512
+
+// serialize query response chunk in place of trailing empty string of reply
+static uint16_t
+_query_chunk(uint16_t size, const OSC_Query_Item *item, const char *path, char *query, size_t offset)
+{
+	if(!size) // no reply buffer available
+		return 0;
+
+	// wind back to beginning of empty string on buffer
+	size -= 4;
+	char *response = (char *)(BUF_R_OFFSET(config_buf) + size);
+
+	// serialize query response chunk directly to buffer
+	*query = '\0';
+	size_t total = osc_query_response_cached(response, QUERY_CHUNK_SIZE, offset, item, path);
+	*query = '!';
+
+	// calculate new message size
+	uint16_t len = total - offset < QUERY_CHUNK_SIZE ? total - offset : QUERY_CHUNK_SIZE;
+	char *ptr = response + len;
+	*ptr++ = '\0';
+	len++;
+	uint16_t rem;
+	if((rem=len%4))
+	{
+		memset(ptr, '\0', 4-rem);
+		ptr += 4-rem;
+	}
+	size += ptr-response;
+
+	switch(config.config.osc.mode)
+	{
+		case OSC_MODE_UDP:
+			break;
+		case OSC_MODE_TCP:
+		{
+			// update TCP preamble
+			int32_t *tcp_size = (int32_t *)BUF_R_OFFSET(config_buf);
+			*tcp_size = htonl(size - sizeof(int32_t));
+			break;
+		}
+		case OSC_MODE_SLIP:
+		{
+			//slip_encode
+			size = slip_encode(BUF_R_OFFSET(config_buf), size);
+			break;
+		}
+	}
+
+	return size;
+}
+
 //FIXME check for overflows
 static uint_fast8_t
 _query(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
@@ -1299,66 +1976,86 @@ _query(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 		buf_ptr = osc_get_int32(buf_ptr, &uuid);
 
 		char *query = strrchr(path, '!'); // last occurence
-		if(query)
+		_config_expire();
+		if(txn_open && (argc > 1) && !query && _config_owner()) // stage owner's write until commit
+		{
+			txn_tick = systick_uptime();
+			uint_fast8_t valid = osc_check_pattern(path); // patterns are resolved on commit
+			if(!valid)
+			{
+				const OSC_Query_Item *item = osc_query_lookup(&root, path);
+				valid = item && (item->type == OSC_QUERY_METHOD) && osc_query_check(item, fmt+1, buf_ptr);
+			}
+
+			if(!valid)
+				size = CONFIG_FAIL("iss", uuid, path, "unknown method for path, format or range");
+			else if(_config_stage(path, fmt, buf))
+				size = CONFIG_SUCCESS("is", uuid, path);
+			else
+				size = CONFIG_FAIL("iss", uuid, path, "transaction log full");
+		}
+		else if(query)
 		{
 			*query = '\0';
-			const OSC_Query_Item *item = osc_query_find(&root, path, -1);
+			const OSC_Query_Item *item = osc_query_lookup(&root, path);
+			size_t total = item ? osc_query_response_cached(NULL, 0, 0, item, path) : 0;
 			*query = '!';
-			if(item)
+			if(item && (total < QUERY_CHUNK_SIZE) )
 			{
 				// serialize empty string
 				size = CONFIG_SUCCESS("iss", uuid, path, nil);
-				size -= 4;
-
-				// wind back to beginning of empty string on buffer
-				char *response = (char *)(BUF_O_OFFSET(buf_o_ptr) + size);
-
-				// serialize query response directly to buffer
-				*query = '\0';
-				osc_query_response(response, item, path);
-
-				// calculate new message size
-				char *ptr = response;
-				uint16_t len = strlen(response) + 1;
-				ptr +=  len;
-				uint16_t rem;
-				if((rem=len%4))
-				{
-					memset(ptr, '\0', 4-rem);
-					ptr += 4-rem;
-				}
-				size += ptr-response;
-
-				switch(config.config.osc.mode)
+				size = _query_chunk(size, item, path, query, 0);
+			}
+			else if(item) // split response into chunks
+			{
+				size_t offset;
+				for(offset=0; offset<total; offset+=QUERY_CHUNK_SIZE)
 				{
-					case OSC_MODE_UDP:
-						break;
-					case OSC_MODE_TCP:
-					{
-						// update TCP preamble
-						int32_t *tcp_size = (int32_t *)BUF_O_OFFSET(buf_o_ptr);
-						*tcp_size = htonl(size - sizeof(int32_t));
-						break;
-					}
-					case OSC_MODE_SLIP:
-					{
-						//slip_encode
-						size = slip_encode(BUF_O_OFFSET(buf_o_ptr), size);
-						break;
-					}
+					// serialize offset, total size and empty string
+					size = CONFIG_SUCCESS("isiis", uuid, path, (int32_t)offset, (int32_t)total, nil);
+					size = _query_chunk(size, item, path, query, offset);
+					if(offset + QUERY_CHUNK_SIZE < total) // last chunk is sent below
+						CONFIG_SEND(size);
 				}
 			}
 			else
 				size = CONFIG_FAIL("iss", uuid, path, "unknown query for path");
 		}
+		else if(osc_check_pattern(path)) // dispatch to all matching methods
+		{
+			Query_Match match = {
+				.fmt = fmt,
+				.argc = argc,
+				.buf = buf,
+				.args = buf_ptr
+			};
+
+			if(osc_query_match(&root, path, _query_match, &match))
+				return 1;
+			else
+				size = CONFIG_FAIL("iss", uuid, path, "no method matches pattern, format or range");
+		}
 		else
 		{
-			const OSC_Query_Item *item = osc_query_find(&root, path, -1);
+#ifdef BENCHMARK
+			stop_watch_start(&sw_query_lookup);
+#endif
+			const OSC_Query_Item *item = osc_query_lookup(&root, path);
+#ifdef BENCHMARK
+			stop_watch_stop(&sw_query_lookup);
+#endif
 			if(item && (item->type != OSC_QUERY_NODE) && (item->type != OSC_QUERY_ARRAY) )
 			{
 				OSC_Method_Cb cb = item->item.method.cb;
 				if(cb && osc_query_check(item, fmt+1, buf_ptr))
-					return cb(path, fmt, argc, buf);
+				{
+					if(argc > 1) // write access
+						osc_query_cache_invalidate();
+					uint_fast8_t res = cb(path, fmt, argc, buf);
+					if(argc > 1)
+						_config_changed(item, path);
+					return res;
+				}
 				else
 					size = CONFIG_FAIL("iss", uuid, path, "callback, format or range invalid");
 			}
@@ -1373,3 +2070,58 @@ _query(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 
 	return 1;
 }
+
+void
+config_touch(const char *path)
+{
+	const OSC_Query_Item *item = osc_query_lookup(&root, path);
+
+	if(item && (item->type == OSC_QUERY_METHOD) )
+		_config_changed(item, path);
+}
+
+void
+config_notify(void)
+{
+	if(!notify_n || (systick_uptime() - notify_tick < CONFIG_NOTIFY_INTERVAL) )
+		return;
+
+	// serialize the current values by querying the methods themselves
+	osc_data_t query [4] __attribute__((aligned(4))) = {0}; // uuid = 0
+	Socket_Config *socket = &config.config.osc.socket;
+	uint_fast8_t i, j, k;
+
+	notifying = 1;
+	for(i=0; i<notify_n; i++)
+	{
+		const OSC_Query_Item *item = osc_query_lookup(&root, notify_paths[i]);
+		if(!item || !item->item.method.cb)
+			continue;
+
+		for(j=0; j<subscribe_n; j++)
+		{
+			if(!_subscribe_match(subscribe_paths[j], notify_paths[i]))
+				continue;
+
+			// push only once to subscribers with multiple matching subscriptions
+			for(k=0; k<j; k++)
+				if(!memcmp(subscribe_ips[k], subscribe_ips[j], 4) && (subscribe_ports[k] == subscribe_ports[j])
+						&& _subscribe_match(subscribe_paths[k], notify_paths[i]))
+					break;
+			if(k < j)
+				continue;
+
+			if(config.config.osc.mode == OSC_MODE_UDP) // TCP and SLIP have a single peer
+				udp_set_remote(socket->sock, subscribe_ips[j], subscribe_ports[j]);
+			item->item.method.cb(notify_paths[i], "i", 1, query);
+		}
+	}
+	notifying = 0;
+
+	// restore remote of last request
+	if(config.config.osc.mode == OSC_MODE_UDP)
+		udp_set_remote(socket->sock, socket->ip, socket->port[DST_PORT]);
+
+	notify_n = 0;
+	notify_tick = systick_uptime();
+}
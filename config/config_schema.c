@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stddef.h>
+
+#include <config.h>
+
+// tagged sections of the configuration as stored in EEPROM
+#define CONFIG_FIELD(TAG, VERSION, MEMBER) \
+	{.tag = TAG, .version = VERSION, .offset = offsetof(Config, MEMBER), .len = sizeof(((Config *)0)->MEMBER)}
+
+const Config_Field config_fields [22] = {
+	CONFIG_FIELD(0x01, 1, name),
+	CONFIG_FIELD(0x02, 1, comm),
+	CONFIG_FIELD(0x03, 1, dump),
+	CONFIG_FIELD(0x04, 1, tuio2),
+	CONFIG_FIELD(0x05, 1, tuio1),
+	CONFIG_FIELD(0x06, 1, scsynth),
+	CONFIG_FIELD(0x07, 1, oscmidi),
+	CONFIG_FIELD(0x08, 1, dummy),
+	CONFIG_FIELD(0x09, 2, custom),
+	CONFIG_FIELD(0x0a, 1, output),
+	CONFIG_FIELD(0x0b, 1, config),
+	CONFIG_FIELD(0x0c, 1, ptp),
+	CONFIG_FIELD(0x0d, 1, sntp),
+	CONFIG_FIELD(0x0e, 1, debug),
+	CONFIG_FIELD(0x0f, 1, ipv4ll),
+	CONFIG_FIELD(0x10, 1, mdns),
+	CONFIG_FIELD(0x11, 1, dhcpc),
+	CONFIG_FIELD(0x12, 1, sensors),
+	CONFIG_FIELD(0x13, 1, groups),
+	CONFIG_FIELD(0x14, 1, scsynth_groups),
+	CONFIG_FIELD(0x15, 1, oscmidi_groups),
+	CONFIG_FIELD(0x16, 1, rtpmidi)
+};
+
+// raw Config of firmware 0.14.0 at EEPROM_CONFIG_OFFSET, stored without a directory,
+// offsets as laid out by arm-none-eabi with its default short enums
+const Config_Field config_legacy_fields [21] = {
+	{.tag = 0x01, .version = 1, .offset = 0x0004, .len = 32}, // name
+	{.tag = 0x02, .version = 1, .offset = 0x0024, .len = 19}, // comm
+	{.tag = 0x03, .version = 1, .offset = 0x0037, .len = 1}, // dump
+	{.tag = 0x04, .version = 1, .offset = 0x0038, .len = 2}, // tuio2
+	{.tag = 0x05, .version = 1, .offset = 0x003a, .len = 2}, // tuio1
+	{.tag = 0x06, .version = 1, .offset = 0x003c, .len = 2}, // scsynth
+	{.tag = 0x07, .version = 1, .offset = 0x003e, .len = 68}, // oscmidi, before allocation, stealing, coalesce
+	{.tag = 0x08, .version = 1, .offset = 0x0082, .len = 3}, // dummy
+	{.tag = 0x09, .version = 1, .offset = 0x0088, .len = 1924}, // custom, enum coded VM
+	{.tag = 0x0a, .version = 1, .offset = 0x0810, .len = 32}, // output
+	{.tag = 0x0b, .version = 1, .offset = 0x0830, .len = 12}, // config
+	{.tag = 0x0c, .version = 1, .offset = 0x083c, .len = 24}, // ptp
+	{.tag = 0x0d, .version = 1, .offset = 0x0854, .len = 12}, // sntp
+	{.tag = 0x0e, .version = 1, .offset = 0x0860, .len = 12}, // debug
+	{.tag = 0x0f, .version = 1, .offset = 0x086c, .len = 1}, // ipv4ll
+	{.tag = 0x10, .version = 1, .offset = 0x086e, .len = 10}, // mdns
+	{.tag = 0x11, .version = 1, .offset = 0x0878, .len = 12}, // dhcpc
+	{.tag = 0x12, .version = 1, .offset = 0x0884, .len = 3}, // sensors, only the members in front of the moved rate
+	{.tag = 0x13, .version = 1, .offset = 0x088c, .len = 128}, // groups
+	{.tag = 0x14, .version = 1, .offset = 0x090c, .len = 160}, // scsynth_groups
+	{.tag = 0x15, .version = 1, .offset = 0x09ac, .len = 96} // oscmidi_groups
+};
@@ -15,6 +15,7 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <math.h> // floor
 
@@ -27,6 +28,53 @@
 
 static Custom_Item *items = config.custom.items;
 static RPN_Stack stack;
+static float hidden [CUSTOM_MAX_EXPR][RPN_HIDDEN_HEIGHT];
+static uint32_t bank_sid [BLOB_MAX]; // 0 marks a free bank, blob ids start at 1
+static float bank [BLOB_MAX][RPN_BANK_HEIGHT];
+static float bank_frame [RPN_BANK_HEIGHT]; // shared by frame, end and idle hooks
+static uint_fast8_t bank_next = 0;
+
+static inline void
+_custom_bank_clear(float *regs)
+{
+	uint_fast8_t i;
+	for(i=0; i<RPN_BANK_HEIGHT; i++)
+		regs[i] = NAN;
+}
+
+// look up register bank of blob, (re)allocate one on first sight
+static float *
+_custom_bank(uint32_t sid)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<BLOB_MAX; i++)
+		if(bank_sid[i] == sid)
+			return bank[i];
+
+	for(i=0; i<BLOB_MAX; i++)
+		if(bank_sid[i] == 0)
+			break;
+	if(i == BLOB_MAX) // missed an off event, recycle round robin
+	{
+		i = bank_next;
+		bank_next = (bank_next + 1) % BLOB_MAX;
+	}
+
+	bank_sid[i] = sid;
+	_custom_bank_clear(bank[i]);
+	return bank[i];
+}
+
+static void
+_custom_bank_free(uint32_t sid)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<BLOB_MAX; i++)
+		if(bank_sid[i] == sid)
+			bank_sid[i] = 0;
+}
 
 static osc_data_t *pack;
 static osc_data_t *bndl;
@@ -38,6 +86,7 @@ custom_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 	stack.sid = stack.gid = stack.pid = 0;
 	stack.x = stack.z = 0.f;
 	stack.vx = stack.vz = 0.f;
+	stack.bank = bank_frame;
 
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm;
@@ -53,7 +102,13 @@ custom_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 		for(i=0; i<CUSTOM_MAX_EXPR; i++)
 		{
 			item = &items[i];
-			if(item->dest == RPN_FRAME)
+			if( (item->dest == RPN_ON) || (item->dest == RPN_OFF) || (item->dest == RPN_SET) )
+			{
+				// evaluate per-frame subexpressions of per-blob hooks once
+				stack.hidden = hidden[i];
+				rpn_run_hoisted(item, &stack);
+			}
+			else if(item->dest == RPN_FRAME)
 			{
 				buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
 				{
@@ -99,6 +154,8 @@ custom_engine_end_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm;
 
+	stack.bank = bank_frame;
+
 	uint_fast8_t i;
 	Custom_Item *item;
 	for(i=0; i<CUSTOM_MAX_EXPR; i++)
@@ -136,6 +193,7 @@ custom_engine_on_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	stack.z = bev->y;
 	stack.vx = bev->vx;
 	stack.vz = bev->vy;
+	stack.bank = _custom_bank(bev->sid);
 
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm;
@@ -147,6 +205,7 @@ custom_engine_on_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 		item = &items[i];
 		if(item->dest == RPN_ON)
 		{
+			stack.hidden = hidden[i];
 			buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
 			{
 				buf_ptr = osc_set_path(buf_ptr, end, item->path);
@@ -171,6 +230,7 @@ custom_engine_off_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	stack.pid = bev->pid;
 	stack.x = stack.z = 0.f;
 	stack.vx = stack.vz = 0.f;
+	stack.bank = _custom_bank(bev->sid);
 
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm;
@@ -182,6 +242,7 @@ custom_engine_off_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 		item = &items[i];
 		if(item->dest == RPN_OFF)
 		{
+			stack.hidden = hidden[i];
 			buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
 			{
 				buf_ptr = osc_set_path(buf_ptr, end, item->path);
@@ -194,6 +255,8 @@ custom_engine_off_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 		else if(item->dest == RPN_NONE)
 			break;
 	}
+
+	_custom_bank_free(bev->sid);
 	
 	return buf_ptr;
 }
@@ -208,6 +271,7 @@ custom_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	stack.z = bev->y;
 	stack.vx = bev->vx;
 	stack.vz = bev->vy;
+	stack.bank = _custom_bank(bev->sid);
 
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm;
@@ -219,6 +283,7 @@ custom_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 		item = &items[i];
 		if(item->dest == RPN_SET)
 		{
+			stack.hidden = hidden[i];
 			buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
 			{
 				buf_ptr = osc_set_path(buf_ptr, end, item->path);
@@ -235,8 +300,37 @@ custom_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	return buf_ptr;
 }
 
+static void
+custom_init(void)
+{
+	uint_fast8_t i;
+	uint_fast8_t j;
+
+	// programs loaded from EEPROM run unchecked, too, drop the ones that fail verification
+	for(i=0, j=0; i<CUSTOM_MAX_EXPR; i++)
+	{
+		Custom_Item *item = &items[i];
+
+		if(item->dest == RPN_NONE)
+			break;
+		if( (item->dest > RPN_IDLE) || rpn_verify(item) )
+			continue;
+
+		if(j != i)
+			items[j] = *item;
+		j++;
+	}
+
+	for( ; j<i; j++)
+		items[j].dest = RPN_NONE;
+
+	for(i=0; i<BLOB_MAX; i++)
+		bank_sid[i] = 0;
+	_custom_bank_clear(bank_frame);
+}
+
 CMC_Engine custom_engine = {
-	NULL,
+	custom_init,
 	custom_engine_frame_cb,
 	custom_engine_on_cb,
 	custom_engine_off_cb,
@@ -274,7 +368,7 @@ _custom_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *
 		item->dest = RPN_NONE;
 		item->path[0] = '\0';
 		item->fmt[0] = '\0';
-		item->vm.inst[0] = RPN_TERMINATOR;
+		item->vm.code[0] = RPN_TERMINATOR;
 	}
 
 	size = CONFIG_SUCCESS("is", uuid, path);
@@ -291,6 +385,18 @@ static const OSC_Query_Value custom_append_destination_args_values [] = {
 	[RPN_IDLE]	= { .s = "idle" }
 };
 
+static void
+_custom_counts(Custom_Item *item, int32_t *raw, int32_t *event, int32_t *frame, int32_t *bytes)
+{
+	uint_fast8_t entry = rpn_entry(&item->vm);
+	uint_fast8_t offset = 0;
+
+	*raw = item->vm.raw;
+	*frame = entry ? rpn_count(&item->vm, &offset) - 1 : 0; // without skip
+	*event = rpn_count(&item->vm, &offset) + (entry ? 1 : 0); // skip over prologue runs per event, too
+	*bytes = offset;
+}
+
 static uint_fast8_t
 _custom_append(int dest, const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -320,13 +426,19 @@ _custom_append(int dest, const char *path, const char *fmt, uint_fast8_t argc, o
 		const char *argv;
 		buf_ptr = osc_get_string(buf_ptr, &argv);
 
-		if( (item->dest == RPN_NONE) && rpn_compile(argv, item) )
+		RPN_Error err;
+		if(item->dest != RPN_NONE)
+			size = CONFIG_FAIL("iss", uuid, path, "no free hook slot");
+		else if(rpn_compile(argv, item, dest, &err))
 		{
+			int32_t raw, event, frame, bytes;
+			_custom_counts(item, &raw, &event, &frame, &bytes);
+
 			item->dest = dest;
-			size = CONFIG_SUCCESS("is", uuid, path);
+			size = CONFIG_SUCCESS("isiiii", uuid, path, raw, event, frame, bytes);
 		}
-		else
-			size = CONFIG_FAIL("iss", uuid, path, "parse error and/or stack under/overflow");
+		else // error message and offset of offending token
+			size = CONFIG_FAIL("issi", uuid, path, err.msg, err.pos);
 	}
 
 	CONFIG_SEND(size);
@@ -370,6 +482,36 @@ _custom_append_idle(const char *path, const char *fmt, uint_fast8_t argc, osc_da
 	return _custom_append(RPN_IDLE, path, fmt, argc, buf);
 }
 
+static uint_fast8_t
+_custom_stats(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	uint16_t i = CUSTOM_MAX_EXPR;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+	sscanf(path, "/engines/custom/stats/%hu", &i);
+
+	if( (i >= CUSTOM_MAX_EXPR) || (items[i].dest == RPN_NONE) )
+		size = CONFIG_FAIL("iss", uuid, path, "no hook at this index");
+	else
+	{
+		Custom_Item *item = &items[i];
+		int32_t raw, event, frame, bytes;
+		_custom_counts(item, &raw, &event, &frame, &bytes);
+
+		size = CONFIG_SUCCESS("isssiiii", uuid, path, custom_append_destination_args_values[item->dest].s,
+			item->path, raw, event, frame, bytes);
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
 static const OSC_Query_Argument custom_append_args [] = {
 	OSC_QUERY_ARGUMENT_STRING("Postfix code", OSC_QUERY_MODE_W, CUSTOM_ARGS_LEN)
 };
@@ -387,8 +529,22 @@ const OSC_Query_Item custom_append_tree [] = {
  * Query
  */
 
+static const OSC_Query_Argument custom_stats_args [] = {
+	OSC_QUERY_ARGUMENT_STRING("Hook", OSC_QUERY_MODE_R, 8),
+	OSC_QUERY_ARGUMENT_STRING("Path", OSC_QUERY_MODE_R, CUSTOM_PATH_LEN),
+	OSC_QUERY_ARGUMENT_INT32("Instructions before optimization", OSC_QUERY_MODE_R, 0, RPN_PROGRAM_LEN, 1),
+	OSC_QUERY_ARGUMENT_INT32("Instructions per event after optimization", OSC_QUERY_MODE_R, 0, CUSTOM_MAX_CODE, 1),
+	OSC_QUERY_ARGUMENT_INT32("Instructions per frame hoisted out of per blob hooks", OSC_QUERY_MODE_R, 0, CUSTOM_MAX_CODE, 1),
+	OSC_QUERY_ARGUMENT_INT32("Bytes of byte code", OSC_QUERY_MODE_R, 0, CUSTOM_MAX_CODE, 1)
+};
+
+static const OSC_Query_Item custom_stats_array [] = {
+	OSC_QUERY_ITEM_METHOD("%i", "Hook", _custom_stats, custom_stats_args)
+};
+
 const OSC_Query_Item custom_tree [] = {
 	OSC_QUERY_ITEM_METHOD("enabled", "Enable/disable", _custom_enabled, config_boolean_args),
 	OSC_QUERY_ITEM_METHOD("reset", "Reset", _custom_reset, NULL),
 	OSC_QUERY_ITEM_NODE("append/", "Append hook", custom_append_tree),
+	OSC_QUERY_ITEM_ARRAY("stats/", "Per hook instruction counts", custom_stats_array, CUSTOM_MAX_EXPR)
 };
@@ -20,11 +20,17 @@
 
 #include <custom.h>
 
+#define RPN_PROGRAM_LEN 64
 #define RPN_STACK_HEIGHT 16
 #define RPN_REG_HEIGHT 8
+#define RPN_HIDDEN_HEIGHT 4
+#define RPN_BANK_HEIGHT 4
+#define RPN_SCALE_MAX 8
 
 typedef struct _RPN_Stack RPN_Stack;
 typedef struct _RPN_Compiler RPN_Compiler;
+typedef struct _RPN_Error RPN_Error;
+typedef struct _RPN_Program RPN_Program;
 
 struct _RPN_Stack {
 	uint32_t fid;
@@ -41,6 +47,8 @@ struct _RPN_Stack {
 	float vz;
 
 	float reg [RPN_REG_HEIGHT]; //FIXME use MAX_BLOB instead?
+	float *hidden; // per item, results of hoisted per-frame subexpressions
+	float *bank; // per blob registers, NAN until first written to
 	float arr [RPN_STACK_HEIGHT];
 	float *ptr;
 };
@@ -48,9 +56,32 @@ struct _RPN_Stack {
 struct _RPN_Compiler {
 	uint_fast8_t offset;
 	int_fast8_t pp;
+	const char *err;
+	const char *pos;
+};
+
+// unpacked program as seen by the compiler passes, before encoding to byte code
+struct _RPN_Program {
+	RPN_Instruction inst [RPN_PROGRAM_LEN];
+	float val [RPN_PROGRAM_LEN];
+};
+
+struct _RPN_Error {
+	const char *msg;
+	int32_t pos; // offset into expression, -1 if not attributable
 };
 
 osc_data_t *rpn_run(osc_data_t *buf, osc_data_t *end, Custom_Item *itm, RPN_Stack *stack);
-uint_fast8_t rpn_compile(const char *args, Custom_Item *itm);
+void rpn_run_hoisted(Custom_Item *itm, RPN_Stack *stack);
+uint_fast8_t rpn_compile(const char *args, Custom_Item *itm, RPN_Destination dest, RPN_Error *err);
+const char *rpn_verify(const Custom_Item *itm);
+uint_fast8_t rpn_count(const RPN_VM *vm, uint_fast8_t *offset);
+
+// byte offset of the per-event program after an optional per-frame prologue
+static inline uint_fast8_t
+rpn_entry(const RPN_VM *vm)
+{
+	return vm->code[0] == RPN_SKIP ? vm->code[1] : 0;
+}
 
 #endif // _CUSTOM_PRIVATE_H_
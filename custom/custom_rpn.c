@@ -16,377 +16,672 @@
  */
 
 #include <string.h>
+#include <math.h>
 
 #include "custom_private.h"
 
 static inline __always_inline float
-pop(RPN_Stack *stack)
+pop(float **sp)
 {
-	(stack->ptr)--; // underflow is checked for at compile time
-	float v = *(stack->ptr);
+	(*sp)--; // underflow is checked for at compile time
+	float v = **sp;
 	return v;
 }
 
 static inline __always_inline void
-push(RPN_Stack *stack, float v)
+push(float **sp, float v)
 {
-	*(stack->ptr) = v;
-	(stack->ptr)++; // overflow is checked for at compile time
+	**sp = v;
+	(*sp)++; // overflow is checked for at compile time
 }
 
 static inline __always_inline void
-xchange(RPN_Stack *stack)
+xchange(float **sp)
 {
-	float b = pop(stack);
-	float a = pop(stack);
-	push(stack, b);
-	push(stack, a);
+	float b = pop(sp);
+	float a = pop(sp);
+	push(sp, b);
+	push(sp, a);
 }
 
 static inline __always_inline void
-duplicate(RPN_Stack *stack, int32_t pos)
+duplicate(float **sp, int32_t pos)
 {
-	float v = *(stack->ptr - pos);
-	push(stack, v);
+	float v = *(*sp - pos);
+	push(sp, v);
 }
 
-osc_data_t *
-rpn_run(osc_data_t *buf, osc_data_t *end, Custom_Item *itm, RPN_Stack *stack)
+// nearest scale degree for each pitch class, 12 denotes the next octave's root
+static const uint8_t rpn_scale [RPN_SCALE_MAX][12] = {
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11}, // chromatic
+	{ 0,  0,  2,  2,  4,  5,  5,  7,  7,  9,  9, 11}, // major
+	{ 0,  0,  2,  3,  3,  5,  5,  7,  8,  8, 10, 10}, // natural minor
+	{ 0,  0,  2,  3,  3,  5,  5,  7,  8,  8, 11, 11}, // harmonic minor
+	{ 0,  0,  2,  2,  4,  4,  7,  7,  7,  9,  9, 12}, // major pentatonic
+	{ 0,  0,  3,  3,  3,  5,  5,  7,  7, 10, 10, 10}, // minor pentatonic
+	{ 0,  0,  3,  3,  3,  5,  6,  7,  7, 10, 10, 10}, // blues
+	{ 0,  0,  2,  2,  4,  4,  6,  6,  8,  8, 10, 10}  // whole tone
+};
+
+// direct-threaded dispatch via GCC's labels-as-values: every handler jumps
+// straight to the handler of the next instruction, without going back
+// through a central switch and its range check
+#define DISPATCH() goto *dispatch[*(++ip)]
+#define DISPATCH_IMM() goto *dispatch[*(ip += 2)]
+#define IMM (ip[1])
+#define CONST (vm->pool[IMM])
+
+// cross jumping would merge the handlers' identical dispatch tails into
+// shared indirect jumps, which defeats per-handler branch prediction
+__attribute__((optimize("no-crossjumping"))) static osc_data_t *
+rpn_exec(osc_data_t *buf, osc_data_t *end, const RPN_VM *vm, const uint8_t *ip, RPN_Stack *stack)
 {
+	static const void *const dispatch [RPN_INSTRUCTION_MAX] = {
+		[RPN_TERMINATOR]				= &&terminator,
+
+		[RPN_PUSH_VALUE]				= &&push_value,
+		[RPN_POP_INT32]					= &&pop_int32,
+		[RPN_POP_FLOAT]					= &&pop_float,
+		[RPN_POP_MIDI]					= &&pop_midi,
+
+		[RPN_PUSH_FID]					= &&push_fid,
+		[RPN_PUSH_SID]					= &&push_sid,
+		[RPN_PUSH_GID]					= &&push_gid,
+		[RPN_PUSH_PID]					= &&push_pid,
+		[RPN_PUSH_X]						= &&push_x,
+		[RPN_PUSH_Z]						= &&push_z,
+		[RPN_PUSH_VX]						= &&push_vx,
+		[RPN_PUSH_VZ]						= &&push_vz,
+		[RPN_PUSH_N]						= &&push_n,
+
+		[RPN_PUSH_REG]					= &&push_reg,
+		[RPN_POP_REG]						= &&pop_reg,
+
+		[RPN_ADD]								= &&add,
+		[RPN_SUB]								= &&sub,
+		[RPN_MUL]								= &&mul,
+		[RPN_DIV]								= &&div,
+		[RPN_MOD]								= &&mod,
+		[RPN_POW]								= &&pow,
+		[RPN_NEG]								= &&neg,
+		[RPN_XCHANGE]						= &&xchange,
+		[RPN_DUPL_AT]						= &&dupl_at,
+		[RPN_DUPL_TOP]					= &&dupl_top,
+		[RPN_LSHIFT]						= &&lshift,
+		[RPN_RSHIFT]						= &&rshift,
+
+		[RPN_LOGICAL_AND]				= &&logical_and,
+		[RPN_BITWISE_AND]				= &&bitwise_and,
+		[RPN_LOGICAL_OR]				= &&logical_or,
+		[RPN_BITWISE_OR]				= &&bitwise_or,
+
+		[RPN_NOT]								= &&not,
+		[RPN_NOTEQ]							= &&noteq,
+		[RPN_COND]							= &&cond,
+		[RPN_LT]								= &&lt,
+		[RPN_LEQ]								= &&leq,
+		[RPN_GT]								= &&gt,
+		[RPN_GEQ]								= &&geq,
+		[RPN_EQ]								= &&eq,
+
+		[RPN_PUSH_VALUE_ADD]		= &&push_value_add,
+		[RPN_PUSH_VALUE_SUB]		= &&push_value_sub,
+		[RPN_PUSH_VALUE_MUL]		= &&push_value_mul,
+		[RPN_PUSH_VALUE_DIV]		= &&push_value_div,
+		[RPN_PUSH_X_VALUE_ADD]	= &&push_x_value_add,
+		[RPN_PUSH_X_VALUE_MUL]	= &&push_x_value_mul,
+		[RPN_PUSH_Z_VALUE_ADD]	= &&push_z_value_add,
+		[RPN_PUSH_Z_VALUE_MUL]	= &&push_z_value_mul,
+		[RPN_PUSH_VALUE_PUSH_REG]	= &&push_value_push_reg,
+		[RPN_PUSH_VALUE_POP_REG]	= &&push_value_pop_reg,
+		[RPN_PUSH_VALUE_DUPL_AT]	= &&push_value_dupl_at,
+
+		[RPN_SKIP]							= &&skip,
+		[RPN_PUSH_HIDDEN]				= &&push_hidden,
+		[RPN_POP_HIDDEN]				= &&pop_hidden,
+
+		[RPN_PUSH_BANK]					= &&push_bank,
+		[RPN_POP_BANK]					= &&pop_bank,
+		[RPN_PUSH_VALUE_PUSH_BANK]	= &&push_value_push_bank,
+		[RPN_PUSH_VALUE_POP_BANK]	= &&push_value_pop_bank,
+		[RPN_SMOOTH]						= &&smooth,
+		[RPN_HYSTERESIS]				= &&hysteresis,
+		[RPN_CLAMP]							= &&clamp,
+		[RPN_SCALE]							= &&scale
+	};
+
 	osc_data_t *buf_ptr = buf;
-	RPN_VM *vm = &itm->vm;
+	float *sp = stack->arr; // reset stack
 
-	stack->ptr = stack->arr; // reset stack
+	goto *dispatch[*ip];
 
-	RPN_Instruction *inst;
-	for(inst = vm->inst; *inst != RPN_TERMINATOR; inst++)
-		switch(*inst)
+	push_value:
+	{
+		push(&sp, CONST);
+		DISPATCH_IMM();
+	}
+	pop_int32:
+	{
+		volatile int32_t i = pop(&sp);
+		buf_ptr = osc_set_int32(buf_ptr, end, i);
+		DISPATCH();
+	}
+	pop_float:
+	{
+		float f = pop(&sp);
+		buf_ptr = osc_set_float(buf_ptr, end, f);
+		DISPATCH();
+	}
+	pop_midi:
+	{
+		uint8_t *m;
+		buf_ptr = osc_set_midi_inline(buf_ptr, end, &m);
+		if(buf_ptr)
 		{
-			case RPN_PUSH_VALUE:
-			{
-				push(stack, vm->val[inst - vm->inst]);
-				break;
-			}
-			case RPN_POP_INT32:
-			{
-				volatile int32_t i = pop(stack);
-				buf_ptr = osc_set_int32(buf_ptr, end, i);
-				break;
-			}
-			case RPN_POP_FLOAT:
-			{
-				float f = pop(stack);
-				buf_ptr = osc_set_float(buf_ptr, end, f);
-				break;
-			}
-			case RPN_POP_MIDI:
-			{
-				uint8_t *m;
-				buf_ptr = osc_set_midi_inline(buf_ptr, end, &m);
-				if(buf_ptr)
-				{
-					m[3] = pop(stack);
-					m[2] = pop(stack);
-					m[1] = pop(stack);
-					m[0] = pop(stack);
-				}
-				break;
-			}
+			m[3] = pop(&sp);
+			m[2] = pop(&sp);
+			m[1] = pop(&sp);
+			m[0] = pop(&sp);
+		}
+		DISPATCH();
+	}
 
-			case RPN_PUSH_FID:
-			{
-				push(stack, stack->fid);
-				break;
-			}
-			case RPN_PUSH_SID:
-			{
-				push(stack, stack->sid);
-				break;
-			}
-			case RPN_PUSH_GID:
-			{
-				push(stack, stack->gid);
-				break;
-			}
-			case RPN_PUSH_PID:
-			{
-				push(stack, stack->pid);
-				break;
-			}
-			case RPN_PUSH_X:
-			{
-				push(stack, stack->x);
-				break;
-			}
-			case RPN_PUSH_Z:
-			{
-				push(stack, stack->z);
-				break;
-			}
-			case RPN_PUSH_VX:
-			{
-				push(stack, stack->vx);
-				break;
-			}
-			case RPN_PUSH_VZ:
-			{
-				push(stack, stack->vz);
-				break;
-			}
-			case RPN_PUSH_N:
-			{
-				push(stack, SENSOR_N);
-				break;
-			}
+	push_fid:
+	{
+		push(&sp, stack->fid);
+		DISPATCH();
+	}
+	push_sid:
+	{
+		push(&sp, stack->sid);
+		DISPATCH();
+	}
+	push_gid:
+	{
+		push(&sp, stack->gid);
+		DISPATCH();
+	}
+	push_pid:
+	{
+		push(&sp, stack->pid);
+		DISPATCH();
+	}
+	push_x:
+	{
+		push(&sp, stack->x);
+		DISPATCH();
+	}
+	push_z:
+	{
+		push(&sp, stack->z);
+		DISPATCH();
+	}
+	push_vx:
+	{
+		push(&sp, stack->vx);
+		DISPATCH();
+	}
+	push_vz:
+	{
+		push(&sp, stack->vz);
+		DISPATCH();
+	}
+	push_n:
+	{
+		push(&sp, SENSOR_N);
+		DISPATCH();
+	}
 
-			case RPN_PUSH_REG:
-			{
-				int32_t pos = pop(stack);
-				float c = pop(stack);
-				if(pos < RPN_REG_HEIGHT)
-					stack->reg[pos] = c;
-				else
-				{
-					; //TODO warn
-				}
-				break;
-			}
-			case RPN_POP_REG:
-			{
-				int32_t pos = pop(stack);
-				if(pos < RPN_REG_HEIGHT)
-					push(stack, stack->reg[pos]);
-				else // TODO warn
-					push(stack, NAN);
-				break;
-			}
+	push_reg:
+	{
+		uint32_t pos = (int32_t)pop(&sp); // negative positions wrap out of range
+		float c = pop(&sp);
+		if(pos < RPN_REG_HEIGHT)
+			stack->reg[pos] = c;
+		else
+		{
+			; //TODO warn
+		}
+		DISPATCH();
+	}
+	pop_reg:
+	{
+		uint32_t pos = (int32_t)pop(&sp); // negative positions wrap out of range
+		if(pos < RPN_REG_HEIGHT)
+			push(&sp, stack->reg[pos]);
+		else // TODO warn
+			push(&sp, NAN);
+		DISPATCH();
+	}
 
-			// standard operators
-			case RPN_ADD:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a + b;
-				push(stack, c);
-				break;
-			}
-			case RPN_SUB:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a - b;
-				push(stack, c);
-				break;
-			}
-			case RPN_MUL:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a * b;
-				push(stack, c);
-				break;
-			}
-			case RPN_DIV:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a / b;
-				push(stack, c);
-				break;
-			}
-			case RPN_MOD:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = fmod(a, b);
-				push(stack, c);
-				break;
-			}
-			case RPN_POW:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = pow(a, b);
-				push(stack, c);
-				break;
-			}
-			case RPN_NEG:
-			{
-				float c = pop(stack);
-				push(stack, -c);
-				break;
-			}
-			case RPN_XCHANGE:
-			{
-				xchange(stack);
-				break;
-			}
-			case RPN_DUPL_AT:
-			{
-				int32_t pos = pop(stack);
-				if(pos > RPN_STACK_HEIGHT)
-					pos = RPN_STACK_HEIGHT;
-				else if(pos < 1)
-					pos = 1;
-				duplicate(stack, pos);
-				break;
-			}
-			case RPN_DUPL_TOP:
-			{
-				duplicate(stack, 1);
-				break;
-			}
-			case RPN_LSHIFT:
-			{
-				int32_t b = pop(stack);
-				int32_t a = pop(stack);
-				int32_t c = a << b;
-				push(stack, c);
-				break;
-			}
-			case RPN_RSHIFT:
-			{
-				int32_t b = pop(stack);
-				int32_t a = pop(stack);
-				int32_t c = a >> b;
-				push(stack, c);
-				break;
-			}
-			case RPN_LOGICAL_AND:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a && b;
-				push(stack, c);
-				break;
-			}
-			case RPN_BITWISE_AND:
-			{
-				int32_t b = pop(stack);
-				int32_t a = pop(stack);
-				int32_t c = a & b;
-				push(stack, c);
-				break;
-			}
-			case RPN_LOGICAL_OR:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a || b;
-				push(stack, c);
-				break;
-			}
-			case RPN_BITWISE_OR:
-			{
-				int32_t b = pop(stack);
-				int32_t a = pop(stack);
-				int32_t c = a | b;
-				push(stack, c);
-				break;
-			}
+	// standard operators
+	add:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a + b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	sub:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a - b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	mul:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a * b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	div:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a / b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	mod:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = fmod(a, b);
+		push(&sp, c);
+		DISPATCH();
+	}
+	pow:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = pow(a, b);
+		push(&sp, c);
+		DISPATCH();
+	}
+	neg:
+	{
+		float c = pop(&sp);
+		push(&sp, -c);
+		DISPATCH();
+	}
+	xchange:
+	{
+		xchange(&sp);
+		DISPATCH();
+	}
+	dupl_at:
+	{
+		int32_t pos = pop(&sp);
+		int32_t height = sp - stack->arr; // at least one, verified at compile time
+		if(pos > height)
+			pos = height;
+		else if(pos < 1)
+			pos = 1;
+		duplicate(&sp, pos);
+		DISPATCH();
+	}
+	dupl_top:
+	{
+		duplicate(&sp, 1);
+		DISPATCH();
+	}
+	lshift: // shift amounts as Cortex-M shifts by register: bottom byte, 0 from 32 on
+	{
+		uint32_t b = (uint32_t)(int32_t)pop(&sp) & 0xff;
+		int32_t a = pop(&sp);
+		int32_t c = b < 32 ? (int32_t)((uint32_t)a << b) : 0;
+		push(&sp, c);
+		DISPATCH();
+	}
+	rshift:
+	{
+		uint32_t b = (uint32_t)(int32_t)pop(&sp) & 0xff;
+		int32_t a = pop(&sp);
+		int32_t c = a >> (b < 32 ? b : 31);
+		push(&sp, c);
+		DISPATCH();
+	}
+	logical_and:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a && b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	bitwise_and:
+	{
+		int32_t b = pop(&sp);
+		int32_t a = pop(&sp);
+		int32_t c = a & b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	logical_or:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a || b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	bitwise_or:
+	{
+		int32_t b = pop(&sp);
+		int32_t a = pop(&sp);
+		int32_t c = a | b;
+		push(&sp, c);
+		DISPATCH();
+	}
 
-			// conditionals
-			case RPN_NOT:
-			{
-				float c = pop(stack);
-				push(stack, !c);
-				break;
-			}
-			case RPN_NOTEQ:
-			{
-				float a = pop(stack);
-				float b = pop(stack);
-				float c = a != b;
-				push(stack, c);
-				break;
-			}
-			case RPN_COND:
-			{
-				float c = pop(stack);
-				if(!c)
-					xchange(stack);
-				pop(stack);
-				break;
-			}
-			case RPN_LT:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a < b;
-				push(stack, c);
-				break;
-			}
-			case RPN_LEQ:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a <= b;
-				push(stack, c);
-				break;
-			}
-			case RPN_GT:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a > b;
-				push(stack, c);
-				break;
-			}
-			case RPN_GEQ:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a >= b;
-				push(stack, c);
-				break;
-			}
-			case RPN_EQ:
-			{
-				float b = pop(stack);
-				float a = pop(stack);
-				float c = a == b;
-				push(stack, c);
-				break;
-			}
-			case RPN_TERMINATOR:
-				// never reached
-				break;
+	// conditionals
+	not:
+	{
+		float c = pop(&sp);
+		push(&sp, !c);
+		DISPATCH();
+	}
+	noteq:
+	{
+		float a = pop(&sp);
+		float b = pop(&sp);
+		float c = a != b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	cond:
+	{
+		float c = pop(&sp);
+		if(!c)
+			xchange(&sp);
+		pop(&sp);
+		DISPATCH();
+	}
+	lt:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a < b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	leq:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a <= b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	gt:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a > b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	geq:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a >= b;
+		push(&sp, c);
+		DISPATCH();
+	}
+	eq:
+	{
+		float b = pop(&sp);
+		float a = pop(&sp);
+		float c = a == b;
+		push(&sp, c);
+		DISPATCH();
+	}
+
+	// superinstructions, fused by rpn_fuse, operate on top of stack in place
+	push_value_add:
+	{
+		sp[-1] += CONST;
+		DISPATCH_IMM();
+	}
+	push_value_sub:
+	{
+		sp[-1] -= CONST;
+		DISPATCH_IMM();
+	}
+	push_value_mul:
+	{
+		sp[-1] *= CONST;
+		DISPATCH_IMM();
+	}
+	push_value_div:
+	{
+		sp[-1] /= CONST;
+		DISPATCH_IMM();
+	}
+	push_x_value_add:
+	{
+		push(&sp, stack->x + CONST);
+		DISPATCH_IMM();
+	}
+	push_x_value_mul:
+	{
+		push(&sp, stack->x * CONST);
+		DISPATCH_IMM();
+	}
+	push_z_value_add:
+	{
+		push(&sp, stack->z + CONST);
+		DISPATCH_IMM();
+	}
+	push_z_value_mul:
+	{
+		push(&sp, stack->z * CONST);
+		DISPATCH_IMM();
+	}
+	push_value_push_reg:
+	{
+		stack->reg[IMM] = pop(&sp); // index is checked for at compile time
+		DISPATCH_IMM();
+	}
+	push_value_pop_reg:
+	{
+		push(&sp, stack->reg[IMM]); // index is checked for at compile time
+		DISPATCH_IMM();
+	}
+	push_value_dupl_at:
+	{
+		duplicate(&sp, IMM); // position is checked for at compile time
+		DISPATCH_IMM();
+	}
+
+	// per-frame prologue
+	skip:
+	{
+		ip = vm->code + IMM;
+		goto *dispatch[*ip];
+	}
+	push_hidden:
+	{
+		push(&sp, stack->hidden[IMM]);
+		DISPATCH_IMM();
+	}
+	pop_hidden:
+	{
+		stack->hidden[IMM] = pop(&sp);
+		DISPATCH_IMM();
+	}
+
+	// per blob registers
+	push_bank:
+	{
+		uint32_t pos = (int32_t)pop(&sp); // negative positions wrap out of range
+		float c = pop(&sp);
+		if(pos < RPN_BANK_HEIGHT)
+			stack->bank[pos] = c;
+		DISPATCH();
+	}
+	pop_bank:
+	{
+		uint32_t pos = (int32_t)pop(&sp); // negative positions wrap out of range
+		if(pos < RPN_BANK_HEIGHT)
+			push(&sp, stack->bank[pos]);
+		else
+			push(&sp, NAN);
+		DISPATCH();
+	}
+	push_value_push_bank:
+	{
+		stack->bank[IMM] = pop(&sp); // index is checked for at compile time
+		DISPATCH_IMM();
+	}
+	push_value_pop_bank:
+	{
+		push(&sp, stack->bank[IMM]); // index is checked for at compile time
+		DISPATCH_IMM();
+	}
+	smooth:
+	{
+		uint32_t pos = (int32_t)pop(&sp);
+		float a = pop(&sp);
+		float x = pop(&sp);
+		if(pos < RPN_BANK_HEIGHT)
+		{
+			float *y = &stack->bank[pos];
+			x = isnan(*y) ? x : *y + a*(x - *y); // one-pole lowpass, starts at first input
+			*y = x;
 		}
-	
+		push(&sp, x);
+		DISPATCH();
+	}
+	hysteresis:
+	{
+		uint32_t pos = (int32_t)pop(&sp);
+		float w = pop(&sp);
+		float x = pop(&sp);
+		if(pos < RPN_BANK_HEIGHT)
+		{
+			float *y = &stack->bank[pos];
+			if(isnan(*y) || (fabsf(x - *y) > w) ) // follow input once it leaves dead band
+				*y = x;
+			x = *y;
+		}
+		push(&sp, x);
+		DISPATCH();
+	}
+	clamp:
+	{
+		float hi = pop(&sp);
+		float lo = pop(&sp);
+		float x = pop(&sp);
+		if(x < lo)
+			x = lo;
+		else if(x > hi)
+			x = hi;
+		push(&sp, x);
+		DISPATCH();
+	}
+	scale:
+	{
+		uint32_t s = (int32_t)pop(&sp);
+		float x = pop(&sp);
+		if(s >= RPN_SCALE_MAX) // out of range scales are chromatic
+			s = 0;
+		if(isfinite(x) && (fabsf(x) < 0x1p24f) )
+		{
+			int32_t note = floorf(x + 0.5f); // round to nearest semitone
+			int32_t oct = note >= 0 ? note / 12 : (note - 11) / 12;
+			x = oct*12 + rpn_scale[s][note - oct*12];
+		}
+		push(&sp, x);
+		DISPATCH();
+	}
+
+	terminator:
+	stack->ptr = sp;
 	return buf_ptr;
 }
 
+osc_data_t *
+rpn_run(osc_data_t *buf, osc_data_t *end, Custom_Item *itm, RPN_Stack *stack)
+{
+	return rpn_exec(buf, end, &itm->vm, itm->vm.code, stack);
+}
+
+void
+rpn_run_hoisted(Custom_Item *itm, RPN_Stack *stack)
+{
+	if(itm->vm.code[0] == RPN_SKIP)
+		rpn_exec(NULL, NULL, &itm->vm, &itm->vm.code[2], stack);
+}
+
+#undef DISPATCH
+#undef DISPATCH_IMM
+#undef IMM
+#undef CONST
+
 static uint_fast8_t
-rpn_add_inst(RPN_VM *vm, RPN_Compiler *compiler, RPN_Instruction inst, float val, uint_fast8_t pops, uint_fast8_t pushs)
+rpn_fail(RPN_Compiler *compiler, const char *err)
+{
+	compiler->err = err;
+	return 0;
+}
+
+static uint_fast8_t
+rpn_add_inst(RPN_Program *prog, RPN_Compiler *compiler, RPN_Instruction inst, float val, uint_fast8_t pops, uint_fast8_t pushs)
 {
 	//check for stack underflow
 	compiler->pp -= pops;
 	if(compiler->pp < 0)
-		return 0;
+		return rpn_fail(compiler, "stack underflow");
 
 	// check for stack overflow
 	compiler->pp += pushs;
 	if(compiler->pp > RPN_STACK_HEIGHT)
-		return 0;
+		return rpn_fail(compiler, "stack overflow");
 
-	vm->inst[compiler->offset] = inst;
-	vm->val[compiler->offset] = val;
+	if(compiler->offset >= RPN_PROGRAM_LEN)
+		return rpn_fail(compiler, "too many instructions");
 
-	if(compiler->offset >= CUSTOM_MAX_INST)
-		return 0;
+	prog->inst[compiler->offset] = inst;
+	prog->val[compiler->offset] = val;
 	compiler->offset++;
 
 	return 1;
 }
 
+typedef struct _RPN_Builtin RPN_Builtin;
+
+struct _RPN_Builtin {
+	const char *name;
+	RPN_Instruction inst;
+	uint8_t pops;
+};
+
+// named operators, all of them push a single result
+static const RPN_Builtin rpn_builtins [] = {
+	{"smooth", RPN_SMOOTH, 3}, // x coefficient register :smooth
+	{"hyst", RPN_HYSTERESIS, 3}, // x width register :hyst
+	{"clamp", RPN_CLAMP, 3}, // x min max :clamp
+	{"scale", RPN_SCALE, 2}, // semitones scale :scale
+	{NULL, RPN_TERMINATOR, 0}
+};
+
 static uint_fast8_t
-rpn_compile_sub(const char *str, size_t len, RPN_VM *vm, RPN_Compiler *compiler)
+rpn_compile_sub(const char *str, size_t len, RPN_Program *prog, RPN_Compiler *compiler)
 {
 	const char *ptr = str;
 	const char *end = str + len;
 
 	while(ptr < end)
 	{
+		compiler->pos = ptr;
+
 		switch(*ptr)
 		{
 			case '$':
@@ -394,57 +689,83 @@ rpn_compile_sub(const char *str, size_t len, RPN_VM *vm, RPN_Compiler *compiler)
 				switch(ptr[1])
 				{
 					case 'f':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_FID, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_FID, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'b':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_SID, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_SID, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'g':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_GID, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_GID, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'p':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_PID, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_PID, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'x':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_X, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_X, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'z':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_Z, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_Z, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'X':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_VX, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_VX, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'Z':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_VZ, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_VZ, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					case 'n':
-						if(!rpn_add_inst(vm, compiler, RPN_PUSH_N, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_PUSH_N, 0.f, 0, 1)) return 0;
 						ptr++;
 						break;
 					default:
-						return 0; // parse error
+						return rpn_fail(compiler, "unknown variable");
 				}
 				ptr++;
 				break;
 			}
 
 			case '[':
-				if(!rpn_add_inst(vm, compiler, RPN_PUSH_REG, 0.f, 2, 0)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_PUSH_REG, 0.f, 2, 0)) return 0;
 				ptr++;
 				break;
 			case ']':
-				if(!rpn_add_inst(vm, compiler, RPN_POP_REG, 0.f, 1, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_POP_REG, 0.f, 1, 1)) return 0;
+				ptr++;
+				break;
+
+			case '{':
+				if(!rpn_add_inst(prog, compiler, RPN_PUSH_BANK, 0.f, 2, 0)) return 0;
+				ptr++;
+				break;
+			case '}':
+				if(!rpn_add_inst(prog, compiler, RPN_POP_BANK, 0.f, 1, 1)) return 0;
 				ptr++;
 				break;
 
+			case ':':
+			{
+				const RPN_Builtin *builtin;
+				for(builtin=rpn_builtins; builtin->name; builtin++)
+				{
+					size_t n = strlen(builtin->name);
+					if( (ptr + 1 + n <= end) && !strncmp(ptr + 1, builtin->name, n)
+						&& ( (ptr + 1 + n == end) || (ptr[1 + n] == ' ') || (ptr[1 + n] == '\t') ) )
+						break;
+				}
+				if(!builtin->name)
+					return rpn_fail(compiler, "unknown builtin");
+				if(!rpn_add_inst(prog, compiler, builtin->inst, 0.f, builtin->pops, 1)) return 0;
+				ptr += 1 + strlen(builtin->name);
+				break;
+			}
+
 			case ' ':
 			case '\t':
 				// skip
@@ -452,46 +773,46 @@ rpn_compile_sub(const char *str, size_t len, RPN_VM *vm, RPN_Compiler *compiler)
 				break;
 
 			case '+':
-				if(!rpn_add_inst(vm, compiler, RPN_ADD, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_ADD, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '-':
-				if(!rpn_add_inst(vm, compiler, RPN_SUB, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_SUB, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '*':
-				if(!rpn_add_inst(vm, compiler, RPN_MUL, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_MUL, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '/':
-				if(!rpn_add_inst(vm, compiler, RPN_DIV, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_DIV, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '%':
-				if(!rpn_add_inst(vm, compiler, RPN_MOD, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_MOD, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '^':
-				if(!rpn_add_inst(vm, compiler, RPN_POW, 0.f, 2, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_POW, 0.f, 2, 1)) return 0;
 				ptr++;
 				break;
 			case '~':
-				if(!rpn_add_inst(vm, compiler, RPN_NEG, 0.f, 1, 1)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_NEG, 0.f, 1, 1)) return 0;
 				ptr++;
 				break;
 			case '#':
-				if(!rpn_add_inst(vm, compiler, RPN_XCHANGE, 0.f, 2, 2)) return 0;
+				if(!rpn_add_inst(prog, compiler, RPN_XCHANGE, 0.f, 2, 2)) return 0;
 				ptr++;
 				break;
 			case '@':
 				switch(ptr[1])
 				{
 					case '@':
-						if(!rpn_add_inst(vm, compiler, RPN_DUPL_TOP, 0.f, 0, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_DUPL_TOP, 0.f, 1, 2)) return 0;
 						ptr++;
 						break;
 					default:
-						if(!rpn_add_inst(vm, compiler, RPN_DUPL_AT, 0.f, 1, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_DUPL_AT, 0.f, 2, 2)) return 0;
 						break;
 				}
 				ptr++;
@@ -501,119 +822,594 @@ rpn_compile_sub(const char *str, size_t len, RPN_VM *vm, RPN_Compiler *compiler)
 				switch(ptr[1])
 				{
 					case '=':
-						if(!rpn_add_inst(vm, compiler, RPN_NOTEQ, 0.f, 2, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_NOTEQ, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					default:
+						if(!rpn_add_inst(prog, compiler, RPN_NOT, 0.f, 1, 1)) return 0;
+						break;
+				}
+				ptr++;
+				break;
+			case '?':
+				if(!rpn_add_inst(prog, compiler, RPN_COND, 0.f, 3, 1)) return 0;
+				ptr++;
+				break;
+			case '<':
+				switch(ptr[1])
+				{
+					case '=':
+						if(!rpn_add_inst(prog, compiler, RPN_LEQ, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					case '<':
+						if(!rpn_add_inst(prog, compiler, RPN_LSHIFT, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					default:
+						if(!rpn_add_inst(prog, compiler, RPN_LT, 0.f, 2, 1)) return 0;
+						break;
+				}
+				ptr++;
+				break;
+			case '>':
+				switch(ptr[1])
+				{
+					case '=':
+						if(!rpn_add_inst(prog, compiler, RPN_GEQ, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					case '>':
+						if(!rpn_add_inst(prog, compiler, RPN_RSHIFT, 0.f, 2, 1)) return 0;
 						ptr++;
 						break;
 					default:
-						if(!rpn_add_inst(vm, compiler, RPN_NOT, 0.f, 1, 1)) return 0;
+						if(!rpn_add_inst(prog, compiler, RPN_GT, 0.f, 2, 1)) return 0;
+						break;
+				}
+				ptr++;
+				break;
+			case '=':
+				switch(ptr[1])
+				{
+					case '=':
+						if(!rpn_add_inst(prog, compiler, RPN_EQ, 0.f, 2, 1)) return 0;
+						ptr++;
 						break;
+					default:
+						return rpn_fail(compiler, "unknown operator");
 				}
 				ptr++;
 				break;
-			case '?':
-				if(!rpn_add_inst(vm, compiler, RPN_COND, 0.f, 3, 1)) return 0;
-				ptr++;
+			case '&':
+				switch(ptr[1])
+				{
+					case '&':
+						if(!rpn_add_inst(prog, compiler, RPN_LOGICAL_AND, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					default:
+						if(!rpn_add_inst(prog, compiler, RPN_BITWISE_AND, 0.f, 2, 1)) return 0;
+						break;
+				}
+				ptr++;
+				break;
+			case '|':
+				switch(ptr[1])
+				{
+					case '|':
+						if(!rpn_add_inst(prog, compiler, RPN_LOGICAL_OR, 0.f, 2, 1)) return 0;
+						ptr++;
+						break;
+					default:
+						if(!rpn_add_inst(prog, compiler, RPN_BITWISE_OR, 0.f, 2, 1)) return 0;
+						break;
+				}
+				ptr++;
+				break;
+
+			default:
+			{
+				char *endptr = NULL;
+				float v = strtod(ptr, &endptr);
+				if(ptr != endptr)
+				{
+					if(!rpn_add_inst(prog, compiler, RPN_PUSH_VALUE, v, 0, 1)) return 0;
+					ptr = endptr;
+				}
+				else
+					return rpn_fail(compiler, "unknown token");
+			}
+		}
+	}
+
+	return 1;
+}
+
+typedef enum _RPN_Immediate RPN_Immediate;
+typedef struct _RPN_Arity RPN_Arity;
+
+// kind of operand byte following the opcode in byte code
+enum _RPN_Immediate {
+	RPN_IMM_NONE = 0,
+	RPN_IMM_CONST, // index into constant pool
+	RPN_IMM_INDEX // register index, stack position or jump target
+};
+
+struct _RPN_Arity {
+	uint8_t pops;
+	uint8_t pushs;
+	uint8_t pure; // result depends on popped operands only
+	RPN_Immediate imm;
+};
+
+static const RPN_Arity rpn_arity [RPN_INSTRUCTION_MAX] = {
+	[RPN_TERMINATOR]					= {0, 0, 0, RPN_IMM_NONE},
+
+	[RPN_PUSH_VALUE]					= {0, 1, 0, RPN_IMM_CONST},
+	[RPN_POP_INT32]						= {1, 0, 0, RPN_IMM_NONE},
+	[RPN_POP_FLOAT]						= {1, 0, 0, RPN_IMM_NONE},
+	[RPN_POP_MIDI]						= {4, 0, 0, RPN_IMM_NONE},
+
+	[RPN_PUSH_FID]						= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_SID]						= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_GID]						= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_PID]						= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_X]							= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_Z]							= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_VX]							= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_VZ]							= {0, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_N]							= {0, 1, 0, RPN_IMM_NONE},
+
+	[RPN_PUSH_REG]						= {2, 0, 0, RPN_IMM_NONE},
+	[RPN_POP_REG]							= {1, 1, 0, RPN_IMM_NONE},
+
+	[RPN_ADD]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_SUB]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_MUL]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_DIV]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_MOD]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_POW]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_NEG]									= {1, 1, 1, RPN_IMM_NONE},
+	[RPN_XCHANGE]							= {2, 2, 1, RPN_IMM_NONE},
+	[RPN_DUPL_AT]							= {2, 2, 0, RPN_IMM_NONE}, // needs a value below position
+	[RPN_DUPL_TOP]						= {1, 2, 1, RPN_IMM_NONE},
+	[RPN_LSHIFT]							= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_RSHIFT]							= {2, 1, 1, RPN_IMM_NONE},
+
+	[RPN_LOGICAL_AND]					= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_BITWISE_AND]					= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_LOGICAL_OR]					= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_BITWISE_OR]					= {2, 1, 1, RPN_IMM_NONE},
+
+	[RPN_NOT]									= {1, 1, 1, RPN_IMM_NONE},
+	[RPN_NOTEQ]								= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_COND]								= {3, 1, 1, RPN_IMM_NONE},
+	[RPN_LT]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_LEQ]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_GT]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_GEQ]									= {2, 1, 1, RPN_IMM_NONE},
+	[RPN_EQ]									= {2, 1, 1, RPN_IMM_NONE},
+
+	[RPN_PUSH_VALUE_ADD]			= {1, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_VALUE_SUB]			= {1, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_VALUE_MUL]			= {1, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_VALUE_DIV]			= {1, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_X_VALUE_ADD]		= {0, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_X_VALUE_MUL]		= {0, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_Z_VALUE_ADD]		= {0, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_Z_VALUE_MUL]		= {0, 1, 0, RPN_IMM_CONST},
+	[RPN_PUSH_VALUE_PUSH_REG]	= {1, 0, 0, RPN_IMM_INDEX},
+	[RPN_PUSH_VALUE_POP_REG]	= {0, 1, 0, RPN_IMM_INDEX},
+	[RPN_PUSH_VALUE_DUPL_AT]	= {0, 1, 0, RPN_IMM_INDEX},
+
+	[RPN_SKIP]								= {0, 0, 0, RPN_IMM_INDEX},
+	[RPN_PUSH_HIDDEN]					= {0, 1, 0, RPN_IMM_INDEX},
+	[RPN_POP_HIDDEN]					= {1, 0, 0, RPN_IMM_INDEX},
+
+	[RPN_PUSH_BANK]						= {2, 0, 0, RPN_IMM_NONE},
+	[RPN_POP_BANK]						= {1, 1, 0, RPN_IMM_NONE},
+	[RPN_PUSH_VALUE_PUSH_BANK]	= {1, 0, 0, RPN_IMM_INDEX},
+	[RPN_PUSH_VALUE_POP_BANK]	= {0, 1, 0, RPN_IMM_INDEX},
+	[RPN_SMOOTH]							= {3, 1, 0, RPN_IMM_NONE},
+	[RPN_HYSTERESIS]					= {3, 1, 0, RPN_IMM_NONE},
+	[RPN_CLAMP]								= {3, 1, 1, RPN_IMM_NONE},
+	[RPN_SCALE]								= {2, 1, 1, RPN_IMM_NONE}
+};
+
+// pushes one value without popping any, e.g. safe to reorder or drop
+static inline __always_inline uint_fast8_t
+rpn_is_leaf(RPN_Instruction inst)
+{
+	return (inst == RPN_PUSH_VALUE)
+		|| ( (inst >= RPN_PUSH_FID) && (inst <= RPN_PUSH_N) );
+}
+
+// evaluate a pure instruction on constant operands with the interpreter itself
+static uint_fast8_t
+rpn_fold(RPN_Program *prog, uint_fast8_t j, RPN_Instruction inst)
+{
+	const RPN_Arity *arity = &rpn_arity[inst];
+	RPN_VM tmp;
+	RPN_Stack stack;
+	uint_fast8_t k;
+	uint_fast8_t n = 0;
+
+	for(k=0; k<arity->pops; k++)
+	{
+		tmp.code[n++] = RPN_PUSH_VALUE;
+		tmp.code[n++] = k;
+		tmp.pool[k] = prog->val[j - arity->pops + k];
+	}
+	tmp.code[n++] = inst;
+	tmp.code[n] = RPN_TERMINATOR;
+
+	rpn_exec(NULL, NULL, &tmp, tmp.code, &stack);
+
+	j -= arity->pops;
+	for(k=0; k<arity->pushs; k++)
+	{
+		prog->inst[j] = RPN_PUSH_VALUE;
+		prog->val[j] = stack.arr[k];
+		j++;
+	}
+
+	return j;
+}
+
+// append an instruction to the optimized program, returns its new length
+static uint_fast8_t
+rpn_peephole(RPN_Program *prog, uint_fast8_t j, RPN_Instruction inst, float val)
+{
+	RPN_Instruction *out = prog->inst;
+	const RPN_Arity *arity = &rpn_arity[inst];
+
+	// constant folding
+	if(arity->pure && (j >= arity->pops) )
+	{
+		uint_fast8_t k;
+		for(k=j - arity->pops; k<j; k++)
+			if(out[k] != RPN_PUSH_VALUE)
+				break;
+		if(k == j)
+			return rpn_fold(prog, j, inst);
+	}
+
+	// algebraic simplification and strength reduction on a constant operand
+	if( (j >= 1) && (out[j-1] == RPN_PUSH_VALUE) )
+	{
+		float c = prog->val[j-1];
+		int e;
+
+		switch(inst)
+		{
+			case RPN_ADD:
+				if( (c == 0.f) && signbit(c) ) // x + -0 = x
+					return j - 1;
+				break;
+			case RPN_SUB:
+				if( (c == 0.f) && !signbit(c) ) // x - 0 = x
+					return j - 1;
+				break;
+			case RPN_MUL:
+				if(c == 1.f) // x * 1 = x
+					return j - 1;
+				if(c == -1.f) // x * -1 = -x
+					return rpn_peephole(prog, j - 1, RPN_NEG, 0.f);
 				break;
-			case '<':
-				switch(ptr[1])
+			case RPN_DIV:
+				if(c == 1.f) // x / 1 = x
+					return j - 1;
+				if(c == -1.f) // x / -1 = -x
+					return rpn_peephole(prog, j - 1, RPN_NEG, 0.f);
+				if(isnormal(c) && (fabsf(frexpf(c, &e)) == 0.5f) && isnormal(1.f / c) )
 				{
-					case '=':
-						if(!rpn_add_inst(vm, compiler, RPN_LEQ, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					case '<':
-						if(!rpn_add_inst(vm, compiler, RPN_LSHIFT, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					default:
-						if(!rpn_add_inst(vm, compiler, RPN_LT, 0.f, 2, 1)) return 0;
-						break;
+					// x / 2^n = x * 2^-n, exactly
+					prog->val[j-1] = 1.f / c;
+					inst = RPN_MUL;
 				}
-				ptr++;
 				break;
-			case '>':
-				switch(ptr[1])
-				{
-					case '=':
-						if(!rpn_add_inst(vm, compiler, RPN_GEQ, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					case '>':
-						if(!rpn_add_inst(vm, compiler, RPN_RSHIFT, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					default:
-						if(!rpn_add_inst(vm, compiler, RPN_GT, 0.f, 2, 1)) return 0;
-						break;
-				}
-				ptr++;
+			case RPN_POW:
+				if(c == 1.f) // x ^ 1 = x
+					return j - 1;
+				if(c == 2.f) // x ^ 2 = x * x
+					return rpn_peephole(prog, rpn_peephole(prog, j - 1, RPN_DUPL_TOP, 0.f), RPN_MUL, 0.f);
 				break;
-			case '=':
-				switch(ptr[1])
-				{
-					case '=':
-						if(!rpn_add_inst(vm, compiler, RPN_EQ, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					default:
-						return 0; // parse error
-				}
-				ptr++;
+			case RPN_DUPL_AT:
+				if(c < 2.f) // clamped to top of stack
+					return rpn_peephole(prog, j - 1, RPN_DUPL_TOP, 0.f);
 				break;
-			case '&':
-				switch(ptr[1])
+			case RPN_COND:
+				// dead push elimination on constant condition
+				if( (j >= 3) && rpn_is_leaf(out[j-3]) && rpn_is_leaf(out[j-2]) )
 				{
-					case '&':
-						if(!rpn_add_inst(vm, compiler, RPN_LOGICAL_AND, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					default:
-						if(!rpn_add_inst(vm, compiler, RPN_BITWISE_AND, 0.f, 2, 1)) return 0;
-						break;
+					if(c == 0.f)
+					{
+						out[j-3] = out[j-2];
+						prog->val[j-3] = prog->val[j-2];
+					}
+					return j - 2;
 				}
-				ptr++;
+				if( (j >= 2) && (c != 0.f) && rpn_is_leaf(out[j-2]) )
+					return j - 2;
 				break;
-			case '|':
-				switch(ptr[1])
-				{
-					case '|':
-						if(!rpn_add_inst(vm, compiler, RPN_LOGICAL_OR, 0.f, 2, 1)) return 0;
-						ptr++;
-						break;
-					default:
-						if(!rpn_add_inst(vm, compiler, RPN_BITWISE_OR, 0.f, 2, 1)) return 0;
-						break;
-				}
-				ptr++;
+			default:
 				break;
+		}
+	}
 
-			default:
+	// cancel out
+	if( (j >= 1) && (out[j-1] == inst) && ( (inst == RPN_NEG) || (inst == RPN_XCHANGE) ) )
+		return j - 1;
+
+	// dead exchange elimination
+	if( (inst == RPN_XCHANGE) && (j >= 2) && rpn_is_leaf(out[j-2]) && rpn_is_leaf(out[j-1]) )
+	{
+		RPN_Instruction a = out[j-2];
+		float v = prog->val[j-2];
+		out[j-2] = out[j-1];
+		prog->val[j-2] = prog->val[j-1];
+		out[j-1] = a;
+		prog->val[j-1] = v;
+		return j;
+	}
+
+	out[j] = inst;
+	prog->val[j] = val;
+	return j + 1;
+}
+
+// constant folding, algebraic simplification and dead push elimination, in place
+static void
+rpn_optimize(RPN_Program *prog)
+{
+	uint_fast8_t i;
+	uint_fast8_t j = 0;
+
+	for(i=0; i<RPN_PROGRAM_LEN; i++)
+	{
+		RPN_Instruction inst = prog->inst[i];
+
+		if(inst == RPN_TERMINATOR)
+		{
+			prog->inst[j] = RPN_TERMINATOR;
+			prog->val[j] = 0.f;
+			break;
+		}
+
+		j = rpn_peephole(prog, j, inst, prog->val[i]);
+	}
+}
+
+// index of the terminator
+static uint_fast8_t
+rpn_program_length(const RPN_Program *prog)
+{
+	uint_fast8_t n;
+
+	for(n=0; (n<RPN_PROGRAM_LEN-1) && (prog->inst[n] != RPN_TERMINATOR); n++)
+		;
+
+	return n;
+}
+
+// dependency class of a subexpression
+typedef enum _RPN_Class RPN_Class;
+typedef struct _RPN_Span RPN_Span;
+
+enum _RPN_Class {
+	RPN_CLASS_CONST = 0,
+	RPN_CLASS_FRAME,
+	RPN_CLASS_BLOB
+};
+
+struct _RPN_Span {
+	uint8_t start;
+	uint8_t end;
+	RPN_Class class;
+};
+
+// move per-frame subexpressions into a prologue that is run once per frame
+static void
+rpn_hoist(RPN_Program *prog)
+{
+	RPN_Program src = *prog;
+	RPN_Span stack [RPN_STACK_HEIGHT];
+	RPN_Span hoist [RPN_HIDDEN_HEIGHT];
+	uint_fast8_t n = rpn_program_length(prog);
+	uint_fast8_t size = n + 1; // with terminator
+	uint_fast8_t nhoist = 0;
+	int_fast8_t sp = 0;
+	uint_fast8_t i;
+	uint_fast8_t k;
+
+	for(k=0; k<n; k++)
+	{
+		RPN_Instruction inst = src.inst[k];
+		const RPN_Arity *arity = &rpn_arity[inst];
+		RPN_Class class = RPN_CLASS_CONST;
+
+		sp -= arity->pops;
+		for(i=sp; i<sp + arity->pops; i++)
+			if(stack[i].class > class)
+				class = stack[i].class;
+
+		if( (inst == RPN_PUSH_VALUE) || (inst == RPN_PUSH_N) )
+			stack[sp++] = (RPN_Span){k, k, RPN_CLASS_CONST};
+		else if(inst == RPN_PUSH_FID)
+			stack[sp++] = (RPN_Span){k, k, RPN_CLASS_FRAME};
+		else if(arity->pure && (arity->pushs == 1) && (class != RPN_CLASS_BLOB) )
+		{
+			stack[sp].end = k; // extend span of deepest operand
+			stack[sp++].class = class;
+		}
+		else
+		{
+			// per-frame operands of per-blob instructions get hoisted
+			for(i=sp; i<sp + arity->pops; i++)
 			{
-				char *endptr = NULL;
-				float v = strtod(ptr, &endptr);
-				if(ptr != endptr)
+				RPN_Span *span = &stack[i];
+				uint_fast8_t len = span->end + 1 - span->start;
+
+				// prologue grows by one for skip and terminator, by one per hidden store
+				uint_fast8_t cost = (nhoist == 0 ? 2 : 0) + 2;
+
+				if( (span->class == RPN_CLASS_FRAME) && (len >= 2)
+					&& (nhoist < RPN_HIDDEN_HEIGHT) && (size + cost <= RPN_PROGRAM_LEN) )
 				{
-					if(!rpn_add_inst(vm, compiler, RPN_PUSH_VALUE, v, 0, 1)) return 0;
-					ptr = endptr;
+					hoist[nhoist++] = *span;
+					size += cost;
 				}
-				else
-					return 0; // parse error
 			}
+
+			for(i=0; i<arity->pushs; i++)
+				stack[sp++] = (RPN_Span){k, k, RPN_CLASS_BLOB};
 		}
 	}
 
-	return 1;
+	if(nhoist == 0)
+		return;
+
+	// sort by position
+	for(i=1; i<nhoist; i++)
+		for(k=i; (k>0) && (hoist[k-1].start > hoist[k].start); k--)
+		{
+			RPN_Span tmp = hoist[k];
+			hoist[k] = hoist[k-1];
+			hoist[k-1] = tmp;
+		}
+
+	// per-frame prologue
+	uint_fast8_t j = 0;
+	prog->inst[j++] = RPN_SKIP;
+	for(i=0; i<nhoist; i++)
+	{
+		for(k=hoist[i].start; k<=hoist[i].end; k++)
+		{
+			prog->inst[j] = src.inst[k];
+			prog->val[j++] = src.val[k];
+		}
+		prog->inst[j] = RPN_POP_HIDDEN;
+		prog->val[j++] = i;
+	}
+	prog->inst[j] = RPN_TERMINATOR;
+	prog->val[j++] = 0.f;
+	prog->val[0] = j;
+
+	// per-event program
+	for(i=0, k=0; k<=n; k++)
+	{
+		if( (i < nhoist) && (k == hoist[i].start) )
+		{
+			prog->inst[j] = RPN_PUSH_HIDDEN;
+			prog->val[j++] = i;
+			k = hoist[i++].end;
+		}
+		else
+		{
+			prog->inst[j] = src.inst[k];
+			prog->val[j++] = src.val[k];
+		}
+	}
 }
 
-uint_fast8_t
-rpn_compile(const char *args, Custom_Item *itm)
+// fuse common instruction sequences into superinstructions, in place
+static void
+rpn_fuse(RPN_Program *prog)
 {
-	RPN_VM *vm = &itm->vm;
-	RPN_Compiler compiler = {
-		.offset = 0,
-		.pp = 0
-	};
+	uint_fast8_t i;
+	uint_fast8_t j = 0;
+	uint_fast8_t entry = 0;
+
+	for(i=0; i<RPN_PROGRAM_LEN; i++)
+	{
+		RPN_Instruction inst = prog->inst[i];
+		float val = prog->val[i];
+
+		// constant operand: PUSH_VALUE + OP -> PUSH_VALUE_OP
+		if( (j > 0) && (prog->inst[j-1] == RPN_PUSH_VALUE) )
+		{
+			RPN_Instruction fused = RPN_TERMINATOR;
+
+			switch(inst)
+			{
+				case RPN_ADD:
+					fused = RPN_PUSH_VALUE_ADD;
+					break;
+				case RPN_SUB:
+					fused = RPN_PUSH_VALUE_SUB;
+					break;
+				case RPN_MUL:
+					fused = RPN_PUSH_VALUE_MUL;
+					break;
+				case RPN_DIV:
+					fused = RPN_PUSH_VALUE_DIV;
+					break;
+				case RPN_PUSH_REG:
+					fused = RPN_PUSH_VALUE_PUSH_REG;
+					break;
+				case RPN_POP_REG:
+					fused = RPN_PUSH_VALUE_POP_REG;
+					break;
+				case RPN_DUPL_AT:
+					fused = RPN_PUSH_VALUE_DUPL_AT;
+					break;
+				case RPN_PUSH_BANK:
+					fused = RPN_PUSH_VALUE_PUSH_BANK;
+					break;
+				case RPN_POP_BANK:
+					fused = RPN_PUSH_VALUE_POP_BANK;
+					break;
+				default:
+					break;
+			}
+
+			if(fused != RPN_TERMINATOR)
+			{
+				j--;
+				inst = fused;
+				val = prog->val[j];
+			}
+		}
+
+		// blob value with constant operand: PUSH_X + PUSH_VALUE_OP -> PUSH_X_VALUE_OP
+		if( (j > 0) && ( (inst == RPN_PUSH_VALUE_ADD) || (inst == RPN_PUSH_VALUE_MUL) ) )
+		{
+			uint_fast8_t add = inst == RPN_PUSH_VALUE_ADD;
+
+			if(prog->inst[j-1] == RPN_PUSH_X)
+			{
+				j--;
+				inst = add ? RPN_PUSH_X_VALUE_ADD : RPN_PUSH_X_VALUE_MUL;
+			}
+			else if(prog->inst[j-1] == RPN_PUSH_Z)
+			{
+				j--;
+				inst = add ? RPN_PUSH_Z_VALUE_ADD : RPN_PUSH_Z_VALUE_MUL;
+			}
+		}
 
+		prog->inst[j] = inst;
+		prog->val[j] = val;
+		j++;
+
+		if(inst == RPN_TERMINATOR)
+		{
+			if(prog->inst[0] != RPN_SKIP)
+				break;
+
+			if(entry) // end of per-event program
+				break;
+
+			entry = j; // end of per-frame prologue
+			prog->val[0] = entry;
+		}
+	}
+}
+
+static uint_fast8_t
+rpn_compile_expr(const char *args, Custom_Item *itm, RPN_Program *prog, RPN_Compiler *compiler)
+{
 	const char *ptr = args;
 	const char *end = args + strlen(args);
 	uint_fast8_t counter = 0;
@@ -625,20 +1421,23 @@ rpn_compile(const char *args, Custom_Item *itm)
 	if(!path_end)
 		path_end = strchr(ptr, '\0');
 	if(!path_end)
-		return 0; // parse error
+		return rpn_fail(compiler, "invalid path");
 
 	// copy and check OSC path
 	size_t path_len = path_end + 1 - ptr;
 	if(path_len > CUSTOM_PATH_LEN)
-		return 0; // parse error
+		return rpn_fail(compiler, "path too long");
 	strlcpy(itm->path, ptr, path_len);
 	if(!osc_check_path(itm->path))
-		return 0; // parse error
+		return rpn_fail(compiler, "invalid path");
 
 	// skip path
 	ptr += path_len;
 
 	while(ptr < end)
+	{
+		compiler->pos = ptr;
+
 		switch(*ptr)
 		{
 			case ' ':
@@ -657,23 +1456,24 @@ rpn_compile(const char *args, Custom_Item *itm)
 					if(closing)
 					{
 						size_t size = closing - ptr;
-						if(rpn_compile_sub(ptr, size, vm, &compiler))
+						if(rpn_compile_sub(ptr, size, prog, compiler))
 						{
 							ptr += size;
 							ptr++; // skip ')'
+							compiler->pos = closing;
 
-							if(!rpn_add_inst(vm, &compiler, RPN_POP_INT32, 0.f, 1, 0)) return 0;
-							if(counter >= CUSTOM_FMT_LEN) return 0;
+							if(!rpn_add_inst(prog, compiler, RPN_POP_INT32, 0.f, 1, 0)) return 0;
+							if(counter >= CUSTOM_FMT_LEN) return rpn_fail(compiler, "too many arguments");
 							itm->fmt[counter++] = OSC_INT32;
 						}
 						else
-							return 0; // parse error
+							return 0; // error set by rpn_compile_sub
 					}
 					else
-						return 0; // parse error
+						return rpn_fail(compiler, "missing ')'");
 				}
 				else
-					return 0; // parse error
+					return rpn_fail(compiler, "missing '('");
 				break;
 			}
 
@@ -687,23 +1487,24 @@ rpn_compile(const char *args, Custom_Item *itm)
 					if(closing)
 					{
 						size_t size = closing - ptr;
-						if(rpn_compile_sub(ptr, size, vm, &compiler))
+						if(rpn_compile_sub(ptr, size, prog, compiler))
 						{
 							ptr += size;
 							ptr++; // skip ')'
+							compiler->pos = closing;
 
-							if(!rpn_add_inst(vm, &compiler, RPN_POP_FLOAT, 0.f, 1, 0)) return 0;
-							if(counter >= CUSTOM_FMT_LEN) return 0;
+							if(!rpn_add_inst(prog, compiler, RPN_POP_FLOAT, 0.f, 1, 0)) return 0;
+							if(counter >= CUSTOM_FMT_LEN) return rpn_fail(compiler, "too many arguments");
 							itm->fmt[counter++] = OSC_FLOAT;
 						}
 						else
-							return 0; // parse error
+							return 0; // error set by rpn_compile_sub
 					}
 					else
-						return 0; // parse error
+						return rpn_fail(compiler, "missing ')'");
 				}
 				else
-					return 0; // parse error
+					return rpn_fail(compiler, "missing '('");
 				break;
 			}
 
@@ -717,23 +1518,24 @@ rpn_compile(const char *args, Custom_Item *itm)
 					if(closing)
 					{
 						size_t size = closing - ptr;
-						if(rpn_compile_sub(ptr, size, vm, &compiler))
+						if(rpn_compile_sub(ptr, size, prog, compiler))
 						{
 							ptr += size;
 							ptr++; // skip ')'
+							compiler->pos = closing;
 
-							if(!rpn_add_inst(vm, &compiler, RPN_POP_MIDI, 0.f, 4, 0)) return 0;
-							if(counter >= CUSTOM_FMT_LEN) return 0;
+							if(!rpn_add_inst(prog, compiler, RPN_POP_MIDI, 0.f, 4, 0)) return 0;
+							if(counter >= CUSTOM_FMT_LEN) return rpn_fail(compiler, "too many arguments");
 							itm->fmt[counter++] = OSC_MIDI;
 						}
 						else
-							return 0; // parse error
+							return 0; // error set by rpn_compile_sub
 					}
 					else
-						return 0; // parse error
+						return rpn_fail(compiler, "missing ')'");
 				}
 				else
-					return 0; // parse error
+					return rpn_fail(compiler, "missing '('");
 				break;
 			}
 
@@ -741,19 +1543,265 @@ rpn_compile(const char *args, Custom_Item *itm)
 			case OSC_FALSE:
 			case OSC_NIL:
 			case OSC_BANG:
-				if(counter >= CUSTOM_FMT_LEN) return 0;
+				if(counter >= CUSTOM_FMT_LEN) return rpn_fail(compiler, "too many arguments");
 				itm->fmt[counter++] = *ptr;
+				ptr++;
 				break;
 
 			//TODO OSC_STRING
 
 			default:
-				return 0; // parse error
+				return rpn_fail(compiler, "unknown argument type");
 		}
+	}
 
-	if(!rpn_add_inst(vm, &compiler, RPN_TERMINATOR, 0.f, 0, 0)) return 0;
-	if(counter >= CUSTOM_FMT_LEN) return 0;
+	if(!rpn_add_inst(prog, compiler, RPN_TERMINATOR, 0.f, 0, 0)) return 0;
+	if(counter >= CUSTOM_FMT_LEN) return rpn_fail(compiler, "too many arguments");
 	itm->fmt[counter++] = '\0';
 
-	return (ptr == end) && (compiler.pp >= 0);
+	return 1;
+}
+
+// pack program into byte code, sharing equal constants in the pool
+static uint_fast8_t
+rpn_encode(const RPN_Program *prog, RPN_VM *vm, RPN_Compiler *compiler)
+{
+	uint_fast8_t i;
+	uint_fast8_t j = 0;
+	uint_fast8_t npool = 0;
+	uint_fast8_t entry = 0;
+
+	memset(vm->pool, 0, sizeof(vm->pool));
+
+	for(i=0; i<RPN_PROGRAM_LEN; i++)
+	{
+		RPN_Instruction inst = prog->inst[i];
+		float val = prog->val[i];
+		RPN_Immediate imm = rpn_arity[inst].imm;
+
+		if(j + (imm ? 2 : 1) > CUSTOM_MAX_CODE)
+			return rpn_fail(compiler, "program too long");
+
+		vm->code[j++] = inst;
+
+		if(imm == RPN_IMM_CONST)
+		{
+			uint_fast8_t k;
+			for(k=0; k<npool; k++)
+				if(!memcmp(&vm->pool[k], &val, sizeof(float)))
+					break;
+			if(k == npool)
+			{
+				if(npool >= CUSTOM_MAX_CONST)
+					return rpn_fail(compiler, "too many constants");
+				vm->pool[npool++] = val;
+			}
+			vm->code[j++] = k;
+		}
+		else if(imm == RPN_IMM_INDEX) // out of range indices get rejected by rpn_verify
+			vm->code[j++] = (val >= 0.f) && (val < 256.f) ? (uint8_t)val : 0xff;
+
+		if(inst == RPN_TERMINATOR)
+		{
+			if( (prog->inst[0] != RPN_SKIP) || entry) // end of per-event program
+				break;
+
+			entry = j; // end of per-frame prologue
+			vm->code[1] = entry;
+		}
+	}
+
+	return 1;
+}
+
+uint_fast8_t
+rpn_compile(const char *args, Custom_Item *itm, RPN_Destination dest, RPN_Error *err)
+{
+	(void)dest; // unused without hoisting
+	RPN_Program prog;
+	RPN_Program hoisted;
+	RPN_Compiler compiler = {
+		.offset = 0,
+		.pp = 0,
+		.err = NULL,
+		.pos = args
+	};
+
+	if(!rpn_compile_expr(args, itm, &prog, &compiler))
+	{
+		err->msg = compiler.err;
+		err->pos = compiler.pos - args;
+		return 0;
+	}
+
+	itm->vm.raw = compiler.offset - 1; // without terminator
+
+#ifndef RPN_NO_OPTIMIZE // plain reference build of the host differential test in tools/rpn
+	rpn_optimize(&prog);
+#endif
+
+	// the hoisted program is larger, fall back to the plain one if it does not fit
+	hoisted = prog;
+#ifndef RPN_NO_OPTIMIZE
+	if( (dest == RPN_ON) || (dest == RPN_OFF) || (dest == RPN_SET) )
+		rpn_hoist(&hoisted);
+	rpn_fuse(&hoisted);
+#endif
+	if(!rpn_encode(&hoisted, &itm->vm, &compiler))
+	{
+		rpn_fuse(&prog);
+		if( (hoisted.inst[0] != RPN_SKIP) || !rpn_encode(&prog, &itm->vm, &compiler) )
+		{
+			err->msg = compiler.err;
+			err->pos = -1; // not attributable to a single token after optimization
+			return 0;
+		}
+	}
+
+	// the runtime trusts verified programs, e.g. does not check stack bounds
+	if( (err->msg = rpn_verify(itm)) )
+	{
+		err->pos = -1; // not attributable to a single token after optimization
+		return 0;
+	}
+
+	return 1;
+}
+
+// number of instructions of a verified program up to the next terminator,
+// advances offset past it
+uint_fast8_t
+rpn_count(const RPN_VM *vm, uint_fast8_t *offset)
+{
+	uint_fast8_t n = 0;
+	uint_fast8_t i = *offset;
+
+	while( (i < CUSTOM_MAX_CODE) && (vm->code[i] != RPN_TERMINATOR) )
+	{
+		i += rpn_arity[vm->code[i]].imm ? 2 : 1;
+		n++;
+	}
+	*offset = i + 1;
+
+	return n;
+}
+
+const char *
+rpn_verify(const Custom_Item *itm)
+{
+	const RPN_VM *vm = &itm->vm;
+	const char *fmt = itm->fmt;
+	uint_fast8_t entry = 0;
+	uint_fast8_t prologue = 0;
+	int_fast8_t pp = 0;
+	uint_fast8_t i = 0;
+
+	if(!memchr(itm->path, '\0', CUSTOM_PATH_LEN) || !osc_check_path(itm->path))
+		return "invalid path";
+	if(!memchr(itm->fmt, '\0', CUSTOM_FMT_LEN))
+		return "invalid format";
+
+	if(vm->code[0] == RPN_SKIP)
+	{
+		entry = vm->code[1];
+		prologue = 1;
+		i = 2;
+	}
+
+	// walk instruction by instruction, e.g. never into an operand byte
+	while(1)
+	{
+		if(i >= CUSTOM_MAX_CODE)
+			return "missing terminator";
+
+		RPN_Instruction inst = vm->code[i];
+
+		if( (inst >= RPN_INSTRUCTION_MAX) || (inst == RPN_SKIP) )
+			return "invalid instruction";
+
+		const RPN_Arity *arity = &rpn_arity[inst];
+		uint_fast8_t width = arity->imm ? 2 : 1;
+
+		if(i + width > CUSTOM_MAX_CODE)
+			return "missing terminator";
+		if(prologue && (inst != RPN_TERMINATOR) && (i + width >= entry) )
+			return "invalid prologue";
+
+		uint_fast8_t imm = arity->imm ? vm->code[i + 1] : 0;
+
+		if( (arity->imm == RPN_IMM_CONST) && (imm >= CUSTOM_MAX_CONST) )
+			return "invalid constant";
+
+		if(inst == RPN_TERMINATOR)
+		{
+			if(!prologue) // end of per-event program
+				break;
+			if(i + 1 != entry) // end of per-frame prologue
+				return "invalid prologue";
+			if(pp != 0)
+				return "prologue leaves values on stack";
+			prologue = 0;
+			i = entry;
+			continue;
+		}
+
+		pp -= arity->pops;
+		if(pp < 0)
+			return "stack underflow";
+
+		switch(inst)
+		{
+			case RPN_PUSH_VALUE_PUSH_REG:
+			case RPN_PUSH_VALUE_POP_REG:
+				if(imm >= RPN_REG_HEIGHT)
+					return "register index out of range";
+				break;
+			case RPN_PUSH_VALUE_PUSH_BANK:
+			case RPN_PUSH_VALUE_POP_BANK:
+				if(imm >= RPN_BANK_HEIGHT)
+					return "bank index out of range";
+				break;
+			case RPN_PUSH_VALUE_DUPL_AT:
+				if( (imm < 1) || (imm > pp) )
+					return "duplicate position out of range";
+				break;
+			case RPN_PUSH_HIDDEN:
+			case RPN_POP_HIDDEN:
+				if(imm >= RPN_HIDDEN_HEIGHT)
+					return "invalid hidden register";
+				break;
+			case RPN_POP_INT32:
+			case RPN_POP_FLOAT:
+			case RPN_POP_MIDI:
+			{
+				const char type = inst == RPN_POP_INT32 ? OSC_INT32
+					: (inst == RPN_POP_FLOAT ? OSC_FLOAT : OSC_MIDI);
+
+				if(prologue)
+					return "output in prologue";
+
+				// skip argument types without payload
+				while( (*fmt == OSC_TRUE) || (*fmt == OSC_FALSE) || (*fmt == OSC_NIL) || (*fmt == OSC_BANG) )
+					fmt++;
+				if(*fmt++ != type)
+					return "argument type mismatch";
+				break;
+			}
+			default:
+				break;
+		}
+
+		pp += arity->pushs;
+		if(pp > RPN_STACK_HEIGHT)
+			return "stack overflow";
+
+		i += width;
+	}
+
+	while( (*fmt == OSC_TRUE) || (*fmt == OSC_FALSE) || (*fmt == OSC_NIL) || (*fmt == OSC_BANG) )
+		fmt++;
+	if(*fmt != '\0')
+		return "argument type mismatch";
+
+	return NULL;
 }
@@ -23,10 +23,13 @@
 void
 DEBUG(const char *fmt, ...)
 {
-	if(config.debug.osc.socket.enabled && (wiz_socket_state[SOCK_DEBUG] == WIZ_SOCKET_STATE_OPEN) )
+	uint8_t *base;
+
+	if(config.debug.osc.socket.enabled && (wiz_socket_state[SOCK_DEBUG] == WIZ_SOCKET_STATE_OPEN)
+		&& (base = buf_r_acquire(BUF_R_DEBUG)) )
 	{
-		osc_data_t *buf = BUF_O_OFFSET(buf_o_ptr);
-		osc_data_t *end = BUF_O_MAX(buf_o_ptr);
+		osc_data_t *buf = BUF_R_OFFSET(base);
+		osc_data_t *end = BUF_R_MAX(base);
 		osc_data_t *buf_ptr = buf;
 		osc_data_t *preamble = NULL;
 
@@ -45,7 +48,8 @@ DEBUG(const char *fmt, ...)
 		if(config.debug.osc.mode == OSC_MODE_SLIP)
 			size = slip_encode(buf, size);
 
-		osc_send(&config.debug.osc, BUF_O_BASE(buf_o_ptr), size);
+		osc_send(&config.debug.osc, base, size);
+		buf_r_release(base);
 	}
 }
 
@@ -18,16 +18,22 @@
 #include <string.h>
 
 #include <libmaple/delay.h>
+#include <libmaple/systick.h>
 
 #include <eeprom.h>
 #include <chimaera.h>
 #include <wiz.h>
+#include <sntp.h>
+
+#include "eeprom_private.h"
 
 #define TIMEOUT 10 // ms
+#define XFER_TIMEOUT (SNTP_SYSTICK_RATE / 10) // = 100ms, a stepped page transfer spans many loop iterations
+#define WRITE_CYCLE (SNTP_SYSTICK_RATE / 100) // = 10ms, see _eeprom_ack_poll
 #define EEPROM_24xx_BASE_ADDR 0b1010000
 
 static EEPROM_24xx _24LC64 = {
-	.page_size = 0x20,			// = 32byte
+	.page_size = EEPROM_24LC64_PAGE_SIZE, // = 32byte
 	.storage_size = 0x2000,	// = 64kbit
 	.address_size = 2,			// 2byte
 	.page_write_time = 2		// ms
@@ -47,6 +53,8 @@ static i2c_msg write_msg;
 static uint8_t write_msg_data [0x22]; // = address_size + page_size
 static i2c_msg read_msg;
 
+static void _eeprom_queue_settle(EEPROM_24xx *eeprom, uint16_t addr, uint16_t len);
+
 static inline void
 _set_address(EEPROM_24xx *eeprom, uint16_t addr)
 {
@@ -112,6 +120,8 @@ eeprom_byte_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t byt)
 	if( (addr + 1U) > eeprom->storage_size)
 		return;
 
+	_eeprom_queue_settle(eeprom, addr, 1);
+
 	_set_address(eeprom, addr);
 	write_msg_data[eeprom->address_size] = byt;
 	write_msg.length = eeprom->address_size + 1;
@@ -123,12 +133,9 @@ eeprom_byte_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t byt)
 	_eeprom_ack_poll(eeprom); // wait until written
 }
 
-void
-eeprom_page_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *page, uint8_t len)
+static int32_t
+_eeprom_page_xfer(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *page, uint8_t len)
 {
-	if( (addr % eeprom->page_size) || (len > eeprom->page_size) || (addr + len > eeprom->storage_size))
-		return;
-
 	_set_address(eeprom, addr);
 	memcpy(&write_msg_data[eeprom->address_size], page, len);
 	write_msg.length = eeprom->address_size + len;
@@ -137,13 +144,26 @@ eeprom_page_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *page, uint8_t len
 	res = i2c_master_xfer(eeprom->dev, &write_msg, 1, TIMEOUT);
 	_eeprom_check_res(eeprom->dev, res);
 
+	return res;
+}
+
+void
+eeprom_page_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *page, uint8_t len)
+{
+	if( ( (addr % eeprom->page_size) + len > eeprom->page_size) || (addr + len > eeprom->storage_size))
+		return; // must not cross a page boundary
+
+	_eeprom_queue_settle(eeprom, addr, len);
+
+	_eeprom_page_xfer(eeprom, addr, page, len);
+
 	_eeprom_ack_poll(eeprom); // wait until written
 }
 
 void
 eeprom_bulk_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t len)
 {
-	if( (addr % eeprom->page_size) || (addr + len > eeprom->storage_size))
+	if(addr + len > eeprom->storage_size)
 		return;
 
 	uint16_t addr_ptr = addr;
@@ -152,7 +172,9 @@ eeprom_bulk_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t le
 	
 	while(remaining > 0)
 	{
-		uint16_t size = remaining < eeprom->page_size ? remaining : eeprom->page_size;
+		uint16_t size = eeprom->page_size - (addr_ptr % eeprom->page_size); // up to next page boundary
+		if(remaining < size)
+			size = remaining;
 		eeprom_page_write(eeprom, addr_ptr, bulk_ptr, size);
 
 		addr_ptr += size;
@@ -167,6 +189,8 @@ eeprom_byte_read(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *byt)
 	if( (addr + 1U) > eeprom->storage_size)
 		return;
 
+	_eeprom_queue_settle(eeprom, addr, 1);
+
 	_set_address(eeprom, addr);
 	write_msg.length = eeprom->address_size;
 
@@ -186,6 +210,8 @@ eeprom_bulk_read(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t len
 	if( addr + len > eeprom->storage_size)
 		return;
 
+	_eeprom_queue_settle(eeprom, addr, len);
+
 	_set_address(eeprom, addr);
 	write_msg.length = eeprom->address_size;
 
@@ -198,3 +224,283 @@ eeprom_bulk_read(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t len
 	res = i2c_master_xfer(eeprom->dev, &read_msg, 1, TIMEOUT);
 	_eeprom_check_res(eeprom->dev, res);
 }
+
+/*
+ * Incremental images
+ */
+
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME 16777619UL
+
+static uint32_t
+_eeprom_hash(const uint8_t *ptr, uint16_t len)
+{
+	uint32_t hash = FNV_OFFSET;
+
+	while(len--)
+		hash = (hash ^ *ptr++) * FNV_PRIME;
+
+	return hash;
+}
+
+// size of chunk up to next page boundary
+static inline uint16_t
+_eeprom_chunk(EEPROM_24xx *eeprom, uint16_t addr, uint16_t remaining)
+{
+	uint16_t size = eeprom->page_size - (addr % eeprom->page_size);
+
+	return remaining < size ? remaining : size;
+}
+
+void
+eeprom_image_read(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len)
+{
+	eeprom_bulk_read(eeprom, addr, bulk, len);
+	eeprom_image_hash(eeprom, image, addr, bulk, len);
+}
+
+void
+eeprom_image_hash(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len)
+{
+	uint16_t remaining = len;
+	uint16_t k;
+	for(k=0; remaining > 0; k++)
+	{
+		uint16_t size = _eeprom_chunk(eeprom, addr, remaining);
+		if(k < image->n)
+			image->hash[k] = _eeprom_hash(bulk, size);
+
+		addr += size;
+		bulk += size;
+		remaining -= size;
+	}
+
+	image->addr = addr - len;
+	image->len = len;
+	image->valid = k <= image->n;
+}
+
+uint16_t
+eeprom_image_write(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len)
+{
+	eeprom_queue_flush(); // make room in queue
+
+	if(eeprom_queue_push(eeprom, image, addr, bulk, len))
+		eeprom_queue_flush();
+
+	return image->written;
+}
+
+/*
+ * Nonblocking write queue
+ */
+
+typedef struct _EEPROM_Job EEPROM_Job;
+
+struct _EEPROM_Job {
+	EEPROM_24xx *eeprom;
+	EEPROM_Image *image;
+	uint8_t *bulk;
+	uint16_t addr;
+	uint16_t len;
+	uint16_t offset; // bytes already processed
+	uint16_t k; // page index at offset
+	uint16_t hashed; // pages below mirror EEPROM content regardless of valid
+	uint8_t valid; // whether image hashes mirror EEPROM content
+	uint32_t since; // systick of first push
+};
+
+static EEPROM_Job queue [EEPROM_QUEUE_MAX];
+static uint_fast8_t queue_n = 0;
+static uint32_t queue_ready = 0; // systick when the last write cycle will have finished
+static uint_fast8_t queue_xfer = 0; // page transfer of queue[0] in progress
+static uint32_t queue_xfer_since = 0; // systick when it was started
+
+static void
+_eeprom_queue_pop(EEPROM_Status status)
+{
+	EEPROM_Image *image = queue[0].image;
+
+	image->status = status;
+	image->valid = (status == EEPROM_STATUS_DONE) && (queue[0].k <= image->n);
+
+	queue_n--;
+	memmove(&queue[0], &queue[1], queue_n*sizeof(EEPROM_Job));
+
+	if(image->cb)
+		image->cb(image);
+}
+
+uint_fast8_t
+eeprom_queue_push(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len)
+{
+	if(addr + len > eeprom->storage_size)
+		return 0;
+
+	uint_fast8_t i;
+	for(i=0; i<queue_n; i++)
+		if(queue[i].image == image)
+		{
+			if( (queue[i].addr != addr) || (queue[i].len != len) || (queue[i].bulk != bulk) )
+			{
+				eeprom_queue_flush(); // finish previous region first
+				break;
+			}
+
+			// already queued, start over to catch changes in pages already written,
+			// pages passed so far have fresh hashes and are only rewritten when dirty
+			if(queue[i].k > queue[i].hashed)
+				queue[i].hashed = queue[i].k;
+			queue[i].offset = 0;
+			queue[i].k = 0;
+			return 1;
+		}
+
+	if(queue_n >= EEPROM_QUEUE_MAX)
+		return 0;
+
+	EEPROM_Job *job = &queue[queue_n++];
+	job->eeprom = eeprom;
+	job->image = image;
+	job->bulk = bulk;
+	job->addr = addr;
+	job->len = len;
+	job->offset = 0;
+	job->k = 0;
+	job->hashed = 0;
+	job->since = systick_uptime();
+	// hashes are only meaningful for the very same region
+	job->valid = image->valid && (image->addr == addr) && (image->len == len);
+
+	image->addr = addr;
+	image->len = len;
+	image->valid = 0; // hashes are in flux until done
+	image->written = 0;
+	image->status = EEPROM_STATUS_PENDING;
+
+	return 1;
+}
+
+// advances the page transfer in progress, returns whether it still is
+static uint_fast8_t
+_eeprom_queue_xfer(void)
+{
+	if(!queue_xfer)
+		return 0;
+
+	EEPROM_Job *job = &queue[0];
+	int32_t res = eeprom_xfer_poll(job->eeprom->dev, &write_msg);
+
+	if( (res > 0) && ( (systick_uptime() - queue_xfer_since) > XFER_TIMEOUT) )
+		res = -1; // bus hangs
+
+	if(res > 0)
+		return 1;
+
+	queue_xfer = 0;
+	queue_ready = systick_uptime() + WRITE_CYCLE;
+
+	if(res == 0)
+		job->image->written++;
+	else
+	{
+		_eeprom_check_res(job->eeprom->dev, res);
+		_eeprom_queue_pop(EEPROM_STATUS_FAILED);
+	}
+
+	return 0;
+}
+
+uint_fast8_t
+eeprom_queue_step(void)
+{
+	if(_eeprom_queue_xfer()) // page transfer in progress
+		return queue_n;
+
+	if(!queue_n || ( (int32_t)(systick_uptime() - queue_ready) < 0) ) // nothing to do or write cycle in progress
+		return queue_n;
+
+	EEPROM_Job *job = &queue[0];
+	EEPROM_Image *image = job->image;
+
+	while(job->offset < job->len)
+	{
+		uint16_t addr = job->addr + job->offset;
+		uint8_t *bulk = job->bulk + job->offset;
+		uint16_t size = _eeprom_chunk(job->eeprom, addr, job->len - job->offset);
+		uint32_t hash = _eeprom_hash(bulk, size);
+		uint_fast8_t dirty = (!job->valid && (job->k >= job->hashed) ) || (job->k >= image->n) || (image->hash[job->k] != hash);
+
+		if(job->k < image->n)
+			image->hash[job->k] = hash;
+		job->offset += size;
+		job->k++;
+
+		if(dirty) // page is copied into the message, bulk may change during the transfer
+		{
+			_set_address(job->eeprom, addr);
+			memcpy(&write_msg_data[job->eeprom->address_size], bulk, size);
+			write_msg.length = job->eeprom->address_size + size;
+
+			if(eeprom_xfer_start(job->eeprom->dev, &write_msg) != 0)
+			{
+				_eeprom_check_res(job->eeprom->dev, -1);
+				_eeprom_queue_pop(EEPROM_STATUS_FAILED);
+			}
+			else
+			{
+				queue_xfer = 1;
+				queue_xfer_since = systick_uptime();
+			}
+
+			return queue_n; // at most one page per save in flight
+		}
+	}
+
+	_eeprom_queue_pop(EEPROM_STATUS_DONE);
+
+	return queue_n;
+}
+
+uint32_t
+eeprom_queue_age(void)
+{
+	return queue_n ? systick_uptime() - queue[0].since : 0;
+}
+
+void
+eeprom_queue_flush(void)
+{
+	while(eeprom_queue_step())
+		; // busy wait for pending saves
+
+	while( (int32_t)(systick_uptime() - queue_ready) < 0)
+		; // busy wait for last write cycle
+}
+
+// blocks until pending saves overlapping the region have finished and the bus and device are free,
+// other saves stay queued
+static void
+_eeprom_queue_settle(EEPROM_24xx *eeprom, uint16_t addr, uint16_t len)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<queue_n; )
+	{
+		EEPROM_Job *job = &queue[i];
+
+		if( (job->eeprom == eeprom) && (job->addr < addr + len) && (addr < job->addr + job->len) )
+		{
+			eeprom_queue_step(); // busy wait for overlapping save
+			i = 0; // queue may have shifted
+		}
+		else
+			i++;
+	}
+
+	while(_eeprom_queue_xfer())
+		; // busy wait for page transfer
+
+	while( (int32_t)(systick_uptime() - queue_ready) < 0)
+		; // busy wait for write cycle
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <libmaple/i2c.h>
+
+#include "eeprom_private.h"
+
+// STM32F3 I2C registers (RM0316), the message is clocked out byte by byte from the main loop,
+// the peripheral stretches SCL until the next byte is written, no interrupt or DMA channel is needed
+#define CR2_SADD_SHIFT 1 // 7-bit slave address
+#define CR2_START (1UL << 13)
+#define CR2_NBYTES_SHIFT 16
+#define CR2_AUTOEND (1UL << 25) // STOP after NBYTES
+
+#define ISR_TXIS (1UL << 1)
+#define ISR_NACKF (1UL << 4)
+#define ISR_STOPF (1UL << 5)
+#define ISR_BERR (1UL << 8)
+#define ISR_ARLO (1UL << 9)
+#define ISR_BUSY (1UL << 15)
+
+#define ICR_NACKCF (1UL << 4)
+#define ICR_STOPCF (1UL << 5)
+#define ICR_BERRCF (1UL << 8)
+#define ICR_ARLOCF (1UL << 9)
+
+int32_t
+eeprom_xfer_start(i2c_dev *dev, i2c_msg *msg)
+{
+	if( (dev->regs->ISR & ISR_BUSY) || (msg->length > 0xff) )
+		return -1;
+
+	dev->regs->ICR = ICR_NACKCF | ICR_STOPCF | ICR_BERRCF | ICR_ARLOCF;
+	msg->xferred = 0;
+	dev->regs->CR2 = (msg->addr << CR2_SADD_SHIFT) | (msg->length << CR2_NBYTES_SHIFT)
+		| CR2_AUTOEND | CR2_START; // write direction
+
+	return 0;
+}
+
+int32_t
+eeprom_xfer_poll(i2c_dev *dev, i2c_msg *msg)
+{
+	uint32_t isr = dev->regs->ISR;
+
+	if(isr & (ISR_NACKF | ISR_BERR | ISR_ARLO))
+	{
+		dev->regs->ICR = ICR_NACKCF | ICR_STOPCF | ICR_BERRCF | ICR_ARLOCF;
+		return -1;
+	}
+
+	// TXIS only holds while the data register is empty, at most two bytes per poll
+	while( (msg->xferred < msg->length) && (dev->regs->ISR & ISR_TXIS) )
+		dev->regs->TXDR = msg->data[msg->xferred++];
+
+	if(isr & ISR_STOPF)
+	{
+		dev->regs->ICR = ICR_STOPCF;
+		return msg->xferred == msg->length ? 0 : -1;
+	}
+
+	return 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _EEPROM_PRIVATE_H_
+#define _EEPROM_PRIVATE_H_
+
+#include <eeprom.h>
+
+// nonblocking transfer of a single write message, libmaple's i2c_master_xfer blocks
+// for the whole message, e.g. ~3ms for a page at 100kHz
+
+// returns 0 when the transfer has been started
+int32_t eeprom_xfer_start(i2c_dev *dev, i2c_msg *msg);
+// feeds what the bus can take without waiting, returns 1 while in progress, 0 when done, -1 on failure
+int32_t eeprom_xfer_poll(i2c_dev *dev, i2c_msg *msg);
+
+#endif // _EEPROM_PRIVATE_H_
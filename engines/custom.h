@@ -22,7 +22,8 @@
 #include <oscquery.h>
 
 #define CUSTOM_MAX_EXPR		8
-#define CUSTOM_MAX_INST		32
+#define CUSTOM_MAX_CODE		111
+#define CUSTOM_MAX_CONST	12
 
 #define CUSTOM_PATH_LEN		64
 #define CUSTOM_FMT_LEN		12
@@ -79,7 +80,37 @@ enum _RPN_Instruction {
 	RPN_LEQ,
 	RPN_GT,
 	RPN_GEQ,
-	RPN_EQ
+	RPN_EQ,
+
+	// superinstructions, only emitted by the compiler
+	RPN_PUSH_VALUE_ADD,
+	RPN_PUSH_VALUE_SUB,
+	RPN_PUSH_VALUE_MUL,
+	RPN_PUSH_VALUE_DIV,
+	RPN_PUSH_X_VALUE_ADD,
+	RPN_PUSH_X_VALUE_MUL,
+	RPN_PUSH_Z_VALUE_ADD,
+	RPN_PUSH_Z_VALUE_MUL,
+	RPN_PUSH_VALUE_PUSH_REG,
+	RPN_PUSH_VALUE_POP_REG,
+	RPN_PUSH_VALUE_DUPL_AT,
+
+	// per-frame prologue of hoisted subexpressions, only emitted by the compiler
+	RPN_SKIP,
+	RPN_PUSH_HIDDEN,
+	RPN_POP_HIDDEN,
+
+	// per blob registers and builtins
+	RPN_PUSH_BANK,
+	RPN_POP_BANK,
+	RPN_PUSH_VALUE_PUSH_BANK,
+	RPN_PUSH_VALUE_POP_BANK,
+	RPN_SMOOTH,
+	RPN_HYSTERESIS,
+	RPN_CLAMP,
+	RPN_SCALE,
+
+	RPN_INSTRUCTION_MAX
 };
 
 enum _RPN_Destination {
@@ -92,9 +123,12 @@ enum _RPN_Destination {
 	RPN_IDLE
 };
 
+// byte code: one byte per opcode, followed by an operand byte for
+// instructions with a constant pool index, register index or jump target
 struct _RPN_VM {
-	RPN_Instruction inst [CUSTOM_MAX_INST];
-	float val [CUSTOM_MAX_INST];
+	float pool [CUSTOM_MAX_CONST];
+	uint8_t code [CUSTOM_MAX_CODE];
+	uint8_t raw; // number of instructions before optimization
 };
 
 struct _Custom_Item {
@@ -105,6 +139,6 @@ struct _Custom_Item {
 };
 
 extern CMC_Engine custom_engine;
-extern const OSC_Query_Item custom_tree [3];
+extern const OSC_Query_Item custom_tree [4];
 
 #endif // _CUSTOM_H_
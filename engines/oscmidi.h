@@ -46,6 +46,6 @@ struct _OSC_MIDI_Group {
 
 extern OSC_MIDI_Group *oscmidi_groups;
 extern CMC_Engine oscmidi_engine;
-extern const OSC_Query_Item oscmidi_tree [7];
+extern const OSC_Query_Item oscmidi_tree [10];
 
 #endif // _OSCMIDI_H_
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _RTPMIDI_H_
+#define _RTPMIDI_H_
+
+#include <cmc.h>
+#include <oscquery.h>
+
+extern CMC_Engine rtpmidi_engine;
+extern const OSC_Query_Item rtpmidi_tree [4];
+
+void rtpmidi_reset(uint8_t enabled);
+void rtpmidi_request(void);
+void rtpmidi_flush(void);
+void rtpmidi_dispatch(uint8_t *ip, uint16_t port, uint8_t *buf, uint16_t len);
+
+#endif // _RTPMIDI_H_
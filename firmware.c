@@ -34,6 +34,7 @@
 #include <libmaple/bkp.h> // backup register
 #include <libmaple/syscfg.h> // syscfg register
 #include <libmaple/systick.h> // systick
+#include <libmaple/delay.h> // mux settle delay
 #include <series/simd.h> // SIMD instructions
 
 /*
@@ -55,6 +56,9 @@
 #include <wiz.h>
 #include <calibration.h>
 #include <sensors.h>
+#include <tuner.h>
+#include <health.h>
+#include <preset.h>
 //#include <osc.h>
 
 #if(ADC_DUAL_LENGTH > 0)
@@ -236,6 +240,9 @@ _counter_inc(void)
 		pin_write_bit(mux_sequence[1], 0); // CP
 	}
 #endif
+
+	if(config.sensors.mux_settle) // give analog inputs time to settle after switching
+		delay_us(config.sensors.mux_settle);
 }
 
 static inline __always_inline void
@@ -378,7 +385,12 @@ config_cb(uint8_t *ip, uint16_t port, uint8_t *buf, uint16_t len)
 
 	// dispatch OSC request
 	if(osc_check_packet(buf, len))
+	{
+		// engine updates are applied once per packet, thus bundles are atomic
+		cmc_defer_begin();
 		osc_dispatch_method(buf, len, config_serv);
+		cmc_defer_end();
+	}
 	else
 		DEBUG("s", "invalid OSC packet");
 }
@@ -608,11 +620,15 @@ loop(void)
 	Stop_Watch sw_adc_fill = {.id = "adc_fill", .thresh=3000};
 	Stop_Watch sw_blob_process = {.id = "blob_process", .thresh=3000};
 	Stop_Watch sw_output_block = {.id = "output_block", .thresh=3000};
+	Stop_Watch sw_eeprom_step = {.id = "eeprom_step", .thresh=3000};
+	Stop_Watch sw_config_dispatch = {.id = "config_dispatch", .thresh=100};
 #endif // BENCHMARK
 
 	while(1) // endless loop
 	{
-		if(config.sensors.rate)
+		uint_fast8_t awake = 1; // keep the performance rate unless touch recognition says otherwise
+
+		if(sensors_rate && !tuning) // the tuner measures the achievable loop period
 		{
 			adc_time_up = 0;
 			timer_resume(adc_timer);
@@ -624,20 +640,24 @@ loop(void)
 		{
 			adc_dma_block();
 			first = 0;
+			DEBUG("si", "boot_us", systick_uptime() * SNTP_SYSTICK_US); // time to first frame
 			continue;
 		}
 
 		if(calibrating)
 			range_calibrate(adc12_raw[adc_raw_ptr], adc3_raw[adc_raw_ptr], order12, order3, adc_sum, adc_rela);
+		else if(tuning)
+			tuner_step(adc12_raw[adc_raw_ptr], adc3_raw[adc_raw_ptr], order12, order3);
 
-		if(config.output.osc.socket.enabled && (wiz_socket_state[SOCK_OUTPUT] == WIZ_SOCKET_STATE_OPEN) )
+		uint_fast8_t output_open = config.output.osc.socket.enabled && (wiz_socket_state[SOCK_OUTPUT] == WIZ_SOCKET_STATE_OPEN);
+		if(output_open || config.rtpmidi.socket.enabled) // RTP-MIDI needs touch recognition, too
 		{
 			uint_fast8_t job = 0;
 
 #ifdef BENCHMARK
 			stop_watch_start(&sw_output_send);
 #endif
-			if(config.output.parallel && cmc_job) // start nonblocking sending of last cycles output
+			if(config.output.parallel && cmc_job && output_open) // start nonblocking sending of last cycles output
 				cmc_stat = osc_send_nonblocking(&config.output.osc, BUF_O_BASE(!buf_o_ptr), cmc_len);
 			else
 				cmc_stat = 0;
@@ -648,6 +668,9 @@ loop(void)
 #endif
 			adc_fill(adc_raw_ptr);
 
+			if(config.sensors.health && !calibrating) // mask broken sensors before touch recognition
+				health_update(adc_rela);
+
 			if(config.sntp.socket.enabled)
 				sntp_timestamp_refresh(ptp_uptime(), &now, &offset);
 			else if(config.ptp.event.enabled)
@@ -675,6 +698,7 @@ loop(void)
 				stop_watch_start(&sw_blob_process);
 #endif
 				buf_ptr = cmc_process(now, offset, adc_rela, buf_ptr, end); // touch recognition of current cycle
+				awake = config.dump.enabled || cmc_n_aoi; // dump output wants the full rate
 			}
 			
 			if(cmc_engines_active + config.dump.enabled > 1)
@@ -683,7 +707,7 @@ loop(void)
 				buf_ptr = osc_end_bundle_item(buf_ptr, end, preamble);
 
 			cmc_len = osc_len(buf_ptr, buf);
-			if(cmc_len > 0) // is there anything after OSC bundle header?
+			if( (cmc_len > 0) && output_open) // is there anything after OSC bundle header?
 			{
 				job = 1;
 
@@ -720,6 +744,10 @@ loop(void)
 #endif
 		}
 
+		// send RTP-MIDI events of this cycle, SPI is not busy with output any more
+		if(config.rtpmidi.socket.enabled)
+			rtpmidi_flush();
+
 		// handle WIZnet IRQs XXX check manually if we should have missed an interrupt
 		if(wiz_needs_attention || (pin_read_bit(UDP_INT) == 0) )
 		{
@@ -748,10 +776,33 @@ loop(void)
 				debug_str("config ARPto or TCP disconnect");
 			}
 			else if( (config_should_listen & WIZ_Sn_IR_RECV) && (wiz_socket_state[SOCK_CONFIG] == WIZ_SOCKET_STATE_OPEN) )
+			{
+				// whole round trip: receive, lookup, method callback and reply
+#ifdef BENCHMARK
+				stop_watch_start(&sw_config_dispatch);
+#endif
 				osc_dispatch(&config.config.osc, BUF_I_BASE(buf_i_ptr), config_cb);
+#ifdef BENCHMARK
+				stop_watch_stop(&sw_config_dispatch);
+#endif
+			}
 			config_should_listen = 0;
 		}
 
+		// push coalesced change notifications to subscribers
+		if(config.config.osc.socket.enabled && (wiz_socket_state[SOCK_CONFIG] == WIZ_SOCKET_STATE_OPEN) )
+			config_notify();
+
+		// write back dirty EEPROM pages of pending saves, each step only feeds the I2C bus
+		// what it can take without waiting, thus runs while playing, too
+#ifdef BENCHMARK
+		stop_watch_start(&sw_eeprom_step);
+#endif
+		eeprom_queue_step();
+#ifdef BENCHMARK
+		stop_watch_stop(&sw_eeprom_step);
+#endif
+
 		if(output_should_listen)
 		{
 			if(output_should_listen & WIZ_Sn_IR_CON) // TCP only
@@ -774,6 +825,18 @@ loop(void)
 			output_should_listen = 0;
 		}
 
+		// run RTP-MIDI session, it shares its socket with debug
+		if(config.rtpmidi.socket.enabled)
+		{
+			if(debug_should_listen & WIZ_Sn_IR_TIMEOUT)
+				rtpmidi_enable(1); // restart session
+			else if(debug_should_listen & WIZ_Sn_IR_RECV)
+				udp_dispatch(config.rtpmidi.socket.sock, BUF_I_BASE(buf_i_ptr), rtpmidi_dispatch);
+			debug_should_listen = 0;
+
+			rtpmidi_request(); // invitations and clock sync
+		}
+
 		if(debug_should_listen)
 		{
 			if(debug_should_listen & WIZ_Sn_IR_CON) // TCP only
@@ -812,9 +875,14 @@ loop(void)
 			// send sntp request
 			if(sync_should_request)
 			{
-				sntp_timestamp_refresh(ptp_uptime(), &now, NULL);
-				len = sntp_request(BUF_O_OFFSET(buf_o_ptr), now);
-				udp_send(config.sntp.socket.sock, BUF_O_BASE(buf_o_ptr), len);
+				uint8_t *base = buf_r_acquire(BUF_R_SNTP);
+				if(base)
+				{
+					sntp_timestamp_refresh(ptp_uptime(), &now, NULL);
+					len = sntp_request(BUF_R_OFFSET(base), now);
+					udp_send(config.sntp.socket.sock, base, len);
+					buf_r_release(base);
+				}
 				sync_should_request = 0;
 			}
 		}
@@ -885,18 +953,32 @@ loop(void)
 
 		adc_dma_block();
 
-		if(config.sensors.rate)
+		if(sensors_adc_dirty) // ADCs are idle now, safe to change sample time
+		{
+			adc_sample_time_reconfigure();
+			sensors_adc_dirty = 0;
+		}
+
+		if(sensors_governor_update(awake)) // switch between performance and idle rate
+		{
+			timer_pause(adc_timer);
+			if(sensors_rate)
+				adc_timer_reconfigure(sensors_rate);
+			adc_time_up = 1; // do not wait for the remainder of an idle period
+		}
+
+		if(sensors_rate && !tuning)
 			while(!adc_time_up)
 				;
 	} // endless loop
 }
 
 void
-adc_timer_reconfigure(void)
+adc_timer_reconfigure(uint16_t rate)
 {
 	// this scheme is good for rates in the range of 20-2000+
 	uint16_t prescaler = 50-1;
-	uint16_t reload = 72e6 / (config.sensors.rate * 50);
+	uint16_t reload = 72e6 / (rate * 50);
 	uint16_t compare = reload;
 
 	timer_set_prescaler(adc_timer, prescaler);
@@ -909,6 +991,22 @@ adc_timer_reconfigure(void)
 	nvic_irq_set_priority(NVIC_ADC_TIMER, ADC_TIMER_PRIORITY);
 }
 
+void
+adc_sample_time_reconfigure(void)
+{
+	// only valid when no conversion is ongoing, e.g. after adc_dma_block
+	adc_smp_rate smp_rate = config.sensors.sample_time;
+
+#if(ADC_DUAL_LENGTH > 0)
+	adc_set_sample_rate(ADC1, smp_rate);
+	adc_set_sample_rate(ADC2, smp_rate);
+#endif
+
+#if(ADC_SING_LENGTH > 0)
+	adc_set_sample_rate(ADC3, smp_rate);
+#endif
+}
+
 void 
 sync_timer_reconfigure(void)
 {
@@ -1081,7 +1179,7 @@ setup(void)
 	eeprom_slave_init(eeprom_24LC64, EEPROM_DEV, 0b000);
 	eeprom_slave_init(eeprom_24AA025E48, EEPROM_DEV, 0b001);
 
-	if(EEPROM_CONFIG_OFFSET + sizeof(Config) < EEPROM_RANGE_OFFSET) //FIXME solve differently with a compile time check
+	if(EEPROM_CONFIG_OFFSET + EEPROM_CONFIG_SIZE < EEPROM_RANGE_OFFSET) //FIXME solve differently with a compile time check
 	{
 		// load config or use factory settings?
 		if(reset_mode == RESET_MODE_FLASH_SOFT)
@@ -1095,7 +1193,12 @@ setup(void)
 		eeprom_bulk_read(eeprom_24AA025E48, 0xfa, config.comm.mac, 6);
 
 	// load calibrated sensor ranges from eeprom
+	uint32_t range_load_ticks = systick_uptime();
 	range_load(0);
+	range_load_ticks = systick_uptime() - range_load_ticks;
+
+	// load persisted scene presets from eeprom
+	preset_init();
 
 	// init DMA, which is used for SPI and ADC
 	dma_init(DMA1);
@@ -1162,7 +1265,8 @@ setup(void)
 	// initialize timers TODO move up
 	timer_init(adc_timer);
 	timer_pause(adc_timer);
-	adc_timer_reconfigure();
+	sensors_governor_reset();
+	adc_timer_reconfigure(sensors_rate);
 
 	timer_init(sync_timer);
 
@@ -1181,6 +1285,7 @@ setup(void)
 	sntp_enable(config.sntp.socket.enabled);
 	ptp_enable(config.ptp.event.enabled);
 	debug_enable(config.debug.osc.socket.enabled);
+	rtpmidi_enable(config.rtpmidi.socket.enabled);
 	mdns_enable(config.mdns.socket.enabled);
 	
 	if(config.mdns.socket.enabled)
@@ -1201,15 +1306,14 @@ setup(void)
 #if(ADC_DUAL_LENGTH > 0)
 	adc_set_exttrig(ADC1, ADC_EXTTRIG_MODE_SOFTWARE);
 	adc_set_exttrig(ADC2, ADC_EXTTRIG_MODE_SOFTWARE);
-	adc_set_sample_rate(ADC1, ADC_SMPR_181_5);
-	adc_set_sample_rate(ADC2, ADC_SMPR_181_5);
 #endif
 
 #if(ADC_SING_LENGTH > 0)
 	adc_set_exttrig(ADC3, ADC_EXTTRIG_MODE_SOFTWARE);
-	adc_set_sample_rate(ADC3, ADC_SMPR_181_5);
 #endif
 
+	adc_sample_time_reconfigure();
+
 #if(ADC_UNUSED_LENGTH > 0)
 	// setup analog input pins
 	for(i=0; i<ADC_UNUSED_LENGTH; i++)
@@ -1306,6 +1410,8 @@ setup(void)
 
 	pin_write_bit(CHIM_LED_PIN, 1);
 	DEBUG("si", "config_size", sizeof(Config));
+	DEBUG("si", "config_load_us", config_load_ticks * SNTP_SYSTICK_US);
+	DEBUG("si", "range_load_us", range_load_ticks * SNTP_SYSTICK_US);
 	DEBUG("si", "reset_mode", reset_mode);
 }
 
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chimaera.h>
+#include <config.h>
+#include <calibration.h>
+
+#include "health_private.h"
+
+// globals
+uint8_t health_mask [SENSOR_N];
+uint_fast8_t health_masked = 0;
+
+// locals
+static Health_Sensor sensors [SENSOR_N];
+static uint8_t masked [SENSOR_N]; // indices of masked sensors
+static uint_fast16_t frame = 0;
+
+void
+health_reset(void)
+{
+	memset(health_mask, HEALTH_OK, sizeof(health_mask));
+	memset(sensors, 0, sizeof(sensors));
+	health_masked = 0;
+	frame = 0;
+}
+
+static inline uint_fast8_t
+_health_in_aoi(uint_fast8_t i)
+{
+	return (abs(sensors[i].mean) << 1) > range.thresh[i]; // same criterion as in cmc_process
+}
+
+static inline uint_fast8_t
+_health_isolated(uint_fast8_t i)
+{
+	// a real magnet always excites its neighbours, a broken sensor does not
+	if( (i > 0) && _health_in_aoi(i-1) )
+		return 0;
+	if( (i < SENSOR_N-1) && _health_in_aoi(i+1) )
+		return 0;
+	return 1;
+}
+
+static void
+_health_rebuild(void)
+{
+	uint_fast8_t i;
+
+	// list of masked sensors
+	health_masked = 0;
+	for(i=0; i<SENSOR_N; i++)
+		if(health_mask[i] != HEALTH_OK)
+			masked[health_masked++] = i;
+}
+
+static void
+_health_evaluate(void)
+{
+	uint_fast8_t i;
+	uint_fast8_t changed = 0;
+
+	// the moving average divides the raw noise variance by 2^(bitshift+1) - 1
+	const uint_fast8_t bitshift = config.sensors.movingaverage_bitshift;
+	const int64_t var_min = (int64_t)HEALTH_WINDOW*HEALTH_WINDOW / HEALTH_VARIANCE_MIN_INV
+		/ ( (2 << bitshift) - 1);
+
+	// window statistics
+	for(i=0; i<SENSOR_N; i++)
+	{
+		Health_Sensor *sen = &sensors[i];
+		int32_t mean = sen->sum / HEALTH_WINDOW;
+		// N^2*variance = N*sum2 - sum^2, exact in integers, float would cancel out
+		int64_t var = (int64_t)HEALTH_WINDOW*sen->sum2 - (int64_t)sen->sum*sen->sum;
+		int32_t raw = range.qui[i] + mean;
+
+		sen->mean = mean;
+		sen->sum = 0;
+		sen->sum2 = 0;
+
+		if(var < var_min)
+			sen->status = HEALTH_STUCK;
+		else if( (raw <= HEALTH_RAIL_MARGIN) || (raw >= ADC_BITDEPTH - HEALTH_RAIL_MARGIN) )
+			sen->status = HEALTH_RAIL;
+		else if(range.thresh[i] && (abs(sen->mean) > range.thresh[i]) )
+			sen->status = HEALTH_OFFSET;
+		else
+			sen->status = HEALTH_OK;
+	}
+
+	// rail and offset conditions only count for isolated sensors
+	for(i=0; i<SENSOR_N; i++)
+	{
+		Health_Sensor *sen = &sensors[i];
+		uint_fast8_t status = sen->status;
+
+		if( (status == HEALTH_RAIL) || (status == HEALTH_OFFSET) )
+		{
+			if(!_health_isolated(i))
+				status = HEALTH_OK;
+		}
+
+		if( (health_mask[i] == HEALTH_STUCK) && (status != HEALTH_STUCK) ) // lively for a whole window
+		{
+			health_mask[i] = status;
+			sen->strikes = 0;
+			changed = 1;
+		}
+		else if( (status != HEALTH_OK) == (health_mask[i] != HEALTH_OK) ) // agrees with current mask
+			sen->strikes = 0;
+		else if(++sen->strikes >= HEALTH_STRIKES) // mask or unmask
+		{
+			health_mask[i] = status;
+			sen->strikes = 0;
+			changed = 1;
+		}
+	}
+
+	if(changed)
+		_health_rebuild();
+}
+
+// is the sample outside of the band its sensor has been masked for?
+static inline uint_fast8_t
+_health_recovered(uint_fast8_t i, int32_t val)
+{
+	switch(health_mask[i])
+	{
+		case HEALTH_STUCK: // a single outlier still passes as stuck, unmasked by _health_evaluate
+			return 0;
+		case HEALTH_RAIL:
+		{
+			int32_t raw = range.qui[i] + val;
+			return (raw > HEALTH_RAIL_MARGIN) && (raw < ADC_BITDEPTH - HEALTH_RAIL_MARGIN);
+		}
+		case HEALTH_OFFSET:
+			return abs(val) <= range.thresh[i];
+		default:
+			return 1;
+	}
+}
+
+void __CCM_TEXT__
+health_update(int16_t *rela)
+{
+	uint_fast8_t i;
+
+	// accumulate statistics of unaltered sensor values
+	for(i=0; i<SENSOR_N; i++)
+	{
+		Health_Sensor *sen = &sensors[i];
+		int32_t val = rela[i];
+
+		sen->sum += val;
+		sen->sum2 += val*val;
+	}
+
+	if(++frame == HEALTH_WINDOW)
+	{
+		_health_evaluate();
+		frame = 0;
+	}
+
+	// interpolate masked sensors from their healthy neighbours
+	uint_fast8_t m;
+	uint_fast8_t recovered = 0;
+	for(m=0; m<health_masked; m++)
+	{
+		int32_t acc = 0;
+		uint_fast8_t n = 0;
+
+		i = masked[m];
+		if(_health_recovered(i, rela[i])) // unmask right away, this may be a real touch
+		{
+			health_mask[i] = HEALTH_OK;
+			sensors[i].strikes = 0;
+			recovered = 1;
+			continue;
+		}
+
+		if( (i > 0) && (health_mask[i-1] == HEALTH_OK) )
+		{
+			acc += rela[i-1];
+			n++;
+		}
+		if( (i < SENSOR_N-1) && (health_mask[i+1] == HEALTH_OK) )
+		{
+			acc += rela[i+1];
+			n++;
+		}
+
+		rela[i] = n ? acc / n : 0;
+	}
+
+	if(recovered)
+		_health_rebuild();
+}
+
+/*
+ * Config
+ */
+
+static uint_fast8_t
+_health_enabled(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	uint_fast8_t res = config_check_bool(path, fmt, argc, buf, &config.sensors.health);
+	if(argc > 1)
+		health_reset();
+	return res;
+}
+
+static uint_fast8_t
+_health_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	health_reset();
+
+	size = CONFIG_SUCCESS("is", uuid, path);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_health_mask(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	uint8_t *mask = NULL;
+	size = CONFIG_SUCCESS("isB", uuid, path, sizeof(health_mask), &mask);
+	memcpy(mask, health_mask, sizeof(health_mask));
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_health_number(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("isi", uuid, path, health_masked);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+/*
+ * Query
+ */
+
+static const OSC_Query_Argument health_mask_args [] = {
+	OSC_QUERY_ARGUMENT_BLOB("Status per sensor: 0=ok, 1=stuck, 2=rail, 3=offset", OSC_QUERY_MODE_R)
+};
+
+static const OSC_Query_Argument health_number_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Number", OSC_QUERY_MODE_R, 0, SENSOR_N, 1)
+};
+
+const OSC_Query_Item health_tree [] = {
+	OSC_QUERY_ITEM_METHOD("enabled", "Enable/disable", _health_enabled, config_boolean_args),
+	OSC_QUERY_ITEM_METHOD("reset", "Unmask all sensors", _health_reset, NULL),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("mask", "Masked sensors", _health_mask, health_mask_args),
+	OSC_QUERY_ITEM_METHOD("number", "Number of masked sensors", _health_number, health_number_args)
+};
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _HEALTH_PRIVATE_H_
+#define _HEALTH_PRIVATE_H_
+
+#include <health.h>
+
+#define HEALTH_WINDOW 256 // frames per evaluation window, 256*2048^2 fits into 32 bits
+#define HEALTH_STRIKES 32 // consecutive bad/good windows before masking/unmasking
+#define HEALTH_VARIANCE_MIN_INV 16 // raw ADC noise of a working sensor exceeds 1/16 LSB^2
+#define HEALTH_RAIL_MARGIN 0x10 // distance to rails considered pegged
+
+typedef struct _Health_Sensor Health_Sensor;
+
+struct _Health_Sensor {
+	int32_t sum;
+	uint32_t sum2;
+	int16_t mean;
+	uint8_t strikes;
+	uint8_t status; // status of last window
+};
+
+#endif // _HEALTH_PRIVATE_H_
@@ -113,8 +113,9 @@ extern Reset_Mode reset_mode;
 #define EEPROM_SIZE 0x2000
 #define EEPROM_CONFIG_OFFSET 0x0000
 #define EEPROM_RANGE_OFFSET 0x1000
-#define EEPROM_RANGE_SIZE 0x0510
-#define EEPROM_RANGE_MAX 2 // we have place for three slots: 0, 1, 2
+#define EEPROM_RANGE_SIZE 0x0510 // slot size of legacy layout without journal
+#define EEPROM_RANGE_JOURNAL_SIZE 0x1000
+#define EEPROM_RANGE_MAX 1 // the journal has place for two slots and a spare frame: 0, 1
 
 // WIZnet interfacing
 #if REVISION == 3
@@ -198,6 +199,29 @@ extern uint8_t buf_i[1] [CHIMAERA_BUFSIZE]; // general purpose input buffer
 //#define BUF_O_MAX(ptr)(buf_o[ptr] + CHIMAERA_BUFSIZE - 2*(WIZ_SEND_OFFSET-3)) // WIZ5200
 #define BUF_O_MAX(ptr)(buf_o[ptr] + CHIMAERA_BUFSIZE - (WIZ_SEND_OFFSET-3)) // WIZ5500
 
+// management replies(config, debug, sNTP, PTP, mDNS, RTP-MIDI) never touch the output frame buffers
+#define BUF_R_NUM 2
+
+typedef enum _Buf_R_Owner {
+	BUF_R_FREE = 0,
+	BUF_R_CONFIG,
+	BUF_R_DEBUG,
+	BUF_R_SNTP,
+	BUF_R_PTP,
+	BUF_R_MDNS,
+	BUF_R_RTPMIDI
+} Buf_R_Owner;
+
+extern uint8_t buf_r [BUF_R_NUM] [CHIMAERA_BUFSIZE]; // reply buffer pool
+extern uint8_t buf_r_owner [BUF_R_NUM];
+extern uint16_t buf_r_dropped;
+
+uint8_t *buf_r_acquire(Buf_R_Owner owner);
+void buf_r_release(uint8_t *base);
+
+#define BUF_R_OFFSET(base)((base) + WIZ_SEND_OFFSET)
+#define BUF_R_MAX(base)((base) + CHIMAERA_BUFSIZE - (WIZ_SEND_OFFSET-3)) // WIZ5500
+
 #define adc_timer TIMER1
 #define NVIC_ADC_TIMER	NVIC_TIMER1_CC
 
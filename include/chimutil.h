@@ -27,7 +27,8 @@ void cidr_to_subnet(uint8_t *subnet, uint8_t mask);
 uint8_t subnet_to_cidr(uint8_t *subnet);
 void broadcast_address(uint8_t *brd, uint8_t *ip, uint8_t *subnet);
 
-void adc_timer_reconfigure(void);
+void adc_timer_reconfigure(uint16_t rate);
+void adc_sample_time_reconfigure(void);
 void sync_timer_reconfigure(void);
 void dhcpc_timer_reconfigure(void);
 void mdns_timer_reconfigure(void);
@@ -38,6 +39,7 @@ void config_enable(uint8_t b);
 void sntp_enable(uint8_t b);
 void ptp_enable(uint8_t b);
 void debug_enable(uint8_t b);
+void rtpmidi_enable(uint8_t b);
 void mdns_enable(uint8_t b);
 void dhcpc_enable(uint8_t b);
 
@@ -79,6 +79,7 @@ struct _CMC_Blob_Event {
 extern CMC_Group *cmc_groups;
 extern uint16_t cmc_groups_n;
 extern uint_fast8_t cmc_engines_active;
+extern uint_fast8_t cmc_n_aoi; // number of sensors above threshold in last cycle
 
 void cmc_velocity_stiffness_update(uint8_t stiffness);
 void cmc_init(void);
@@ -87,5 +88,10 @@ osc_data_t *cmc_process(OSC_Timetag now, OSC_Timetag offset, int16_t *rela, osc_
 void cmc_group_reset(void);
 void cmc_group_update(void);
 void cmc_engines_update(void);
+void cmc_engine_init(CMC_Engine *engine);
+
+// group updates and engine (re)initializations are coalesced until the outermost end
+void cmc_defer_begin(void);
+void cmc_defer_end(void);
 
 #endif // _CMC_H_
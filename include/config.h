@@ -26,6 +26,7 @@
 #include <scsynth.h>
 #include <custom.h>
 #include <oscmidi.h>
+#include <schema.h>
 
 #define SRC_PORT 0
 #define DST_PORT 1
@@ -59,6 +60,7 @@ enum _OSC_Mode {
 };
 
 extern const OSC_Query_Value config_mode_args_values [3];
+extern const OSC_Query_Value config_saving_args_values [4];
 
 struct _OSC_Config {
 	Socket_Config socket;
@@ -75,6 +77,7 @@ enum {
 	SOCK_OUTPUT	= 4,
 	SOCK_CONFIG = 5,
 	SOCK_DEBUG	= 6,
+	SOCK_RTPMIDI = 6, // = SOCK_DEBUG
 	SOCK_MDNS		= 7,
 };
 
@@ -122,8 +125,15 @@ struct _Config {
 		uint8_t format;
 		uint8_t mpe;
 		char path [64];
+		uint8_t allocation;
+		uint8_t stealing;
+		uint8_t coalesce;
 	} oscmidi;
 
+	struct _rtpmidi {
+		Socket_Config socket;
+	} rtpmidi;
+
 	struct _dummy {
 		uint8_t enabled;
 		uint8_t redundancy;
@@ -183,7 +193,12 @@ struct _Config {
 		uint8_t movingaverage_bitshift;
 		uint8_t interpolation_mode;
 		uint8_t velocity_stiffness;
+		uint8_t sample_time; // ADC_SMPR_*
+		uint8_t mux_settle; // us to wait after mux switching
+		uint8_t health; // mask and interpolate broken sensors
 		uint16_t rate; // the maximal update rate the chimaera should run at
+		uint16_t idle_rate; // the update rate to fall back to when idle, 0 disables the governor
+		uint16_t idle_timeout; // ms without any area of interest before falling back to idle_rate
 	} sensors;
 
 	CMC_Group groups [GROUP_MAX];
@@ -191,13 +206,37 @@ struct _Config {
 	OSC_MIDI_Group oscmidi_groups [GROUP_MAX];
 };
 
+// EEPROM layout of the configuration: a schema directory followed by the raw Config
+#define CONFIG_SCHEMA_MAGIC 0x5343 // 'CS', no valid board revision in legacy layout
+#define CONFIG_SCHEMA_MAX 32
+
+typedef struct _Config_Schema Config_Schema;
+
+struct _Config_Schema {
+	uint16_t magic;
+	uint16_t n; // number of fields
+	Firmware_Version version;
+	Config_Field fields [CONFIG_SCHEMA_MAX];
+};
+
+#define CONFIG_SCHEMA_SIZE ( (sizeof(Config_Schema) + 0x1f) & ~0x1f) // page aligned
+#define EEPROM_CONFIG_DATA_OFFSET (EEPROM_CONFIG_OFFSET + CONFIG_SCHEMA_SIZE)
+#define EEPROM_CONFIG_SIZE (CONFIG_SCHEMA_SIZE + sizeof(Config))
+#define CONFIG_LEGACY_SIZE 0x0a10 // raw Config of firmware 0.14.0
+
+extern const Config_Field config_fields [22];
+extern const Config_Field config_legacy_fields [21];
+
 extern Config config;
 extern const OSC_Method config_serv [];
+extern uint32_t config_load_ticks; // duration of last load incl. migration
 
 uint_fast8_t version_match(void);
 
 uint_fast8_t config_load(void);
 uint_fast8_t config_save(void);
+void config_touch(const char *path);
+void config_notify(void);
 
 uint_fast8_t groups_load(void);
 uint_fast8_t groups_save(void);
@@ -214,6 +253,7 @@ uint_fast8_t config_check_bool(const char *path, const char *fmt, uint_fast8_t a
 uint_fast8_t config_check_float(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf, float *val);
 
 const OSC_Query_Argument config_boolean_args [1];
+const OSC_Query_Argument config_saving_args [2];
 const OSC_Query_Argument config_mode_args [1];
 const OSC_Query_Argument config_address_args [1];
 
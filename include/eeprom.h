@@ -22,7 +22,13 @@
 
 #include <libmaple/i2c.h>
 
+#define EEPROM_24LC64_PAGE_SIZE 0x20
+
+// maximal number of pages an image of given length may touch
+#define EEPROM_IMAGE_PAGES(LEN, PAGE_SIZE) ((LEN) / (PAGE_SIZE) + 2)
+
 typedef struct _EEPROM_24xx EEPROM_24xx;
+typedef struct _EEPROM_Image EEPROM_Image;
 
 struct _EEPROM_24xx {
 	i2c_dev *dev;
@@ -33,6 +39,30 @@ struct _EEPROM_24xx {
 	uint8_t page_write_time; // ms
 };
 
+// maximal number of concurrently queued images
+#define EEPROM_QUEUE_MAX 4
+
+typedef enum _EEPROM_Status {
+	EEPROM_STATUS_IDLE		= 0,
+	EEPROM_STATUS_PENDING	= 1,
+	EEPROM_STATUS_DONE		= 2,
+	EEPROM_STATUS_FAILED	= 3
+} EEPROM_Status;
+
+typedef void (*EEPROM_Image_Cb)(EEPROM_Image *image);
+
+// tracks page hashes of a struct as last read from or written to EEPROM
+struct _EEPROM_Image {
+	uint16_t addr;
+	uint16_t len;
+	uint8_t valid; // hashes mirror EEPROM content at addr
+	uint8_t status; // EEPROM_Status of last queued save
+	uint16_t written; // pages written by last save
+	uint16_t n; // capacity of hash
+	uint32_t *hash; // one per touched page
+	EEPROM_Image_Cb cb; // called when a queued save has finished or failed
+};
+
 extern EEPROM_24xx *eeprom_24LC64;
 extern EEPROM_24xx *eeprom_24AA025E48;
 
@@ -48,4 +78,16 @@ void eeprom_page_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *page, uint8_
 void eeprom_bulk_write(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t len);
 void eeprom_bulk_read(EEPROM_24xx *eeprom, uint16_t addr, uint8_t *bulk, uint16_t len);
 
+// incremental bulk access, only pages that changed since the last access are written
+void eeprom_image_read(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len);
+void eeprom_image_hash(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len); // bulk mirrors EEPROM
+uint16_t eeprom_image_write(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len);
+
+// nonblocking incremental bulk write, bulk must not change until the save has finished,
+// push it again after a change to restart the save
+uint_fast8_t eeprom_queue_push(EEPROM_24xx *eeprom, EEPROM_Image *image, uint16_t addr, uint8_t *bulk, uint16_t len);
+uint_fast8_t eeprom_queue_step(void); // advances at most one page transfer without waiting, returns number of pending saves
+uint32_t eeprom_queue_age(void); // systicks since the oldest pending save was pushed
+void eeprom_queue_flush(void); // blocks until all pending saves have finished
+
 #endif // _EEPROM_H_
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _HEALTH_H_
+#define _HEALTH_H_
+
+#include <stdint.h>
+
+#include <chimaera.h>
+#include <oscquery.h>
+
+typedef enum _Health_Status Health_Status;
+
+enum _Health_Status {
+	HEALTH_OK			= 0,
+	HEALTH_STUCK	= 1, // variance too low
+	HEALTH_RAIL		= 2, // pegged to ground or supply rail
+	HEALTH_OFFSET	= 3 // isolated permanent hit far from quiescent value
+};
+
+// globals
+extern uint8_t health_mask [SENSOR_N]; // Health_Status per sensor
+extern uint_fast8_t health_masked; // number of masked sensors
+extern const OSC_Query_Item health_tree [4];
+
+void health_reset(void);
+void health_update(int16_t *rela);
+
+#endif // _HEALTH_H_
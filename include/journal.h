@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+
+#include <eeprom.h>
+
+#define JOURNAL_MAGIC 0x4a52 // 'JR'
+#define JOURNAL_FRAMES_MAX 8
+
+typedef struct _Journal_Header Journal_Header;
+typedef struct _Journal Journal;
+
+typedef enum _Journal_State {
+	JOURNAL_STATE_EMPTY			= 0, // no record header
+	JOURNAL_STATE_UNCHECKED	= 1, // record header, CRC not yet checked
+	JOURNAL_STATE_VALID			= 2,
+	JOURNAL_STATE_INVALID		= 3 // torn or corrupted record
+} Journal_State;
+
+// precedes each record in EEPROM
+struct _Journal_Header {
+	uint16_t magic; // JOURNAL_MAGIC
+	uint8_t tag; // record identifier, e.g. slot number
+	uint8_t reserved;
+	uint16_t len; // payload length
+	uint16_t reserved2;
+	uint32_t seq; // increases with every record written to the journal
+	uint32_t crc; // CRC-32 over header with zero crc and payload
+};
+
+// an EEPROM region split into equally sized frames holding one record each
+struct _Journal {
+	EEPROM_24xx *eeprom;
+	uint16_t offset; // region start
+	uint16_t frame; // frame size, multiple of page size
+	uint8_t frames; // number of frames in region
+	uint8_t last; // frame of newest record
+	uint32_t seq; // sequence number of newest record
+
+	// headers as scanned, loading a record then needs a single sequential read
+	uint8_t state [JOURNAL_FRAMES_MAX];
+	uint8_t tag [JOURNAL_FRAMES_MAX];
+	uint16_t lens [JOURNAL_FRAMES_MAX];
+	uint32_t seqs [JOURNAL_FRAMES_MAX];
+	uint32_t crcs [JOURNAL_FRAMES_MAX];
+
+	Journal_Header header; // of record being written
+	EEPROM_Image image; // of header being written
+};
+
+// size of a frame that can hold a record of given payload length
+#define JOURNAL_FRAME_SIZE(LEN, PAGE_SIZE) \
+	( (sizeof(Journal_Header) + (LEN) + (PAGE_SIZE) - 1) / (PAGE_SIZE) * (PAGE_SIZE) )
+
+uint32_t journal_crc(uint32_t crc, const uint8_t *ptr, uint16_t len);
+
+void journal_init(Journal *journal, EEPROM_24xx *eeprom, uint16_t offset, uint16_t size, uint16_t len);
+uint_fast8_t journal_empty(Journal *journal);
+uint_fast8_t journal_read(Journal *journal, uint8_t tag, uint8_t *data, uint16_t len);
+uint_fast8_t journal_write(Journal *journal, uint8_t tag, uint8_t *data, uint16_t len, EEPROM_Image *image);
+// carries n fixed slots of a legacy layout at the journal offset over as records tagged 0..n-1,
+// tmp must hold n payloads, blocks until written
+uint_fast8_t journal_import(Journal *journal, uint16_t slot, uint8_t n, uint8_t *tmp, uint16_t len, EEPROM_Image *image);
+
+#endif // _JOURNAL_H_
@@ -50,43 +50,71 @@ enum _MIDI_COMMAND {
 #define MIDI_MSV 0x00
 #define MIDI_LSV 0x20
 
-typedef struct _MIDI_Hash MIDI_Hash;
-
-struct _MIDI_Hash {
-	uint32_t sid;
-	uint8_t cha;
-	uint8_t key;
-};
-
-void midi_add_key(MIDI_Hash *hash, uint32_t sid, uint8_t key, uint8_t cha);
-uint8_t midi_get_key(MIDI_Hash *hash, uint32_t sid, uint8_t *key, uint8_t *cha);
-uint8_t midi_rem_key(MIDI_Hash *hash, uint32_t sid, uint8_t *key, uint8_t *cha);
-
-//TODO create a MIDI meta engine, both OSC-MIDI and RTP-MIDI can refer to
-
 #define MIDI_BOT (3.f*12.f - 0.5f - (SENSOR_N % 18 / 6.f))
 #define MIDI_RANGE (SENSOR_N/3.f)
 
 #define CHAN_MAX 16
 #define ZONE_MAX (CHAN_MAX / 2)
 
-typedef struct _zone_t zone_t;
-typedef struct _mpe_t mpe_t;
+// voice and channel allocation shared by the MIDI output engines
+
+#define MIDI_NIL 0xff
+#define MIDI_HASH_SIZE (BLOB_MAX * 2) // power of two, at most half full
+
+typedef enum _MIDI_Select MIDI_Select;
+typedef enum _MIDI_Steal MIDI_Steal;
+typedef struct _MIDI_Voice MIDI_Voice;
+typedef struct _MIDI_Zone MIDI_Zone;
+typedef struct _MIDI_Alloc MIDI_Alloc;
+
+// which free member channel of a zone a new voice gets
+enum _MIDI_Select {
+	MIDI_SELECT_ROUND_ROBIN = 0, // next free channel after the last acquired one
+	MIDI_SELECT_LEAST_RECENT // free channel released longest ago
+};
+
+// what a new voice does when all member channels of its zone are busy
+enum _MIDI_Steal {
+	MIDI_STEAL_STACK = 0, // share a busy channel, round robin
+	MIDI_STEAL_OLDEST, // turn off the oldest voice of the zone and take its channel
+	MIDI_STEAL_NONE // drop the new voice
+};
+
+struct _MIDI_Voice {
+	uint32_t sid; // 0 if unused
+	uint8_t cha;
+	uint8_t key;
+	uint8_t zone;
+	uint8_t prev; // age list of zone, oldest first
+	uint8_t next; // age list of zone or free list
+};
 
-struct _zone_t {
-	uint8_t base;
-	uint8_t span;
-	uint8_t ref;
+struct _MIDI_Zone {
+	uint8_t base; // master channel, member channels follow, same as single channel without MPE
+	uint8_t span; // number of member channels, 0 without MPE
+	uint8_t ref; // round robin position
+	uint8_t oldest; // head of age list
+	uint8_t newest; // tail of age list
+	uint8_t head; // least recently released free channel in ring
+	uint8_t count; // number of channels in ring
+	uint16_t free; // bit per member channel without voices
 };
 
-struct _mpe_t {
+struct _MIDI_Alloc {
 	uint8_t n_zones;
-	zone_t zones [ZONE_MAX];
-	int8_t channels [CHAN_MAX];
+	uint8_t select;
+	uint8_t steal;
+	uint8_t unused; // head of free voice list
+	MIDI_Zone zones [ZONE_MAX];
+	MIDI_Voice voices [BLOB_MAX];
+	uint8_t hash [MIDI_HASH_SIZE]; // sid -> voice, open addressing
+	uint8_t ring [CHAN_MAX]; // per zone rings of free member channels
+	uint8_t load [CHAN_MAX]; // number of voices per channel
 };
 
-void mpe_populate(mpe_t *mpe, uint8_t n_zones);
-uint8_t mpe_acquire(mpe_t *mpe, uint8_t zone_idx);
-void mpe_release(mpe_t *mpe, uint8_t zone_idx, uint8_t ch);
+void midi_alloc_populate(MIDI_Alloc *alloc, uint8_t n_zones, uint8_t mpe, MIDI_Select select, MIDI_Steal steal);
+MIDI_Voice *midi_voice_acquire(MIDI_Alloc *alloc, uint32_t sid, uint8_t zone_idx, uint8_t key, MIDI_Voice *stolen);
+MIDI_Voice *midi_voice_get(MIDI_Alloc *alloc, uint32_t sid);
+uint8_t midi_voice_release(MIDI_Alloc *alloc, uint32_t sid, uint8_t *key, uint8_t *cha);
 
 #endif // _MIDI_H_ 
@@ -107,6 +107,9 @@ struct _OSC_Method {
 int osc_check_path(const char *path);
 int osc_check_fmt(const char *format, int offset);
 
+int osc_check_pattern(const char *path);
+int osc_match_pattern(const char *pattern, const char *path);
+int osc_match_pattern_part(const char *pattern, size_t pattern_len, const char *part, size_t part_len);
 int osc_match_method(OSC_Method *methods, const char *path, const char *fmt);
 void osc_dispatch_method(osc_data_t *buf, size_t size, const OSC_Method *methods);
 int osc_check_message(osc_data_t *buf, size_t size);
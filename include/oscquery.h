@@ -29,6 +29,10 @@ typedef struct _OSC_Query_Node OSC_Query_Node;
 typedef struct _OSC_Query_Method OSC_Query_Method;
 typedef struct _OSC_Query_Argument OSC_Query_Argument;
 
+typedef uint_fast8_t (*OSC_Query_Match_Cb)(const OSC_Query_Item *item, const char *path, void *data);
+
+#define OSC_QUERY_PATH_MAX 64
+
 typedef enum _OSC_Query_Type {
 	OSC_QUERY_NODE,
 	OSC_QUERY_ARRAY,
@@ -84,7 +88,12 @@ struct _OSC_Query_Item {
 };
 
 const OSC_Query_Item *osc_query_find(const OSC_Query_Item *item, const char *path, int_fast8_t argc);
-void osc_query_response(char *buf, const OSC_Query_Item *item, const char *path);
+void osc_query_index(const OSC_Query_Item *root);
+const OSC_Query_Item *osc_query_lookup(const OSC_Query_Item *root, const char *path);
+uint_fast16_t osc_query_match(const OSC_Query_Item *root, const char *pattern, OSC_Query_Match_Cb cb, void *data);
+size_t osc_query_response(char *buf, size_t len, size_t offset, const OSC_Query_Item *item, const char *path);
+size_t osc_query_response_cached(char *buf, size_t len, size_t offset, const OSC_Query_Item *item, const char *path);
+void osc_query_cache_invalidate(void);
 uint_fast8_t osc_query_format(const OSC_Query_Item *item, const char *fmt);
 uint_fast8_t osc_query_check(const OSC_Query_Item *item, const char *fmt, osc_data_t *buf);
 
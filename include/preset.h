@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _PRESET_H_
+#define _PRESET_H_
+
+#include <stdint.h>
+
+#include <oscquery.h>
+#include <config.h>
+
+#define PRESET_MAX 4
+#define PRESET_NAME_LENGTH 16
+
+typedef struct _Preset Preset;
+
+// the output engine and group sections of the configuration, that make up a scene
+struct _Preset {
+	Firmware_Version version; // must match to be loadable from EEPROM
+	uint8_t valid;
+	char name [PRESET_NAME_LENGTH];
+
+	struct _dump dump;
+	struct _tuio2 tuio2;
+	struct _tuio1 tuio1;
+	struct _scsynth scsynth;
+	struct _oscmidi oscmidi;
+	struct _dummy dummy;
+	uint8_t custom_enabled; // expressions are too big to be part of a preset
+
+	CMC_Group groups [GROUP_MAX];
+	SCSynth_Group scsynth_groups [GROUP_MAX];
+	OSC_MIDI_Group oscmidi_groups [GROUP_MAX];
+};
+
+extern const OSC_Query_Item preset_tree [3];
+
+void preset_init(void);
+
+#endif // _PRESET_H_
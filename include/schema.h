@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _SCHEMA_H_
+#define _SCHEMA_H_
+
+#include <stdint.h>
+
+#include <eeprom.h>
+
+typedef struct _Config_Field Config_Field;
+
+// tagged section of a struct as stored in EEPROM
+struct _Config_Field {
+	uint8_t tag; // never reused for another section
+	uint8_t version; // bumped when the section changes other than by appending members
+	uint16_t offset; // within struct
+	uint16_t len;
+};
+
+const Config_Field *schema_field(const Config_Field *fields, uint_fast8_t n, uint8_t tag);
+
+// single pass over stored sections at addr, copies those known with the same version into bulk,
+// unknown or incompatible ones and appended members of a grown section keep their defaults
+void schema_import(EEPROM_24xx *eeprom, uint16_t addr, uint16_t size,
+	const Config_Field *stored, uint_fast8_t stored_n,
+	const Config_Field *fields, uint_fast8_t n, uint8_t *bulk);
+
+#endif // _SCHEMA_H_
@@ -26,7 +26,12 @@ extern uint8_t adc2_sequence [ADC_DUAL_LENGTH]; // analog input pins read out by
 extern uint8_t adc3_sequence [ADC_SING_LENGTH]; // analog input pins read out by the ADC3
 extern uint8_t adc_unused [ADC_UNUSED_LENGTH];
 extern uint8_t adc_order [ADC_LENGTH];
-extern const OSC_Query_Item sensors_tree [6];
+extern uint16_t sensors_rate; // update rate currently chosen by the rate governor
+extern uint_fast8_t sensors_adc_dirty; // sample time needs to be reapplied
+extern const OSC_Query_Item sensors_tree [11];
+
+void sensors_governor_reset(void);
+uint_fast8_t sensors_governor_update(uint_fast8_t awake);
 
 enum Interpolation_Mode {
 	INTERPOLATION_NONE,
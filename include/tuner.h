@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _TUNER_H_
+#define _TUNER_H_
+
+#include <stdint.h>
+
+#include <oscquery.h>
+
+// globals
+extern uint_fast8_t tuning;
+extern const OSC_Query_Item tuner_tree [4];
+
+void tuner_step(int16_t *raw12, int16_t *raw3, uint8_t *order12, uint8_t *order3);
+
+#endif // _TUNER_H_
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <string.h>
+
+#include <journal.h>
+
+// CRC-32 (IEEE 802.3), reflected, nibble-wise table
+static const uint32_t crc_table [16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+	0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+	0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t
+journal_crc(uint32_t crc, const uint8_t *ptr, uint16_t len)
+{
+	crc = ~crc;
+	while(len--)
+	{
+		crc ^= *ptr++;
+		crc = (crc >> 4) ^ crc_table[crc & 0xf];
+		crc = (crc >> 4) ^ crc_table[crc & 0xf];
+	}
+
+	return ~crc;
+}
+
+static uint32_t
+_journal_header_crc(const Journal_Header *header)
+{
+	Journal_Header tmp = *header;
+	tmp.crc = 0;
+
+	return journal_crc(0, (const uint8_t *)&tmp, sizeof(Journal_Header));
+}
+
+static inline uint16_t
+_journal_addr(Journal *journal, uint_fast8_t f)
+{
+	return journal->offset + f*journal->frame;
+}
+
+// reconstruct header of a scanned record
+static void
+_journal_header(Journal *journal, uint_fast8_t f, Journal_Header *header)
+{
+	header->magic = JOURNAL_MAGIC;
+	header->tag = journal->tag[f];
+	header->reserved = 0;
+	header->len = journal->lens[f];
+	header->reserved2 = 0;
+	header->seq = journal->seqs[f];
+	header->crc = journal->crcs[f];
+}
+
+// check CRC of a record by streaming it from EEPROM
+static void
+_journal_verify(Journal *journal, uint_fast8_t f)
+{
+	Journal_Header header;
+	uint8_t chunk [0x20];
+	uint16_t addr = _journal_addr(journal, f) + sizeof(Journal_Header);
+
+	_journal_header(journal, f, &header);
+
+	uint32_t crc = _journal_header_crc(&header);
+	uint16_t remaining = header.len;
+	while(remaining > 0)
+	{
+		uint16_t size = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+		eeprom_bulk_read(journal->eeprom, addr, chunk, size);
+		crc = journal_crc(crc, chunk, size);
+
+		addr += size;
+		remaining -= size;
+	}
+
+	journal->state[f] = crc == header.crc ? JOURNAL_STATE_VALID : JOURNAL_STATE_INVALID;
+}
+
+// frame of newest record with given tag, or -1
+static int_fast8_t
+_journal_newest(Journal *journal, uint8_t tag, uint_fast8_t verify)
+{
+	while(1)
+	{
+		int_fast8_t newest = -1;
+		uint_fast8_t f;
+
+		for(f=0; f<journal->frames; f++)
+			if( ( (journal->state[f] == JOURNAL_STATE_UNCHECKED) || (journal->state[f] == JOURNAL_STATE_VALID) )
+					&& (journal->tag[f] == tag)
+					&& ( (newest == -1) || (journal->seqs[f] > journal->seqs[newest]) ) )
+				newest = f;
+
+		if( (newest == -1) || !verify || (journal->state[newest] == JOURNAL_STATE_VALID) )
+			return newest;
+
+		_journal_verify(journal, newest); // may turn out invalid, try next older one
+	}
+}
+
+void
+journal_init(Journal *journal, EEPROM_24xx *eeprom, uint16_t offset, uint16_t size, uint16_t len)
+{
+	uint_fast8_t f;
+
+	journal->eeprom = eeprom;
+	journal->offset = offset;
+	journal->frame = JOURNAL_FRAME_SIZE(len, eeprom->page_size);
+	journal->frames = size / journal->frame;
+	if(journal->frames > JOURNAL_FRAMES_MAX)
+		journal->frames = JOURNAL_FRAMES_MAX;
+	journal->last = journal->frames - 1; // first record goes to frame 0
+	journal->seq = 0;
+
+	memset(&journal->image, 0, sizeof(EEPROM_Image)); // no hashes, header is always written
+
+	// only headers are read here, CRCs are checked lazily
+	for(f=0; f<journal->frames; f++)
+	{
+		Journal_Header header;
+		eeprom_bulk_read(eeprom, _journal_addr(journal, f), (uint8_t *)&header, sizeof(Journal_Header));
+
+		if( (header.magic == JOURNAL_MAGIC) && (header.len <= journal->frame - sizeof(Journal_Header)) )
+		{
+			journal->state[f] = JOURNAL_STATE_UNCHECKED;
+			journal->tag[f] = header.tag;
+			journal->lens[f] = header.len;
+			journal->seqs[f] = header.seq;
+			journal->crcs[f] = header.crc;
+
+			if(header.seq >= journal->seq)
+			{
+				journal->seq = header.seq;
+				journal->last = f;
+			}
+		}
+		else
+			journal->state[f] = JOURNAL_STATE_EMPTY;
+	}
+}
+
+uint_fast8_t
+journal_empty(Journal *journal)
+{
+	uint_fast8_t f;
+
+	for(f=0; f<journal->frames; f++)
+		if(journal->state[f] != JOURNAL_STATE_EMPTY)
+			return 0;
+
+	return 1;
+}
+
+uint_fast8_t
+journal_read(Journal *journal, uint8_t tag, uint8_t *data, uint16_t len)
+{
+	int_fast8_t f;
+
+	// newest record first, fall back to older ones when torn or corrupted
+	while( (f = _journal_newest(journal, tag, 0)) != -1)
+	{
+		if(journal->lens[f] == len)
+		{
+			Journal_Header header;
+			_journal_header(journal, f, &header);
+
+			// header is known from scan, a single read of the payload suffices
+			eeprom_bulk_read(journal->eeprom, _journal_addr(journal, f) + sizeof(Journal_Header), data, len);
+
+			if(journal_crc(_journal_header_crc(&header), data, len) == header.crc)
+			{
+				journal->state[f] = JOURNAL_STATE_VALID;
+				return 1;
+			}
+		}
+
+		journal->state[f] = JOURNAL_STATE_INVALID;
+	}
+
+	return 0;
+}
+
+uint_fast8_t
+journal_write(Journal *journal, uint8_t tag, uint8_t *data, uint16_t len, EEPROM_Image *image)
+{
+	uint8_t live [JOURNAL_FRAMES_MAX];
+	int_fast8_t target = -1;
+	uint_fast8_t f;
+	uint_fast8_t i;
+
+	if(len > journal->frame - sizeof(Journal_Header))
+		return 0;
+
+	if(journal->image.status == EEPROM_STATUS_PENDING) // header staging is still in use
+		eeprom_queue_flush();
+
+	// the newest valid record of each tag must survive a power loss during this write
+	memset(live, 0, sizeof(live));
+	for(f=0; f<journal->frames; f++)
+		if( (journal->state[f] == JOURNAL_STATE_UNCHECKED) || (journal->state[f] == JOURNAL_STATE_VALID) )
+		{
+			int_fast8_t newest = _journal_newest(journal, journal->tag[f], 1);
+			if(newest != -1)
+				live[newest] = 1;
+		}
+
+	// a new tag must leave a spare frame for the next write of any tag
+	uint_fast8_t n = 0;
+	uint_fast8_t own = 0;
+	for(f=0; f<journal->frames; f++)
+		if(live[f])
+		{
+			n++;
+			if(journal->tag[f] == tag)
+				own = 1;
+		}
+	if(!own && (n + 2 > journal->frames) )
+		return 0;
+
+	// rotate through frames to level wear
+	for(i=1; i<=journal->frames; i++)
+	{
+		f = (journal->last + i) % journal->frames;
+		if(!live[f])
+		{
+			target = f;
+			break;
+		}
+	}
+
+	if(target == -1) // no spare frame left, never overwrite a live record
+		return 0;
+
+	uint16_t addr = _journal_addr(journal, target);
+
+	Journal_Header *header = &journal->header;
+	header->magic = JOURNAL_MAGIC;
+	header->tag = tag;
+	header->reserved = 0;
+	header->len = len;
+	header->reserved2 = 0;
+	header->seq = journal->seq + 1;
+	header->crc = journal_crc(_journal_header_crc(header), data, len);
+
+	// a torn write of either part fails the CRC check
+	if(!eeprom_queue_push(journal->eeprom, &journal->image, addr, (uint8_t *)header, sizeof(Journal_Header)))
+		return 0;
+	if(!eeprom_queue_push(journal->eeprom, image, addr + sizeof(Journal_Header), data, len))
+		return 0;
+
+	journal->state[target] = JOURNAL_STATE_VALID;
+	journal->tag[target] = tag;
+	journal->lens[target] = len;
+	journal->seqs[target] = header->seq;
+	journal->crcs[target] = header->crc;
+	journal->seq = header->seq;
+	journal->last = target;
+
+	return 1;
+}
+
+uint_fast8_t
+journal_import(Journal *journal, uint16_t slot, uint8_t n, uint8_t *tmp, uint16_t len, EEPROM_Image *image)
+{
+	uint_fast8_t i;
+
+	// frames overlap the slots, thus read all of them before the first write
+	for(i=0; i<n; i++)
+		eeprom_bulk_read(journal->eeprom, journal->offset + i*slot, tmp + i*len, len);
+
+	for(i=0; i<n; i++)
+		if(!journal_write(journal, i, tmp + i*len, len, image))
+			break;
+
+	eeprom_queue_flush(); // tmp must stay valid until written
+
+	return i == n;
+}
@@ -355,7 +355,10 @@ _serialize_PTR_arpa(uint8_t *buf, uint16_t rclass, uint32_t ttl)
 static void
 _hook_services(DNS_Query *query)
 {
-	uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+	if(!base)
+		return;
+	uint8_t *head = BUF_R_OFFSET(base);
 	uint8_t *tail = head;
 	uint16_t rclass = MDNS_CLASS_FLUSH | MDNS_CLASS_INET;
 	uint32_t ttl = MDNS_TTL_75MIN;
@@ -369,13 +372,17 @@ _hook_services(DNS_Query *query)
 	tail = _serialize_SRV_instance(tail, rclass, ttl);
 	tail = _serialize_A_instance(tail, rclass, ttl);
 
-	udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+	udp_send(config.mdns.socket.sock, base, tail-head);
+	buf_r_release(base);
 }
 
 static void
 _hook_osc(DNS_Query *query)
 {
-	uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+	if(!base)
+		return;
+	uint8_t *head = BUF_R_OFFSET(base);
 	uint8_t *tail = head;
 	uint16_t rclass = MDNS_CLASS_FLUSH | MDNS_CLASS_INET;
 	uint32_t ttl = MDNS_TTL_75MIN;
@@ -388,13 +395,17 @@ _hook_osc(DNS_Query *query)
 	tail = _serialize_SRV_instance(tail, rclass, ttl);
 	tail = _serialize_A_instance(tail, rclass, ttl);
 
-	udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+	udp_send(config.mdns.socket.sock, base, tail-head);
+	buf_r_release(base);
 }
 
 static void
 _hook_instance(DNS_Query *query)
 {
-	uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+	if(!base)
+		return;
+	uint8_t *head = BUF_R_OFFSET(base);
 	uint8_t *tail = head;
 	uint16_t rclass = MDNS_CLASS_FLUSH | MDNS_CLASS_INET;
 	uint32_t ttl = MDNS_TTL_75MIN;
@@ -406,13 +417,17 @@ _hook_instance(DNS_Query *query)
 	tail = _serialize_SRV_instance(tail, rclass, ttl);
 	tail = _serialize_A_instance(tail, rclass, ttl);
 
-	udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+	udp_send(config.mdns.socket.sock, base, tail-head);
+	buf_r_release(base);
 }
 
 static void
 _hook_arpa(DNS_Query *query)
 {
-	uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+	if(!base)
+		return;
+	uint8_t *head = BUF_R_OFFSET(base);
 	uint8_t *tail = head;
 	uint16_t rclass = MDNS_CLASS_FLUSH | MDNS_CLASS_INET;
 	uint32_t ttl = MDNS_TTL_75MIN;
@@ -420,7 +435,8 @@ _hook_arpa(DNS_Query *query)
 	tail = _serialize_query(tail, query->ID, MDNS_FLAGS_QR | MDNS_FLAGS_AA, 0, 1, 0, 0);
 	tail = _serialize_PTR_arpa(tail, rclass, ttl);
 
-	udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+	udp_send(config.mdns.socket.sock, base, tail-head);
+	buf_r_release(base);
 }
 
 static uint16_t
@@ -551,17 +567,22 @@ _dns_question(DNS_Query *query, uint8_t *buf)
 			// reply with current IP when there is a request for our name
 			if(!strncmp(hook_self, qname, len_self))
 			{
-				uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
-				uint8_t *tail = head;
-
-				tail = _serialize_query(tail, query->ID, MDNS_FLAGS_QR | MDNS_FLAGS_AA, 0, 1, 0, 0);
-				//FIXME append negative response for IPv6 via NSEC record
-				tail = _serialize_answer(tail, hook_self, MDNS_TYPE_A, MDNS_CLASS_FLUSH | MDNS_CLASS_INET, MDNS_TTL_75MIN, 4);
-
-				memcpy(tail, config.comm.ip, 4);
-				tail += 4;
-
-				udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+				uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+				if(base)
+				{
+					uint8_t *head = BUF_R_OFFSET(base);
+					uint8_t *tail = head;
+
+					tail = _serialize_query(tail, query->ID, MDNS_FLAGS_QR | MDNS_FLAGS_AA, 0, 1, 0, 0);
+					//FIXME append negative response for IPv6 via NSEC record
+					tail = _serialize_answer(tail, hook_self, MDNS_TYPE_A, MDNS_CLASS_FLUSH | MDNS_CLASS_INET, MDNS_TTL_75MIN, 4);
+
+					memcpy(tail, config.comm.ip, 4);
+					tail += 4;
+
+					udp_send(config.mdns.socket.sock, base, tail-head);
+					buf_r_release(base);
+				}
 			}
 		}
 
@@ -685,14 +706,18 @@ void mdns_probe()
 	int i;
 	for(i=0; i<3; i++)
 	{
-		uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+		uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+		if(!base)
+			return;
+		uint8_t *head = BUF_R_OFFSET(base);
 		uint8_t *tail = head;
 		
 		uint16_t id = rand() & 0xffff;
 		tail = _serialize_query(tail, id, MDNS_FLAGS_AA, 0, 1, 0, 0);
 		tail = _serialize_question(tail, hook_self, MDNS_TYPE_ANY, MDNS_CLASS_INET);
 		
-		udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+		udp_send(config.mdns.socket.sock, base, tail-head);
+		buf_r_release(base);
 
 		// wait 250ms second
 		uint32_t tick = systick_uptime();
@@ -714,7 +739,10 @@ _mdns_tell(int count, uint16_t rclass, uint32_t ttl)
 	int i;
 	for(i=0; i<count; i++)
 	{
-		uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+		uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+		if(!base)
+			return;
+		uint8_t *head = BUF_R_OFFSET(base);
 		uint8_t *tail = head;
 		
 		uint16_t id = rand() & 0xffff;
@@ -731,7 +759,8 @@ _mdns_tell(int count, uint16_t rclass, uint32_t ttl)
 		tail = _serialize_SRV_instance(tail, rclass, ttl);
 		tail = _serialize_A_instance(tail, rclass, ttl);
 		
-		udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+		udp_send(config.mdns.socket.sock, base, tail-head);
+		buf_r_release(base);
 
 		if(i == count-1)
 			break;
@@ -803,14 +832,21 @@ mdns_resolve(const char *name, mDNS_Resolve_Cb cb, void *data)
 	resolve.data = data;
 
 	// serialize and send mDNS name request
-	uint8_t *head = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_MDNS);
+	if(!base)
+	{
+		resolve.cb = NULL;
+		return 0;
+	}
+	uint8_t *head = BUF_R_OFFSET(base);
 	uint8_t *tail = head;
 
 	uint16_t id = rand() & 0xffff;
 	tail = _serialize_query(tail, id, 0, 1, 0, 0, 0);
 	tail = _serialize_question(tail, resolve.name, MDNS_TYPE_A, MDNS_CLASS_INET);
 	
-	udp_send(config.mdns.socket.sock, BUF_O_BASE(buf_o_ptr), tail-head);
+	udp_send(config.mdns.socket.sock, base, tail-head);
+	buf_r_release(base);
 
 	// start timer for timeout
 	timer_pause(mdns_timer);
@@ -15,125 +15,283 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+
+#include <stddef.h>
+
 #include <chimaera.h>
 #include <midi.h>
 
-inline void
-midi_add_key(MIDI_Hash *hash, uint32_t sid, uint8_t key, uint8_t cha)
+static inline uint8_t *
+_midi_hash_slot(MIDI_Alloc *alloc, uint32_t sid)
 {
-	uint_fast8_t k;
-	for(k=0; k<BLOB_MAX; k++)
-		if(hash[k].sid == 0)
-		{
-			hash[k].sid = sid;
-			hash[k].key = key;
-			hash[k].cha = cha;
+	uint_fast8_t h = sid & (MIDI_HASH_SIZE - 1);
+
+	while( (alloc->hash[h] != MIDI_NIL) && (alloc->voices[alloc->hash[h]].sid != sid) )
+		h = (h + 1) & (MIDI_HASH_SIZE - 1);
+
+	return &alloc->hash[h];
+}
+
+// remove with backward shift, keeps probe sequences free of tombstones
+static inline void
+_midi_hash_remove(MIDI_Alloc *alloc, uint8_t *slot)
+{
+	uint_fast8_t i = slot - alloc->hash;
+	uint_fast8_t j = i;
 
+	while(1)
+	{
+		j = (j + 1) & (MIDI_HASH_SIZE - 1);
+		if(alloc->hash[j] == MIDI_NIL)
 			break;
+
+		uint_fast8_t h = alloc->voices[alloc->hash[j]].sid & (MIDI_HASH_SIZE - 1);
+		// move entry j into the gap unless its home lies cyclically in (i, j]
+		if( ( (j - h) & (MIDI_HASH_SIZE - 1) ) >= ( (j - i) & (MIDI_HASH_SIZE - 1) ) )
+		{
+			alloc->hash[i] = alloc->hash[j];
+			i = j;
 		}
+	}
+
+	alloc->hash[i] = MIDI_NIL;
 }
 
-inline uint8_t
-midi_get_key(MIDI_Hash *hash, uint32_t sid, uint8_t *key, uint8_t *ch)
+static inline void
+_midi_age_append(MIDI_Alloc *alloc, MIDI_Zone *zone, uint_fast8_t v)
 {
-	uint_fast8_t k;
-	for(k=0; k<BLOB_MAX; k++)
-		if(hash[k].sid == sid)
-		{
-			*key = hash[k].key;
-			*ch = hash[k].cha;
+	MIDI_Voice *voice = &alloc->voices[v];
 
-			return 0; // success
-		}
-	return 1; // not found
+	voice->prev = zone->newest;
+	voice->next = MIDI_NIL;
+	if(zone->newest != MIDI_NIL)
+		alloc->voices[zone->newest].next = v;
+	else
+		zone->oldest = v;
+	zone->newest = v;
 }
 
-inline uint8_t
-midi_rem_key(MIDI_Hash *hash, uint32_t sid, uint8_t *key, uint8_t *ch)
+static inline void
+_midi_age_remove(MIDI_Alloc *alloc, MIDI_Zone *zone, uint_fast8_t v)
 {
-	uint_fast8_t k;
-	for(k=0; k<BLOB_MAX; k++)
-		if(hash[k].sid == sid)
-		{
-			hash[k].sid = 0;
-			*key = hash[k].key;
-			*ch = hash[k].cha;
+	MIDI_Voice *voice = &alloc->voices[v];
 
-			return 0; // success
-		}
-	return 1; // not found
+	if(voice->prev != MIDI_NIL)
+		alloc->voices[voice->prev].next = voice->next;
+	else
+		zone->oldest = voice->next;
+	if(voice->next != MIDI_NIL)
+		alloc->voices[voice->next].prev = voice->prev;
+	else
+		zone->newest = voice->prev;
+}
+
+// first free member channel at or after the round robin position
+static inline uint_fast8_t
+_midi_free_next(MIDI_Zone *zone)
+{
+	uint32_t mask = ( (uint32_t)zone->free << zone->span) | zone->free;
+	uint_fast8_t pos = zone->ref + __builtin_ctz(mask >> zone->ref);
+
+	return pos >= zone->span ? pos - zone->span : pos;
+}
+
+static inline void
+_midi_chan_take(MIDI_Alloc *alloc, MIDI_Zone *zone, uint_fast8_t ch)
+{
+	if(alloc->load[ch]++ || !zone->span)
+		return;
+
+	uint_fast8_t pos = ch - zone->base - 1;
+	zone->free &= ~(1U << pos);
+
+	if(alloc->select == MIDI_SELECT_LEAST_RECENT)
+	{
+		// channel is taken from the head of the ring
+		zone->head = zone->head + 1 == zone->span ? 0 : zone->head + 1;
+		zone->count--;
+	}
 }
 
-inline void
-mpe_populate(mpe_t *mpe, uint8_t n_zones)
+static inline void
+_midi_chan_give(MIDI_Alloc *alloc, MIDI_Zone *zone, uint_fast8_t ch)
 {
-	n_zones %= ZONE_MAX + 1; // wrap around if n_zones > ZONE_MAX
-	int8_t rem = CHAN_MAX % n_zones;
-	const uint8_t span = (CHAN_MAX - rem) / n_zones - 1;
-	uint8_t ptr = 0;
-
-	mpe->n_zones = n_zones;
-	zone_t *zones = mpe->zones;
-	int8_t *channels = mpe->channels;
-
-	for(uint8_t i=0;
-		i<n_zones;
-		rem--, ptr += 1 + zones[i++].span)
+	if(--alloc->load[ch] || !zone->span)
+		return;
+
+	uint_fast8_t pos = ch - zone->base - 1;
+	zone->free |= 1U << pos;
+
+	if(alloc->select == MIDI_SELECT_LEAST_RECENT)
 	{
-		zones[i].base = ptr;
-		zones[i].ref = 0;
-		zones[i].span = span;
-		if(rem > 0)
-			zones[i].span += 1;
+		uint_fast8_t tail = zone->head + zone->count++;
+		if(tail >= zone->span)
+			tail -= zone->span;
+		alloc->ring[zone->base + 1 + tail] = ch;
 	}
+}
+
+static inline void
+_midi_voice_free(MIDI_Alloc *alloc, uint8_t *slot)
+{
+	uint_fast8_t v = *slot;
+	MIDI_Voice *voice = &alloc->voices[v];
+	MIDI_Zone *zone = &alloc->zones[voice->zone];
+
+	_midi_hash_remove(alloc, slot);
+	_midi_age_remove(alloc, zone, v);
+	_midi_chan_give(alloc, zone, voice->cha);
 
-	for(uint8_t i=0; i<CHAN_MAX; i++)
-		channels[i] = 0;
+	voice->sid = 0;
+	voice->next = alloc->unused;
+	alloc->unused = v;
 }
 
-inline uint8_t
-mpe_acquire(mpe_t *mpe, uint8_t zone_idx)
+void
+midi_alloc_populate(MIDI_Alloc *alloc, uint8_t n_zones, uint8_t mpe, MIDI_Select select, MIDI_Steal steal)
 {
-	zone_idx %= mpe->n_zones; // wrap around if zone_idx > n_zones
-	zone_t *zone = &mpe->zones[zone_idx];
-	int8_t *channels = mpe->channels;
-
-	int8_t min = INT8_MAX;
-	uint8_t pos = zone->ref; // start search at current channel
-	const uint8_t base_1 = zone->base + 1;
-	for(uint8_t i = zone->ref; i < zone->ref + zone->span; i++)
+	uint_fast8_t i;
+
+	alloc->select = select;
+	alloc->steal = steal;
+
+	if(mpe)
+	{
+		n_zones %= ZONE_MAX + 1; // wrap around if n_zones > ZONE_MAX
+		int8_t rem = CHAN_MAX % n_zones;
+		const uint8_t span = (CHAN_MAX - rem) / n_zones - 1;
+		uint8_t ptr = 0;
+
+		for(i=0; i<n_zones; rem--, ptr += 1 + alloc->zones[i++].span)
+		{
+			alloc->zones[i].base = ptr;
+			alloc->zones[i].span = span;
+			if(rem > 0)
+				alloc->zones[i].span += 1;
+		}
+	}
+	else // one channel per group
 	{
-		const uint8_t ch = base_1 + (i % zone->span); // wrap to [0..span]
-		if(channels[ch] < min) // check for less occupation
+		n_zones = ZONE_MAX;
+		for(i=0; i<n_zones; i++)
 		{
-			min = channels[ch]; // lower minimum
-			pos = i; // set new minimally occupied channel
+			alloc->zones[i].base = i;
+			alloc->zones[i].span = 0;
 		}
 	}
+	alloc->n_zones = n_zones;
 
-	const uint8_t ch = base_1 + (pos % zone->span); // wrap to [0..span]
-	if(channels[ch] <= 0) // off since long
-		channels[ch] = 1;
-	else
-		channels[ch] += 1; // increase occupation
-	zone->ref = (pos + 1) % zone->span; // start next search from next channel
+	for(i=0; i<n_zones; i++)
+	{
+		MIDI_Zone *zone = &alloc->zones[i];
+		uint_fast8_t j;
 
-	return ch;
+		zone->ref = 0;
+		zone->oldest = MIDI_NIL;
+		zone->newest = MIDI_NIL;
+		zone->head = 0;
+		zone->count = zone->span;
+		zone->free = (1U << zone->span) - 1;
+		for(j=0; j<zone->span; j++)
+			alloc->ring[zone->base + 1 + j] = zone->base + 1 + j;
+	}
+
+	for(i=0; i<CHAN_MAX; i++)
+		alloc->load[i] = 0;
+
+	for(i=0; i<MIDI_HASH_SIZE; i++)
+		alloc->hash[i] = MIDI_NIL;
+
+	for(i=0; i<BLOB_MAX; i++)
+	{
+		alloc->voices[i].sid = 0;
+		alloc->voices[i].next = i + 1 < BLOB_MAX ? i + 1 : MIDI_NIL;
+	}
+	alloc->unused = 0;
 }
 
-inline void
-mpe_release(mpe_t *mpe, uint8_t zone_idx, uint8_t ch)
+MIDI_Voice *
+midi_voice_acquire(MIDI_Alloc *alloc, uint32_t sid, uint8_t zone_idx, uint8_t key, MIDI_Voice *stolen)
 {
-	zone_idx %= mpe->n_zones; // wrap around if zone_idx > n_zones
-	ch %= CHAN_MAX; // wrap around if ch > CHAN_MAX
-	zone_t *zone = &mpe->zones[zone_idx];
-	int8_t *channels = mpe->channels;
+	zone_idx %= alloc->n_zones; // wrap around if zone_idx > n_zones
+	MIDI_Zone *zone = &alloc->zones[zone_idx];
+	uint8_t *slot = _midi_hash_slot(alloc, sid);
+	uint_fast8_t ch;
 
-	const uint8_t base_1 = zone->base + 1;
-	for(uint8_t i = base_1; i < base_1 + zone->span; i++)
+	stolen->sid = 0;
+
+	if(*slot != MIDI_NIL) // missed release of previous use of sid
+		_midi_voice_free(alloc, slot);
+
+	if(!zone->span)
+		ch = zone->base;
+	else if(zone->free)
 	{
-		if( (i == ch) || (channels[i] <= 0) )
-			channels[i] -= 1;
-		// do not decrease occupied channels
+		if(alloc->select == MIDI_SELECT_LEAST_RECENT)
+			ch = alloc->ring[zone->base + 1 + zone->head];
+		else
+		{
+			uint_fast8_t pos = _midi_free_next(zone);
+			zone->ref = pos + 1 == zone->span ? 0 : pos + 1;
+			ch = zone->base + 1 + pos;
+		}
 	}
+	else if(alloc->steal == MIDI_STEAL_OLDEST)
+	{
+		*stolen = alloc->voices[zone->oldest];
+		_midi_voice_free(alloc, _midi_hash_slot(alloc, stolen->sid));
+		ch = stolen->cha; // is free again
+		if(alloc->select == MIDI_SELECT_ROUND_ROBIN)
+			zone->ref = ch - zone->base == zone->span ? 0 : ch - zone->base;
+	}
+	else if(alloc->steal == MIDI_STEAL_STACK)
+	{
+		ch = zone->base + 1 + zone->ref;
+		zone->ref = zone->ref + 1 == zone->span ? 0 : zone->ref + 1;
+	}
+	else // MIDI_STEAL_NONE
+		return NULL;
+
+	// slot may have moved while freeing
+	slot = _midi_hash_slot(alloc, sid);
+
+	uint_fast8_t v = alloc->unused;
+	if(v == MIDI_NIL) // more voices than blobs
+		return NULL;
+	MIDI_Voice *voice = &alloc->voices[v];
+	alloc->unused = voice->next;
+
+	voice->sid = sid;
+	voice->cha = ch;
+	voice->key = key;
+	voice->zone = zone_idx;
+	*slot = v;
+	_midi_age_append(alloc, zone, v);
+	_midi_chan_take(alloc, zone, ch);
+
+	return voice;
+}
+
+MIDI_Voice *
+midi_voice_get(MIDI_Alloc *alloc, uint32_t sid)
+{
+	uint8_t *slot = _midi_hash_slot(alloc, sid);
+
+	return *slot != MIDI_NIL ? &alloc->voices[*slot] : NULL;
+}
+
+uint8_t
+midi_voice_release(MIDI_Alloc *alloc, uint32_t sid, uint8_t *key, uint8_t *cha)
+{
+	uint8_t *slot = _midi_hash_slot(alloc, sid);
+
+	if(*slot == MIDI_NIL)
+		return 1; // not found, e.g. dropped or stolen
+
+	MIDI_Voice *voice = &alloc->voices[*slot];
+	*key = voice->key;
+	*cha = voice->cha;
+	_midi_voice_free(alloc, slot);
+
+	return 0; // success
 }
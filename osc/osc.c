@@ -72,12 +72,138 @@ osc_check_fmt(const char *format, int offset)
 	return 1;
 }
 
+// is path an OSC address pattern?
+int
+osc_check_pattern(const char *path)
+{
+	return strpbrk(path, "*?[{") != NULL;
+}
+
+// match address pattern range [p, pe) against address range [s, se), wildcards do not cross '/'
+static int
+_osc_pattern_match(const char *p, const char *pe, const char *s, const char *se)
+{
+	while(p < pe)
+	{
+		switch(*p)
+		{
+			case '?':
+			{
+				if( (s == se) || (*s == '/') )
+					return 0;
+				p++;
+				s++;
+				break;
+			}
+			case '*':
+			{
+				while( (p < pe) && (*p == '*') )
+					p++;
+				for( ; ; s++)
+				{
+					if(_osc_pattern_match(p, pe, s, se))
+						return 1;
+					if( (s == se) || (*s == '/') )
+						return 0;
+				}
+			}
+			case '[':
+			{
+				if( (s == se) || (*s == '/') )
+					return 0;
+				p++;
+				int negate = 0;
+				int hit = 0;
+				if( (p < pe) && (*p == '!') )
+				{
+					negate = 1;
+					p++;
+				}
+				while( (p < pe) && (*p != ']') )
+				{
+					if( (p+2 < pe) && (p[1] == '-') && (p[2] != ']') ) // range
+					{
+						if( (*s >= p[0]) && (*s <= p[2]) )
+							hit = 1;
+						p += 3;
+					}
+					else // single character
+					{
+						if(*s == *p)
+							hit = 1;
+						p++;
+					}
+				}
+				if(p == pe) // unterminated
+					return 0;
+				if(hit == negate)
+					return 0;
+				p++;
+				s++;
+				break;
+			}
+			case '{':
+			{
+				const char *close = memchr(p, '}', pe - p);
+				if(!close) // unterminated
+					return 0;
+				const char *alt = p + 1;
+				while(alt <= close)
+				{
+					const char *sep = alt;
+					while( (sep < close) && (*sep != ',') )
+						sep++;
+					size_t len = sep - alt;
+					if( (len <= (size_t)(se - s)) && !strncmp(alt, s, len)
+							&& _osc_pattern_match(close + 1, pe, s + len, se) )
+						return 1;
+					alt = sep + 1;
+				}
+				return 0;
+			}
+			default:
+			{
+				if( (s == se) || (*s != *p) )
+					return 0;
+				p++;
+				s++;
+				break;
+			}
+		}
+	}
+
+	return s == se;
+}
+
+// match whole OSC address pattern against an address
+int
+osc_match_pattern(const char *pattern, const char *path)
+{
+	return _osc_pattern_match(pattern, pattern + strlen(pattern), path, path + strlen(path));
+}
+
+// match a single component of an OSC address pattern against an address component
+int
+osc_match_pattern_part(const char *pattern, size_t pattern_len, const char *part, size_t part_len)
+{
+	return _osc_pattern_match(pattern, pattern + pattern_len, part, part + part_len);
+}
+
+static inline int
+_osc_match_path(const char *meth_path, const char *path, int pattern)
+{
+	if(!meth_path) // wildcard method
+		return 1;
+	return pattern ? osc_match_pattern(path, meth_path) : !strcmp(meth_path, path);
+}
+
 int
 osc_match_method(OSC_Method *methods, const char *path, const char *fmt)
 {
 	OSC_Method *meth;
+	int pattern = osc_check_pattern(path);
 	for(meth=methods; meth->cb; meth++)
-		if( (!meth->path || !strcmp(meth->path, path)) && (!meth->fmt || !strcmp(meth->fmt, fmt+1)) )
+		if(_osc_match_path(meth->path, path, pattern) && (!meth->fmt || !strcmp(meth->fmt, fmt+1)) )
 			return 1;
 	return 0;
 }
@@ -94,11 +220,16 @@ _osc_dispatch_method_message(osc_data_t *buf, size_t size, const OSC_Method *met
 	ptr = osc_get_path(ptr, &path);
 	ptr = osc_get_fmt(ptr, &fmt);
 
+	int pattern = osc_check_pattern(path);
 	const OSC_Method *meth;
 	for(meth=methods; meth->cb; meth++)
-		if( (!meth->path || !strcmp(meth->path, path)) && (!meth->fmt || !strcmp(meth->fmt, fmt+1)) )
-			if(meth->cb(path, fmt+1, strlen(fmt)-1, ptr))
+		if(_osc_match_path(meth->path, path, pattern) && (!meth->fmt || !strcmp(meth->fmt, fmt+1)) )
+		{
+			// wildcard methods receive the pattern itself, concrete ones their own path
+			const char *meth_path = pattern && meth->path ? meth->path : path;
+			if(meth->cb(meth_path, fmt+1, strlen(fmt)-1, ptr) && !pattern) // patterns fan out to all matches
 				break;
+		}
 }
 
 static void
@@ -22,6 +22,7 @@
 #include <config.h>
 #include <midi.h>
 #include <oscmidi.h>
+#include <rtpmidi.h>
 
 OSC_MIDI_Group *oscmidi_groups = config.oscmidi_groups;
 
@@ -48,8 +49,33 @@ static const char *oscmidi_fmt_1 [] = {
 	[OSC_MIDI_FORMAT_BLOB] = "b"
 };
 
-static MIDI_Hash oscmidi_hash [BLOB_MAX];
-static mpe_t mpe;
+static MIDI_Alloc alloc;
+
+#define OSCMIDI_EVENT_MAX (BLOB_MAX * 5) // stolen note off, note on, pitch bend, 2 controllers
+#define OSCMIDI_UNKNOWN 0xff
+
+typedef struct _OSC_MIDI_Event OSC_MIDI_Event;
+typedef struct _OSC_MIDI_Cache OSC_MIDI_Cache;
+
+struct _OSC_MIDI_Event {
+	uint8_t status; // with channel
+	uint8_t dat1;
+	uint8_t dat2;
+};
+
+// last controller values sent per channel, OSCMIDI_UNKNOWN if not sent yet
+struct _OSC_MIDI_Cache {
+	uint8_t bend [2];
+	uint8_t pressure;
+	uint8_t poly [2]; // key, value
+	uint8_t control [2][2]; // controller, value for MSB and LSB
+};
+
+static uint_fast8_t coalesce = 0;
+static OSC_MIDI_Event events [OSCMIDI_EVENT_MAX];
+static uint_fast8_t events_n = 0;
+static OSC_MIDI_Cache cache [CHAN_MAX];
+static char coalesce_fmt [OSCMIDI_EVENT_MAX + 1];
 
 static osc_data_t *pack;
 static osc_data_t *bndl;
@@ -69,11 +95,144 @@ oscmidi_init(void)
 			mul[i] = (float)0x1fff / group->range;
 	}
 
-	// populate mpe struct
-	mpe_populate(&mpe, cmc_groups_n);
+	// populate zones and voices
+	midi_alloc_populate(&alloc, cmc_groups_n, config.oscmidi.mpe,
+		config.oscmidi.allocation, config.oscmidi.stealing);
 
 	// only update zones when mpe is activated
 	update_zones = config.oscmidi.mpe;
+
+	// receivers may have been reset, too
+	memset(cache, OSCMIDI_UNKNOWN, sizeof(cache));
+}
+
+// queue event until end of frame, drop controller values the receiver already has
+static void
+oscmidi_enqueue(uint8_t channel, uint8_t status, uint8_t dat1, uint8_t dat2)
+{
+	OSC_MIDI_Cache *c = &cache[channel];
+	uint8_t *val;
+
+	if(events_n == OSCMIDI_EVENT_MAX)
+		return;
+
+	switch(status)
+	{
+		case MIDI_STATUS_PITCH_BEND:
+			val = c->bend;
+			break;
+		case MIDI_STATUS_CHANNEL_PRESSURE:
+			if(c->pressure == dat1)
+				return;
+			c->pressure = dat1;
+			val = NULL;
+			break;
+		case MIDI_STATUS_NOTE_PRESSURE:
+			val = c->poly;
+			break;
+		case MIDI_STATUS_CONTROL_CHANGE:
+			val = c->control[dat1 & MIDI_LSV ? 1 : 0];
+			break;
+		default: // notes are never dropped
+			val = NULL;
+			break;
+	}
+
+	if(val)
+	{
+		if( (val[0] == dat1) && (val[1] == dat2) )
+			return;
+		val[0] = dat1;
+		val[1] = dat2;
+	}
+
+	events[events_n++] = (OSC_MIDI_Event){channel | status, dat1, dat2};
+}
+
+// serialize queued events of frame grouped by channel into a single message,
+// a blob with running status or one midi or int32 argument per event
+static osc_data_t *
+oscmidi_flush(osc_data_t *buf, osc_data_t *end)
+{
+	osc_data_t *buf_ptr = buf;
+	osc_data_t *itm = NULL;
+	OSC_MIDI_Format format = config.oscmidi.format;
+	uint8_t count [CHAN_MAX + 1];
+	uint8_t order [OSCMIDI_EVENT_MAX];
+	uint_fast8_t i;
+
+	// stable counting sort by channel
+	memset(count, 0, sizeof(count));
+	for(i=0; i<events_n; i++)
+		count[(events[i].status & 0x0f) + 1]++;
+	for(i=0; i<CHAN_MAX; i++)
+		count[i + 1] += count[i];
+	for(i=0; i<events_n; i++)
+		order[count[events[i].status & 0x0f]++] = i;
+
+	buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
+	buf_ptr = osc_set_path(buf_ptr, end, config.oscmidi.path);
+
+	if(format == OSC_MIDI_FORMAT_BLOB)
+	{
+		uint8_t stream [OSCMIDI_EVENT_MAX * 3];
+		uint8_t *ptr = stream;
+		uint8_t running = 0;
+
+		for(i=0; i<events_n; i++)
+		{
+			const OSC_MIDI_Event *ev = &events[order[i]];
+			uint8_t status = ev->status;
+			uint8_t dat2 = ev->dat2;
+
+			if( (status & 0xf0) == MIDI_STATUS_NOTE_OFF) // note on with zero velocity keeps running status
+			{
+				status = MIDI_STATUS_NOTE_ON | (status & 0x0f);
+				dat2 = 0x0;
+			}
+
+			if(status != running)
+				*ptr++ = running = status;
+			*ptr++ = ev->dat1;
+			if( (status & 0xf0) != MIDI_STATUS_CHANNEL_PRESSURE)
+				*ptr++ = dat2;
+		}
+
+		buf_ptr = osc_set_fmt(buf_ptr, end, oscmidi_fmt_1[format]);
+		buf_ptr = osc_set_blob(buf_ptr, end, ptr - stream, stream);
+	}
+	else // OSC_MIDI_FORMAT_MIDI || OSC_MIDI_FORMAT_INT32
+	{
+		memset(coalesce_fmt, oscmidi_fmt_1[format][0], events_n);
+		coalesce_fmt[events_n] = '\0';
+		buf_ptr = osc_set_fmt(buf_ptr, end, coalesce_fmt);
+
+		for(i=0; i<events_n; i++)
+		{
+			const OSC_MIDI_Event *ev = &events[order[i]];
+
+			if(format == OSC_MIDI_FORMAT_MIDI)
+			{
+				uint8_t *M;
+				buf_ptr = osc_set_midi_inline(buf_ptr, end, &M);
+				if(buf_ptr)
+				{
+					M[0] = 0;
+					M[1] = ev->status;
+					M[2] = ev->dat1;
+					M[3] = ev->dat2;
+				}
+			}
+			else
+				buf_ptr = osc_set_int32(buf_ptr, end, (ev->dat2 << 16) | (ev->dat1 << 8) | ev->status);
+		}
+	}
+
+	buf_ptr = osc_end_bundle_item(buf_ptr, end, itm);
+
+	events_n = 0;
+
+	return buf_ptr;
 }
 
 static osc_data_t *
@@ -83,6 +242,12 @@ oscmidi_serialize(osc_data_t *buf, osc_data_t *end, OSC_MIDI_Format format, uint
 	osc_data_t *itm = NULL;
 	uint_fast8_t multi = config.oscmidi.multi;
 
+	if(coalesce)
+	{
+		oscmidi_enqueue(channel, status, dat1, dat2);
+		return buf_ptr;
+	}
+
 	if(!multi)
 	{
 		buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
@@ -131,6 +296,29 @@ oscmidi_serialize(osc_data_t *buf, osc_data_t *end, OSC_MIDI_Format format, uint
 	return buf_ptr;
 }
 
+static osc_data_t *
+oscmidi_note_off(osc_data_t *buf, osc_data_t *end, uint8_t ch, uint8_t key)
+{
+	osc_data_t *buf_ptr = buf;
+	osc_data_t *itm = NULL;
+	OSC_MIDI_Format format = config.oscmidi.format;
+	uint_fast8_t multi = config.oscmidi.multi && !coalesce;
+
+	if(multi)
+	{
+		buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
+		buf_ptr = osc_set_path(buf_ptr, end, config.oscmidi.path);
+		buf_ptr = osc_set_fmt(buf_ptr, end, oscmidi_fmt_1[format]);
+	}
+
+	buf_ptr = oscmidi_serialize(buf_ptr, end, format, ch, MIDI_STATUS_NOTE_OFF, key, 0x7f);
+
+	if(multi)
+		buf_ptr = osc_end_bundle_item(buf_ptr, end, itm);
+
+	return buf_ptr;
+}
+
 static osc_data_t *
 oscmidi_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 {
@@ -140,6 +328,10 @@ oscmidi_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 		buf_ptr = osc_start_bundle_item(buf_ptr, end, &pack);
 	buf_ptr = osc_start_bundle(buf_ptr, end, fev->offset, &bndl);
 
+	// zone definitions are sent as is
+	uint_fast8_t coalesced = coalesce;
+	coalesce = 0;
+
 	if(update_zones)
 	{
 		OSC_MIDI_Format format = config.oscmidi.format;
@@ -155,7 +347,7 @@ oscmidi_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 				buf_ptr = osc_set_fmt(buf_ptr, end, "mmmmmm");
 			}
 
-			const zone_t *zone = &mpe.zones[z];
+			const MIDI_Zone *zone = &alloc.zones[z];
 
 			// define zone span
 			buf_ptr = oscmidi_serialize(buf_ptr, end, format, zone->base, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_RPN_LSB, 0x6);
@@ -175,6 +367,11 @@ oscmidi_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 		update_zones = 0;
 	}
 
+	// receivers' state is unknown after uncoalesced frames
+	if(config.oscmidi.coalesce && !coalesced)
+		memset(cache, OSCMIDI_UNKNOWN, sizeof(cache));
+	coalesce = config.oscmidi.coalesce;
+
 	return buf_ptr;
 }
 
@@ -184,6 +381,9 @@ oscmidi_engine_end_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
 	(void)fev;
 	osc_data_t *buf_ptr = buf;
 
+	if(coalesce && events_n)
+		buf_ptr = oscmidi_flush(buf_ptr, end);
+
 	buf_ptr = osc_end_bundle(buf_ptr, end, bndl);
 	if(cmc_engines_active + config.dump.enabled > 1)
 		buf_ptr = osc_end_bundle_item(buf_ptr, end, pack);
@@ -197,11 +397,21 @@ oscmidi_engine_on_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm = NULL;
 	OSC_MIDI_Format format = config.oscmidi.format;
-	uint_fast8_t multi = config.oscmidi.multi;
-	uint_fast8_t use_mpe = config.oscmidi.mpe;
+	uint_fast8_t multi = config.oscmidi.multi && !coalesce;
 	OSC_MIDI_Group *group = &oscmidi_groups[bev->gid];
 	OSC_MIDI_Mapping mapping = group->mapping;
 
+	float X = group->offset + bev->x*group->range;
+	uint8_t key = floor(X);
+	MIDI_Voice stolen;
+	MIDI_Voice *voice = midi_voice_acquire(&alloc, bev->sid, bev->gid, key, &stolen);
+
+	if(stolen.sid) // all channels of zone busy
+		buf_ptr = oscmidi_note_off(buf_ptr, end, stolen.cha, stolen.key);
+	if(!voice) // dropped
+		return buf_ptr;
+	uint8_t ch = voice->cha;
+
 	if(multi)
 	{
 		buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
@@ -212,15 +422,6 @@ oscmidi_engine_on_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 			buf_ptr = osc_set_fmt(buf_ptr, end, oscmidi_fmt_3[format]);
 	}
 
-	uint8_t ch;
-	if(use_mpe)
-		ch = mpe_acquire(&mpe, bev->gid);
-	else
-		ch = bev->gid;
-	float X = group->offset + bev->x*group->range;
-	uint8_t key = floor(X);
-	midi_add_key(oscmidi_hash, bev->sid, key, ch);
-
 	uint16_t bend =(X - key)*mul[bev->gid] + 0x1fff;
 	uint16_t eff = bev->y * 0x3fff;
 
@@ -252,29 +453,14 @@ static osc_data_t *
 oscmidi_engine_off_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 {
 	osc_data_t *buf_ptr = buf;
-	osc_data_t *itm = NULL;
-	OSC_MIDI_Format format = config.oscmidi.format;
-	uint_fast8_t multi = config.oscmidi.multi;
-	uint_fast8_t use_mpe = config.oscmidi.mpe;
-
-	if(multi)
-	{
-		buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
-		buf_ptr = osc_set_path(buf_ptr, end, config.oscmidi.path);
-		buf_ptr = osc_set_fmt(buf_ptr, end, oscmidi_fmt_1[format]);
-	}
-
 	uint8_t key;
 	uint8_t ch;
-	midi_rem_key(oscmidi_hash, bev->sid, &key, &ch);
-	if(use_mpe)
-		mpe_release(&mpe, bev->gid, ch);
 
-	// serialize
-	buf_ptr = oscmidi_serialize(buf_ptr, end, format, ch, MIDI_STATUS_NOTE_OFF, key, 0x7f);
+	if(midi_voice_release(&alloc, bev->sid, &key, &ch)) // dropped or stolen
+		return buf_ptr;
 
-	if(multi)
-		buf_ptr = osc_end_bundle_item(buf_ptr, end, itm);
+	// serialize
+	buf_ptr = oscmidi_note_off(buf_ptr, end, ch, key);
 
 	return buf_ptr;
 }
@@ -285,10 +471,16 @@ oscmidi_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	osc_data_t *buf_ptr = buf;
 	osc_data_t *itm = NULL;
 	OSC_MIDI_Format format = config.oscmidi.format;
-	uint_fast8_t multi = config.oscmidi.multi;
+	uint_fast8_t multi = config.oscmidi.multi && !coalesce;
 	OSC_MIDI_Group *group = &oscmidi_groups[bev->gid];
 	OSC_MIDI_Mapping mapping = group->mapping;
 
+	MIDI_Voice *voice = midi_voice_get(&alloc, bev->sid);
+	if(!voice) // dropped or stolen
+		return buf_ptr;
+	uint8_t key = voice->key;
+	uint8_t ch = voice->cha;
+
 	if(multi)
 	{
 		buf_ptr = osc_start_bundle_item(buf_ptr, end, &itm);
@@ -300,9 +492,6 @@ oscmidi_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
 	}
 
 	float X = group->offset + bev->x*group->range;
-	uint8_t key;
-	uint8_t ch;
-	midi_get_key(oscmidi_hash, bev->sid, &key, &ch);
 	uint16_t bend =(X - key)*mul[bev->gid] + 0x1fff;
 	uint16_t eff = bev->y * 0x3fff;
 
@@ -342,6 +531,13 @@ CMC_Engine oscmidi_engine = {
  * Config
  */
 
+static void
+_oscmidi_engines_init(void)
+{
+	cmc_engine_init(&oscmidi_engine);
+	cmc_engine_init(&rtpmidi_engine); // shares attributes and MPE settings
+}
+
 static uint_fast8_t
 _oscmidi_enabled(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -356,12 +552,18 @@ _oscmidi_multi(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t
 	return config_check_bool(path, fmt, argc, buf, &config.oscmidi.multi);
 }
 
+static uint_fast8_t
+_oscmidi_coalesce(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return config_check_bool(path, fmt, argc, buf, &config.oscmidi.coalesce);
+}
+
 static uint_fast8_t
 _oscmidi_mpe(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
 	uint8_t res = config_check_bool(path, fmt, argc, buf, &config.oscmidi.mpe);
 	if( (argc > 1) && config.oscmidi.mpe)
-		oscmidi_init(); // send zones
+		_oscmidi_engines_init(); // send zones
 	return res;
 }
 
@@ -435,6 +637,69 @@ _oscmidi_format(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t
 	return 1;
 }
 
+static const OSC_Query_Value oscmidi_allocation_args_values [] = {
+	[MIDI_SELECT_ROUND_ROBIN]		= { .s = "round_robin" },
+	[MIDI_SELECT_LEAST_RECENT]	= { .s = "least_recent" }
+};
+
+static const OSC_Query_Value oscmidi_stealing_args_values [] = {
+	[MIDI_STEAL_STACK]					= { .s = "stack" },
+	[MIDI_STEAL_OLDEST]					= { .s = "oldest" },
+	[MIDI_STEAL_NONE]						= { .s = "none" }
+};
+
+static uint_fast8_t
+_oscmidi_select(const char *path, uint_fast8_t argc, osc_data_t *buf, uint8_t *val,
+	const OSC_Query_Value *values, uint_fast8_t n)
+{
+	osc_data_t *buf_ptr = buf;
+	uint16_t size = 0;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc == 1)
+		size = CONFIG_SUCCESS("iss", uuid, path, values[*val].s);
+	else
+	{
+		uint_fast8_t i;
+		const char *s;
+		buf_ptr = osc_get_string(buf_ptr, &s);
+		for(i=0; i<n; i++)
+			if(!strcmp(s, values[i].s))
+				break;
+
+		if(i < n)
+		{
+			*val = i;
+			_oscmidi_engines_init(); // repopulate voices
+			size = CONFIG_SUCCESS("is", uuid, path);
+		}
+		else
+			size = CONFIG_FAIL("iss", uuid, path, "unknown value");
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_oscmidi_allocation(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	return _oscmidi_select(path, argc, buf, &config.oscmidi.allocation, oscmidi_allocation_args_values,
+		sizeof(oscmidi_allocation_args_values)/sizeof(OSC_Query_Value));
+}
+
+static uint_fast8_t
+_oscmidi_stealing(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	return _oscmidi_select(path, argc, buf, &config.oscmidi.stealing, oscmidi_stealing_args_values,
+		sizeof(oscmidi_stealing_args_values)/sizeof(OSC_Query_Value));
+}
+
 static uint_fast8_t
 _oscmidi_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -466,7 +731,7 @@ _oscmidi_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t
 	CONFIG_SEND(size);
 
 	if(config.oscmidi.mpe)
-		oscmidi_init(); // send zones
+		_oscmidi_engines_init(); // send zones
 
 	return 1;
 }
@@ -538,7 +803,7 @@ _oscmidi_range(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t
 	uint_fast8_t res = config_check_float(path, fmt, argc, buf, &grp->range);
 
 	if( (argc > 1) && config.oscmidi.mpe)
-		oscmidi_init(); // send zones
+		_oscmidi_engines_init(); // send zones
 
 	return res;
 }
@@ -563,6 +828,14 @@ static const OSC_Query_Argument oscmidi_format_args [] = {
 	OSC_QUERY_ARGUMENT_STRING_VALUES("Format", OSC_QUERY_MODE_RW, oscmidi_format_args_values)
 };
 
+static const OSC_Query_Argument oscmidi_allocation_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("Allocation", OSC_QUERY_MODE_RW, oscmidi_allocation_args_values)
+};
+
+static const OSC_Query_Argument oscmidi_stealing_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("Stealing", OSC_QUERY_MODE_RW, oscmidi_stealing_args_values)
+};
+
 static const OSC_Query_Argument mapping_args [] = {
 	OSC_QUERY_ARGUMENT_STRING_VALUES("Mapping", OSC_QUERY_MODE_RW, oscmidi_mapping_args_values)
 };
@@ -594,7 +867,10 @@ const OSC_Query_Item oscmidi_tree [] = {
 	OSC_QUERY_ITEM_METHOD("enabled", "Enable/disable", _oscmidi_enabled, config_boolean_args),
 	OSC_QUERY_ITEM_METHOD("multi", "OSC Multi argument?", _oscmidi_multi, config_boolean_args),
 	OSC_QUERY_ITEM_METHOD("format", "OSC Format", _oscmidi_format, oscmidi_format_args),
+	OSC_QUERY_ITEM_METHOD("coalesce", "Coalesce events per frame?", _oscmidi_coalesce, config_boolean_args),
 	OSC_QUERY_ITEM_METHOD("mpe", "Multidimensional polyphonic expression?", _oscmidi_mpe, config_boolean_args),
+	OSC_QUERY_ITEM_METHOD("allocation", "MPE channel allocation", _oscmidi_allocation, oscmidi_allocation_args),
+	OSC_QUERY_ITEM_METHOD("stealing", "MPE note stealing", _oscmidi_stealing, oscmidi_stealing_args),
 	OSC_QUERY_ITEM_METHOD("path", "OSC Path", _oscmidi_path, oscmidi_path_args),
 	OSC_QUERY_ITEM_METHOD("reset", "Reset attributes", _oscmidi_reset, NULL),
 	OSC_QUERY_ITEM_ARRAY("attributes/", "Attributes", group_array, GROUP_MAX)
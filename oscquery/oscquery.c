@@ -17,9 +17,191 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 #include <oscquery.h>
 
+/*
+ * Flat path index
+ */
+
+#define OSC_QUERY_INDEX_MAX 256 // maximal number of indexed items
+#define OSC_QUERY_INDEX_BUCKETS 128 // must be a power of two
+#define OSC_QUERY_INDEX_NIL 0xffff
+#define OSC_QUERY_INDEX_DEPTH 16 // maximal number of path components
+
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME 16777619UL
+
+typedef struct _OSC_Query_Entry OSC_Query_Entry;
+
+struct _OSC_Query_Entry {
+	uint32_t hash; // of path with array indices replaced by '#'
+	const OSC_Query_Item *item;
+	uint16_t parent;
+	uint16_t next; // in bucket
+};
+
+static const OSC_Query_Item *index_root = NULL;
+static uint_fast16_t index_n = 0;
+static uint_fast8_t index_overflow = 0;
+static OSC_Query_Entry index_entries [OSC_QUERY_INDEX_MAX];
+static uint16_t index_buckets [OSC_QUERY_INDEX_BUCKETS];
+
+static inline uint32_t
+_fnv(uint32_t hash, char c)
+{
+	return (hash ^ (uint8_t)c) * FNV_PRIME;
+}
+
+static uint32_t
+_osc_query_index_hash(uint32_t hash, const char *path)
+{
+	const char *ptr;
+	if(!strncmp(path, "%i", 2)) // array element
+	{
+		hash = _fnv(hash, '#');
+		ptr = path + 2;
+	}
+	else
+		ptr = path;
+
+	for( ; *ptr; ptr++)
+		hash = _fnv(hash, *ptr);
+
+	return hash;
+}
+
+static void
+_osc_query_index_add(const OSC_Query_Item *item, uint16_t parent, uint32_t hash)
+{
+	if(index_n >= OSC_QUERY_INDEX_MAX)
+	{
+		index_overflow = 1;
+		return;
+	}
+
+	hash = _osc_query_index_hash(hash, item->path);
+
+	uint16_t self = index_n++;
+	OSC_Query_Entry *entry = &index_entries[self];
+	uint_fast8_t bucket = hash & (OSC_QUERY_INDEX_BUCKETS - 1);
+
+	entry->hash = hash;
+	entry->item = item;
+	entry->parent = parent;
+	entry->next = index_buckets[bucket];
+	index_buckets[bucket] = self;
+
+	if( (item->type == OSC_QUERY_NODE) || (item->type == OSC_QUERY_ARRAY) )
+	{
+		// array elements share a single template entry
+		uint_fast8_t n = item->type == OSC_QUERY_NODE ? item->item.node.argc : 1;
+		uint_fast8_t i;
+		for(i=0; i<n; i++)
+			_osc_query_index_add(&item->item.node.tree[i], self, hash);
+	}
+}
+
+void
+osc_query_index(const OSC_Query_Item *root)
+{
+	index_n = 0;
+	index_overflow = 0;
+	memset(index_buckets, 0xff, sizeof(index_buckets)); // OSC_QUERY_INDEX_NIL
+
+	_osc_query_index_add(root, OSC_QUERY_INDEX_NIL, FNV_OFFSET);
+
+	index_root = root;
+}
+
+// verify a hash hit by comparing path components from leaf to root
+static uint_fast8_t
+_osc_query_index_verify(uint16_t idx, const char *path, const char **comp, uint_fast8_t n)
+{
+	const OSC_Query_Entry *entry = &index_entries[idx];
+
+	while(n--)
+	{
+		const char *item_path = entry->item->path;
+		const char *part = comp[n];
+		size_t len = comp[n+1] - part;
+
+		if(entry->parent == OSC_QUERY_INDEX_NIL)
+			return 0;
+		const OSC_Query_Item *parent = index_entries[entry->parent].item;
+
+		if(!strncmp(item_path, "%i", 2)) // array element, check index range
+		{
+			if( (*part < '0') || (*part > '9') || strcmp(item_path + 2, part[len-1] == '/' ? "/" : "") )
+				return 0;
+			unsigned long i = strtoul(part, NULL, 10);
+			if( (parent->type != OSC_QUERY_ARRAY) || (i >= parent->item.node.argc) )
+				return 0;
+		}
+		else if( (strlen(item_path) != len) || strncmp(item_path, part, len) )
+			return 0;
+
+		entry = &index_entries[entry->parent];
+	}
+
+	return (entry->parent == OSC_QUERY_INDEX_NIL) && !strncmp(entry->item->path, path, comp[0] - path);
+}
+
+const OSC_Query_Item *
+osc_query_lookup(const OSC_Query_Item *root, const char *path)
+{
+	if(index_root != root)
+		osc_query_index(root);
+	if(index_overflow) // fall back to tree walk
+		return osc_query_find(root, path, -1);
+
+	const char *comp [OSC_QUERY_INDEX_DEPTH + 1];
+	uint_fast8_t n = 0;
+	uint32_t hash = FNV_OFFSET;
+	const char *ptr = path;
+
+	// root component
+	if(*ptr != '/')
+		return NULL;
+	hash = _fnv(hash, *ptr++);
+
+	// remaining components, purely numeric ones are array indices
+	while(*ptr)
+	{
+		const char *part = ptr;
+		uint_fast8_t numeric = 1;
+
+		for( ; *ptr && (*ptr != '/'); ptr++)
+			if( (*ptr < '0') || (*ptr > '9') )
+				numeric = 0;
+
+		if(n >= OSC_QUERY_INDEX_DEPTH)
+			return NULL;
+		comp[n++] = part;
+
+		if(numeric && (ptr > part) )
+			hash = _fnv(hash, '#');
+		else
+		{
+			const char *c;
+			for(c=part; c<ptr; c++)
+				hash = _fnv(hash, *c);
+		}
+
+		if(*ptr == '/')
+			hash = _fnv(hash, *ptr++);
+	}
+	comp[n] = ptr;
+
+	uint16_t idx;
+	for(idx=index_buckets[hash & (OSC_QUERY_INDEX_BUCKETS - 1)]; idx!=OSC_QUERY_INDEX_NIL; idx=index_entries[idx].next)
+		if( (index_entries[idx].hash == hash) && _osc_query_index_verify(idx, path, comp, n) )
+			return index_entries[idx].item;
+
+	return NULL;
+}
+
 const OSC_Query_Item *
 osc_query_find(const OSC_Query_Item *item, const char *path, int_fast8_t argc)
 {
@@ -65,6 +247,69 @@ osc_query_find(const OSC_Query_Item *item, const char *path, int_fast8_t argc)
 	return NULL;
 }
 
+static uint_fast16_t
+_osc_query_match(const OSC_Query_Item *item, const char *pattern, int_fast8_t argc,
+	char *path, char *path_end, OSC_Query_Match_Cb cb, void *data)
+{
+	// expand array index and append item path to concrete path
+	int len;
+	if(strstr(item->path, "%i") && (argc >= 0) )
+		len = snprintf(path_end, OSC_QUERY_PATH_MAX - (path_end - path), item->path, argc);
+	else
+		len = snprintf(path_end, OSC_QUERY_PATH_MAX - (path_end - path), "%s", item->path);
+	if( (len <= 0) || (path_end + len >= path + OSC_QUERY_PATH_MAX) )
+		return 0;
+
+	// compare one path component
+	const char *pattern_next = strchr(pattern, '/');
+	size_t pattern_len = pattern_next ? (size_t)(pattern_next - pattern) : strlen(pattern);
+	size_t part_len = path_end[len-1] == '/' ? (size_t)len - 1 : (size_t)len;
+	if(!osc_match_pattern_part(pattern, pattern_len, path_end, part_len))
+		return 0;
+
+	if(item->type == OSC_QUERY_METHOD)
+	{
+		if(pattern_next) // pattern continues beyond method
+			return 0;
+		return cb(item, path, data);
+	}
+	else if(!pattern_next || !pattern_next[1]) // only methods are dispatched to
+		return 0;
+
+	uint_fast16_t n = 0;
+	uint_fast8_t i;
+	if(item->type == OSC_QUERY_NODE)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			n += _osc_query_match(&item->item.node.tree[i], pattern_next + 1, -1, path, path_end + len, cb, data);
+	}
+	else if(item->type == OSC_QUERY_ARRAY)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			n += _osc_query_match(item->item.node.tree, pattern_next + 1, i, path, path_end + len, cb, data);
+	}
+
+	return n;
+}
+
+// call cb for every method matching an OSC address pattern, returns number of matches
+uint_fast16_t
+osc_query_match(const OSC_Query_Item *root, const char *pattern, OSC_Query_Match_Cb cb, void *data)
+{
+	char path [OSC_QUERY_PATH_MAX];
+	uint_fast16_t n = 0;
+	uint_fast8_t i;
+
+	if( (pattern[0] != '/') || (root->type != OSC_QUERY_NODE) )
+		return 0;
+
+	path[0] = '/';
+	for(i=0; i<root->item.node.argc; i++)
+		n += _osc_query_match(&root->item.node.tree[i], pattern + 1, -1, path, path + 1, cb, data);
+
+	return n;
+}
+
 uint_fast8_t
 osc_query_check(const OSC_Query_Item *item, const char *fmt, osc_data_t *buf)
 {
@@ -184,157 +429,283 @@ _serialize_float(char *str, float f)
 		sprintf(str, "%f", f);
 }
 
-void
-osc_query_response(char *buf, const OSC_Query_Item *item, const char *path)
+/*
+ * Streaming JSON serializer
+ *
+ * The response is rendered piecewise and only the bytes falling into the
+ * window [offset, offset+len) are copied to the buffer, thus arbitrarily
+ * large responses can be sent in bounded chunks.
+ */
+
+typedef struct _OSC_Query_Writer OSC_Query_Writer;
+
+struct _OSC_Query_Writer {
+	char *buf;
+	size_t len; // window size
+	size_t offset; // window start
+	size_t pos; // bytes rendered so far
+};
+
+static void
+_emit(OSC_Query_Writer *w, const char *str)
+{
+	for( ; *str; str++, w->pos++)
+		if( (w->pos >= w->offset) && (w->pos - w->offset < w->len) )
+			w->buf[w->pos - w->offset] = *str;
+}
+
+static void
+_emit_char(OSC_Query_Writer *w, char c)
+{
+	const char str [2] = {c, '\0'};
+	_emit(w, str);
+}
+
+static void
+_emit_int(OSC_Query_Writer *w, int32_t i)
+{
+	char val [16];
+	sprintf(val, "%"PRIi32, i);
+	_emit(w, val);
+}
+
+static void
+_emit_float(OSC_Query_Writer *w, float f)
+{
+	char val [32];
+	_serialize_float(val, f);
+	_emit(w, val);
+}
+
+static const char path_head [] = "{\"path\":\""; // every response starts with its path
+
+static void
+_emit_head(OSC_Query_Writer *w, const char *path, const char *type, const char *description, const char *list)
+{
+	_emit(w, path_head);
+	_emit(w, path);
+	_emit(w, "\",\"type\":\"");
+	_emit(w, type);
+	_emit(w, "\",\"description\":\"");
+	_emit(w, description);
+	_emit(w, "\",\"");
+	_emit(w, list);
+	_emit(w, "\":[");
+}
+
+static void
+_emit_argument(OSC_Query_Writer *w, const OSC_Query_Argument *arg)
 {
-	*buf++ = '{';
+	uint_fast8_t j;
+
+	_emit(w, "{\"type\":\"");
+	_emit_char(w, arg->type);
+	_emit(w, "\",\"description\":\"");
+	_emit(w, arg->description);
+	_emit(w, "\",\"read\":");
+	_emit(w, arg->mode & OSC_QUERY_MODE_R ? "true" : "false");
+	_emit(w, ",\"write\":");
+	_emit(w, arg->mode & OSC_QUERY_MODE_W ? "true" : "false");
+
+	switch(arg->type)
+	{
+		case OSC_INT32:
+		case OSC_STRING:
+			if(arg->values.argc)
+			{
+				_emit(w, ",\"values\":[");
+				for(j=0; j<arg->values.argc; j++)
+				{
+					if(j)
+						_emit_char(w, ',');
+					if(arg->type == OSC_INT32)
+						_emit_int(w, arg->values.ptr[j].i);
+					else // OSC_STRING
+					{
+						_emit_char(w, '"');
+						_emit(w, arg->values.ptr[j].s);
+						_emit_char(w, '"');
+					}
+				}
+				_emit_char(w, ']');
+			}
+			else // !values
+			{
+				_emit(w, ",\"range\":[");
+				_emit_int(w, arg->range.min.i);
+				_emit_char(w, ',');
+				_emit_int(w, arg->range.max.i);
+				_emit_char(w, ',');
+				_emit_int(w, arg->range.step.i);
+				_emit_char(w, ']');
+			}
+			break;
+		case OSC_FLOAT:
+			if(arg->values.argc)
+			{
+				_emit(w, ",\"values\":[");
+				for(j=0; j<arg->values.argc; j++)
+				{
+					if(j)
+						_emit_char(w, ',');
+					_emit_float(w, arg->values.ptr[j].f);
+				}
+				_emit_char(w, ']');
+			}
+			else // !values
+			{
+				_emit(w, ",\"range\":[");
+				_emit_float(w, arg->range.min.f);
+				_emit_char(w, ',');
+				_emit_float(w, arg->range.max.f);
+				_emit_char(w, ',');
+				_emit_float(w, arg->range.step.f);
+				_emit_char(w, ']');
+			}
+			break;
+		//FIXME add other types
+		default:
+			break;
+	}
+
+	_emit_char(w, '}');
+}
+
+size_t
+osc_query_response(char *buf, size_t len, size_t offset, const OSC_Query_Item *item, const char *path)
+{
+	OSC_Query_Writer w = {
+		.buf = buf,
+		.len = len,
+		.offset = offset,
+		.pos = 0
+	};
+	uint_fast8_t i;
 
 	if(item->type == OSC_QUERY_NODE)
 	{
-		sprintf(buf, "\"path\":\"%s\",\"type\":\"node\",\"description\":\"%s\",\"items\":[",
-			path, item->description);
-		buf += strlen(buf);
+		_emit_head(&w, path, "node", item->description, "items");
 
-		uint_fast8_t i;
 		for(i=0; i<item->item.node.argc; i++)
 		{
-			const OSC_Query_Item *sub = &item->item.node.tree[i];
-			sprintf(buf, "\"%s\"", sub->path);
-			buf += strlen(buf);
-			if(i < item->item.node.argc-1)
-				*buf++ = ',';
+			if(i)
+				_emit_char(&w, ',');
+			_emit_char(&w, '"');
+			_emit(&w, item->item.node.tree[i].path);
+			_emit_char(&w, '"');
 		}
-
-		*buf++ = ']';
 	}
 	else if(item->type == OSC_QUERY_ARRAY)
 	{
-		sprintf(buf, "\"path\":\"%s\",\"type\":\"node\",\"description\":\"%s\",\"items\":[",
-			path, item->description);
-		buf += strlen(buf);
+		_emit_head(&w, path, "node", item->description, "items");
 
 		const OSC_Query_Item *sub = item->item.node.tree;
-		uint_fast8_t i;
 		for(i=0; i<item->item.node.argc; i++)
 		{
-			*buf++ = '"';
-			sprintf(buf, sub->path, i);
-			buf += strlen(buf);
-			*buf++ = '"';
-			if(i < item->item.node.argc-1)
-				*buf++ = ',';
+			char elmnt [32];
+			snprintf(elmnt, 32, sub->path, i);
+			if(i)
+				_emit_char(&w, ',');
+			_emit_char(&w, '"');
+			_emit(&w, elmnt);
+			_emit_char(&w, '"');
 		}
-
-		*buf++ = ']';
 	}
 	else // OSC_QUERY_METHOD
 	{
-		sprintf(buf, "\"path\":\"%s\",\"type\":\"method\",\"description\":\"%s\",\"arguments\":[",
-			path, item->description);
-		buf += strlen(buf);
+		_emit_head(&w, path, "method", item->description, "arguments");
 
-		uint_fast8_t i;
 		for(i=0; i<item->item.method.argc; i++)
 		{
-			const OSC_Query_Argument *arg = &item->item.method.args[i];
-			sprintf(buf, "{\"type\":\"%c\",\"description\":\"%s\",\"read\":%s,\"write\":%s",
-				arg->type, arg->description,
-				arg->mode & OSC_QUERY_MODE_R ? "true" : "false",
-				arg->mode & OSC_QUERY_MODE_W ? "true" : "false");
-			buf += strlen(buf);
-
-			switch(arg->type)
-			{
-				case OSC_INT32:
-					if(arg->values.argc)
-					{
-						sprintf(buf, ",\"values\":[");
-						buf += strlen(buf);
-						uint_fast8_t j;
-						for(j=0; j<arg->values.argc; j++)
-						{
-							sprintf(buf, "%li,", arg->values.ptr[j].i);
-							buf += strlen(buf);
-						}
-						buf--;
-						*buf++ = ']';
-					}
-					else // !values
-					{
-						sprintf(buf, ",\"range\":[%li,%li,%li]", arg->range.min.i, arg->range.max.i, arg->range.step.i);
-						buf += strlen(buf);
-					}
-					break;
-				case OSC_FLOAT:
-				{
-					char val[32];
-					if(arg->values.argc)
-					{
-						sprintf(buf, ",\"values\":[");
-						buf += strlen(buf);
-						uint_fast8_t j;
-						for(j=0; j<arg->values.argc; j++)
-						{
-							_serialize_float(val, arg->values.ptr[j].f);
-							sprintf(buf, "%s,", val);
-							buf += strlen(buf);
-						}
-						buf--;
-						*buf++ = ']';
-					}
-					else // !values
-					{
-						sprintf(buf, ",\"range\":[");
-						buf += strlen(buf);
+			if(i)
+				_emit_char(&w, ',');
+			_emit_argument(&w, &item->item.method.args[i]);
+		}
+	}
 
-						_serialize_float(val, arg->range.min.f);
-						sprintf(buf, "%s,", val);
-						buf += strlen(buf);
+	_emit(&w, "]}");
 
-						_serialize_float(val, arg->range.max.f);
-						sprintf(buf, "%s,", val);
-						buf += strlen(buf);
+	return w.pos;
+}
 
-						_serialize_float(val, arg->range.step.f);
-						sprintf(buf, "%s", val);
-						buf += strlen(buf);
+/*
+ * Response cache
+ *
+ * The query tree is constant, rendered responses are kept in an arena and
+ * served from there until the next config write invalidates them.
+ */
 
-						*buf++ = ']';
-					}
-					break;
-				}
-				case OSC_STRING:
-					if(arg->values.argc)
-					{
-						sprintf(buf, ",\"values\":[");
-						buf += strlen(buf);
-						uint_fast8_t j;
-						for(j=0; j<arg->values.argc; j++)
-						{
-							sprintf(buf, "\"%s\",", arg->values.ptr[j].s);
-							buf += strlen(buf);
-						}
-						buf--;
-						*buf++ = ']';
-					}
-					else // !values
-					{
-						sprintf(buf, ",\"range\":[%li,%li,%li]", arg->range.min.i, arg->range.max.i, arg->range.step.i);
-						buf += strlen(buf);
-					}
-					break;
-				//FIXME add other types
-				default:
-					break;
-			}
-			*buf++ = '}';
-			if(i < item->item.method.argc-1)
-				*buf++ = ',';
-		}
+#define OSC_QUERY_CACHE_SIZE 1024
+#define OSC_QUERY_CACHE_MAX 8
+
+typedef struct _OSC_Query_Cache OSC_Query_Cache;
+
+struct _OSC_Query_Cache {
+	const OSC_Query_Item *item;
+	uint32_t hash; // of path, a match is verified against the rendered path
+	uint16_t offset; // into arena
+	uint16_t len;
+};
+
+static uint_fast8_t cache_n = 0;
+static uint16_t cache_used = 0;
+static OSC_Query_Cache cache_entries [OSC_QUERY_CACHE_MAX];
+static char cache_arena [OSC_QUERY_CACHE_SIZE];
+
+void
+osc_query_cache_invalidate(void)
+{
+	cache_n = 0;
+	cache_used = 0;
+}
 
-		*buf++ = ']';
+// array elements share an item and their hashes may collide, the path
+// itself is part of the rendered response, thus compare against that
+static uint_fast8_t
+_osc_query_cache_verify(const OSC_Query_Cache *entry, const char *path)
+{
+	const char *rendered = &cache_arena[entry->offset + sizeof(path_head) - 1];
+	size_t len = strlen(path);
+
+	return (entry->len > sizeof(path_head) - 1 + len)
+		&& !strncmp(rendered, path, len) && (rendered[len] == '"');
+}
+
+size_t
+osc_query_response_cached(char *buf, size_t len, size_t offset, const OSC_Query_Item *item, const char *path)
+{
+	OSC_Query_Cache *entry;
+	uint32_t hash = _osc_query_index_hash(FNV_OFFSET, path);
+	uint_fast8_t i;
+
+	for(i=0; i<cache_n; i++)
+	{
+		entry = &cache_entries[i];
+		if( (entry->item == item) && (entry->hash == hash) && _osc_query_cache_verify(entry, path) )
+			goto hit;
+	}
+
+	// miss, render into arena if there is room, flush it otherwise
+	size_t total = osc_query_response(NULL, 0, 0, item, path);
+	if(total > OSC_QUERY_CACHE_SIZE) // too big to cache, render directly
+		return osc_query_response(buf, len, offset, item, path);
+	if( (cache_n >= OSC_QUERY_CACHE_MAX) || (cache_used + total > OSC_QUERY_CACHE_SIZE) )
+		osc_query_cache_invalidate();
+
+	entry = &cache_entries[cache_n++];
+	entry->item = item;
+	entry->hash = hash;
+	entry->offset = cache_used;
+	entry->len = total;
+	osc_query_response(&cache_arena[cache_used], total, 0, item, path);
+	cache_used += total;
+
+hit:
+	if(len && (offset < entry->len) )
+	{
+		size_t n = entry->len - offset;
+		memcpy(buf, &cache_arena[entry->offset + offset], n < len ? n : len);
 	}
 
-	*buf++ = '}';
-	*buf++ = '\0';
+	return entry->len;
 }
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <chimaera.h>
+#include <config.h>
+#include <eeprom.h>
+#include <cmc.h>
+#include <engines.h>
+
+#include "preset_private.h"
+
+// locals
+static Preset presets [PRESET_MAX];
+static Preset back; // scene active before the last recall
+
+static uint32_t preset_hash [PRESET_MAX][EEPROM_IMAGE_PAGES(sizeof(Preset), EEPROM_24LC64_PAGE_SIZE)];
+static EEPROM_Image preset_images [PRESET_MAX];
+
+static void
+_preset_capture(Preset *preset)
+{
+	preset->version = config.version;
+	preset->valid = 1;
+
+	preset->dump = config.dump;
+	preset->tuio2 = config.tuio2;
+	preset->tuio1 = config.tuio1;
+	preset->scsynth = config.scsynth;
+	preset->oscmidi = config.oscmidi;
+	preset->dummy = config.dummy;
+	preset->custom_enabled = config.custom.enabled;
+
+	memcpy(preset->groups, config.groups, sizeof(config.groups));
+	memcpy(preset->scsynth_groups, config.scsynth_groups, sizeof(config.scsynth_groups));
+	memcpy(preset->oscmidi_groups, config.oscmidi_groups, sizeof(config.oscmidi_groups));
+}
+
+static void
+_preset_swap(void *a, void *b, size_t len)
+{
+	uint8_t *x = a;
+	uint8_t *y = b;
+
+	while(len--)
+	{
+		uint8_t t = *x;
+		*x++ = *y;
+		*y++ = t;
+	}
+}
+
+#define PRESET_SECTION(DST, SRC, ENGINE) \
+	if(memcmp(&(DST), &(SRC), sizeof(DST))) \
+	{ \
+		_preset_swap(&(DST), &(SRC), sizeof(DST)); \
+		cmc_engine_init(ENGINE); \
+		cmc_engines_update(); \
+	}
+
+// swap in a scene through the back buffer, which ends up with the scene
+// active before, only sections that changed get their engines reinitialized
+static void
+_preset_apply(const Preset *preset)
+{
+	if(preset != &back)
+		back = *preset;
+
+	cmc_defer_begin();
+
+	if(memcmp(config.groups, back.groups, sizeof(config.groups)))
+	{
+		_preset_swap(config.groups, back.groups, sizeof(config.groups));
+		cmc_group_update(); // reinitializes all engines
+	}
+
+	if(memcmp(&config.dump, &back.dump, sizeof(config.dump)))
+	{
+		_preset_swap(&config.dump, &back.dump, sizeof(config.dump));
+		cmc_engines_update();
+	}
+
+	PRESET_SECTION(config.tuio2, back.tuio2, &tuio2_engine);
+	PRESET_SECTION(config.tuio1, back.tuio1, &tuio1_engine);
+	PRESET_SECTION(config.scsynth, back.scsynth, &scsynth_engine);
+	PRESET_SECTION(config.scsynth_groups, back.scsynth_groups, &scsynth_engine);
+	PRESET_SECTION(config.oscmidi, back.oscmidi, &oscmidi_engine);
+	PRESET_SECTION(config.oscmidi_groups, back.oscmidi_groups, &oscmidi_engine);
+	PRESET_SECTION(config.dummy, back.dummy, &dummy_engine);
+	PRESET_SECTION(config.custom.enabled, back.custom_enabled, &custom_engine);
+
+	cmc_defer_end();
+
+	back.version = config.version;
+	back.valid = 1;
+	strcpy(back.name, "back");
+}
+
+static uint16_t
+_preset_eeprom_addr(uint_fast8_t i)
+{
+	return PRESET_EEPROM_OFFSET + i*sizeof(Preset);
+}
+
+static void
+_preset_saved(EEPROM_Image *image)
+{
+	static char path [32];
+
+	sprintf(path, "/presets/slot/%i/saving", (int)(image - preset_images));
+	config_touch(path); // notify subscribers about finished save
+}
+
+// a queued save must not see the slot change, restart it
+static void
+_preset_changed(uint_fast8_t i)
+{
+	if( (i < PRESET_EEPROM_MAX) && (preset_images[i].status == EEPROM_STATUS_PENDING) )
+		eeprom_queue_push(eeprom_24LC64, &preset_images[i], _preset_eeprom_addr(i), (uint8_t *)&presets[i], sizeof(Preset));
+}
+
+void
+preset_init(void)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<PRESET_MAX; i++)
+	{
+		Preset *preset = &presets[i];
+		EEPROM_Image *image = &preset_images[i];
+
+		image->valid = 0;
+		image->n = EEPROM_IMAGE_PAGES(sizeof(Preset), EEPROM_24LC64_PAGE_SIZE);
+		image->hash = preset_hash[i];
+		image->cb = _preset_saved;
+
+		if(i < PRESET_EEPROM_MAX) // EEPROM mirrors the slot now, only dirty pages need to be written on save
+			eeprom_image_read(eeprom_24LC64, image, _preset_eeprom_addr(i), (uint8_t *)preset, sizeof(Preset));
+
+		if( (i >= PRESET_EEPROM_MAX) || (preset->valid != 1)
+				|| memcmp(&preset->version, &config.version, sizeof(Firmware_Version)) )
+		{
+			memset(preset, 0, sizeof(Preset));
+			sprintf(preset->name, "preset %i", i);
+		}
+	}
+
+	back.valid = 0;
+}
+
+/*
+ * Config
+ */
+
+#define PRESET_ID(PATH) \
+({ \
+	uint16_t _i = 0; \
+	sscanf(PATH, "/presets/slot/%hu/", &_i); \
+	&presets[_i]; \
+})
+
+static uint_fast8_t
+_preset_name(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc == 1) // query
+		size = CONFIG_SUCCESS("iss", uuid, path, preset->name);
+	else
+	{
+		const char *s;
+		buf_ptr = osc_get_string(buf_ptr, &s);
+		strncpy(preset->name, s, PRESET_NAME_LENGTH-1);
+		preset->name[PRESET_NAME_LENGTH-1] = '\0';
+		_preset_changed(preset - presets);
+
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_valid(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	Preset *preset = PRESET_ID(path);
+
+	return config_check_bool(path, fmt, argc, buf, &preset->valid);
+}
+
+static uint_fast8_t
+_preset_store(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	_preset_capture(preset);
+	_preset_changed(preset - presets);
+
+	size = CONFIG_SUCCESS("is", uuid, path);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_recall(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(preset->valid)
+	{
+		_preset_apply(preset);
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "preset slot is empty");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_save(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+	uint_fast8_t i = preset - presets;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(i < PRESET_EEPROM_MAX)
+	{
+		// pages are written in the background by eeprom_queue_step
+		if(eeprom_queue_push(eeprom_24LC64, &preset_images[i], _preset_eeprom_addr(i), (uint8_t *)preset, sizeof(Preset)))
+			size = CONFIG_SUCCESS("is", uuid, path);
+		else
+			size = CONFIG_FAIL("iss", uuid, path, "EEPROM queue full");
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "no room in EEPROM for this slot");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_load(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+	uint_fast8_t i = preset - presets;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(i < PRESET_EEPROM_MAX)
+	{
+		uint8_t head [offsetof(Preset, name)]; // version and valid flag only
+		Firmware_Version version;
+
+		eeprom_bulk_read(eeprom_24LC64, _preset_eeprom_addr(i), head, sizeof(head));
+		memcpy(&version, &head[offsetof(Preset, version)], sizeof(Firmware_Version));
+
+		if(preset_images[i].status == EEPROM_STATUS_PENDING)
+			size = CONFIG_FAIL("iss", uuid, path, "slot is being saved");
+		else if( (head[offsetof(Preset, valid)] == 1) && !memcmp(&version, &config.version, sizeof(Firmware_Version)) )
+		{
+			eeprom_image_read(eeprom_24LC64, &preset_images[i], _preset_eeprom_addr(i), (uint8_t *)preset, sizeof(Preset));
+			size = CONFIG_SUCCESS("is", uuid, path);
+		}
+		else
+			size = CONFIG_FAIL("iss", uuid, path, "no valid preset in EEPROM");
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "no room in EEPROM for this slot");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_saving(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	Preset *preset = PRESET_ID(path);
+	EEPROM_Image *image = &preset_images[preset - presets];
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("issi", uuid, path, config_saving_args_values[image->status].s, image->written);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_undo(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(back.valid)
+	{
+		_preset_apply(&back); // swaps front and back buffer
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+	else
+		size = CONFIG_FAIL("iss", uuid, path, "nothing to undo");
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_preset_persistent(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("isi", uuid, path,
+		PRESET_EEPROM_MAX < PRESET_MAX ? PRESET_EEPROM_MAX : PRESET_MAX);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+/*
+ * Query
+ */
+
+static const OSC_Query_Argument preset_name_args [] = {
+	OSC_QUERY_ARGUMENT_STRING("Name", OSC_QUERY_MODE_RW, PRESET_NAME_LENGTH - 1)
+};
+
+static const OSC_Query_Argument preset_valid_args [] = {
+	OSC_QUERY_ARGUMENT_BOOL("Valid", OSC_QUERY_MODE_R)
+};
+
+static const OSC_Query_Argument preset_persistent_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Number", OSC_QUERY_MODE_R, 0, PRESET_MAX, 1)
+};
+
+static const OSC_Query_Item preset_slot_tree [] = {
+	// read-write
+	OSC_QUERY_ITEM_METHOD("name", "Name", _preset_name, preset_name_args),
+	OSC_QUERY_ITEM_METHOD("store", "Store current scene into slot", _preset_store, NULL),
+	OSC_QUERY_ITEM_METHOD("recall", "Swap in scene from slot", _preset_recall, NULL),
+	OSC_QUERY_ITEM_METHOD("save", "Save slot to EEPROM", _preset_save, NULL),
+	OSC_QUERY_ITEM_METHOD("load", "Load slot from EEPROM", _preset_load, NULL),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("valid", "Slot holds a scene", _preset_valid, preset_valid_args),
+	OSC_QUERY_ITEM_METHOD("saving", "Status of last slot save to EEPROM", _preset_saving, config_saving_args),
+};
+
+static const OSC_Query_Item preset_slot_array [] = {
+	OSC_QUERY_ITEM_NODE("%i/", "Slot", preset_slot_tree)
+};
+
+const OSC_Query_Item preset_tree [] = {
+	OSC_QUERY_ITEM_ARRAY("slot/", "Slots", preset_slot_array, PRESET_MAX),
+	OSC_QUERY_ITEM_METHOD("undo", "Swap back scene active before last recall", _preset_undo, NULL),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("persistent", "Number of slots with room in EEPROM", _preset_persistent, preset_persistent_args),
+};
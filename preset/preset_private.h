@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _PRESET_PRIVATE_H_
+#define _PRESET_PRIVATE_H_
+
+#include <preset.h>
+#include <chimaera.h>
+
+// persisted slots live in the gap between configuration and calibrated ranges
+#define PRESET_EEPROM_OFFSET ((EEPROM_CONFIG_OFFSET + EEPROM_CONFIG_SIZE + 0x1f) & ~0x1f) // page aligned
+#define PRESET_EEPROM_MAX ((EEPROM_RANGE_OFFSET - PRESET_EEPROM_OFFSET) / sizeof(Preset))
+
+#endif // _PRESET_PRIVATE_H_
@@ -169,7 +169,10 @@ _ptp_update_offset(void)
 void
 ptp_request()
 {
-	uint8_t *buf = BUF_O_OFFSET(buf_o_ptr);
+	uint8_t *base = buf_r_acquire(BUF_R_PTP);
+	if(!base)
+		return;
+	uint8_t *buf = BUF_R_OFFSET(base);
 	static PTP_Request req;
 
 	req.message_id = PTP_MESSAGE_ID_DELAY_REQ;
@@ -189,7 +192,8 @@ ptp_request()
 	ptp_request_ntoh(&req);
 	memcpy(buf, &req, sizeof(PTP_Request));
 	
-	udp_send(config.ptp.event.sock, BUF_O_BASE(buf_o_ptr), sizeof(PTP_Request)); // port 319
+	udp_send(config.ptp.event.sock, base, sizeof(PTP_Request)); // port 319
+	buf_r_release(base);
 	t3 = TICK_TO_US(ptp_uptime());
 }
 
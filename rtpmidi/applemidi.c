@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <string.h>
+
+#include "rtpmidi_private.h"
+
+#include <netdef.h>
+
+static const char cmd_invitation [2] = {'I', 'N'};
+static const char cmd_accepted [2] = {'O', 'K'};
+static const char cmd_rejected [2] = {'N', 'O'};
+static const char cmd_bye [2] = {'B', 'Y'};
+static const char cmd_sync [2] = {'C', 'K'};
+
+static inline uint_fast8_t
+_applemidi_is(const char *command, const char *ref)
+{
+	return (command[0] == ref[0]) && (command[1] == ref[1]);
+}
+
+static void
+_applemidi_invite(AppleMIDI_Session *session, uint64_t now, uint64_t delay)
+{
+	session->state = APPLEMIDI_STATE_INVITE_CONTROL;
+	session->attempts = 0;
+	session->sync_pending = 0;
+	session->token += 1; // new token for each invitation round
+	session->remote_ssrc = 0;
+	session->due = now + delay;
+}
+
+static uint16_t
+_applemidi_invitation(AppleMIDI_Session *session, uint8_t *buf, const char *command, uint_fast8_t with_name)
+{
+	AppleMIDI_Invitation *inv = (AppleMIDI_Invitation *)buf;
+	uint16_t len = sizeof(AppleMIDI_Invitation);
+
+	inv->signature = hton(APPLEMIDI_SIGNATURE);
+	memcpy(inv->command, command, 2);
+	inv->version = htonl(APPLEMIDI_VERSION);
+	inv->token = htonl(session->token);
+	inv->ssrc = htonl(session->ssrc);
+
+	if(with_name)
+	{
+		uint16_t size = strlen(session->name) + 1;
+		memcpy(inv->name, session->name, size);
+		len += size;
+	}
+
+	return len;
+}
+
+static uint16_t
+_applemidi_sync(AppleMIDI_Session *session, uint8_t *buf, uint8_t count, const uint64_t *timestamp)
+{
+	AppleMIDI_Sync *sync = (AppleMIDI_Sync *)buf;
+
+	sync->signature = hton(APPLEMIDI_SIGNATURE);
+	memcpy(sync->command, cmd_sync, 2);
+	sync->ssrc = htonl(session->ssrc);
+	sync->count = count;
+	memset(sync->padding, 0, 3);
+	sync->timestamp[0] = htonll(timestamp[0]);
+	sync->timestamp[1] = htonll(timestamp[1]);
+	sync->timestamp[2] = htonll(timestamp[2]);
+
+	return sizeof(AppleMIDI_Sync);
+}
+
+void
+applemidi_reset(AppleMIDI_Session *session, uint32_t ssrc, const char *name)
+{
+	memset(session, 0, sizeof(AppleMIDI_Session));
+	session->ssrc = ssrc;
+	session->token = ssrc;
+	strncpy(session->name, name, APPLEMIDI_NAME_LEN - 1);
+}
+
+void
+applemidi_start(AppleMIDI_Session *session, uint64_t now)
+{
+	_applemidi_invite(session, now, 0);
+}
+
+uint16_t
+applemidi_request(AppleMIDI_Session *session, uint64_t now, uint8_t *buf, AppleMIDI_Port *port)
+{
+	switch(session->state)
+	{
+		case APPLEMIDI_STATE_INVITE_CONTROL:
+		case APPLEMIDI_STATE_INVITE_DATA:
+		{
+			if(now < session->due)
+				return 0;
+
+			if(session->state == APPLEMIDI_STATE_INVITE_DATA)
+			{
+				if(session->attempts >= APPLEMIDI_INVITE_ATTEMPTS) // start over on control port
+				{
+					_applemidi_invite(session, now, APPLEMIDI_RETRY_INTERVAL);
+					return 0;
+				}
+				*port = APPLEMIDI_PORT_DATA;
+			}
+			else
+				*port = APPLEMIDI_PORT_CONTROL;
+
+			if(session->attempts < APPLEMIDI_INVITE_ATTEMPTS)
+			{
+				session->attempts += 1;
+				session->due = now + APPLEMIDI_INVITE_INTERVAL;
+			}
+			else // responder not reachable, slow down
+				session->due = now + APPLEMIDI_RETRY_INTERVAL;
+
+			return _applemidi_invitation(session, buf, cmd_invitation, 1);
+		}
+
+		case APPLEMIDI_STATE_CONNECTED:
+		{
+			if(now - session->synced > APPLEMIDI_SYNC_TIMEOUT) // responder has gone away
+			{
+				_applemidi_invite(session, now, 0);
+				return 0;
+			}
+
+			if(now < session->due)
+				return 0;
+
+			*port = APPLEMIDI_PORT_DATA;
+			session->sync_pending = 1;
+			session->due = now + (session->attempts < APPLEMIDI_SYNC_FAST_COUNT
+				? APPLEMIDI_SYNC_FAST_INTERVAL
+				: APPLEMIDI_SYNC_INTERVAL);
+
+			const uint64_t timestamp [3] = {now, 0, 0};
+			return _applemidi_sync(session, buf, 0, timestamp);
+		}
+
+		case APPLEMIDI_STATE_IDLE:
+		default:
+			return 0;
+	}
+}
+
+uint16_t
+applemidi_dispatch(AppleMIDI_Session *session, uint64_t now, AppleMIDI_Port port,
+	const uint8_t *buf, uint16_t len, uint8_t *reply)
+{
+	if(len < 4)
+		return 0;
+
+	const AppleMIDI_Invitation *inv = (const AppleMIDI_Invitation *)buf;
+	if(ntoh(inv->signature) != APPLEMIDI_SIGNATURE)
+		return 0; // not a session command
+
+	if(_applemidi_is(inv->command, cmd_sync))
+	{
+		const AppleMIDI_Sync *sync = (const AppleMIDI_Sync *)buf;
+
+		if( (len < sizeof(AppleMIDI_Sync))
+			|| (session->state != APPLEMIDI_STATE_CONNECTED)
+			|| (ntohl(sync->ssrc) != session->remote_ssrc) )
+			return 0;
+
+		uint64_t timestamp [3] = {
+			ntohll(sync->timestamp[0]),
+			ntohll(sync->timestamp[1]),
+			ntohll(sync->timestamp[2])
+		};
+
+		switch(sync->count)
+		{
+			case 0: // clock sync initiated by responder
+				timestamp[1] = now;
+				return _applemidi_sync(session, reply, 1, timestamp);
+			case 1: // answer to our own clock sync
+				if(!session->sync_pending)
+					return 0;
+				session->sync_pending = 0;
+				session->latency = (now - timestamp[0]) / 2;
+				session->synced = now;
+				if(session->attempts < APPLEMIDI_SYNC_FAST_COUNT)
+					session->attempts += 1;
+				timestamp[2] = now;
+				return _applemidi_sync(session, reply, 2, timestamp);
+			case 2: // responder has completed its clock sync
+				session->synced = now;
+				return 0;
+			default:
+				return 0;
+		}
+	}
+
+	if(len < sizeof(AppleMIDI_Invitation)) // IN, OK, NO and BY
+		return 0;
+
+	if(_applemidi_is(inv->command, cmd_accepted))
+	{
+		if( (ntohl(inv->token) != session->token) || (ntohl(inv->version) != APPLEMIDI_VERSION) )
+			return 0;
+
+		if( (session->state == APPLEMIDI_STATE_INVITE_CONTROL) && (port == APPLEMIDI_PORT_CONTROL) )
+		{
+			session->state = APPLEMIDI_STATE_INVITE_DATA;
+			session->remote_ssrc = ntohl(inv->ssrc);
+			session->attempts = 0;
+			session->due = now;
+		}
+		else if( (session->state == APPLEMIDI_STATE_INVITE_DATA) && (port == APPLEMIDI_PORT_DATA) )
+		{
+			session->state = APPLEMIDI_STATE_CONNECTED;
+			session->attempts = 0;
+			session->due = now; // synchronize clocks right away
+			session->synced = now;
+		}
+	}
+	else if(_applemidi_is(inv->command, cmd_rejected))
+	{
+		if( (ntohl(inv->token) == session->token)
+				&& ( (session->state == APPLEMIDI_STATE_INVITE_CONTROL)
+					|| (session->state == APPLEMIDI_STATE_INVITE_DATA) ) )
+			_applemidi_invite(session, now, APPLEMIDI_RETRY_INTERVAL);
+	}
+	else if(_applemidi_is(inv->command, cmd_bye))
+	{
+		if( (session->state != APPLEMIDI_STATE_IDLE) && (ntohl(inv->ssrc) == session->remote_ssrc) )
+			_applemidi_invite(session, now, APPLEMIDI_INVITE_INTERVAL);
+	}
+	// ignore IN from others and RS receiver feedback, as we send no journal
+
+	return 0;
+}
+
+uint16_t
+applemidi_bye(AppleMIDI_Session *session, uint8_t *buf)
+{
+	uint16_t len = 0;
+
+	if( (session->state == APPLEMIDI_STATE_INVITE_DATA) || (session->state == APPLEMIDI_STATE_CONNECTED) )
+		len = _applemidi_invitation(session, buf, cmd_bye, 0);
+
+	session->state = APPLEMIDI_STATE_IDLE;
+
+	return len;
+}
+
+uint16_t
+rtpmidi_packet(AppleMIDI_Session *session, uint64_t now, uint8_t *buf,
+	const RTPMIDI_Event *events, uint_fast8_t n)
+{
+	if( (session->state != APPLEMIDI_STATE_CONNECTED) || !n)
+		return 0;
+
+	if(n > RTPMIDI_EVENT_MAX)
+		n = RTPMIDI_EVENT_MAX;
+
+	RTPMIDI_Header *header = (RTPMIDI_Header *)buf;
+	header->flags = 0x80;
+	header->type = RTPMIDI_PAYLOAD_TYPE;
+	header->seq = hton(session->seq);
+	header->timestamp = htonl((uint32_t)now); // 10kHz media clock
+	header->ssrc = htonl(session->ssrc);
+	session->seq += 1;
+
+	// command list after long section header, without journal (J=0), all deltas zero
+	uint8_t *list = buf + sizeof(RTPMIDI_Header) + 2;
+	uint8_t *ptr = list;
+	uint8_t running = 0;
+
+	for(uint_fast8_t i=0; i<n; i++)
+	{
+		const RTPMIDI_Event *ev = &events[i];
+
+		if(i > 0)
+			*ptr++ = 0x00; // delta time
+
+		if(ev->status != running)
+			*ptr++ = running = ev->status;
+
+		*ptr++ = ev->dat1;
+		switch(ev->status & 0xf0)
+		{
+			case 0xc0: // program change
+			case 0xd0: // channel pressure
+				break;
+			default:
+				*ptr++ = ev->dat2;
+				break;
+		}
+	}
+
+	uint16_t size = ptr - list;
+	uint8_t *section = buf + sizeof(RTPMIDI_Header);
+
+	if(size > 0x0f)
+	{
+		section[0] = 0x80 | (size >> 8); // B=1, 12 bit length
+		section[1] = size & 0xff;
+		return sizeof(RTPMIDI_Header) + 2 + size;
+	}
+
+	section[0] = size; // B=0, 4 bit length
+	memmove(section + 1, list, size);
+
+	return sizeof(RTPMIDI_Header) + 1 + size;
+}
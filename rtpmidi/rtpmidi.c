@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <string.h>
+#include <math.h> // floor, ceil
+
+#include "rtpmidi_private.h"
+
+#include <chimaera.h>
+#include <chimutil.h>
+#include <config.h>
+#include <wiz.h>
+#include <ptp.h>
+#include <midi.h>
+#include <oscmidi.h>
+#include <rtpmidi.h>
+
+// the engine shares mapping, MPE and voice allocation settings with oscmidi,
+// but keeps its own voices, as both may be enabled side by side
+
+static AppleMIDI_Session session;
+static uint8_t responder [4]; // latched when the control port accepts
+static MIDI_Alloc alloc;
+static RTPMIDI_Event events [RTPMIDI_EVENT_MAX];
+static uint_fast8_t events_n = 0;
+static uint_fast8_t update_zones = 0;
+
+static inline uint64_t
+_rtpmidi_now(void)
+{
+	return ptp_uptime() / 100; // 100us units of AppleMIDI clock
+}
+
+// talk to the configured address until the control port accepts, then only to
+// that responder, the session falls back to inviting after BY and timeouts
+static inline uint8_t *
+_rtpmidi_remote(void)
+{
+	return session.state > APPLEMIDI_STATE_INVITE_CONTROL ? responder : config.rtpmidi.socket.ip;
+}
+
+static void
+_rtpmidi_send(uint8_t *ip, uint8_t *base, uint16_t len, AppleMIDI_Port port)
+{
+	Socket_Config *socket = &config.rtpmidi.socket;
+
+	udp_set_remote(socket->sock, ip, socket->port[DST_PORT] + port);
+	udp_send(socket->sock, base, len);
+}
+
+static void
+rtpmidi_init(void)
+{
+	midi_alloc_populate(&alloc, cmc_groups_n, config.oscmidi.mpe,
+		config.oscmidi.allocation, config.oscmidi.stealing);
+
+	// only update zones when mpe is activated
+	update_zones = config.oscmidi.mpe;
+}
+
+static void
+rtpmidi_enqueue(uint8_t channel, uint8_t status, uint8_t dat1, uint8_t dat2)
+{
+	if(events_n < RTPMIDI_EVENT_MAX)
+		events[events_n++] = (RTPMIDI_Event){channel | status, dat1, dat2};
+}
+
+static void
+rtpmidi_effect(const OSC_MIDI_Group *group, uint8_t ch, uint8_t key, float x, float y)
+{
+	float X = group->offset + x*group->range;
+	float range = config.oscmidi.mpe ? ceil(group->range) : group->range; //MPE only supports whole semitone ranges
+	uint16_t bend = (X - key)*(float)0x1fff/range + 0x1fff;
+	uint16_t eff = y * 0x3fff;
+
+	rtpmidi_enqueue(ch, MIDI_STATUS_PITCH_BEND, bend & 0x7f, bend >> 7);
+	switch(group->mapping)
+	{
+		case OSC_MIDI_MAPPING_NOTE_PRESSURE:
+			rtpmidi_enqueue(ch, MIDI_STATUS_NOTE_PRESSURE, key, eff >> 7);
+			break;
+		case OSC_MIDI_MAPPING_CHANNEL_PRESSURE:
+			rtpmidi_enqueue(ch, MIDI_STATUS_CHANNEL_PRESSURE, eff >> 7, 0x0);
+			break;
+		case OSC_MIDI_MAPPING_CONTROL_CHANGE:
+			if(group->control <= 0xd)
+				rtpmidi_enqueue(ch, MIDI_STATUS_CONTROL_CHANGE, group->control | MIDI_LSV, eff & 0x7f);
+			rtpmidi_enqueue(ch, MIDI_STATUS_CONTROL_CHANGE, group->control | MIDI_MSV, eff >> 7);
+			break;
+	}
+}
+
+// events are only queued here, they are sent by rtpmidi_flush outside of
+// touch recognition, when the SPI bus is not busy with the output socket
+static osc_data_t *
+rtpmidi_engine_frame_cb(osc_data_t *buf, osc_data_t *end, CMC_Frame_Event *fev)
+{
+	(void)end;
+	(void)fev;
+
+	if(update_zones && (session.state == APPLEMIDI_STATE_CONNECTED) )
+	{
+		for(uint8_t z=0; z<cmc_groups_n; z++)
+		{
+			const MIDI_Zone *zone = &alloc.zones[z];
+
+			// define zone span
+			rtpmidi_enqueue(zone->base, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_RPN_LSB, 0x6);
+			rtpmidi_enqueue(zone->base, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_RPN_MSB, 0x0);
+			rtpmidi_enqueue(zone->base, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_DATA_ENTRY, zone->span);
+
+			// define zone bend range
+			rtpmidi_enqueue(zone->base+1, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_RPN_LSB, 0x0);
+			rtpmidi_enqueue(zone->base+1, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_RPN_MSB, 0x0);
+			rtpmidi_enqueue(zone->base+1, MIDI_STATUS_CONTROL_CHANGE, MIDI_CONTROLLER_DATA_ENTRY, ceil(oscmidi_groups[z].range));
+		}
+
+		update_zones = 0;
+	}
+
+	return buf;
+}
+
+static osc_data_t *
+rtpmidi_engine_on_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
+{
+	(void)end;
+	const OSC_MIDI_Group *group = &oscmidi_groups[bev->gid];
+
+	uint8_t key = floor(group->offset + bev->x*group->range);
+	MIDI_Voice stolen;
+	MIDI_Voice *voice = midi_voice_acquire(&alloc, bev->sid, bev->gid, key, &stolen);
+
+	if(stolen.sid) // all channels of zone busy
+		rtpmidi_enqueue(stolen.cha, MIDI_STATUS_NOTE_OFF, stolen.key, 0x7f);
+	if(!voice) // dropped
+		return buf;
+
+	rtpmidi_enqueue(voice->cha, MIDI_STATUS_NOTE_ON, key, 0x7f);
+	rtpmidi_effect(group, voice->cha, key, bev->x, bev->y);
+
+	return buf;
+}
+
+static osc_data_t *
+rtpmidi_engine_off_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
+{
+	(void)end;
+	uint8_t key;
+	uint8_t ch;
+
+	if(midi_voice_release(&alloc, bev->sid, &key, &ch)) // dropped or stolen
+		return buf;
+
+	rtpmidi_enqueue(ch, MIDI_STATUS_NOTE_OFF, key, 0x7f);
+
+	return buf;
+}
+
+static osc_data_t *
+rtpmidi_engine_set_cb(osc_data_t *buf, osc_data_t *end, CMC_Blob_Event *bev)
+{
+	(void)end;
+
+	MIDI_Voice *voice = midi_voice_get(&alloc, bev->sid);
+	if(!voice) // dropped or stolen
+		return buf;
+
+	rtpmidi_effect(&oscmidi_groups[bev->gid], voice->cha, voice->key, bev->x, bev->y);
+
+	return buf;
+}
+
+CMC_Engine rtpmidi_engine = {
+	rtpmidi_init,
+	rtpmidi_engine_frame_cb,
+	rtpmidi_engine_on_cb,
+	rtpmidi_engine_off_cb,
+	rtpmidi_engine_set_cb,
+	NULL
+};
+
+/*
+ * Session
+ */
+
+void
+rtpmidi_reset(uint8_t enabled)
+{
+	if(!enabled) // say goodbye while the socket is still open
+	{
+		uint8_t *ip = _rtpmidi_remote(); // before the session goes idle
+		uint8_t *base = buf_r_acquire(BUF_R_RTPMIDI);
+		if(base)
+		{
+			uint16_t len = applemidi_bye(&session, BUF_R_OFFSET(base));
+			if(len)
+				_rtpmidi_send(ip, base, len, APPLEMIDI_PORT_CONTROL);
+			buf_r_release(base);
+		}
+
+		return;
+	}
+
+	const uint8_t *mac = config.comm.mac;
+	uint32_t ssrc = (mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5];
+	uint64_t now = _rtpmidi_now();
+
+	applemidi_reset(&session, ssrc ^ (uint32_t)now, config.name);
+	applemidi_start(&session, now);
+	events_n = 0;
+}
+
+void
+rtpmidi_request(void)
+{
+	if(session.state == APPLEMIDI_STATE_IDLE)
+		return;
+
+	uint8_t *base = buf_r_acquire(BUF_R_RTPMIDI);
+	if(base)
+	{
+		AppleMIDI_Port port;
+		uint16_t len = applemidi_request(&session, _rtpmidi_now(), BUF_R_OFFSET(base), &port);
+		if(len)
+			_rtpmidi_send(_rtpmidi_remote(), base, len, port);
+		buf_r_release(base);
+	}
+}
+
+void
+rtpmidi_flush(void)
+{
+	if(!events_n)
+		return;
+
+	uint8_t *base = buf_r_acquire(BUF_R_RTPMIDI);
+	if(base)
+	{
+		uint16_t len = rtpmidi_packet(&session, _rtpmidi_now(), BUF_R_OFFSET(base), events, events_n);
+		if(len) // only when connected
+			_rtpmidi_send(responder, base, len, APPLEMIDI_PORT_DATA);
+		buf_r_release(base);
+	}
+
+	events_n = 0;
+}
+
+void
+rtpmidi_dispatch(uint8_t *ip, uint16_t port, uint8_t *buf, uint16_t len)
+{
+	Socket_Config *socket = &config.rtpmidi.socket;
+	AppleMIDI_Port remote = port == socket->port[DST_PORT] + 1
+		? APPLEMIDI_PORT_DATA
+		: APPLEMIDI_PORT_CONTROL;
+	uint8_t state = session.state;
+
+	// once the control port has accepted, only listen to that responder
+	if( (state > APPLEMIDI_STATE_INVITE_CONTROL) && memcmp(ip, responder, 4) )
+		return;
+
+	uint8_t *base = buf_r_acquire(BUF_R_RTPMIDI);
+	if(base)
+	{
+		uint16_t size = applemidi_dispatch(&session, _rtpmidi_now(), remote, buf, len, BUF_R_OFFSET(base));
+		if(size) // clock sync answer
+			_rtpmidi_send(ip, base, size, remote);
+		buf_r_release(base);
+	}
+
+	if( (state == APPLEMIDI_STATE_INVITE_CONTROL) && (session.state == APPLEMIDI_STATE_INVITE_DATA) )
+		memcpy(responder, ip, 4); // latch responder, e.g. when invited via broadcast
+	else if( (state != APPLEMIDI_STATE_CONNECTED) && (session.state == APPLEMIDI_STATE_CONNECTED) )
+		update_zones = config.oscmidi.mpe; // new session, send zones again
+}
+
+/*
+ * Config
+ */
+
+static uint_fast8_t
+_rtpmidi_enabled(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return config_socket_enabled(&config.rtpmidi.socket, path, fmt, argc, buf);
+}
+
+static uint_fast8_t
+_rtpmidi_address(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return config_address(&config.rtpmidi.socket, path, fmt, argc, buf);
+}
+
+static const OSC_Query_Value rtpmidi_status_args_values [] = {
+	[APPLEMIDI_STATE_IDLE]						= { .s = "idle" },
+	[APPLEMIDI_STATE_INVITE_CONTROL]	= { .s = "invite_control" },
+	[APPLEMIDI_STATE_INVITE_DATA]			= { .s = "invite_data" },
+	[APPLEMIDI_STATE_CONNECTED]				= { .s = "connected" }
+};
+
+static uint_fast8_t
+_rtpmidi_status(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("iss", uuid, path, rtpmidi_status_args_values[session.state].s);
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_rtpmidi_latency(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	float latency = session.latency * 1e-4f;
+	size = CONFIG_SUCCESS("isf", uuid, path, latency);
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+/*
+ * Query
+ */
+
+static const OSC_Query_Argument rtpmidi_status_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("Status", OSC_QUERY_MODE_R, rtpmidi_status_args_values)
+};
+
+static const OSC_Query_Argument rtpmidi_latency_args [] = {
+	OSC_QUERY_ARGUMENT_FLOAT("Seconds", OSC_QUERY_MODE_R, 0.f, 10.f, 0.f)
+};
+
+const OSC_Query_Item rtpmidi_tree [] = {
+	// read-write
+	OSC_QUERY_ITEM_METHOD("enabled", "Enable/disable", _rtpmidi_enabled, config_boolean_args),
+	OSC_QUERY_ITEM_METHOD("address", "Session responder", _rtpmidi_address, config_address_args),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("status", "Session status", _rtpmidi_status, rtpmidi_status_args),
+	OSC_QUERY_ITEM_METHOD("latency", "One way latency", _rtpmidi_latency, rtpmidi_latency_args)
+};
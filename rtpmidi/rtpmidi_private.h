@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _RTPMIDI_PRIVATE_H_
+#define _RTPMIDI_PRIVATE_H_
+
+#include <stdint.h>
+
+// AppleMIDI session protocol and journal-less RTP-MIDI (RFC 6295) payloads,
+// independent of engine and sockets; time is counted in 100us units
+
+#define APPLEMIDI_SIGNATURE 0xffff
+#define APPLEMIDI_VERSION 2
+#define APPLEMIDI_NAME_LEN 32
+
+#define APPLEMIDI_INVITE_INTERVAL 10000 // 1s
+#define APPLEMIDI_INVITE_ATTEMPTS 12
+#define APPLEMIDI_RETRY_INTERVAL 100000 // 10s, after failed invitations
+#define APPLEMIDI_SYNC_FAST_INTERVAL 15000 // 1.5s
+#define APPLEMIDI_SYNC_FAST_COUNT 6
+#define APPLEMIDI_SYNC_INTERVAL 100000 // 10s
+#define APPLEMIDI_SYNC_TIMEOUT 600000 // 60s without clock sync answer
+
+#define RTPMIDI_PAYLOAD_TYPE 0x61
+#define RTPMIDI_EVENT_MAX 96
+#define RTPMIDI_PACKET_MAX (sizeof(RTPMIDI_Header) + 2 + RTPMIDI_EVENT_MAX*4)
+
+typedef enum _AppleMIDI_State AppleMIDI_State;
+typedef enum _AppleMIDI_Port AppleMIDI_Port;
+typedef struct _AppleMIDI_Invitation AppleMIDI_Invitation;
+typedef struct _AppleMIDI_Sync AppleMIDI_Sync;
+typedef struct _AppleMIDI_Session AppleMIDI_Session;
+typedef struct _RTPMIDI_Header RTPMIDI_Header;
+typedef struct _RTPMIDI_Event RTPMIDI_Event;
+
+enum _AppleMIDI_State {
+	APPLEMIDI_STATE_IDLE = 0, // not started
+	APPLEMIDI_STATE_INVITE_CONTROL,
+	APPLEMIDI_STATE_INVITE_DATA,
+	APPLEMIDI_STATE_CONNECTED
+};
+
+enum _AppleMIDI_Port {
+	APPLEMIDI_PORT_CONTROL = 0,
+	APPLEMIDI_PORT_DATA = 1 // control port + 1
+};
+
+// IN, OK, NO and BY
+struct _AppleMIDI_Invitation {
+	uint16_t signature;
+	char command [2];
+	uint32_t version;
+	uint32_t token;
+	uint32_t ssrc;
+	char name []; // zero terminated, IN and OK only
+} __attribute((packed));
+
+// CK
+struct _AppleMIDI_Sync {
+	uint16_t signature;
+	char command [2];
+	uint32_t ssrc;
+	uint8_t count;
+	uint8_t padding [3];
+	uint64_t timestamp [3];
+} __attribute((packed));
+
+struct _AppleMIDI_Session {
+	uint8_t state;
+	uint8_t attempts; // invitations sent or clock syncs completed
+	uint8_t sync_pending;
+	uint16_t seq; // RTP sequence number
+	uint32_t ssrc;
+	uint32_t token;
+	uint32_t remote_ssrc;
+	uint64_t due; // next session command
+	uint64_t synced; // last completed clock sync
+	uint32_t latency; // last measured one way latency
+	char name [APPLEMIDI_NAME_LEN];
+};
+
+struct _RTPMIDI_Header {
+	uint8_t flags; // version 2, no padding, extension nor CSRC
+	uint8_t type; // marker and payload type
+	uint16_t seq;
+	uint32_t timestamp;
+	uint32_t ssrc;
+} __attribute((packed));
+
+struct _RTPMIDI_Event {
+	uint8_t status; // with channel
+	uint8_t dat1;
+	uint8_t dat2;
+};
+
+void applemidi_reset(AppleMIDI_Session *session, uint32_t ssrc, const char *name);
+void applemidi_start(AppleMIDI_Session *session, uint64_t now);
+uint16_t applemidi_request(AppleMIDI_Session *session, uint64_t now, uint8_t *buf, AppleMIDI_Port *port);
+uint16_t applemidi_dispatch(AppleMIDI_Session *session, uint64_t now, AppleMIDI_Port port,
+	const uint8_t *buf, uint16_t len, uint8_t *reply);
+uint16_t applemidi_bye(AppleMIDI_Session *session, uint8_t *buf);
+uint16_t rtpmidi_packet(AppleMIDI_Session *session, uint64_t now, uint8_t *buf,
+	const RTPMIDI_Event *events, uint_fast8_t n);
+
+#endif // _RTPMIDI_PRIVATE_H_
@@ -34,10 +34,16 @@ BUILDDIRS += $(BUILD_PATH)/$(d)/arp
 BUILDDIRS += $(BUILD_PATH)/$(d)/calibration
 BUILDDIRS += $(BUILD_PATH)/$(d)/linalg
 BUILDDIRS += $(BUILD_PATH)/$(d)/sensors
+BUILDDIRS += $(BUILD_PATH)/$(d)/tuner
+BUILDDIRS += $(BUILD_PATH)/$(d)/health
+BUILDDIRS += $(BUILD_PATH)/$(d)/preset
+BUILDDIRS += $(BUILD_PATH)/$(d)/journal
+BUILDDIRS += $(BUILD_PATH)/$(d)/schema
 
 BUILDDIRS += $(BUILD_PATH)/$(d)/tuio2
 BUILDDIRS += $(BUILD_PATH)/$(d)/tuio1
 BUILDDIRS += $(BUILD_PATH)/$(d)/oscmidi
+BUILDDIRS += $(BUILD_PATH)/$(d)/rtpmidi
 BUILDDIRS += $(BUILD_PATH)/$(d)/midi
 BUILDDIRS += $(BUILD_PATH)/$(d)/dummy
 BUILDDIRS += $(BUILD_PATH)/$(d)/custom
@@ -109,10 +115,12 @@ endif
 cSRCS_$(d) += osc/osc.c
 cSRCS_$(d) += oscquery/oscquery.c
 cSRCS_$(d) += config/config.c
+cSRCS_$(d) += config/config_schema.c
 cSRCS_$(d) += sntp/sntp.c
 cSRCS_$(d) += ptp/ptp.c
 cSRCS_$(d) += tube/tube.c
 cSRCS_$(d) += eeprom/eeprom.c
+cSRCS_$(d) += eeprom/eeprom_i2c.c
 cSRCS_$(d) += chimutil/chimutil.c
 cSRCS_$(d) += debug/debug.c
 cSRCS_$(d) += chimaera/chimaera.c
@@ -121,12 +129,20 @@ cSRCS_$(d) += ipv4ll/ipv4ll.c
 cSRCS_$(d) += dhcpc/dhcpc.c
 cSRCS_$(d) += arp/arp.c
 cSRCS_$(d) += calibration/calibration.c
+cSRCS_$(d) += calibration/calibration_curve.c
 cSRCS_$(d) += linalg/linalg.c
 cSRCS_$(d) += sensors/sensors.c
+cSRCS_$(d) += tuner/tuner.c
+cSRCS_$(d) += health/health.c
+cSRCS_$(d) += preset/preset.c
+cSRCS_$(d) += journal/journal.c
+cSRCS_$(d) += schema/schema.c
 cSRCS_$(d) += firmware.c
 
 cSRCS_$(d) += dump/dump.c
 cSRCS_$(d) += oscmidi/oscmidi.c
+cSRCS_$(d) += rtpmidi/rtpmidi.c
+cSRCS_$(d) += rtpmidi/applemidi.c
 cSRCS_$(d) += midi/midi.c
 cSRCS_$(d) += dummy/dummy.c
 cSRCS_$(d) += scsynth/scsynth.c
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stddef.h>
+
+#include <schema.h>
+
+const Config_Field *
+schema_field(const Config_Field *fields, uint_fast8_t n, uint8_t tag)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<n; i++)
+		if(fields[i].tag == tag)
+			return &fields[i];
+
+	return NULL;
+}
+
+void
+schema_import(EEPROM_24xx *eeprom, uint16_t addr, uint16_t size,
+	const Config_Field *stored, uint_fast8_t stored_n,
+	const Config_Field *fields, uint_fast8_t n, uint8_t *bulk)
+{
+	uint_fast8_t i;
+
+	for(i=0; i<stored_n; i++)
+	{
+		const Config_Field *field = schema_field(fields, n, stored[i].tag);
+
+		if(!field || (field->version != stored[i].version)
+				|| (stored[i].offset + stored[i].len > size) )
+			continue;
+
+		uint16_t len = stored[i].len < field->len ? stored[i].len : field->len;
+		eeprom_bulk_read(eeprom, addr + stored[i].offset, bulk + field->offset, len);
+	}
+}
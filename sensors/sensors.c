@@ -17,10 +17,15 @@
 
 #include <stdio.h>
 
+#include <libmaple/systick.h>
+
 #include <sensors.h>
 #include <config.h>
 #include <chimutil.h>
 #include <cmc.h>
+#include <sntp.h>
+#include <tuner.h>
+#include <health.h>
 
 #if SENSOR_N == 16
 uint8_t adc1_sequence [ADC_DUAL_LENGTH] = {}; // analog input pins read out by the ADC1
@@ -84,6 +89,70 @@ uint8_t adc_unused [ADC_UNUSED_LENGTH] = {};
 uint8_t adc_order [ADC_LENGTH] = { 9, 5, 8, 4, 7, 3, 6, 2, 1, 0};
 #endif
 
+/*
+ * Rate governor
+ */
+
+uint16_t sensors_rate = 0;
+uint_fast8_t sensors_adc_dirty = 0;
+
+static uint_fast8_t governor_idle = 0;
+static uint32_t governor_last = 0; // systick of last area of interest
+static uint32_t governor_wakeups = 0;
+
+void
+sensors_governor_reset(void)
+{
+	sensors_rate = config.sensors.rate;
+	governor_idle = 0;
+	governor_last = systick_uptime();
+}
+
+uint_fast8_t
+sensors_governor_update(uint_fast8_t awake)
+{
+	if(awake)
+	{
+		governor_last = systick_uptime();
+
+		if(governor_idle) // jump back to performance rate on first area of interest
+		{
+			governor_idle = 0;
+			governor_wakeups++;
+			sensors_rate = config.sensors.rate;
+			return 1;
+		}
+	}
+	else if(!governor_idle && config.sensors.idle_rate)
+	{
+		uint32_t timeout = (uint32_t)config.sensors.idle_timeout * SNTP_SYSTICK_RATE / 1000;
+
+		if(systick_uptime() - governor_last > timeout) // fall back to idle rate
+		{
+			governor_idle = 1;
+			sensors_rate = config.sensors.idle_rate;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+_sensors_governor_apply(void)
+{
+	sensors_governor_reset();
+
+	if(sensors_rate)
+	{
+		timer_pause(adc_timer);
+		adc_timer_reconfigure(sensors_rate);
+		timer_resume(adc_timer);
+	}
+	else
+		timer_pause(adc_timer);
+}
+
 /*
  * Config
  */
@@ -95,6 +164,17 @@ static const OSC_Query_Value interpolation_mode_args_values [] = {
 	[INTERPOLATION_LAGRANGE]	= { .s = "lagrange" },
 };
 
+static const OSC_Query_Value sample_time_args_values [] = {
+	[ADC_SMPR_1_5]		= { .s = "1.5" },
+	[ADC_SMPR_2_5]		= { .s = "2.5" },
+	[ADC_SMPR_4_5]		= { .s = "4.5" },
+	[ADC_SMPR_7_5]		= { .s = "7.5" },
+	[ADC_SMPR_19_5]		= { .s = "19.5" },
+	[ADC_SMPR_61_5]		= { .s = "61.5" },
+	[ADC_SMPR_181_5]	= { .s = "181.5" },
+	[ADC_SMPR_601_5]	= { .s = "601.5" }
+};
+
 static uint_fast8_t
 _sensors_number(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -129,15 +209,7 @@ _sensors_rate(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *
 		int32_t i;
 		buf_ptr = osc_get_int32(buf_ptr, &i);
 		config.sensors.rate = i;
-
-		if(config.sensors.rate)
-		{
-			timer_pause(adc_timer);
-			adc_timer_reconfigure();
-			timer_resume(adc_timer);
-		}
-		else
-			timer_pause(adc_timer);
+		_sensors_governor_apply();
 
 		size = CONFIG_SUCCESS("is", uuid, path);
 	}
@@ -231,6 +303,113 @@ _sensors_velocity_stiffness(const char *path, const char *fmt, uint_fast8_t argc
 	return res;
 }
 
+static uint_fast8_t
+_sensors_sample_time(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	uint8_t *sample_time = &config.sensors.sample_time;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc == 1) // query
+		size = CONFIG_SUCCESS("iss", uuid, path, sample_time_args_values[*sample_time].s);
+	else
+	{
+		const char *smp;
+		buf_ptr = osc_get_string(buf_ptr, &smp);
+
+		uint_fast8_t i;
+		for(i=0; i<sizeof(sample_time_args_values)/sizeof(OSC_Query_Value); i++)
+			if(!strcmp(smp, sample_time_args_values[i].s))
+			{
+				*sample_time = i;
+				sensors_adc_dirty = 1; // applied by main loop after current conversion
+				break;
+			}
+
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_sensors_mux_settle(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return config_check_uint8(path, fmt, argc, buf, &config.sensors.mux_settle);
+}
+
+static uint_fast8_t
+_governor_idle_rate(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	uint_fast8_t res = config_check_uint16(path, fmt, argc, buf, &config.sensors.idle_rate);
+	if(argc > 1)
+		_sensors_governor_apply();
+	return res;
+}
+
+static uint_fast8_t
+_governor_timeout(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return config_check_uint16(path, fmt, argc, buf, &config.sensors.idle_timeout);
+}
+
+static uint_fast8_t
+_governor_state(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("iss", uuid, path, governor_idle ? "idle" : "performance");
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_governor_rate(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("isi", uuid, path, sensors_rate);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_governor_wakeups(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	size = CONFIG_SUCCESS("isi", uuid, path, governor_wakeups);
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
 static uint_fast8_t
 _group_reset(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
 {
@@ -403,6 +582,50 @@ static const OSC_Query_Argument sensors_rate_args [] = {
 	OSC_QUERY_ARGUMENT_INT32("Hz", OSC_QUERY_MODE_RW, 0, 10000, 100)
 };
 
+static const OSC_Query_Argument sensors_sample_time_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("ADC cycles", OSC_QUERY_MODE_RW, sample_time_args_values)
+};
+
+static const OSC_Query_Argument sensors_mux_settle_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Microseconds", OSC_QUERY_MODE_RW, 0, 20, 1)
+};
+
+static const OSC_Query_Argument governor_idle_rate_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Hz", OSC_QUERY_MODE_RW, 0, 10000, 10)
+};
+
+static const OSC_Query_Argument governor_timeout_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Milliseconds", OSC_QUERY_MODE_RW, 0, 60000, 100)
+};
+
+static const OSC_Query_Value governor_state_args_values [] = {
+	{ .s = "performance" },
+	{ .s = "idle" }
+};
+
+static const OSC_Query_Argument governor_state_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("State", OSC_QUERY_MODE_R, governor_state_args_values)
+};
+
+static const OSC_Query_Argument governor_rate_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Hz", OSC_QUERY_MODE_R, 0, 10000, 1)
+};
+
+static const OSC_Query_Argument governor_wakeups_args [] = {
+	OSC_QUERY_ARGUMENT_INT32("Number", OSC_QUERY_MODE_R, 0, INT32_MAX, 1)
+};
+
+static const OSC_Query_Item governor_tree [] = {
+	// read-write
+	OSC_QUERY_ITEM_METHOD("idle_rate", "Update rate when idle, 0 disables", _governor_idle_rate, governor_idle_rate_args),
+	OSC_QUERY_ITEM_METHOD("timeout", "Idle time before falling back", _governor_timeout, governor_timeout_args),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("state", "Current state", _governor_state, governor_state_args),
+	OSC_QUERY_ITEM_METHOD("rate", "Current update rate", _governor_rate, governor_rate_args),
+	OSC_QUERY_ITEM_METHOD("wakeups", "Number of wake-ups", _governor_wakeups, governor_wakeups_args)
+};
+
 static const OSC_Query_Value sensors_movingaverage_windows_values [] = {
 	{ .i = 1 },
 	{ .i = 2 },
@@ -429,6 +652,11 @@ const OSC_Query_Item sensors_tree [] = {
 	OSC_QUERY_ITEM_METHOD("interpolation", "Interpolation", _sensors_interpolation, sensors_interpolation_args),
 	OSC_QUERY_ITEM_METHOD("velocity_stiffness", "Stiffness of velocity filter", _sensors_velocity_stiffness, sensors_velocity_stiffness_args),
 	OSC_QUERY_ITEM_METHOD("rate", "Update rate", _sensors_rate, sensors_rate_args),
+	OSC_QUERY_ITEM_NODE("governor/", "Rate governor", governor_tree),
+	OSC_QUERY_ITEM_METHOD("sample_time", "ADC sample time", _sensors_sample_time, sensors_sample_time_args),
+	OSC_QUERY_ITEM_METHOD("mux_settle", "Settle delay after mux switching", _sensors_mux_settle, sensors_mux_settle_args),
+	OSC_QUERY_ITEM_NODE("tuner/", "Sample time and settle delay tuner", tuner_tree),
+	OSC_QUERY_ITEM_NODE("health/", "Sensor health monitoring", health_tree),
 
 	OSC_QUERY_ITEM_METHOD("number", "Sensor number", _sensors_number, sensors_number_args),
 };
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host check and benchmark of the firmware's unmodified calibration/calibration_curve.c
+// against the curve lookup table as computed with cbrtf for every sample
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <oscquery.h>
+
+#include "../../calibration/calibration_private.h"
+
+#define N 0x800
+#define TOLERANCE 1e-6f
+#define RUNS 2000
+
+static float table [N];
+static float reference [N];
+
+// lookup table as computed before, one cbrtf and sqrtf per sample
+static void
+_reference(float *tab, const float *C)
+{
+	uint32_t i;
+
+	for(i=0; i<N; i++)
+	{
+		float x =(float)i /(float)0x7ff;
+		float y = C[0]*cbrtf(x) + C[1]*sqrtf(x) + C[2]*x;
+		y = y < 0.f ? 0.f :(y > 1.f ? 1.f : y);
+		tab[i] = y;
+	}
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+// best of runs, in us per table
+static double
+_bench(void (*fill)(float *tab, const float *C), const float *C)
+{
+	double best = INFINITY;
+	unsigned r;
+
+	for(r=0; r<RUNS; r++)
+	{
+		double t0 = _now();
+		fill(table, C);
+		double dt = _now() - t0;
+		if(dt < best)
+			best = dt;
+	}
+
+	return best * 1e-3;
+}
+
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	// factory default, pure roots and a typical five-point fit
+	static const float Cs [][3] = {
+		{0.f, 1.f, 0.f},
+		{1.f, 0.f, 0.f},
+		{0.f, 0.f, 1.f},
+		{0.42f, 0.81f, -0.23f},
+		{1.3f, -0.4f, 0.1f}
+	};
+	unsigned failures = 0;
+	unsigned c;
+
+	printf("%-24s %10s %10s %10s\n", "C0 C1 C2", "max error", "before us", "after us");
+	for(c=0; c<sizeof(Cs) / sizeof(Cs[0]); c++)
+	{
+		const float *C = Cs[c];
+		float worst = 0.f;
+		uint32_t i;
+
+		_reference(reference, C);
+		range_curve_fill(table, C);
+
+		for(i=0; i<N; i++)
+		{
+			float err = fabsf(table[i] - reference[i]);
+			if(err > worst)
+				worst = err;
+		}
+
+		double before = _bench(_reference, C);
+		double after = _bench(range_curve_fill, C);
+
+		printf("%6.2f %6.2f %6.2f    %10.2g %10.1f %10.1f %s\n", C[0], C[1], C[2],
+			worst, before, after, worst <= TOLERANCE ? "ok" : "FAIL");
+		if(worst > TOLERANCE)
+			failures++;
+	}
+
+	printf("libm calls per table: %u before, %u after\n", 2*N, N + 0x40);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
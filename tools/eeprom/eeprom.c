@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host model of the 24LC64 behind the firmware's unmodified eeprom/eeprom.c,
+// counts page write cycles of image and queued saves and verifies the stored content,
+// queued pages are clocked out by stepped transfers as with eeprom/eeprom_i2c.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmaple/i2c.h>
+#include <libmaple/delay.h>
+#include <libmaple/systick.h>
+
+#include <eeprom.h>
+
+#include "../../eeprom/eeprom_private.h"
+
+#define STORAGE_SIZE 0x2000
+#define PAGE_SIZE EEPROM_24LC64_PAGE_SIZE
+#define BIT_TIME 10 // us, 100kHz I2C
+#define WRITE_TIME 5000 // us, maximal write cycle of the 24LC64
+#define POLL_TIME 2 // us, register accesses of a transfer poll
+#define POLL_BYTES 2 // bytes fed per poll, data register and shift register
+
+// representative sizes of the config struct and a calibration slot
+#define CONFIG_LEN 3344
+#define RANGE_LEN 1296
+#define RANGE_ADDR (0x1000 + RANGE_LEN) // slot 1, not page aligned
+
+typedef struct _Model Model;
+
+struct _Model {
+	uint8_t mem [STORAGE_SIZE];
+	uint16_t ptr; // address counter
+	uint32_t now; // us
+	uint32_t busy; // end of write cycle in progress
+	unsigned writes; // page write cycles
+	unsigned nacks; // transfers during a write cycle
+	unsigned crossings; // page writes wrapping at a page boundary
+	unsigned collisions; // blocking transfers during a stepped one
+	i2c_msg *xfer; // stepped transfer in progress
+	uint32_t shifted; // when the bytes fed so far will have been clocked out
+};
+
+static Model model;
+static unsigned failures = 0;
+
+int32_t
+i2c_master_xfer(i2c_dev *dev, i2c_msg *msgs, uint16_t num, uint32_t timeout)
+{
+	(void)dev;
+	(void)timeout;
+
+	if(model.xfer)
+		model.collisions++;
+
+	for(uint16_t m=0; m<num; m++)
+	{
+		i2c_msg *msg = &msgs[m];
+
+		model.now += (msg->length + 1) * 9 * BIT_TIME; // slave address + payload
+
+		if( (int32_t)(model.now - model.busy) < 0) // device does not acknowledge while writing
+		{
+			model.nacks++;
+			return -1;
+		}
+
+		if(msg->flags & I2C_MSG_READ)
+		{
+			for(uint16_t i=0; i<msg->length; i++)
+				msg->data[i] = model.mem[model.ptr++ % STORAGE_SIZE];
+		}
+		else
+		{
+			model.ptr = ( (msg->data[0] << 8) | msg->data[1] ) % STORAGE_SIZE;
+
+			if(msg->length > 2) // page write
+			{
+				uint16_t page = model.ptr & ~(PAGE_SIZE - 1);
+
+				for(uint16_t i=2; i<msg->length; i++)
+				{
+					if( (model.ptr & ~(PAGE_SIZE - 1)) != page)
+						model.crossings++;
+					model.mem[page | (model.ptr & (PAGE_SIZE - 1))] = msg->data[i];
+					model.ptr = page | ( (model.ptr + 1) & (PAGE_SIZE - 1) );
+				}
+
+				model.writes++;
+				model.busy = model.now + WRITE_TIME;
+			}
+		}
+
+		msg->xferred = msg->length;
+	}
+
+	return 0;
+}
+
+// the slave address goes out on start, SCL is stretched while the data register is empty
+int32_t
+eeprom_xfer_start(i2c_dev *dev, i2c_msg *msg)
+{
+	(void)dev;
+
+	if(model.xfer)
+	{
+		model.collisions++;
+		return -1;
+	}
+
+	model.now += POLL_TIME;
+	msg->xferred = 0;
+	model.xfer = msg;
+	model.shifted = model.now + 9 * BIT_TIME;
+
+	return 0;
+}
+
+int32_t
+eeprom_xfer_poll(i2c_dev *dev, i2c_msg *msg)
+{
+	model.now += POLL_TIME;
+
+	if( (int32_t)(model.now - model.shifted) < 0) // still clocking out
+		return 1;
+
+	if(msg->xferred < msg->length)
+	{
+		uint16_t n = msg->length - msg->xferred;
+		if(n > POLL_BYTES)
+			n = POLL_BYTES;
+
+		msg->xferred += n;
+		model.shifted = model.now + n * 9 * BIT_TIME;
+
+		return 1;
+	}
+
+	// STOP, the model commits the whole message at once, its clock already advanced
+	model.xfer = NULL;
+	uint32_t now = model.now;
+	model.now -= (msg->length + 1) * 9 * BIT_TIME;
+	int32_t res = i2c_master_xfer(dev, msg, 1, 0);
+	model.now = now;
+
+	return res;
+}
+
+void
+i2c_master_enable(i2c_dev *dev, uint32_t flags)
+{
+	(void)dev;
+	(void)flags;
+}
+
+void
+i2c_disable(i2c_dev *dev)
+{
+	(void)dev;
+}
+
+void
+delay_us(uint32_t us)
+{
+	model.now += us;
+}
+
+uint32_t
+systick_uptime(void)
+{
+	model.now++; // polling takes time, too
+
+	return model.now / 1000;
+}
+
+static void
+_check(const char *what, unsigned expected, unsigned got)
+{
+	uint_fast8_t ok = expected == got;
+
+	printf("%-40s %4u %4u %s\n", what, expected, got, ok ? "ok" : "FAIL");
+	if(!ok)
+		failures++;
+}
+
+static void
+_verify(const char *what, uint16_t addr, const uint8_t *bulk, uint16_t len)
+{
+	_check(what, 0, memcmp(&model.mem[addr], bulk, len) != 0);
+}
+
+static unsigned
+_pages(uint16_t addr, uint16_t len)
+{
+	return (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+}
+
+static uint8_t cfg [CONFIG_LEN];
+static uint8_t rng [RANGE_LEN];
+static uint32_t cfg_hash [EEPROM_IMAGE_PAGES(CONFIG_LEN, PAGE_SIZE)];
+static uint32_t rng_hash [EEPROM_IMAGE_PAGES(RANGE_LEN, PAGE_SIZE)];
+
+static EEPROM_Image cfg_image = {
+	.n = EEPROM_IMAGE_PAGES(CONFIG_LEN, PAGE_SIZE),
+	.hash = cfg_hash
+};
+
+static EEPROM_Image rng_image = {
+	.n = EEPROM_IMAGE_PAGES(RANGE_LEN, PAGE_SIZE),
+	.hash = rng_hash
+};
+
+// incremental saves write only the pages that changed
+static void
+_image(void)
+{
+	uint16_t i;
+
+	for(i=0; i<CONFIG_LEN; i++)
+		cfg[i] = i * 7;
+
+	model.writes = 0;
+	eeprom_bulk_write(eeprom_24LC64, 0, cfg, CONFIG_LEN);
+	_check("bulk save of config", _pages(0, CONFIG_LEN), model.writes);
+
+	eeprom_image_read(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN);
+	model.writes = 0;
+	_check("image save of unchanged config", 0, eeprom_image_write(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN));
+	_check("  page writes", 0, model.writes);
+
+	cfg[100] ^= 1;
+	model.writes = 0;
+	_check("image save of 1 changed byte", 1, eeprom_image_write(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN));
+	_check("  page writes", 1, model.writes);
+
+	cfg[5] ^= 1;
+	cfg[3000] ^= 1;
+	cfg[3001] ^= 1;
+	model.writes = 0;
+	_check("image save of 3 bytes in 2 pages", 2, eeprom_image_write(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN));
+	_check("  page writes", 2, model.writes);
+	_verify("  content mismatch", 0, cfg, CONFIG_LEN);
+
+	for(i=0; i<RANGE_LEN; i++)
+		rng[i] = i * 3;
+
+	model.writes = 0;
+	_check("first image save of unaligned slot", _pages(RANGE_ADDR, RANGE_LEN),
+		eeprom_image_write(eeprom_24LC64, &rng_image, RANGE_ADDR, rng, RANGE_LEN));
+	_check("  page writes", _pages(RANGE_ADDR, RANGE_LEN), model.writes);
+
+	rng[700] ^= 0xff;
+	model.writes = 0;
+	_check("image save of 1 changed byte in slot", 1, eeprom_image_write(eeprom_24LC64, &rng_image, RANGE_ADDR, rng, RANGE_LEN));
+	_check("  page writes", 1, model.writes);
+	_verify("  content mismatch", RANGE_ADDR, rng, RANGE_LEN);
+	_verify("  config clobbered", 0, cfg, CONFIG_LEN);
+
+	// a different region invalidates the hashes
+	model.writes = 0;
+	_check("image save of slot at another address", _pages(0x1000, RANGE_LEN),
+		eeprom_image_write(eeprom_24LC64, &rng_image, 0x1000, rng, RANGE_LEN));
+	_verify("  content mismatch", 0x1000, rng, RANGE_LEN);
+}
+
+// runs the write queue once per 1ms frame until idle, returns the longest step in us
+static uint32_t
+_frames(unsigned max)
+{
+	uint32_t worst = 0;
+
+	while(max--)
+	{
+		uint32_t t0 = model.now;
+		uint_fast8_t pending = eeprom_queue_step();
+		if(model.now - t0 > worst)
+			worst = model.now - t0;
+		model.now += 1000;
+
+		if(!pending)
+			break;
+	}
+
+	return worst;
+}
+
+// a change while a queued save is in flight either restarts the save or mixes old and new values
+static void
+_queue(void)
+{
+	uint16_t i;
+	unsigned pages = _pages(0, CONFIG_LEN);
+
+	for(i=0; i<CONFIG_LEN; i++)
+		cfg[i] = i * 11;
+
+	cfg_image.valid = 0; // worst case, all pages dirty
+	model.writes = 0;
+	eeprom_queue_push(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN);
+	uint32_t worst = _frames(pages * 11); // half way through
+	cfg[10] ^= 0xff; // already written
+	cfg[CONFIG_LEN - 1] ^= 0xff; // not yet written
+	_check("queued save pending half way", EEPROM_STATUS_PENDING, cfg_image.status);
+	uint32_t t0 = model.now;
+	_frames(-1);
+	_check("  without restart", EEPROM_STATUS_DONE, cfg_image.status);
+	uint32_t per_page = (model.now - t0) / (model.writes ? model.writes : 1);
+	_check("  mixes old and new values", 1, memcmp(&model.mem[0], cfg, CONFIG_LEN) != 0);
+
+	for(i=0; i<CONFIG_LEN; i++)
+		cfg[i] = i * 13;
+
+	model.writes = 0;
+	eeprom_queue_push(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN);
+	_frames(pages * 11);
+	cfg[10] ^= 0xff;
+	cfg[CONFIG_LEN - 1] ^= 0xff;
+	eeprom_queue_push(eeprom_24LC64, &cfg_image, 0, cfg, CONFIG_LEN); // restart
+	uint32_t age = eeprom_queue_age();
+	_frames(-1);
+	_check("  with restart", EEPROM_STATUS_DONE, cfg_image.status);
+	_check("  page writes, 1 rewritten", pages + 1, model.writes);
+	_verify("  content mismatch", 0, cfg, CONFIG_LEN);
+	_check("  age kept on restart", 1, age >= pages / 2 * 10);
+
+	printf("longest queue step %u us, %u us per page at 100kHz and 1ms frames,\n"
+		"blocking page transfer %u us\n", worst, per_page, (PAGE_SIZE + 3) * 9 * BIT_TIME);
+}
+
+// blocking reads beside a queued save leave it pending, reads of its region wait for it
+static void
+_settle(void)
+{
+	uint8_t byt;
+	uint16_t i;
+
+	for(i=0; i<RANGE_LEN; i++)
+		rng[i] = i * 5;
+
+	rng_image.valid = 0;
+	eeprom_queue_push(eeprom_24LC64, &rng_image, RANGE_ADDR, rng, RANGE_LEN);
+	_frames(20);
+	eeprom_byte_read(eeprom_24LC64, 10, &byt);
+	_check("read beside queued save", EEPROM_STATUS_PENDING, rng_image.status);
+	_check("  value", cfg[10], byt);
+	eeprom_byte_read(eeprom_24LC64, RANGE_ADDR + RANGE_LEN - 1, &byt);
+	_check("read within queued save", EEPROM_STATUS_DONE, rng_image.status);
+	_check("  value", rng[RANGE_LEN - 1], byt);
+}
+
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	eeprom_init(NULL);
+	eeprom_slave_init(eeprom_24LC64, NULL, 0);
+
+	printf("%-40s %4s %4s\n", "", "exp", "got");
+	_image();
+	_queue();
+	_settle();
+
+	_check("transfers during write cycle", 0, model.nacks);
+	_check("blocking transfers during stepped ones", 0, model.collisions);
+	_check("page writes across page boundary", 0, model.crossings);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in for eeprom/eeprom_i2c.c, completes the transfer at once via the
+// tool's model behind i2c_master_xfer, for tools that do not look at stepping
+
+#include <libmaple/i2c.h>
+
+#include "../../../eeprom/eeprom_private.h"
+
+int32_t
+eeprom_xfer_start(i2c_dev *dev, i2c_msg *msg)
+{
+	return i2c_master_xfer(dev, msg, 1, 0);
+}
+
+int32_t
+eeprom_xfer_poll(i2c_dev *dev, i2c_msg *msg)
+{
+	(void)dev;
+	(void)msg;
+
+	return 0; // done by eeprom_xfer_start
+}
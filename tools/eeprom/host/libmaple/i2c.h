@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in for libmaple's I2C interface, the transfers are served by
+// the 24LC64 model in eeprom.c
+
+#ifndef _LIBMAPLE_I2C_H_
+#define _LIBMAPLE_I2C_H_
+
+#include <stdint.h>
+
+#define I2C_MSG_READ 0x1
+#define I2C_BUS_RESET 0x2
+
+typedef struct i2c_dev i2c_dev;
+typedef struct i2c_msg i2c_msg;
+
+struct i2c_msg {
+	uint16_t addr;
+	uint16_t flags;
+	uint16_t length;
+	uint16_t xferred;
+	uint8_t *data;
+};
+
+int32_t i2c_master_xfer(i2c_dev *dev, i2c_msg *msgs, uint16_t num, uint32_t timeout);
+void i2c_master_enable(i2c_dev *dev, uint32_t flags);
+void i2c_disable(i2c_dev *dev);
+
+#endif // _LIBMAPLE_I2C_H_
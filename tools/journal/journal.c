@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host power-loss simulator for the firmware's unmodified journal/journal.c,
+// cuts power at every byte of a save and checks that each slot still loads
+// either its new or its previous record
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmaple/i2c.h>
+#include <libmaple/delay.h>
+#include <libmaple/systick.h>
+
+#include <journal.h>
+
+#define STORAGE_SIZE 0x2000
+#define PAGE_SIZE EEPROM_24LC64_PAGE_SIZE
+
+// as in include/chimaera.h with 160 sensors
+#define RANGE_OFFSET 0x1000
+#define RANGE_LEGACY_SIZE 0x0510
+#define RANGE_JOURNAL_SIZE 0x1000
+#define RANGE_LEN 1296
+#define SLOTS 2
+
+#define VERSIONS 8
+
+typedef struct _Model Model;
+
+struct _Model {
+	uint8_t mem [STORAGE_SIZE];
+	uint16_t ptr; // address counter
+	uint32_t now; // us
+	long budget; // bytes until power is cut, negative for never
+	uint_fast8_t off; // power is cut, transfers fail until reboot
+	unsigned bytes; // written
+};
+
+static Model model;
+static Journal journal;
+static EEPROM_Image image;
+static uint8_t versions [VERSIONS][RANGE_LEN];
+static uint8_t staging [RANGE_LEN]; // payload must not change while being written
+static uint8_t tmp [SLOTS][RANGE_LEN];
+static unsigned trials = 0;
+static unsigned failures = 0;
+
+int32_t
+i2c_master_xfer(i2c_dev *dev, i2c_msg *msgs, uint16_t num, uint32_t timeout)
+{
+	(void)dev;
+	(void)timeout;
+
+	for(uint16_t m=0; m<num; m++)
+	{
+		i2c_msg *msg = &msgs[m];
+
+		if(model.off)
+			return -1;
+
+		if(msg->flags & I2C_MSG_READ)
+		{
+			for(uint16_t i=0; i<msg->length; i++)
+				msg->data[i] = model.mem[model.ptr++ % STORAGE_SIZE];
+			continue;
+		}
+
+		model.ptr = ( (msg->data[0] << 8) | msg->data[1] ) % STORAGE_SIZE;
+
+		for(uint16_t i=2; i<msg->length; i++)
+		{
+			if(model.budget == 0) // torn page write, rest of the page buffer is garbage
+			{
+				for(; i<msg->length; i++)
+					model.mem[model.ptr + i - 2] ^= 0x5a;
+				model.off = 1;
+				return -1;
+			}
+			if(model.budget > 0)
+				model.budget--;
+
+			model.mem[model.ptr + i - 2] = msg->data[i];
+			model.bytes++;
+		}
+	}
+
+	return 0;
+}
+
+void
+i2c_master_enable(i2c_dev *dev, uint32_t flags)
+{
+	(void)dev;
+	(void)flags;
+}
+
+void
+i2c_disable(i2c_dev *dev)
+{
+	(void)dev;
+}
+
+void
+delay_us(uint32_t us)
+{
+	model.now += us;
+}
+
+uint32_t
+systick_uptime(void)
+{
+	model.now += 100; // polling takes time, too
+
+	return model.now / 1000;
+}
+
+// power cycle, pending writes fail and RAM state is lost
+static void
+_reboot(void)
+{
+	eeprom_queue_flush();
+	model.off = 0;
+	model.budget = -1;
+
+	memset(&journal, 0, sizeof(Journal));
+	memset(&image, 0, sizeof(EEPROM_Image));
+	journal_init(&journal, eeprom_24LC64, RANGE_OFFSET, RANGE_JOURNAL_SIZE, RANGE_LEN);
+}
+
+static uint_fast8_t
+_save(uint8_t tag, const uint8_t *data)
+{
+	memcpy(staging, data, RANGE_LEN);
+	if(!journal_write(&journal, tag, staging, RANGE_LEN, &image))
+		return 0;
+	eeprom_queue_flush();
+
+	return !model.off;
+}
+
+static uint_fast8_t
+_load(uint8_t tag, const uint8_t *expected)
+{
+	uint8_t data [RANGE_LEN];
+
+	return journal_read(&journal, tag, data, RANGE_LEN) && !memcmp(data, expected, RANGE_LEN);
+}
+
+static void
+_fail(const char *what, int a, int b)
+{
+	if(failures++ < 10)
+		printf("FAIL %s (%i, %i)\n", what, a, b);
+}
+
+// saves slot 0 with power cut at every byte, slot 1 must survive, slot 0 must hold new or previous version
+static void
+_torn(int history)
+{
+	static uint8_t base [STORAGE_SIZE];
+	int v;
+
+	memset(model.mem, 0xff, STORAGE_SIZE);
+	_reboot();
+	_save(1, versions[VERSIONS-1]);
+	for(v=0; v<history; v++)
+	{
+		_reboot();
+		_save(0, versions[v]);
+		if(v % 2) // move slot 1 around, too
+			_save(1, versions[VERSIONS-1]);
+	}
+	memcpy(base, model.mem, STORAGE_SIZE);
+
+	_reboot();
+	model.bytes = 0;
+	_save(0, versions[history]);
+	unsigned total = model.bytes;
+
+	for(unsigned b=0; b<=total; b++)
+	{
+		memcpy(model.mem, base, STORAGE_SIZE);
+		_reboot();
+		model.budget = b;
+		_save(0, versions[history]);
+		_reboot();
+		trials++;
+
+		if(!_load(0, versions[history]) && !_load(0, versions[history-1]) )
+			_fail("slot 0 lost", history, b);
+		if(!_load(1, versions[VERSIONS-1]) )
+			_fail("slot 1 lost", history, b);
+	}
+
+	printf("history %i: save of %u bytes cut at every byte\n", history, total);
+}
+
+// a new tag must leave a spare frame, live records are never overwritten
+static void
+_spare(void)
+{
+	memset(model.mem, 0xff, STORAGE_SIZE);
+	_reboot();
+
+	if(!_save(0, versions[0]) || !_save(1, versions[1]) )
+		_fail("two slots", journal.frames, 0);
+	if(_save(2, versions[2]) )
+		_fail("third slot takes spare frame", journal.frames, 0);
+	for(int i=0; i<10; i++)
+		if(!_save(i % 2, versions[3 + i % 2]) )
+			_fail("rotation with spare frame", i, 0);
+
+	_reboot();
+	if(!_load(0, versions[3]) || !_load(1, versions[4]) )
+		_fail("slots after rotation", 0, 0);
+
+	printf("%u frames of %u bytes, %u slots and a spare\n", journal.frames, journal.frame, SLOTS);
+}
+
+// first save carries the legacy slots over, power cut at every 7th byte of the import
+static void
+_import(void)
+{
+	static uint8_t legacy [STORAGE_SIZE];
+	unsigned total;
+	int s;
+
+	memset(legacy, 0xff, STORAGE_SIZE);
+	for(s=0; s<=SLOTS; s++)
+		memcpy(&legacy[RANGE_OFFSET + s*RANGE_LEGACY_SIZE], versions[s], RANGE_LEN);
+
+	memcpy(model.mem, legacy, STORAGE_SIZE);
+	_reboot();
+	model.bytes = 0;
+	if(!journal_empty(&journal) || !journal_import(&journal, RANGE_LEGACY_SIZE, SLOTS, tmp[0], RANGE_LEN, &image) )
+		_fail("import", 0, 0);
+	total = model.bytes;
+	_save(1, versions[VERSIONS-1]); // the save that triggered the import
+
+	_reboot();
+	if(!_load(0, versions[0]) )
+		_fail("legacy slot 0 after import", 0, 0);
+	if(!_load(1, versions[VERSIONS-1]) )
+		_fail("saved slot 1 after import", 0, 0);
+
+	for(unsigned b=0; b<=total; b+=7)
+	{
+		memcpy(model.mem, legacy, STORAGE_SIZE);
+		_reboot();
+		model.budget = b;
+		journal_import(&journal, RANGE_LEGACY_SIZE, SLOTS, tmp[0], RANGE_LEN, &image);
+		_reboot();
+		trials++;
+
+		// slots imported completely before the cut must load
+		for(s=0; s<SLOTS; s++)
+			if( (b >= (s + 1)*(total / SLOTS)) && !_load(s, versions[s]) )
+				_fail("imported slot lost", s, b);
+	}
+
+	printf("import of %u legacy slots, %u bytes\n", SLOTS, total);
+}
+
+// saves of one slot spread over the frames not live for the other
+static void
+_wear(void)
+{
+	unsigned count [JOURNAL_FRAMES_MAX] = {0};
+
+	memset(model.mem, 0xff, STORAGE_SIZE);
+	_reboot();
+	_save(1, versions[VERSIONS-1]);
+	for(int i=0; i<30; i++)
+	{
+		_save(0, versions[i % (VERSIONS-1)]);
+		count[journal.last]++;
+	}
+
+	printf("30 saves of slot 0 per frame:");
+	for(int f=0; f<journal.frames; f++)
+		printf(" %u", count[f]);
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	for(int v=0; v<VERSIONS; v++)
+		for(int i=0; i<RANGE_LEN; i++)
+			versions[v][i] = i*31 + v*8;
+
+	eeprom_init(NULL);
+	eeprom_slave_init(eeprom_24LC64, NULL, 0);
+
+	for(int history=1; history<6; history++)
+		_torn(history);
+	_spare();
+	_import();
+	_wear();
+
+	printf("%u power-loss trials, %u failures\n", trials, failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// randomized check of the MIDI voice allocator in midi/midi.c against a
+// reference model: after every acquire and release the channel loads, free
+// masks, least recent rings and age lists must agree with a plain recount,
+// and the chosen or stolen channel must be the one the model expects
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <midi.h>
+
+#define ROUNDS 3000
+#define OPS 2000
+#define SID_MAX (1000 + OPS * 41) // upper bound of the sids handed out per round
+
+typedef struct _Model Model;
+
+struct _Model {
+	uint32_t live [BLOB_MAX]; // sids with a voice
+	uint8_t nlive;
+	uint8_t lru [ZONE_MAX][CHAN_MAX]; // free member channels per zone, least recently released first
+	uint8_t nlru [ZONE_MAX];
+};
+
+static MIDI_Alloc alloc;
+static Model model;
+static uint8_t zone_of [SID_MAX];
+static unsigned failed = 0;
+
+#define CHECK(COND) \
+	if(!(COND)) \
+	{ \
+		printf("line %i: %s\n", __LINE__, #COND); \
+		failed++; \
+		return; \
+	}
+
+static void
+model_remove(uint8_t z, uint8_t cha)
+{
+	uint_fast8_t k;
+
+	for(k=0; k<model.nlru[z]; k++)
+		if(model.lru[z][k] == cha)
+		{
+			memmove(&model.lru[z][k], &model.lru[z][k+1], model.nlru[z] - k - 1);
+			model.nlru[z]--;
+			return;
+		}
+}
+
+static void
+model_forget(uint32_t sid)
+{
+	uint_fast8_t k;
+
+	for(k=0; k<model.nlive; k++)
+		if(model.live[k] == sid)
+		{
+			model.live[k] = model.live[--model.nlive];
+			return;
+		}
+}
+
+// channel the allocator must pick in zone z, -1 if none is free
+static int
+model_expect(uint8_t z)
+{
+	const MIDI_Zone *zone = &alloc.zones[z];
+	uint_fast8_t j;
+
+	if(!zone->free)
+		return -1;
+	if(alloc.select == MIDI_SELECT_LEAST_RECENT)
+		return model.lru[z][0];
+
+	for(j=0; j<zone->span; j++)
+	{
+		uint_fast8_t p = (zone->ref + j) % zone->span;
+
+		if(zone->free & (1 << p))
+			return zone->base + 1 + p;
+	}
+
+	return -1;
+}
+
+static void
+consistent(void)
+{
+	uint8_t load [CHAN_MAX];
+	uint_fast8_t voices = 0;
+	uint_fast8_t i;
+	uint_fast8_t z;
+
+	memset(load, 0, sizeof(load));
+	for(i=0; i<BLOB_MAX; i++)
+		if(alloc.voices[i].sid)
+		{
+			voices++;
+			load[alloc.voices[i].cha]++;
+			CHECK(midi_voice_get(&alloc, alloc.voices[i].sid) == &alloc.voices[i]);
+		}
+	CHECK(voices == model.nlive);
+	CHECK(!memcmp(load, alloc.load, sizeof(load)));
+
+	for(z=0; z<alloc.n_zones; z++)
+	{
+		const MIDI_Zone *zone = &alloc.zones[z];
+		uint_fast8_t nfree = 0;
+		uint_fast8_t aged = 0;
+		uint_fast8_t owned = 0;
+		uint8_t v;
+		uint_fast8_t j;
+
+		for(j=0; j<zone->span; j++)
+		{
+			uint_fast8_t cha = zone->base + 1 + j;
+
+			CHECK(!!(zone->free & (1 << j)) == (alloc.load[cha] == 0));
+			nfree += alloc.load[cha] == 0;
+		}
+
+		if( (alloc.select == MIDI_SELECT_LEAST_RECENT) && zone->span)
+		{
+			CHECK(nfree == zone->count);
+			CHECK(nfree == model.nlru[z]);
+			for(j=0; j<nfree; j++)
+				CHECK(alloc.ring[zone->base + 1 + (zone->head + j) % zone->span] == model.lru[z][j]);
+		}
+
+		for(v=zone->oldest; v!=MIDI_NIL; v=alloc.voices[v].next)
+		{
+			CHECK(alloc.voices[v].zone == z);
+			aged++;
+		}
+		for(i=0; i<BLOB_MAX; i++)
+			owned += alloc.voices[i].sid && (alloc.voices[i].zone == z);
+		CHECK(aged == owned);
+	}
+}
+
+static void
+acquire(uint32_t sid, uint8_t z, unsigned long *steals, unsigned long *drops)
+{
+	const MIDI_Zone *zone = &alloc.zones[z];
+	uint32_t oldest = zone->oldest == MIDI_NIL ? 0 : alloc.voices[zone->oldest].sid;
+	int expect = model_expect(z);
+	MIDI_Voice stolen;
+	MIDI_Voice *voice;
+
+	voice = midi_voice_acquire(&alloc, sid, z, sid & 0x7f, &stolen);
+
+	if(expect >= 0)
+	{
+		CHECK(voice && (voice->cha == expect) && !stolen.sid);
+		model_remove(z, expect);
+	}
+	else if(alloc.steal == MIDI_STEAL_OLDEST)
+	{
+		CHECK(voice && (stolen.sid == oldest) && (voice->cha == stolen.cha));
+		model_forget(stolen.sid);
+		(*steals)++;
+	}
+	else if(alloc.steal == MIDI_STEAL_NONE)
+	{
+		CHECK(!voice && !stolen.sid);
+		(*drops)++;
+		return;
+	}
+	else // MIDI_STEAL_STACK
+		CHECK(voice && !stolen.sid);
+
+	zone_of[sid] = z;
+	model.live[model.nlive++] = sid;
+}
+
+static void
+release(uint32_t sid)
+{
+	uint8_t z = zone_of[sid];
+	uint8_t key;
+	uint8_t cha;
+
+	model_forget(sid);
+
+	CHECK(!midi_voice_release(&alloc, sid, &key, &cha));
+	CHECK(key == (sid & 0x7f));
+	if(alloc.zones[z].span && (alloc.load[cha] == 0) )
+		model.lru[z][model.nlru[z]++] = cha;
+
+	CHECK(midi_voice_release(&alloc, sid, &key, &cha)); // already released
+}
+
+int
+main(void)
+{
+	unsigned long ops = 0;
+	unsigned long steals = 0;
+	unsigned long drops = 0;
+	unsigned round;
+
+	srand(1);
+	for(round=0; round<ROUNDS; round++)
+	{
+		uint8_t n_zones = 1 + rand() % ZONE_MAX;
+		uint32_t sid = 1 + rand() % 1000;
+		unsigned i;
+		uint_fast8_t z;
+
+		midi_alloc_populate(&alloc, n_zones, 1, rand() % 2, rand() % 3);
+
+		memset(&model, 0, sizeof(model));
+		for(z=0; z<n_zones; z++)
+		{
+			uint_fast8_t j;
+
+			model.nlru[z] = alloc.zones[z].span;
+			for(j=0; j<model.nlru[z]; j++)
+				model.lru[z][j] = alloc.zones[z].base + 1 + j;
+		}
+
+		for(i=0; i<OPS; i++, ops++)
+		{
+			if( (model.nlive < BLOB_MAX) && (!model.nlive || (rand() % 2) ) )
+			{
+				acquire(sid, rand() % n_zones, &steals, &drops);
+				sid += 1 + (rand() % 3 == 0 ? rand() % 40 : 0); // sparse sids collide in the hash
+			}
+			else
+				release(model.live[rand() % model.nlive]);
+
+			consistent();
+			if(failed)
+				return 1;
+		}
+	}
+
+	printf("%lu operations, %lu steals, %lu drops: ok\n", ops, steals, drops);
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host benchmark of the MIDI voice allocator: 8 fingers retrigger every 2-5
+// frames, every frame runs on, set or off for each of them, built against
+// midi/midi.c and with -DOLD against the linear allocator it replaced
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <midi.h>
+
+#define FINGERS 8
+
+#ifdef OLD
+static const char *name = "linear";
+static MIDI_Hash hash [BLOB_MAX];
+static mpe_t mpe;
+
+static void
+init(uint8_t zones, uint8_t select, uint8_t steal)
+{
+	(void)select;
+	(void)steal;
+	memset(hash, 0, sizeof(hash));
+	mpe_populate(&mpe, zones);
+}
+
+static void
+on(uint32_t sid, uint8_t zone, uint8_t key)
+{
+	uint8_t cha = mpe_acquire(&mpe, zone);
+
+	midi_add_key(hash, sid, key, cha);
+}
+
+static void
+set(uint32_t sid)
+{
+	uint8_t key;
+	uint8_t cha;
+
+	midi_get_key(hash, sid, &key, &cha);
+}
+
+static void
+off(uint32_t sid, uint8_t zone)
+{
+	uint8_t key;
+	uint8_t cha;
+
+	midi_rem_key(hash, sid, &key, &cha);
+	mpe_release(&mpe, zone, cha);
+}
+#else
+static const char *name = "MIDI_Alloc";
+static MIDI_Alloc alloc;
+
+static void
+init(uint8_t zones, uint8_t select, uint8_t steal)
+{
+	midi_alloc_populate(&alloc, zones, 1, select, steal);
+}
+
+static void
+on(uint32_t sid, uint8_t zone, uint8_t key)
+{
+	MIDI_Voice stolen;
+
+	midi_voice_acquire(&alloc, sid, zone, key, &stolen);
+}
+
+static void
+set(uint32_t sid)
+{
+	MIDI_Voice * volatile voice = midi_voice_get(&alloc, sid);
+
+	(void)voice;
+}
+
+static void
+off(uint32_t sid, uint8_t zone)
+{
+	uint8_t key;
+	uint8_t cha;
+
+	(void)zone;
+	midi_voice_release(&alloc, sid, &key, &cha);
+}
+#endif
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t zones = argc > 1 ? atoi(argv[1]) : 1;
+	uint8_t select = argc > 2 ? atoi(argv[2]) : 1; // least recent
+	uint8_t steal = argc > 3 ? atoi(argv[3]) : 0; // stack
+	uint32_t frames = argc > 4 ? strtoul(argv[4], NULL, 10) : 2000000;
+	uint32_t sids [FINGERS];
+	uint32_t ages [FINGERS];
+	uint32_t sid = 1;
+	uint64_t events = 0;
+	uint64_t t0;
+	uint32_t fid;
+	uint_fast8_t i;
+
+	if( (zones < 1) || (zones > ZONE_MAX) )
+	{
+		fprintf(stderr, "usage: %s [ZONES [SELECT [STEAL [FRAMES]]]], 1-%u zones\n", argv[0], ZONE_MAX);
+		return 1;
+	}
+
+	memset(sids, 0, sizeof(sids));
+	init(zones, select, steal);
+
+	t0 = now_ns();
+	for(fid=0; fid<frames; fid++)
+		for(i=0; i<FINGERS; i++)
+		{
+			uint32_t life = 2 + (i*3 + fid/97) % 4; // staggered glissando
+			uint8_t zone = i % zones;
+
+			if(!sids[i])
+			{
+				sids[i] = sid++;
+				ages[i] = 0;
+				on(sids[i], zone, (fid + i*5) & 0x7f);
+			}
+			else if(++ages[i] >= life)
+			{
+				off(sids[i], zone);
+				sids[i] = 0;
+			}
+			else
+				set(sids[i]);
+			events++;
+		}
+
+	printf("  %-10s %u zones: %"PRIu64" events, %.2f ns/event\n", name, zones, events,
+		(double)(now_ns() - t0) / events);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// stand-ins for the arguments of the query tree's methods, which tree.awk
+// drops along with their callbacks
+
+#include <math.h>
+
+#include <oscquery.h>
+
+static const OSC_Query_Value int_values [] = {
+	{.i = -1}, {.i = 0}, {.i = 0x7fffffff}
+};
+
+static const OSC_Query_Value float_values [] = {
+	{.f = 0.25f}, {.f = -INFINITY}, {.f = NAN}
+};
+
+static const OSC_Query_Value string_values [] = {
+	{.s = "udp"}, {.s = "tcp"}, {.s = "slip"}
+};
+
+// every argument type and branch of the serializers, methods get one to three
+const OSC_Query_Argument tree_args [TREE_ARGS_N] = {
+	OSC_QUERY_ARGUMENT_BOOL("Boolean", OSC_QUERY_MODE_RW),
+	OSC_QUERY_ARGUMENT_INT32("Signed", OSC_QUERY_MODE_R, -0x8000, 0x7fff, 1),
+	OSC_QUERY_ARGUMENT_INT32_VALUES("Enumeration", OSC_QUERY_MODE_W, int_values),
+	OSC_QUERY_ARGUMENT_FLOAT("Seconds", OSC_QUERY_MODE_RW, 0.f, 10.f, 0.0001f),
+	OSC_QUERY_ARGUMENT_FLOAT("Unbounded", OSC_QUERY_MODE_RW, -INFINITY, INFINITY, NAN),
+	{ // there is no OSC_QUERY_ARGUMENT_FLOAT_VALUES
+		OSC_QUERY_ARGUMENT(OSC_FLOAT, "Steps", OSC_QUERY_MODE_R),
+		.values.ptr = float_values,
+		.values.argc = sizeof(float_values) / sizeof(OSC_Query_Value)
+	},
+	OSC_QUERY_ARGUMENT_STRING("ASCII", OSC_QUERY_MODE_RW, 32),
+	OSC_QUERY_ARGUMENT_STRING_VALUES("Mode", OSC_QUERY_MODE_RW, string_values),
+	OSC_QUERY_ARGUMENT_BLOB("Payload", OSC_QUERY_MODE_W),
+	OSC_QUERY_ARGUMENT_INT32("Unsigned", OSC_QUERY_MODE_RW, 0, 0xffff, 1)
+};
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// the sprintf based renderer replaced by the streaming writer in
+// oscquery/oscquery.c, kept as reference for the byte comparison of make check,
+// int32 formats changed from %li to PRIi32 for hosts where int32_t is no long
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <oscquery.h>
+
+static const char *inf_s = "null";
+static const char *ninf_s = "null";
+static const char *null_s = "null";
+
+static void
+_serialize_float(char *str, float f)
+{
+	if(isinf(f)) {
+		if(f < 0.f)
+			sprintf(str, "%s", ninf_s);
+		else
+			sprintf(str, "%s", inf_s);
+	}
+	else if(isnan(f))
+		sprintf(str, "%s", null_s);
+	else
+		sprintf(str, "%f", f);
+}
+
+void
+old_query_response(char *buf, const OSC_Query_Item *item, const char *path)
+{
+	*buf++ = '{';
+
+	if(item->type == OSC_QUERY_NODE)
+	{
+		sprintf(buf, "\"path\":\"%s\",\"type\":\"node\",\"description\":\"%s\",\"items\":[",
+			path, item->description);
+		buf += strlen(buf);
+
+		uint_fast8_t i;
+		for(i=0; i<item->item.node.argc; i++)
+		{
+			const OSC_Query_Item *sub = &item->item.node.tree[i];
+			sprintf(buf, "\"%s\"", sub->path);
+			buf += strlen(buf);
+			if(i < item->item.node.argc-1)
+				*buf++ = ',';
+		}
+
+		*buf++ = ']';
+	}
+	else if(item->type == OSC_QUERY_ARRAY)
+	{
+		sprintf(buf, "\"path\":\"%s\",\"type\":\"node\",\"description\":\"%s\",\"items\":[",
+			path, item->description);
+		buf += strlen(buf);
+
+		const OSC_Query_Item *sub = item->item.node.tree;
+		uint_fast8_t i;
+		for(i=0; i<item->item.node.argc; i++)
+		{
+			*buf++ = '"';
+			sprintf(buf, sub->path, i);
+			buf += strlen(buf);
+			*buf++ = '"';
+			if(i < item->item.node.argc-1)
+				*buf++ = ',';
+		}
+
+		*buf++ = ']';
+	}
+	else // OSC_QUERY_METHOD
+	{
+		sprintf(buf, "\"path\":\"%s\",\"type\":\"method\",\"description\":\"%s\",\"arguments\":[",
+			path, item->description);
+		buf += strlen(buf);
+
+		uint_fast8_t i;
+		for(i=0; i<item->item.method.argc; i++)
+		{
+			const OSC_Query_Argument *arg = &item->item.method.args[i];
+			sprintf(buf, "{\"type\":\"%c\",\"description\":\"%s\",\"read\":%s,\"write\":%s",
+				arg->type, arg->description,
+				arg->mode & OSC_QUERY_MODE_R ? "true" : "false",
+				arg->mode & OSC_QUERY_MODE_W ? "true" : "false");
+			buf += strlen(buf);
+
+			switch(arg->type)
+			{
+				case OSC_INT32:
+					if(arg->values.argc)
+					{
+						sprintf(buf, ",\"values\":[");
+						buf += strlen(buf);
+						uint_fast8_t j;
+						for(j=0; j<arg->values.argc; j++)
+						{
+							sprintf(buf, "%"PRIi32",", arg->values.ptr[j].i);
+							buf += strlen(buf);
+						}
+						buf--;
+						*buf++ = ']';
+					}
+					else // !values
+					{
+						sprintf(buf, ",\"range\":[%"PRIi32",%"PRIi32",%"PRIi32"]", arg->range.min.i, arg->range.max.i, arg->range.step.i);
+						buf += strlen(buf);
+					}
+					break;
+				case OSC_FLOAT:
+				{
+					char val[32];
+					if(arg->values.argc)
+					{
+						sprintf(buf, ",\"values\":[");
+						buf += strlen(buf);
+						uint_fast8_t j;
+						for(j=0; j<arg->values.argc; j++)
+						{
+							_serialize_float(val, arg->values.ptr[j].f);
+							sprintf(buf, "%s,", val);
+							buf += strlen(buf);
+						}
+						buf--;
+						*buf++ = ']';
+					}
+					else // !values
+					{
+						sprintf(buf, ",\"range\":[");
+						buf += strlen(buf);
+
+						_serialize_float(val, arg->range.min.f);
+						sprintf(buf, "%s,", val);
+						buf += strlen(buf);
+
+						_serialize_float(val, arg->range.max.f);
+						sprintf(buf, "%s,", val);
+						buf += strlen(buf);
+
+						_serialize_float(val, arg->range.step.f);
+						sprintf(buf, "%s", val);
+						buf += strlen(buf);
+
+						*buf++ = ']';
+					}
+					break;
+				}
+				case OSC_STRING:
+					if(arg->values.argc)
+					{
+						sprintf(buf, ",\"values\":[");
+						buf += strlen(buf);
+						uint_fast8_t j;
+						for(j=0; j<arg->values.argc; j++)
+						{
+							sprintf(buf, "\"%s\",", arg->values.ptr[j].s);
+							buf += strlen(buf);
+						}
+						buf--;
+						*buf++ = ']';
+					}
+					else // !values
+					{
+						sprintf(buf, ",\"range\":[%"PRIi32",%"PRIi32",%"PRIi32"]", arg->range.min.i, arg->range.max.i, arg->range.step.i);
+						buf += strlen(buf);
+					}
+					break;
+				//FIXME add other types
+				default:
+					break;
+			}
+			*buf++ = '}';
+			if(i < item->item.method.argc-1)
+				*buf++ = ',';
+		}
+
+		*buf++ = ']';
+	}
+
+	*buf++ = '}';
+	*buf++ = '\0';
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host check and benchmark of the firmware's unmodified oscquery/oscquery.c,
+// resolves every path of the real query tree, as extracted by tree.awk,
+// through the flat path index and through the recursive tree walk it replaces
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <oscquery.h>
+
+#define PATH_MAX_N 4096
+#define ENDS_MAX 32
+#define RUNS 2000
+
+extern const OSC_Query_Item tree_root;
+
+static char paths [PATH_MAX_N][OSC_QUERY_PATH_MAX];
+static uint_fast16_t paths_n = 0;
+static uint_fast16_t hits_n = 0;
+static uint_fast16_t items_n = 0;
+static char ends [ENDS_MAX][OSC_QUERY_PATH_MAX];
+static uint_fast16_t ends_n = 0;
+
+static void
+_add(const char *path)
+{
+	if(paths_n >= PATH_MAX_N)
+	{
+		fprintf(stderr, "too many paths, raise PATH_MAX_N\n");
+		exit(1);
+	}
+	snprintf(paths[paths_n++], OSC_QUERY_PATH_MAX, "%s", path);
+}
+
+// collect the concrete paths of all items, array elements expanded
+static void
+_walk(const OSC_Query_Item *item, const char *prefix, int argc, int template)
+{
+	char path [OSC_QUERY_PATH_MAX];
+	int len = snprintf(path, OSC_QUERY_PATH_MAX, "%s", prefix);
+	if(argc >= 0)
+		snprintf(path + len, OSC_QUERY_PATH_MAX - len, item->path, argc);
+	else
+		snprintf(path + len, OSC_QUERY_PATH_MAX - len, "%s", item->path);
+
+	if(template)
+		items_n++;
+	_add(path);
+
+	uint_fast8_t i;
+	if(item->type == OSC_QUERY_NODE)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			_walk(&item->item.node.tree[i], path, -1, template);
+	}
+	else if(item->type == OSC_QUERY_ARRAY)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			_walk(item->item.node.tree, path, i, template && !i);
+
+		// index one past the end, added with the other misses
+		if(template && (ends_n < ENDS_MAX))
+		{
+			char *miss = ends[ends_n++];
+			len = snprintf(miss, OSC_QUERY_PATH_MAX, "%s", path);
+			snprintf(miss + len, OSC_QUERY_PATH_MAX - len, item->item.node.tree->path, item->item.node.argc);
+		}
+	}
+}
+
+// near misses of every hit: unknown leaf, truncated, prefix without slash,
+// some of which exist, e.g. a truncated method name
+static void
+_misses(void)
+{
+	uint_fast16_t i;
+	for(i=0; i<ends_n; i++)
+		_add(ends[i]);
+	for(i=0; i<hits_n; i++)
+	{
+		char miss [OSC_QUERY_PATH_MAX];
+		size_t len = strlen(paths[i]);
+
+		snprintf(miss, OSC_QUERY_PATH_MAX, "%sx", paths[i]);
+		_add(miss);
+		if(len > 1)
+		{
+			snprintf(miss, OSC_QUERY_PATH_MAX, "%.*s", (int)len - 1, paths[i]);
+			_add(miss);
+		}
+		snprintf(miss, OSC_QUERY_PATH_MAX, "%s", paths[i] + 1);
+		_add(miss);
+	}
+	_add("");
+	_add("/nonexistent");
+	_add("//");
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const OSC_Query_Item *
+_find(const OSC_Query_Item *root, const char *path)
+{
+	return osc_query_find(root, path, -1);
+}
+
+// mean ns per lookup of paths [from, to)
+static double
+_bench(const OSC_Query_Item *(*lookup)(const OSC_Query_Item *, const char *),
+	uint_fast16_t from, uint_fast16_t to)
+{
+	volatile const OSC_Query_Item *sink;
+	uint_fast16_t i, j;
+
+	double t0 = _now();
+	for(j=0; j<RUNS; j++)
+		for(i=from; i<to; i++)
+			sink = lookup(&tree_root, paths[i]);
+	(void)sink;
+
+	return (_now() - t0) / (RUNS * (to - from));
+}
+
+int
+main(int argc, char **argv)
+{
+	uint_fast16_t i;
+	unsigned errors = 0;
+	unsigned found = 0;
+
+	_walk(&tree_root, "", -1, 1);
+	hits_n = paths_n;
+	_misses();
+
+	// both must resolve to the very same item, or both not at all
+	for(i=0; i<paths_n; i++)
+	{
+		const OSC_Query_Item *walked = osc_query_find(&tree_root, paths[i], -1);
+		const OSC_Query_Item *looked = osc_query_lookup(&tree_root, paths[i]);
+
+		if(walked && (i < hits_n) )
+			found++;
+		if(looked != walked)
+		{
+			fprintf(stderr, "mismatch for '%s': %s vs %s\n", paths[i],
+				looked ? looked->path : "NULL", walked ? walked->path : "NULL");
+			errors++;
+		}
+	}
+	if(found < hits_n) // the tree walk itself must know every collected path
+	{
+		fprintf(stderr, "%u of %u paths not found by osc_query_find\n",
+			(unsigned)(hits_n - found), (unsigned)hits_n);
+		errors++;
+	}
+	printf("%u items, %u paths, %u misses: %s\n", (unsigned)items_n, (unsigned)hits_n,
+		(unsigned)(paths_n - hits_n), errors ? "FAILED" : "ok");
+
+	double find_hit, lookup_hit, find_miss, lookup_miss;
+	find_hit = _bench(_find, 0, hits_n);
+	lookup_hit = _bench(osc_query_lookup, 0, hits_n);
+	find_miss = _bench(_find, hits_n, paths_n);
+	lookup_miss = _bench(osc_query_lookup, hits_n, paths_n);
+
+	printf("hits: tree walk %.0f ns, path index %.0f ns per lookup (%.1fx)\n",
+		find_hit, lookup_hit, find_hit / lookup_hit);
+	printf("misses: tree walk %.0f ns, path index %.0f ns per lookup (%.1fx)\n",
+		find_miss, lookup_miss, find_miss / lookup_miss);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host check of the firmware's unmodified streaming serializer and response
+// cache in oscquery/oscquery.c against the sprintf based renderer it replaced,
+// for every path of the real query tree, as extracted by tree.awk
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <oscquery.h>
+
+#define PATH_MAX_N 1024
+#define RESPONSE_MAX 4096
+#define QUERY_CHUNK_SIZE 512 // as in config/config.c
+#define CACHE_SIZE 1024 // as OSC_QUERY_CACHE_SIZE in oscquery/oscquery.c
+
+void old_query_response(char *buf, const OSC_Query_Item *item, const char *path);
+
+extern const OSC_Query_Item tree_root;
+
+extern const OSC_Query_Argument tree_args [TREE_ARGS_N];
+
+#define LOREM "All argument types at once and a description long enough to overflow the cache. "
+
+// chunked, the second one too big for the cache arena, thus rendered directly
+static const OSC_Query_Item big_tree [] = {
+	{.path = "all", .description = "All argument types at once", .type = OSC_QUERY_METHOD,
+		.item.method = {.args = tree_args, .argc = TREE_ARGS_N}},
+	{.path = "long", .description = LOREM LOREM LOREM LOREM LOREM LOREM LOREM LOREM, .type = OSC_QUERY_METHOD,
+		.item.method = {.args = tree_args, .argc = TREE_ARGS_N}}
+};
+
+static const OSC_Query_Item big_root = {
+	.path = "/", .description = "Root node", .type = OSC_QUERY_NODE,
+	.item.node = {.tree = big_tree, .argc = 2}
+};
+
+typedef struct _Query Query;
+
+struct _Query {
+	const OSC_Query_Item *item;
+	char path [OSC_QUERY_PATH_MAX];
+	char reference [RESPONSE_MAX];
+	size_t len;
+};
+
+static Query queries [PATH_MAX_N];
+static uint_fast16_t queries_n = 0;
+
+// collect the concrete paths of all items, array elements expanded
+static void
+_walk(const OSC_Query_Item *root, const OSC_Query_Item *item, const char *prefix, int argc)
+{
+	if(queries_n >= PATH_MAX_N)
+	{
+		fprintf(stderr, "too many paths, raise PATH_MAX_N\n");
+		exit(1);
+	}
+
+	Query *query = &queries[queries_n++];
+	int len = snprintf(query->path, OSC_QUERY_PATH_MAX, "%s", prefix);
+	if(argc >= 0)
+		snprintf(query->path + len, OSC_QUERY_PATH_MAX - len, item->path, argc);
+	else
+		snprintf(query->path + len, OSC_QUERY_PATH_MAX - len, "%s", item->path);
+	query->item = osc_query_lookup(root, query->path);
+
+	uint_fast8_t i;
+	if(item->type == OSC_QUERY_NODE)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			_walk(root, &item->item.node.tree[i], query->path, -1);
+	}
+	else if(item->type == OSC_QUERY_ARRAY)
+	{
+		for(i=0; i<item->item.node.argc; i++)
+			_walk(root, item->item.node.tree, query->path, i);
+	}
+}
+
+// render a whole response piecewise as config/config.c's _query does: a
+// single "iss" reply below QUERY_CHUNK_SIZE, "isiis" replies with offset and
+// total otherwise, each chunk serialized with osc_set_vararg and read back
+// as a client would
+static int
+_chunked(const Query *query, char *out)
+{
+	osc_data_t msg [QUERY_CHUNK_SIZE + 128] __attribute__((aligned(4)));
+	osc_data_t *end = msg + sizeof(msg);
+	char chunk [QUERY_CHUNK_SIZE + 1];
+	size_t total = osc_query_response_cached(NULL, 0, 0, query->item, query->path);
+	size_t offset = 0;
+
+	do
+	{
+		size_t len = osc_query_response_cached(chunk, QUERY_CHUNK_SIZE, offset, query->item, query->path);
+		if(len != total)
+			return -1;
+		len = total - offset < QUERY_CHUNK_SIZE ? total - offset : QUERY_CHUNK_SIZE;
+		chunk[len] = '\0';
+
+		osc_data_t *ptr;
+		if(total < QUERY_CHUNK_SIZE)
+			ptr = osc_set_vararg(msg, end, "/success", "iss", 13, query->path, chunk);
+		else
+			ptr = osc_set_vararg(msg, end, "/success", "isiis", 13, query->path,
+				(int32_t)offset, (int32_t)total, chunk);
+		if(!ptr || !osc_check_message(msg, ptr - msg))
+			return -1;
+
+		const char *path, *fmt, *str;
+		int32_t uuid, off = 0, tot = total;
+		ptr = osc_get_path(msg, &path);
+		ptr = osc_get_fmt(ptr, &fmt);
+		ptr = osc_get_int32(ptr, &uuid);
+		ptr = osc_get_string(ptr, &str);
+		if(strcmp(str, query->path))
+			return -1;
+		if(!strcmp(fmt, ",isiis"))
+		{
+			ptr = osc_get_int32(ptr, &off);
+			ptr = osc_get_int32(ptr, &tot);
+		}
+		else if(strcmp(fmt, ",iss"))
+			return -1;
+		ptr = osc_get_string(ptr, &str);
+		if( ((size_t)off != offset) || ((size_t)tot != total) || (strlen(str) != len) )
+			return -1;
+
+		memcpy(out + off, str, len);
+		offset += len;
+	} while(offset < total);
+	out[total] = '\0';
+
+	return total >= QUERY_CHUNK_SIZE;
+}
+
+static unsigned
+_check(const Query *query, const char *order)
+{
+	char out [RESPONSE_MAX];
+
+	// uncached, whole and in odd sized windows
+	size_t total = osc_query_response(NULL, 0, 0, query->item, query->path);
+	size_t offset;
+	if(total != query->len)
+		goto fail;
+	for(offset=0; offset<total; offset+=61)
+		osc_query_response(out + offset, 61, offset, query->item, query->path);
+	if(memcmp(out, query->reference, total))
+		goto fail;
+
+	// cached, reassembled from replies
+	if( (_chunked(query, out) < 0) || strcmp(out, query->reference) )
+		goto fail;
+
+	return 0;
+
+fail:
+	fprintf(stderr, "mismatch for '%s' (%s)\n", query->path, order);
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint_fast16_t i, j;
+	uint_fast16_t tree_n;
+	unsigned errors = 0;
+	unsigned chunked = 0;
+	unsigned uncached = 0;
+
+	_walk(&tree_root, &tree_root, "", -1);
+	tree_n = queries_n;
+	for(i=0; i<big_root.item.node.argc; i++)
+		_walk(&big_root, &big_tree[i], "/", -1);
+
+	for(i=0; i<queries_n; i++)
+	{
+		Query *query = &queries[i];
+		if(!query->item)
+		{
+			fprintf(stderr, "no item for '%s'\n", query->path);
+			return 1;
+		}
+		old_query_response(query->reference, query->item, query->path);
+		query->len = strlen(query->reference);
+		if(query->len >= QUERY_CHUNK_SIZE)
+			chunked++;
+		if(query->len > CACHE_SIZE)
+			uncached++;
+	}
+
+	// fill the cache in tree order, reverse order, then interleave the
+	// elements of arrays, which share their items
+	for(i=0; i<queries_n; i++)
+		errors += _check(&queries[i], "forward");
+	for(i=queries_n; i>0; i--)
+		errors += _check(&queries[i-1], "reverse");
+	srand(0);
+	for(j=0; j<8*queries_n; j++)
+		errors += _check(&queries[rand() % tree_n], "random");
+
+	printf("%u responses, %u chunked, %u too big to cache: %s\n", (unsigned)queries_n,
+		chunked, uncached, errors ? "FAILED" : "ok");
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#!/usr/bin/awk -f
+#
+# Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+#
+# This is free software: you can redistribute it and/or modify
+# it under the terms of the Artistic License 2.0 as published by
+# The Perl Foundation.
+#
+# This source is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# Artistic License 2.0 for more details.
+#
+# You should have received a copy of the Artistic License 2.0
+# along the source as a COPYING file. If not, obtain it from
+# http://www.perlfoundation.org/artistic_license_2_0.
+#
+
+# extracts the firmware's OSC query tree from its sources into a host
+# translation unit, usage: awk -v args=N -f tree.awk HEADERS... SOURCES... > tree.c
+#
+# headers only provide the #defines used as array sizes, in sources every
+# 'OSC_Query_Item NAME [] = {' block is copied item by item, trees are
+# renamed by source file as static trees of the same name exist in several
+# files, method callbacks are dropped and their arguments replaced by one
+# to three consecutive ones out of the host's tree_args [N]
+
+function stem(file,   s)
+{
+	s = file
+	sub(/.*\//, "", s)
+	sub(/\.[ch]$/, "", s)
+	gsub(/[^A-Za-z0-9_]/, "_", s)
+	return s
+}
+
+# quoted string starting at or after position pos of line, sets qend
+function quoted(line, pos,   s, e)
+{
+	s = index(substr(line, pos), "\"") + pos
+	e = index(substr(line, s), "\"") + s - 1
+	qend = e
+	return substr(line, s, e - s)
+}
+
+function trim(s)
+{
+	gsub(/^[ \t]+|[ \t]+$/, "", s)
+	return s
+}
+
+FILENAME ~ /\.h$/ && /^#define[ \t]+[A-Za-z_0-9]+[ \t]/ {
+	name = $2
+	value = $0
+	sub(/^#define[ \t]+[A-Za-z_0-9]+[ \t]+/, "", value)
+	sub(/[ \t]*\/\/.*/, "", value)
+	if(!(name in defines))
+		defines[name] = value
+	next
+}
+
+FILENAME ~ /\.c$/ && /OSC_Query_Item [a-z_0-9]+ *\[\] *= *\{/ {
+	tree = $0
+	sub(/ *\[\].*/, "", tree)
+	sub(/.*OSC_Query_Item /, "", tree)
+	cur = stem(FILENAME) "_" tree
+	trees[++tree_n] = cur
+	tree_file[cur] = FILENAME
+	tree_argc[cur] = 0
+	if($0 !~ /^static/)
+		global[tree] = cur
+	next
+}
+
+cur && /^\};/ {
+	cur = ""
+	next
+}
+
+cur && /OSC_QUERY_ITEM_(NODE|ARRAY|METHOD)\(/ {
+	type = $0
+	sub(/.*OSC_QUERY_ITEM_/, "", type)
+	sub(/\(.*/, "", type)
+	path = quoted($0, 1)
+	description = quoted($0, qend + 1)
+	rest = substr($0, qend + 1)
+	sub(/\)[^)]*$/, "", rest)
+	split(rest, fields, ",")
+
+	k = cur SUBSEP tree_argc[cur]++
+	item_type[k] = type
+	item_path[k] = path
+	item_description[k] = description
+	item_tree[k] = trim(fields[2])
+	item_size[k] = trim(fields[3])
+	next
+}
+
+# resolve a tree reference, prefer the referencing file's own static trees
+function resolve(file, name)
+{
+	if((stem(file) "_" name) in tree_file)
+		return stem(file) "_" name
+	if(name in global)
+		return global[name]
+	print "tree.awk: unresolved tree " name " in " file > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+# emit a #define and the ones it depends on
+function define(name,   value, n, i, ids)
+{
+	if(!(name in defines) || (name in defined))
+		return
+	defined[name] = 1
+	value = defines[name]
+	n = split(value, ids, /[^A-Za-z_0-9]+/)
+	for(i=1; i<=n; i++)
+		define(ids[i])
+	print "#define " name " " value
+}
+
+END {
+	if(failed)
+		exit 1
+
+	print "// generated by tree.awk from the firmware sources, do not edit"
+	print ""
+	print "#include <oscquery.h>"
+	print ""
+	if(args)
+	{
+		print "extern const OSC_Query_Argument tree_args [" args "];"
+		print ""
+	}
+
+	for(t=1; t<=tree_n; t++)
+		for(i=0; i<tree_argc[trees[t]]; i++)
+			if(item_type[trees[t], i] == "ARRAY")
+				define(item_size[trees[t], i])
+	print ""
+
+	for(t=1; t<=tree_n; t++)
+		print "static const OSC_Query_Item " trees[t] " [" tree_argc[trees[t]] "];"
+	print ""
+
+	for(t=1; t<=tree_n; t++)
+	{
+		cur = trees[t]
+		print "static const OSC_Query_Item " cur " [" tree_argc[cur] "] = {"
+		for(i=0; i<tree_argc[cur]; i++)
+		{
+			k = cur SUBSEP i
+			printf "\t{.path = \"%s\", .description = \"%s\", ", item_path[k], item_description[k]
+			if(item_type[k] == "METHOD")
+			{
+				printf ".type = OSC_QUERY_METHOD"
+				if(args)
+				{
+					argc = 1 + methods % 3
+					printf ", .item.method = {.args = &tree_args[%i], .argc = %i}", methods % (args - argc + 1), argc
+				}
+				methods++
+			}
+			else
+			{
+				sub_tree = resolve(tree_file[cur], item_tree[k])
+				argc = item_type[k] == "ARRAY" ? item_size[k] : tree_argc[sub_tree]
+				printf ".type = OSC_QUERY_%s, .item.node = {.tree = %s, .argc = %s}", item_type[k], sub_tree, argc
+			}
+			print "},"
+		}
+		print "};"
+		print ""
+	}
+
+	print "const OSC_Query_Item tree_root = {"
+	print "\t.path = \"/\", .description = \"Root node\", .type = OSC_QUERY_NODE,"
+	print "\t.item.node = {.tree = " global_root() ", .argc = " tree_argc[global_root()] "}"
+	print "};"
+}
+
+function global_root(   t)
+{
+	for(t=1; t<=tree_n; t++)
+		if(trees[t] ~ /_root_tree$/)
+			return trees[t]
+}
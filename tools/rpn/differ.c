@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host differential test of the RPN compiler passes: every expression is
+// compiled as set hook by custom/custom_rpn.c and by a plain reference build
+// of it without optimization, hoisting and fusion (ref_* symbols, see
+// Makefile), both are run on the same synthetic events and must produce the
+// same OSC bytes, a new frame starts every third event
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "custom_private.h"
+
+#define EVENTS 2000
+#define OUT_LEN 256
+
+uint_fast8_t ref_compile(const char *args, Custom_Item *itm, RPN_Destination dest, RPN_Error *err);
+osc_data_t *ref_run(osc_data_t *buf, osc_data_t *end, Custom_Item *itm, RPN_Stack *stack);
+void ref_run_hoisted(Custom_Item *itm, RPN_Stack *stack);
+uint_fast8_t ref_count(const RPN_VM *vm, uint_fast8_t *offset);
+
+// together these cover every rewrite of the optimizer and the fusion pass,
+// those reading $f also get per-frame subexpressions hoisted, the last ones
+// use the per-blob register banks and the builtins
+static const char *exprs [] = {
+	"/a f($x 127 * 0.5 +) f($z 2 * 1 -)",
+	"/b f(1 2 + 3 *) i(7 2 %) f(2 0.5 ^)",
+	"/c f($x 0 +) f($x 0 ~ +) f($x 0 -) f($x 1 *) f($x 1 /)",
+	"/c2 f($x 1 ~ *) f($x 4 /) f($x 3 /) f($x ~ 0 -) f($x ~ 0 ~ +)",
+	"/d f($x 2 ^) f($x 1 ^) f($x ~ ~) f($x $z # #) f($x $z #)",
+	"/e f($x $z 1 ?) f($x $z 0 ?) f($x 2 * $z 0 ?) f($x 2 * $z 1 ?) f($x $z $b ?)",
+	"/f f($x 1 @) f($x $z 2 @) f($x 0 @) f(2 @@ *) f($x 3 + @@ *)",
+	"/f2 f($x $z $b 3 % 1 + @) f($x $z $b 3 % 5 - @)",
+	"/g i($b 1 << 3 |) i(1 2 < 3 4 >= &&) f($x 0.5 > $z 0.2 <= ||) f($x 1 2 == !)",
+	"/h f($x 0 [ 0 ] 2 * 0 ] 1 + *) f(1 0 /) f(0 0 /) f($x $b 9 + ] +)",
+	"/i m(0 0x90 $x 127 * 24 + $z 127 *) m(0 0xb0 $g 7 + $z 0x3fff * 7 >>)",
+	"/j f($x 1 ~ /) f($x 0.25 /) f($x 1e-39 /) f($x 1 2 - *) f(1 2 # -)",
+	"/k f($x 2 3 + 1 ? ) f(3 $x ~ ~ *) i($f $b $g $p + + +) f($n 1 /)",
+	"/l i($f 16 %) f($x $f 2 % 0 == *) f($f 7 & $x $f 3 % + #)",
+	"/m f($f 2 % $x $f 3 % * +) f($f @@ * $x +) i($f 4 >> $b +)",
+	"/n f($f 1 + $f 2 + $f 3 + $f 4 + $f 5 + + + + $x *)",
+	"/o f($f 1 + $x *) f($f 2 + $x *) f($f 3 + $x *) f($f 4 + $x *) f($f 5 + $x *)",
+	"/p m(0 0x90 $f 8 % 12 * $x 48 * + $z 127 *)",
+	"/s f($x 0 } 0 } $x ? @@ 0 {) f($x 0.25 1 :smooth) f($z 0.1 2 :hyst) f($x 0.2 0.8 :clamp)",
+	"/t f($x 48 * $b 8 % :scale) f($z 24 * 4 :scale) f(1 2 3 :clamp $x 1 + 9 :scale)",
+	"/u f($x $b 5 % { $b 5 % }) f($x 1 { 1 } 2 { 2 } 3 { 3 })",
+	"/v f($x $f 2 % 0.5 * 0.1 + 3 :smooth) f($x 0.05 $f 4 % :hyst) f($f 3 % 1 $f 4 % :clamp)"
+};
+
+// instructions per event of a verified program, without a per-frame prologue
+static unsigned
+count(const RPN_VM *vm, uint_fast8_t (*cnt)(const RPN_VM *, uint_fast8_t *))
+{
+	uint_fast8_t offset = 0;
+
+	if(rpn_entry(vm))
+		cnt(vm, &offset);
+
+	return cnt(vm, &offset) + (rpn_entry(vm) ? 1 : 0);
+}
+
+// the first events hit signed zeros and exact fractions
+static void
+event(RPN_Stack *stack, uint32_t i)
+{
+	static const float xs [] = {0.f, -0.f, 1.f, 0.5f, 0.333f, 1e-3f};
+
+	stack->fid = i / 3;
+	stack->sid = i % 7;
+	stack->gid = i % 3;
+	stack->pid = 1;
+	stack->x = i < sizeof(xs)/sizeof(float) ? xs[i] : (i*37 % 1000) / 999.f;
+	stack->z = (i*91 % 1000) / 999.f - 0.3f;
+	stack->vx = 0.1f;
+	stack->vz = -0.2f;
+}
+
+static int
+differ(const char *expr)
+{
+	static Custom_Item itm, ref;
+	static RPN_Stack stack, stack_ref;
+	static float hidden [RPN_HIDDEN_HEIGHT], hidden_ref [RPN_HIDDEN_HEIGHT];
+	static float bank [RPN_BANK_HEIGHT], bank_ref [RPN_BANK_HEIGHT];
+	static osc_data_t buf [OUT_LEN], buf_ref [OUT_LEN];
+	RPN_Error err, err_ref;
+	uint32_t i;
+
+	memset(&itm, 0, sizeof(itm));
+	memset(&ref, 0, sizeof(ref));
+	memset(&stack, 0, sizeof(stack));
+	memset(&stack_ref, 0, sizeof(stack_ref));
+	for(i=0; i<RPN_BANK_HEIGHT; i++)
+		bank[i] = bank_ref[i] = NAN;
+	stack.hidden = hidden;
+	stack.bank = bank;
+	stack_ref.hidden = hidden_ref;
+	stack_ref.bank = bank_ref;
+
+	printf("%s\n", expr);
+	if(!ref_compile(expr, &ref, RPN_SET, &err_ref))
+	{
+		printf("  reference failed: %s\n", err_ref.msg);
+		return 1;
+	}
+	if(!rpn_compile(expr, &itm, RPN_SET, &err))
+	{
+		printf("  failed: %s\n", err.msg);
+		return 1;
+	}
+	printf("  %u -> %u instructions per event\n", count(&ref.vm, ref_count), count(&itm.vm, rpn_count));
+
+	for(i=0; i<EVENTS; i++)
+	{
+		osc_data_t *ptr, *ptr_ref;
+
+		event(&stack, i);
+		event(&stack_ref, i);
+
+		if(i % 3 == 0) // frame callback of the custom engine
+		{
+			rpn_run_hoisted(&itm, &stack);
+			ref_run_hoisted(&ref, &stack_ref);
+		}
+
+		memset(buf, 0, OUT_LEN);
+		memset(buf_ref, 0, OUT_LEN);
+		ptr = rpn_run(buf, buf + OUT_LEN, &itm, &stack);
+		ptr_ref = ref_run(buf_ref, buf_ref + OUT_LEN, &ref, &stack_ref);
+
+		if( (ptr - buf != ptr_ref - buf_ref) || memcmp(buf, buf_ref, OUT_LEN) )
+		{
+			printf("  output differs at event %u\n", i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int
+main(void)
+{
+	unsigned failed = 0;
+	unsigned e;
+
+	for(e=0; e<sizeof(exprs)/sizeof(const char *); e++)
+		failed += differ(exprs[e]);
+
+	printf("%u of %u expressions differ\n", failed, e);
+
+	return failed ? 1 : 0;
+}
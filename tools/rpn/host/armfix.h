@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in for include/armfix.h, whose ARM fixed-point types are not
+// available on other targets, only their sizes matter to the RPN sources
+
+#ifndef _ARMFIX_H_
+#define _ARMFIX_H_
+
+#include <stdint.h>
+
+// unsaturated fixed point types
+typedef uint8_t fix_0_8_t;
+typedef uint16_t fix_0_16_t;
+typedef uint32_t fix_0_32_t;
+typedef uint64_t fix_0_64_t;
+
+typedef int8_t fix_s_7_t;
+typedef int16_t fix_s_15_t;
+typedef int32_t fix_s_31_t;
+typedef int64_t fix_s_63_t;
+
+typedef uint16_t fix_8_8_t;
+typedef uint32_t fix_16_16_t;
+typedef uint64_t fix_32_32_t;
+
+typedef int16_t fix_s7_8_t;
+typedef int32_t fix_s15_16_t;
+typedef int64_t fix_s31_32_t;
+
+// saturated fixed point types
+typedef fix_0_8_t sat_fix_0_8_t;
+typedef fix_0_16_t sat_fix_0_16_t;
+typedef fix_0_32_t sat_fix_0_32_t;
+typedef fix_0_64_t sat_fix_0_64_t;
+
+typedef fix_s_7_t sat_fix_s_7_t;
+typedef fix_s_15_t sat_fix_s_15_t;
+typedef fix_s_31_t sat_fix_s_31_t;
+typedef fix_s_63_t sat_fix_s_63_t;
+
+typedef fix_8_8_t sat_fix_8_8_t;
+typedef fix_16_16_t sat_fix_16_16_t;
+typedef fix_32_32_t sat_fix_32_32_t;
+
+typedef fix_s7_8_t sat_fix_s7_8_t;
+typedef fix_s15_16_t sat_fix_s15_16_t;
+typedef fix_s31_32_t sat_fix_s31_32_t;
+
+#endif // _ARMFIX_H_
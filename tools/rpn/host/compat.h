@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+
+// host stand-in for newlib's BSD extensions, forced in by the Makefile,
+// defined weakly in osc.c for C libraries that lack them
+
+#ifndef _COMPAT_H_
+#define _COMPAT_H_
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif // _COMPAT_H_
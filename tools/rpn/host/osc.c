@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-ins for the firmware's OSC serialization used by the RPN runtime,
+// shared by the tools linking custom/custom_rpn.c
+
+#include <string.h>
+#include <ctype.h>
+
+#include "custom_private.h"
+
+int
+osc_check_path(const char *path)
+{
+	const char *ptr;
+
+	if(path[0] != '/')
+		return 0;
+
+	for(ptr=path+1; *ptr!='\0'; ptr++)
+		if(!isprint((int)*ptr) || (*ptr == ' ') || (*ptr == '#') )
+			return 0;
+
+	return 1;
+}
+
+osc_data_t *
+osc_set_int32(osc_data_t *buf, osc_data_t *end, int32_t i)
+{
+	if(!buf || (buf + 4 > end) )
+		return NULL;
+	uint32_t u = __builtin_bswap32((uint32_t)i);
+	memcpy(buf, &u, 4);
+	return buf + 4;
+}
+
+osc_data_t *
+osc_set_float(osc_data_t *buf, osc_data_t *end, float f)
+{
+	uint32_t u;
+
+	if(!buf || (buf + 4 > end) )
+		return NULL;
+	memcpy(&u, &f, 4);
+	u = __builtin_bswap32(u);
+	memcpy(buf, &u, 4);
+	return buf + 4;
+}
+
+osc_data_t *
+osc_set_midi_inline(osc_data_t *buf, osc_data_t *end, uint8_t **m)
+{
+	*m = (uint8_t *)buf;
+	if(!buf || (buf + 4 > end) )
+		return NULL;
+	return buf + 4;
+}
+
+// only newer C libraries ship this
+__attribute__((weak)) size_t
+strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if(size)
+	{
+		size_t n = len >= size ? size - 1 : len;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+
+	return len;
+}
@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host tool to compile, disassemble and benchmark custom engine expressions,
+// links the firmware's unmodified custom/custom_rpn.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "custom_private.h"
+
+#define BLOB_MAX 8 // as in include/chimaera.h
+#define OUT_LEN 256
+
+typedef enum _Immediate Immediate;
+typedef struct _Mnemonic Mnemonic;
+typedef struct _Blob Blob;
+
+enum _Immediate {
+	IMM_NONE = 0,
+	IMM_CONST,
+	IMM_INDEX
+};
+
+struct _Mnemonic {
+	const char *name;
+	Immediate imm;
+};
+
+static const Mnemonic mnemonics [] = {
+	[RPN_TERMINATOR]					= {"terminator", IMM_NONE},
+
+	[RPN_PUSH_VALUE]					= {"push_value", IMM_CONST},
+	[RPN_POP_INT32]						= {"pop_int32", IMM_NONE},
+	[RPN_POP_FLOAT]						= {"pop_float", IMM_NONE},
+	[RPN_POP_MIDI]						= {"pop_midi", IMM_NONE},
+
+	[RPN_PUSH_FID]						= {"push_fid", IMM_NONE},
+	[RPN_PUSH_SID]						= {"push_sid", IMM_NONE},
+	[RPN_PUSH_GID]						= {"push_gid", IMM_NONE},
+	[RPN_PUSH_PID]						= {"push_pid", IMM_NONE},
+	[RPN_PUSH_X]							= {"push_x", IMM_NONE},
+	[RPN_PUSH_Z]							= {"push_z", IMM_NONE},
+	[RPN_PUSH_VX]							= {"push_vx", IMM_NONE},
+	[RPN_PUSH_VZ]							= {"push_vz", IMM_NONE},
+	[RPN_PUSH_N]							= {"push_n", IMM_NONE},
+
+	[RPN_PUSH_REG]						= {"push_reg", IMM_NONE},
+	[RPN_POP_REG]							= {"pop_reg", IMM_NONE},
+
+	[RPN_ADD]									= {"add", IMM_NONE},
+	[RPN_SUB]									= {"sub", IMM_NONE},
+	[RPN_MUL]									= {"mul", IMM_NONE},
+	[RPN_DIV]									= {"div", IMM_NONE},
+	[RPN_MOD]									= {"mod", IMM_NONE},
+	[RPN_POW]									= {"pow", IMM_NONE},
+	[RPN_NEG]									= {"neg", IMM_NONE},
+	[RPN_XCHANGE]							= {"xchange", IMM_NONE},
+	[RPN_DUPL_AT]							= {"dupl_at", IMM_NONE},
+	[RPN_DUPL_TOP]						= {"dupl_top", IMM_NONE},
+	[RPN_LSHIFT]							= {"lshift", IMM_NONE},
+	[RPN_RSHIFT]							= {"rshift", IMM_NONE},
+
+	[RPN_LOGICAL_AND]					= {"logical_and", IMM_NONE},
+	[RPN_BITWISE_AND]					= {"bitwise_and", IMM_NONE},
+	[RPN_LOGICAL_OR]					= {"logical_or", IMM_NONE},
+	[RPN_BITWISE_OR]					= {"bitwise_or", IMM_NONE},
+
+	[RPN_NOT]									= {"not", IMM_NONE},
+	[RPN_NOTEQ]								= {"noteq", IMM_NONE},
+	[RPN_COND]								= {"cond", IMM_NONE},
+	[RPN_LT]									= {"lt", IMM_NONE},
+	[RPN_LEQ]									= {"leq", IMM_NONE},
+	[RPN_GT]									= {"gt", IMM_NONE},
+	[RPN_GEQ]									= {"geq", IMM_NONE},
+	[RPN_EQ]									= {"eq", IMM_NONE},
+
+	[RPN_PUSH_VALUE_ADD]			= {"push_value_add", IMM_CONST},
+	[RPN_PUSH_VALUE_SUB]			= {"push_value_sub", IMM_CONST},
+	[RPN_PUSH_VALUE_MUL]			= {"push_value_mul", IMM_CONST},
+	[RPN_PUSH_VALUE_DIV]			= {"push_value_div", IMM_CONST},
+	[RPN_PUSH_X_VALUE_ADD]		= {"push_x_value_add", IMM_CONST},
+	[RPN_PUSH_X_VALUE_MUL]		= {"push_x_value_mul", IMM_CONST},
+	[RPN_PUSH_Z_VALUE_ADD]		= {"push_z_value_add", IMM_CONST},
+	[RPN_PUSH_Z_VALUE_MUL]		= {"push_z_value_mul", IMM_CONST},
+	[RPN_PUSH_VALUE_PUSH_REG]	= {"push_value_push_reg", IMM_INDEX},
+	[RPN_PUSH_VALUE_POP_REG]	= {"push_value_pop_reg", IMM_INDEX},
+	[RPN_PUSH_VALUE_DUPL_AT]	= {"push_value_dupl_at", IMM_INDEX},
+
+	[RPN_SKIP]								= {"skip", IMM_INDEX},
+	[RPN_PUSH_HIDDEN]					= {"push_hidden", IMM_INDEX},
+	[RPN_POP_HIDDEN]					= {"pop_hidden", IMM_INDEX},
+
+	[RPN_PUSH_BANK]						= {"push_bank", IMM_NONE},
+	[RPN_POP_BANK]						= {"pop_bank", IMM_NONE},
+	[RPN_PUSH_VALUE_PUSH_BANK]	= {"push_value_push_bank", IMM_INDEX},
+	[RPN_PUSH_VALUE_POP_BANK]	= {"push_value_pop_bank", IMM_INDEX},
+	[RPN_SMOOTH]							= {"smooth", IMM_NONE},
+	[RPN_HYSTERESIS]					= {"hysteresis", IMM_NONE},
+	[RPN_CLAMP]								= {"clamp", IMM_NONE},
+	[RPN_SCALE]								= {"scale", IMM_NONE}
+};
+
+_Static_assert(sizeof(mnemonics) / sizeof(Mnemonic) == RPN_INSTRUCTION_MAX,
+	"mnemonics out of sync with RPN_Instruction");
+
+struct _Blob {
+	uint32_t sid;
+	uint32_t born;
+	uint32_t life;
+	float phase;
+	float bank [RPN_BANK_HEIGHT];
+};
+
+static const char *destinations [] = {
+	[RPN_FRAME]	= "frame",
+	[RPN_ON]		= "on",
+	[RPN_OFF]		= "off",
+	[RPN_SET]		= "set",
+	[RPN_END]		= "end",
+	[RPN_IDLE]	= "idle"
+};
+
+static RPN_Destination
+destination(const char *name)
+{
+	RPN_Destination dest;
+
+	for(dest=RPN_FRAME; dest<=RPN_IDLE; dest++)
+		if(!strcmp(name, destinations[dest]))
+			return dest;
+
+	return RPN_NONE;
+}
+
+static void
+disassemble(const Custom_Item *itm)
+{
+	const RPN_VM *vm = &itm->vm;
+	uint_fast8_t entry = rpn_entry(vm);
+	uint_fast8_t i = 0;
+	uint_fast8_t terminators = 0;
+
+	while(i < CUSTOM_MAX_CODE)
+	{
+		RPN_Instruction inst = vm->code[i];
+		const Mnemonic *mnemonic = &mnemonics[inst];
+
+		if(entry && (i == 2) )
+			printf("  ; per frame\n");
+		else if(i == entry)
+			printf("  ; per event\n");
+
+		if(mnemonic->imm == IMM_NONE)
+			printf("  %03u  %02x     %s\n", (unsigned)i, vm->code[i], mnemonic->name);
+		else if(mnemonic->imm == IMM_CONST)
+			printf("  %03u  %02x %02x  %-22s %g\n", (unsigned)i, vm->code[i], vm->code[i+1], mnemonic->name,
+				vm->pool[vm->code[i+1]]);
+		else
+			printf("  %03u  %02x %02x  %-22s %u\n", (unsigned)i, vm->code[i], vm->code[i+1], mnemonic->name,
+				vm->code[i+1]);
+
+		i += mnemonic->imm ? 2 : 1;
+
+		if(inst == RPN_TERMINATOR)
+		{
+			terminators++;
+			if(!entry || (terminators == 2) )
+				break;
+		}
+	}
+}
+
+static void
+print_outputs(const Custom_Item *itm, const osc_data_t *buf, const osc_data_t *end)
+{
+	const char *fmt;
+
+	printf("    %s", itm->path);
+	for(fmt=itm->fmt; *fmt && (buf + 4 <= end); fmt++)
+	{
+		uint32_t u;
+		int32_t i;
+		float f;
+
+		switch(*fmt)
+		{
+			case OSC_INT32:
+				memcpy(&u, buf, 4);
+				u = __builtin_bswap32(u);
+				memcpy(&i, &u, 4);
+				printf(" %"PRIi32, i);
+				buf += 4;
+				break;
+			case OSC_FLOAT:
+				memcpy(&u, buf, 4);
+				u = __builtin_bswap32(u);
+				memcpy(&f, &u, 4);
+				printf(" %g", f);
+				buf += 4;
+				break;
+			case OSC_MIDI:
+				printf(" [%02x %02x %02x %02x]", buf[0], buf[1], buf[2], buf[3]);
+				buf += 4;
+				break;
+			default:
+				printf(" %c", *fmt);
+				break;
+		}
+	}
+	printf("\n");
+}
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+// cost of a bare pair of clock reads, subtracted from each measurement
+static double
+overhead_ns(void)
+{
+	uint64_t ns = 0;
+	uint32_t i;
+
+	for(i=0; i<100000; i++)
+	{
+		uint64_t t0 = now_ns();
+		ns += now_ns() - t0;
+	}
+
+	return (double)ns / 100000;
+}
+
+static inline void
+blob_state(RPN_Stack *stack, Blob *blob, uint32_t fid)
+{
+	float t = (fid - blob->born) * 0.002f + blob->phase;
+
+	stack->sid = blob->sid;
+	stack->gid = blob->sid % 2;
+	stack->pid = 0x80;
+	stack->x = fmodf(t, 1.f);
+	stack->z = 0.5f + 0.4f*sinf(6.2831853f*t);
+	stack->vx = 0.002f;
+	stack->vz = 0.0025f*cosf(6.2831853f*t);
+	stack->bank = blob->bank;
+}
+
+// synthetic sensor data: blobs of staggered lifetime move along the array,
+// hooks are run in the order the custom engine runs them
+static void
+bench(Custom_Item *itm, uint32_t frames, uint_fast8_t nblobs, uint32_t verbose)
+{
+	static RPN_Stack stack;
+	static osc_data_t buf [OUT_LEN];
+	static float hidden [RPN_HIDDEN_HEIGHT];
+	static float bank_frame [RPN_BANK_HEIGHT];
+	Blob blobs [BLOB_MAX];
+	uint32_t sid = 0;
+	uint64_t events = 0;
+	uint64_t ns = 0;
+	uint64_t ns_frame = 0;
+	uint_fast8_t i;
+	uint32_t fid;
+
+	for(i=0; i<RPN_BANK_HEIGHT; i++)
+		bank_frame[i] = NAN;
+	for(i=0; i<nblobs; i++)
+	{
+		blobs[i].sid = 0; // born in first frame
+		blobs[i].born = 0;
+		blobs[i].life = 1 + i*37 % 100;
+		blobs[i].phase = i * 0.125f;
+	}
+
+	stack.hidden = hidden;
+
+	for(fid=0; fid<frames; fid++)
+	{
+		uint64_t t0;
+		osc_data_t *ptr;
+
+		stack.fid = fid;
+		stack.sid = stack.gid = stack.pid = 0;
+		stack.x = stack.z = stack.vx = stack.vz = 0.f;
+		stack.bank = bank_frame;
+
+		t0 = now_ns();
+		switch(itm->dest)
+		{
+			case RPN_FRAME:
+			case RPN_END:
+				ptr = rpn_run(buf, buf + OUT_LEN, itm, &stack);
+				events++;
+				break;
+			case RPN_ON:
+			case RPN_OFF:
+			case RPN_SET:
+				rpn_run_hoisted(itm, &stack);
+				ptr = NULL;
+				break;
+			default: // idle hooks never run while blobs are present
+				ptr = NULL;
+				break;
+		}
+		ns_frame += now_ns() - t0;
+
+		if(ptr && (events <= verbose) )
+			print_outputs(itm, buf, ptr);
+
+		for(i=0; i<nblobs; i++)
+		{
+			Blob *blob = &blobs[i];
+			RPN_Destination dest = RPN_SET;
+
+			if(blob->sid == 0)
+			{
+				uint_fast8_t j;
+
+				blob->sid = ++sid;
+				blob->born = fid;
+				for(j=0; j<RPN_BANK_HEIGHT; j++)
+					blob->bank[j] = NAN;
+				dest = RPN_ON;
+			}
+			else if(fid - blob->born >= blob->life)
+				dest = RPN_OFF;
+
+			if(dest == itm->dest)
+			{
+				blob_state(&stack, blob, fid);
+				if(dest == RPN_OFF)
+					stack.x = stack.z = stack.vx = stack.vz = 0.f;
+
+				t0 = now_ns();
+				ptr = rpn_run(buf, buf + OUT_LEN, itm, &stack);
+				ns += now_ns() - t0;
+				events++;
+
+				if(events <= verbose)
+					print_outputs(itm, buf, ptr);
+			}
+
+			if(dest == RPN_OFF)
+				blob->sid = 0; // reborn in next frame
+		}
+	}
+
+	if(itm->dest == RPN_FRAME || itm->dest == RPN_END)
+		ns = ns_frame, ns_frame = 0;
+
+	double overhead = overhead_ns();
+
+	if(events)
+		printf("  %"PRIu64" events in %"PRIu32" frames: %.1f ns/event\n",
+			events, frames, (double)ns / events - overhead);
+	else
+		printf("  no events\n");
+	if(rpn_entry(&itm->vm))
+		printf("  per frame prologue: %.1f ns/frame\n", (double)ns_frame / frames - overhead);
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-d DEST] [-f FRAMES] [-b BLOBS] [-v N] [-l] EXPRESSION ...\n"
+		"\n"
+		"  -d DEST    hook to compile for: frame, on, off, set (default), end, idle\n"
+		"  -f FRAMES  number of synthetic frames to run (default 100000)\n"
+		"  -b BLOBS   number of concurrent blobs, 1-%u (default 4)\n"
+		"  -v N       print outputs of the first N events\n"
+		"  -l         listing only, do not run\n"
+		"\n"
+		"example: %s -d on 'i($b) f($x 48 * 1 :scale)'\n",
+		name, BLOB_MAX, name);
+}
+
+int
+main(int argc, char **argv)
+{
+	RPN_Destination dest = RPN_SET;
+	uint32_t frames = 100000;
+	uint_fast8_t nblobs = 4;
+	uint32_t verbose = 0;
+	int listing = 0;
+	int failed = 0;
+	int c;
+
+	while( (c = getopt(argc, argv, "d:f:b:v:lh")) != -1)
+	{
+		switch(c)
+		{
+			case 'd':
+				if( (dest = destination(optarg)) == RPN_NONE)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'f':
+				frames = strtoul(optarg, NULL, 10);
+				break;
+			case 'b':
+				nblobs = strtoul(optarg, NULL, 10);
+				if( (nblobs < 1) || (nblobs > BLOB_MAX) )
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'v':
+				verbose = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				listing = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return c != 'h';
+		}
+	}
+
+	if(optind == argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	for( ; optind<argc; optind++)
+	{
+		static Custom_Item itm;
+		static char args [CUSTOM_PATH_LEN + CUSTOM_ARGS_LEN];
+		const char *expr = argv[optind];
+		RPN_Error err;
+
+		// the path is optional on the command line
+		if(expr[0] != '/')
+		{
+			snprintf(args, sizeof(args), "/%s %s", destinations[dest], expr);
+			expr = args;
+		}
+
+		memset(&itm, 0, sizeof(itm));
+		if(!rpn_compile(expr, &itm, dest, &err))
+		{
+			printf("%s\n", expr);
+			if(err.pos >= 0)
+				printf("%*s^ %s\n", (int)err.pos, "", err.msg);
+			else
+				printf("error: %s\n", err.msg);
+			failed = 1;
+			continue;
+		}
+		itm.dest = dest;
+
+		uint_fast8_t offset = 0;
+		uint_fast8_t entry = rpn_entry(&itm.vm);
+		uint_fast8_t frame = entry ? rpn_count(&itm.vm, &offset) - 1 : 0;
+		uint_fast8_t event = rpn_count(&itm.vm, &offset) + (entry ? 1 : 0);
+		uint_fast8_t nconst = 0;
+		uint_fast8_t i;
+
+		for(i=0; i<offset; i += mnemonics[itm.vm.code[i]].imm ? 2 : 1)
+			if( (mnemonics[itm.vm.code[i]].imm == IMM_CONST) && (itm.vm.code[i+1] >= nconst) )
+				nconst = itm.vm.code[i+1] + 1;
+
+		printf("%s\n", expr);
+		printf("  %s hook, %u instructions before optimization, %u per event, %u per frame,"
+			" %u/%u bytes, %u/%u constants\n",
+			destinations[dest], itm.vm.raw, (unsigned)event, (unsigned)frame,
+			(unsigned)offset, CUSTOM_MAX_CODE, (unsigned)nconst, CUSTOM_MAX_CONST);
+		disassemble(&itm);
+
+		if(!listing)
+			bench(&itm, frames, nblobs, verbose);
+	}
+
+	return failed;
+}
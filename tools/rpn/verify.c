@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host checks of the RPN verifier: malformed expressions must fail with their
+// precise error, randomly mutated byte code that passes rpn_verify must run
+// without a memory error, build with -fsanitize=address,undefined (see Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "custom_private.h"
+
+#define OUT_LEN 256
+
+typedef struct _Reject Reject;
+
+struct _Reject {
+	const char *expr;
+	const char *msg; // NULL if it compiles
+	int pos;
+};
+
+static const Reject rejects [] = {
+	{"/e f($x +)", "stack underflow", 8},
+	{"/e f($y)", "unknown variable", 5},
+	{"/e f($x 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16)", "stack overflow", 44},
+	{"/e f($x = 1)", "unknown operator", 8},
+	{"/e f($x 9 ])", "register index out of range", -1},
+	{"/e f($x 1 2 ~ ])", "register index out of range", -1},
+	{"/e f($x 3 @)", "duplicate position out of range", -1},
+	{"/e f($x", "missing ')'", 3},
+	{"/e f$x)", "missing '('", 3},
+	{"/e q($x)", "unknown argument type", 3},
+	{"e f($x)", "invalid path", 0},
+	{"/e f(x)", "unknown token", 5},
+	{"/e i() f()", "stack underflow", 5},
+	{"/e f($x 5 [)", "stack underflow", 11},
+	{"/e f(@@)", "stack underflow", 5},
+	{"/e f($x @)", "stack underflow", 8},
+	{"/e f($x :nope)", "unknown builtin", 8},
+	{"/e f($x $x 9 {)", "bank index out of range", -1},
+	{"/e f($x :clamp)", "stack underflow", 8},
+	{"/e f($x :scalex 1)", "unknown builtin", 8},
+	{"/e T F N I i($x) T", NULL, 0}
+};
+
+// mutation bases: registers, banks, builtins, hoisting, duplicates, MIDI and
+// every output type
+static const char *bases [] = {
+	"/a f($x 0 [ 0 ] 2 * 0 ] 1 + *) i($b 7 & ]) f($x $z 2 @ @@ *)",
+	"/d f($x @@ 1 { 0.5 2 :smooth $b 4 % :scale) f($x 0.1 3 :hyst 0 1 :clamp 2 } +)",
+	"/b f($f 3 % $x *) i($b ]) m(1 2 3 4) T f($x $z 2 @) f($f 2 * 1 + $x *)",
+	"/c f($f 1 + $f 2 + $f 3 + $f 4 + $f 5 + + + + $x *) f($f 7 & $x $f 3 % + #)"
+};
+
+static unsigned
+reject(void)
+{
+	static Custom_Item itm;
+	unsigned failed = 0;
+	unsigned i;
+
+	for(i=0; i<sizeof(rejects)/sizeof(Reject); i++)
+	{
+		const Reject *r = &rejects[i];
+		RPN_Error err = {.msg = NULL, .pos = 0};
+		uint_fast8_t ok;
+
+		memset(&itm, 0, sizeof(itm));
+		ok = rpn_compile(r->expr, &itm, RPN_SET, &err);
+
+		if(ok ? r->msg != NULL : !r->msg || strcmp(err.msg, r->msg) || (err.pos != r->pos) )
+		{
+			printf("%s\n  expected %s @%i, got %s @%i\n", r->expr,
+				r->msg ? r->msg : "success", r->pos, ok ? "success" : err.msg, ok ? 0 : (int)err.pos);
+			failed++;
+		}
+	}
+
+	printf("%u of %u malformed expressions not rejected as expected\n", failed, i);
+
+	return failed;
+}
+
+static void
+mutate(Custom_Item *itm)
+{
+	int n = rand() % 4 + 1;
+
+	while(n--)
+	{
+		int r = rand() % 8;
+
+		if(r < 3) // any opcode, including invalid ones
+			itm->vm.code[rand() % CUSTOM_MAX_CODE] = rand() % (RPN_INSTRUCTION_MAX + 2);
+		else if(r < 6) // small immediates
+			itm->vm.code[rand() % CUSTOM_MAX_CODE] = rand() % 24;
+		else
+			itm->vm.pool[rand() % CUSTOM_MAX_CONST] = (rand() % 40) - 8;
+	}
+
+	if(rand() % 8 == 0)
+		itm->fmt[rand() % CUSTOM_FMT_LEN] = "ifmTFNI\0x"[rand() % 9];
+}
+
+static void
+fuzz(long runs)
+{
+	static Custom_Item base [sizeof(bases)/sizeof(const char *)];
+	static float hidden [RPN_HIDDEN_HEIGHT];
+	static float bank [RPN_BANK_HEIGHT];
+	Custom_Item *itm = malloc(sizeof(Custom_Item)); // heap, so ASan sees overruns
+	RPN_Stack *stack = malloc(sizeof(RPN_Stack));
+	osc_data_t *buf = malloc(OUT_LEN);
+	unsigned nbases = sizeof(bases)/sizeof(const char *);
+	long verified = 0;
+	long n;
+	unsigned b;
+
+	for(b=0; b<nbases; b++)
+	{
+		RPN_Error err;
+
+		if(!rpn_compile(bases[b], &base[b], RPN_SET, &err))
+		{
+			printf("%s\n  base failed: %s\n", bases[b], err.msg);
+			exit(1);
+		}
+	}
+
+	srand(1);
+	for(n=0; n<runs; n++)
+	{
+		*itm = base[n % nbases];
+		mutate(itm);
+
+		if(rpn_verify(itm))
+			continue;
+		verified++;
+
+		memset(stack, 0, sizeof(RPN_Stack));
+		stack->hidden = hidden;
+		stack->bank = bank;
+		stack->x = 0.3f;
+		stack->sid = n & 31;
+		stack->fid = n;
+
+		rpn_run_hoisted(itm, stack);
+		rpn_run(buf, buf + OUT_LEN, itm, stack);
+	}
+
+	printf("%ld of %ld mutants verified and ran\n", verified, runs);
+
+	free(buf);
+	free(stack);
+	free(itm);
+}
+
+int
+main(int argc, char **argv)
+{
+	long runs = argc > 1 ? strtol(argv[1], NULL, 10) : 1000000;
+	unsigned failed = reject();
+
+	fuzz(runs); // a memory error aborts
+
+	return failed ? 1 : 0;
+}
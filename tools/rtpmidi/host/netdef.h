@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in for include/netdef.h, which byte swaps with ARM instructions
+
+#ifndef _NETDEF_H_
+#define _NETDEF_H_
+
+#include <stdint.h>
+#include <arpa/inet.h> // htonl, ntohl
+
+#undef hton
+#undef ntoh
+#define hton htons
+#define ntoh ntohs
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#	define htonll(x) __builtin_bswap64(x)
+#	define ntohll(x) __builtin_bswap64(x)
+#else
+#	define htonll(x) (x)
+#	define ntohll(x) (x)
+#endif
+
+#endif // _NETDEF_H_
@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in to test the firmware's RTP-MIDI engine on a local network:
+// a minimal AppleMIDI session responder that decodes the incoming stream,
+// and an initiator that drives the firmware's unmodified rtpmidi/applemidi.c
+// with a synthetic glissando, just like the engine does on the device
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "rtpmidi_private.h"
+
+#include <netdef.h>
+
+#define BUF_LEN 1024
+
+typedef struct _Responder Responder;
+
+struct _Responder {
+	int fd [2]; // control, data
+	uint32_t ssrc;
+	uint32_t remote_ssrc;
+	uint8_t connected;
+	uint8_t synced; // clock syncs completed by initiator
+	uint8_t sync_sent; // clock sync initiated by ourselves
+	uint16_t seq;
+	uint32_t packets;
+	uint32_t events;
+	uint32_t lost;
+	uint32_t long_headers;
+};
+
+static volatile sig_atomic_t done = 0;
+
+static void
+_sig(int signum)
+{
+	(void)signum;
+	done = 1;
+}
+
+static uint64_t
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*10000 + ts.tv_nsec/100000; // 100us units
+}
+
+static int
+_bind(uint16_t port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_ANY)
+	};
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if( (fd < 0) || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) )
+	{
+		perror("bind");
+		exit(1);
+	}
+
+	return fd;
+}
+
+static uint_fast8_t
+_data_len(uint8_t status)
+{
+	switch(status & 0xf0)
+	{
+		case 0xc0:
+		case 0xd0:
+			return 1;
+		default:
+			return 2;
+	}
+}
+
+// decode command section of a journal-less RTP-MIDI packet
+static void
+_responder_midi(Responder *res, const uint8_t *buf, ssize_t len, uint_fast8_t verbose)
+{
+	const RTPMIDI_Header *header = (const RTPMIDI_Header *)buf;
+	const uint8_t *ptr = buf + sizeof(RTPMIDI_Header);
+	const uint8_t *end = buf + len;
+
+	if( (len < (ssize_t)sizeof(RTPMIDI_Header) + 1) || (header->flags != 0x80)
+		|| ( (header->type & 0x7f) != RTPMIDI_PAYLOAD_TYPE) )
+	{
+		fprintf(stderr, "invalid RTP packet\n");
+		return;
+	}
+
+	uint16_t seq = ntoh(header->seq);
+	if(res->packets && (seq != (uint16_t)(res->seq + 1)) )
+		res->lost += (uint16_t)(seq - res->seq - 1);
+	res->seq = seq;
+	res->packets++;
+
+	uint16_t size = ptr[0] & 0x0f;
+	if(ptr[0] & 0x80) // B flag, 12 bit length
+	{
+		size = (size << 8) | ptr[1];
+		ptr += 2;
+		res->long_headers++;
+	}
+	else
+		ptr += 1;
+
+	if(buf[sizeof(RTPMIDI_Header)] & 0x70) // J, Z and P flags
+		fprintf(stderr, "unexpected flags 0x%02x\n", buf[sizeof(RTPMIDI_Header)]);
+
+	if(ptr + size != end)
+	{
+		fprintf(stderr, "section length %u does not match packet\n", size);
+		return;
+	}
+
+	if(verbose)
+		printf("#%u @%"PRIu32":", seq, ntohl(header->timestamp));
+
+	uint8_t running = 0;
+	for(uint_fast8_t first = 1; ptr < end; first = 0)
+	{
+		if(!first) // delta time, one to four bytes
+			while( (ptr < end) && (*ptr++ & 0x80) )
+				;
+
+		if(*ptr & 0x80)
+			running = *ptr++;
+		else if(!running)
+		{
+			fprintf(stderr, "missing status byte\n");
+			return;
+		}
+
+		uint_fast8_t n = _data_len(running);
+		if(ptr + n > end)
+		{
+			fprintf(stderr, "truncated command\n");
+			return;
+		}
+
+		if(verbose)
+		{
+			printf(" %02x %02x", running, ptr[0]);
+			if(n == 2)
+				printf(" %02x", ptr[1]);
+		}
+		ptr += n;
+		res->events++;
+	}
+
+	if(verbose)
+		printf("\n");
+}
+
+static void
+_responder_session(Responder *res, int fd, const uint8_t *buf, ssize_t len,
+	struct sockaddr_in *from, socklen_t from_len, uint_fast8_t verbose)
+{
+	const AppleMIDI_Invitation *inv = (const AppleMIDI_Invitation *)buf;
+	uint8_t reply [BUF_LEN];
+
+	if(!memcmp(inv->command, "IN", 2) && (len >= (ssize_t)sizeof(AppleMIDI_Invitation)) )
+	{
+		AppleMIDI_Invitation *ok = (AppleMIDI_Invitation *)reply;
+		const char *name = "stand-in";
+		uint_fast8_t data = fd == res->fd[APPLEMIDI_PORT_DATA];
+
+		printf("IN on %s port from %s:%u, \"%.*s\"\n", data ? "data" : "control",
+			inet_ntoa(from->sin_addr), ntohs(from->sin_port),
+			(int)(len - sizeof(AppleMIDI_Invitation)), inv->name);
+
+		*ok = *inv;
+		memcpy(ok->command, "OK", 2);
+		ok->ssrc = htonl(res->ssrc);
+		strcpy(ok->name, name);
+		sendto(fd, reply, sizeof(AppleMIDI_Invitation) + strlen(name) + 1, 0,
+			(struct sockaddr *)from, from_len);
+
+		res->remote_ssrc = ntohl(inv->ssrc);
+		if(data)
+		{
+			res->connected = 1;
+			res->synced = 0;
+			res->sync_sent = 0;
+			res->packets = 0;
+		}
+	}
+	else if(!memcmp(inv->command, "CK", 2) && (len >= (ssize_t)sizeof(AppleMIDI_Sync)) )
+	{
+		const AppleMIDI_Sync *sync = (const AppleMIDI_Sync *)buf;
+		AppleMIDI_Sync *ck = (AppleMIDI_Sync *)reply;
+		uint64_t now = _now();
+
+		*ck = *sync;
+		ck->ssrc = htonl(res->ssrc);
+
+		switch(sync->count)
+		{
+			case 0:
+				ck->count = 1;
+				ck->timestamp[1] = htonll(now);
+				sendto(fd, reply, sizeof(AppleMIDI_Sync), 0, (struct sockaddr *)from, from_len);
+				break;
+			case 1: // answer to our own clock sync
+				ck->count = 2;
+				ck->timestamp[2] = htonll(now);
+				sendto(fd, reply, sizeof(AppleMIDI_Sync), 0, (struct sockaddr *)from, from_len);
+				printf("CK initiated by responder, round trip %.1f ms\n",
+					(now - ntohll(sync->timestamp[0])) * 0.1);
+				break;
+			case 2:
+			{
+				uint64_t t1 = ntohll(sync->timestamp[0]);
+				uint64_t t3 = ntohll(sync->timestamp[2]);
+				res->synced++;
+				if(verbose || (res->synced == 1) )
+					printf("CK #%u completed, initiator round trip %.1f ms\n", res->synced, (t3 - t1) * 0.1);
+
+				if(!res->sync_sent) // exercise clock sync in the other direction, too
+				{
+					memset(ck, 0, sizeof(AppleMIDI_Sync));
+					ck->signature = hton(APPLEMIDI_SIGNATURE);
+					memcpy(ck->command, "CK", 2);
+					ck->ssrc = htonl(res->ssrc);
+					ck->timestamp[0] = htonll(_now());
+					sendto(fd, reply, sizeof(AppleMIDI_Sync), 0, (struct sockaddr *)from, from_len);
+					res->sync_sent = 1;
+				}
+				break;
+			}
+		}
+	}
+	else if(!memcmp(inv->command, "BY", 2) && (len >= (ssize_t)sizeof(AppleMIDI_Invitation)) )
+	{
+		printf("BY: %"PRIu32" packets, %"PRIu32" events, %"PRIu32" lost, %"PRIu32" long headers\n",
+			res->packets, res->events, res->lost, res->long_headers);
+		res->connected = 0;
+	}
+	else
+		printf("ignored %.2s\n", inv->command);
+}
+
+static int
+_responder(uint16_t port, uint_fast8_t verbose, uint_fast8_t once)
+{
+	Responder res = {
+		.fd = {_bind(port), _bind(port + 1)},
+		.ssrc = 0x5354414e // 'STAN'
+	};
+	struct pollfd fds [2] = {
+		{.fd = res.fd[0], .events = POLLIN},
+		{.fd = res.fd[1], .events = POLLIN}
+	};
+
+	printf("responding on ports %u and %u\n", port, port + 1);
+	fflush(stdout);
+
+	while(!done)
+	{
+		if(poll(fds, 2, 100) <= 0)
+			continue;
+
+		for(int i=0; i<2; i++)
+		{
+			uint8_t buf [BUF_LEN];
+			struct sockaddr_in from;
+			socklen_t from_len = sizeof(from);
+
+			if( !(fds[i].revents & POLLIN) )
+				continue;
+
+			ssize_t len = recvfrom(fds[i].fd, buf, BUF_LEN, 0, (struct sockaddr *)&from, &from_len);
+			if(len < 4)
+				continue;
+
+			if( (buf[0] == 0xff) && (buf[1] == 0xff) )
+			{
+				uint_fast8_t connected = res.connected;
+				_responder_session(&res, fds[i].fd, buf, len, &from, from_len, verbose);
+				if(connected && !res.connected && once)
+					done = 1;
+			}
+			else if(i == APPLEMIDI_PORT_DATA)
+				_responder_midi(&res, buf, len, verbose);
+		}
+		fflush(stdout);
+	}
+
+	close(res.fd[0]);
+	close(res.fd[1]);
+
+	return 0;
+}
+
+// one frame of a glissando over a few octaves, with a burst of notes now and then
+static uint_fast8_t
+_glissando(uint32_t frame, RTPMIDI_Event *events)
+{
+	uint_fast8_t n = 0;
+	uint8_t key = 0x30 + (frame / 64) % 24;
+	uint16_t bend = 0x2000 + (frame % 64) * 0x80;
+
+	if(frame % 64 == 0)
+	{
+		if(frame)
+			events[n++] = (RTPMIDI_Event){0x80, key - 1, 0x7f};
+		events[n++] = (RTPMIDI_Event){0x90, key, 0x7f};
+	}
+
+	events[n++] = (RTPMIDI_Event){0xe0, bend & 0x7f, bend >> 7};
+	events[n++] = (RTPMIDI_Event){0xb0, 0x07, frame & 0x7f};
+	events[n++] = (RTPMIDI_Event){0xd0, (frame * 3) & 0x7f, 0};
+
+	if(frame % 256 == 128) // chord, needs a long section header
+		for(uint_fast8_t i=0; i<8; i++)
+		{
+			events[n++] = (RTPMIDI_Event){0x91 + i, 0x40 + i, 0x60};
+			events[n++] = (RTPMIDI_Event){0x81 + i, 0x40 + i, 0x00};
+		}
+
+	return n;
+}
+
+static int
+_initiator(const char *host, uint16_t port, uint16_t local, double seconds, uint32_t period)
+{
+	struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+	struct addrinfo *ai;
+	if(getaddrinfo(host, NULL, &hints, &ai))
+	{
+		fprintf(stderr, "unknown host %s\n", host);
+		return 1;
+	}
+	struct sockaddr_in remote = *(struct sockaddr_in *)ai->ai_addr;
+	freeaddrinfo(ai);
+
+	int fd = _bind(local); // a single socket for control and data, as on the device
+	AppleMIDI_Session session;
+	uint64_t start = _now();
+	uint64_t last = 0;
+	uint8_t state = APPLEMIDI_STATE_IDLE;
+	uint32_t frame = 0;
+	uint32_t sent_events = 0;
+	uint32_t sent_packets = 0;
+	uint32_t sent_bytes = 0;
+
+	applemidi_reset(&session, 0x43484d41 ^ (uint32_t)start, "chimaera stand-in"); // 'CHMA'
+	applemidi_start(&session, start);
+
+	while(!done && (_now() - start < seconds * 10000) )
+	{
+		uint8_t buf [BUF_LEN];
+		uint8_t reply [BUF_LEN];
+		AppleMIDI_Port p;
+		uint16_t len;
+		uint64_t now = _now();
+
+		if( (len = applemidi_request(&session, now, buf, &p)) )
+		{
+			remote.sin_port = htons(port + p);
+			sendto(fd, buf, len, 0, (struct sockaddr *)&remote, sizeof(remote));
+		}
+
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		while(poll(&pfd, 1, 0) > 0)
+		{
+			struct sockaddr_in from;
+			socklen_t from_len = sizeof(from);
+			ssize_t n = recvfrom(fd, buf, BUF_LEN, 0, (struct sockaddr *)&from, &from_len);
+			if(n <= 0)
+				break;
+
+			p = ntohs(from.sin_port) == port + 1 ? APPLEMIDI_PORT_DATA : APPLEMIDI_PORT_CONTROL;
+			if( (len = applemidi_dispatch(&session, _now(), p, buf, n, reply)) )
+				sendto(fd, reply, len, 0, (struct sockaddr *)&from, from_len);
+		}
+
+		if(session.state != state)
+		{
+			static const char *states [] = {"idle", "invite_control", "invite_data", "connected"};
+			printf("%.1f ms: %s\n", (_now() - start) * 0.1, states[session.state]);
+			state = session.state;
+		}
+
+		now = _now();
+		if( (session.state == APPLEMIDI_STATE_CONNECTED) && (now - last >= period) )
+		{
+			RTPMIDI_Event events [RTPMIDI_EVENT_MAX];
+			uint_fast8_t n = _glissando(frame++, events);
+
+			if( (len = rtpmidi_packet(&session, now, buf, events, n)) )
+			{
+				remote.sin_port = htons(port + APPLEMIDI_PORT_DATA);
+				sendto(fd, buf, len, 0, (struct sockaddr *)&remote, sizeof(remote));
+				sent_events += n;
+				sent_packets++;
+				sent_bytes += len;
+			}
+			last = now;
+		}
+
+		usleep(100);
+	}
+
+	uint8_t buf [BUF_LEN];
+	uint16_t len = applemidi_bye(&session, buf);
+	if(len)
+	{
+		remote.sin_port = htons(port);
+		sendto(fd, buf, len, 0, (struct sockaddr *)&remote, sizeof(remote));
+	}
+
+	printf("sent %"PRIu32" packets, %"PRIu32" events, %.1f bytes/packet, latency %.2f ms\n",
+		sent_packets, sent_events, sent_packets ? (double)sent_bytes / sent_packets : 0.0,
+		session.latency * 0.1);
+	close(fd);
+
+	return session.state == APPLEMIDI_STATE_IDLE ? 0 : 1;
+}
+
+static void
+_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s -r [-p PORT] [-1] [-v]\n"
+		"       %s -i HOST [-p PORT] [-l LOCAL] [-t SECONDS] [-f PERIOD]\n"
+		"\n"
+		"  -r           session responder on control PORT and data PORT+1\n"
+		"  -i HOST      initiate session with responder at HOST:PORT\n"
+		"  -p PORT      responder control port (5004)\n"
+		"  -l LOCAL     local port of initiator (5004)\n"
+		"  -t SECONDS   duration of initiated session (5)\n"
+		"  -f PERIOD    frame period of glissando in 100us (10)\n"
+		"  -1           exit responder after first session ended\n"
+		"  -v           print every packet\n",
+		argv0, argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host = NULL;
+	uint_fast8_t respond = 0;
+	uint_fast8_t verbose = 0;
+	uint_fast8_t once = 0;
+	uint16_t port = 5004;
+	uint16_t local = 5004;
+	double seconds = 5.0;
+	uint32_t period = 10;
+	int c;
+
+	while( (c = getopt(argc, argv, "ri:p:l:t:f:1v")) != -1)
+	{
+		switch(c)
+		{
+			case 'r':
+				respond = 1;
+				break;
+			case 'i':
+				host = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'l':
+				local = atoi(optarg);
+				break;
+			case 't':
+				seconds = atof(optarg);
+				break;
+			case 'f':
+				period = atoi(optarg);
+				break;
+			case '1':
+				once = 1;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(respond == !!host)
+	{
+		_usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, _sig);
+	signal(SIGTERM, _sig);
+
+	if(respond)
+		return _responder(port, verbose, once);
+
+	return _initiator(host, port, local, seconds, period);
+}
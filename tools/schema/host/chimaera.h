@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host stand-in for include/chimaera.h, include/config.h only needs the group and blob counts,
+// the checks the EEPROM location of the configuration
+
+#ifndef _CHIMAERA_H_
+#define _CHIMAERA_H_
+
+#define BLOB_MAX 8 // as in include/chimaera.h
+#define GROUP_MAX 8 // as in include/chimaera.h
+#define EEPROM_CONFIG_OFFSET 0x0000 // as in include/chimaera.h
+
+#endif // _CHIMAERA_H_
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host checks of the firmware's unmodified schema/schema.c, migrates images
+// stored by a previous layout of a config-like struct from a model EEPROM,
+// and a raw Config of firmware 0.14.0 via config/config_schema.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <libmaple/i2c.h>
+#include <libmaple/delay.h>
+#include <libmaple/systick.h>
+
+#include <schema.h>
+#include <config.h>
+
+#define STORAGE_SIZE 0x2000
+#define DATA_OFFSET 0x100
+#define DATA_SIZE 0x400
+
+typedef struct _Previous Previous;
+typedef struct _Current Current;
+
+// layout of a previous firmware
+struct _Previous {
+	char name [8];
+	struct {
+		uint16_t rate;
+	} sensors;
+	struct {
+		uint8_t ip [4];
+		uint16_t port;
+	} comm;
+	uint8_t removed [6];
+};
+
+// current layout: grown, changed and new sections, different offsets
+struct _Current {
+	uint8_t added [12];
+	struct {
+		uint16_t port;
+		uint8_t ip [4];
+	} comm;
+	struct {
+		uint16_t rate;
+		uint16_t idle_rate; // appended member
+	} sensors;
+	char name [6]; // shrunk
+	uint8_t guard [4];
+};
+
+#define FIELD(TYPE, TAG, VERSION, MEMBER) \
+	{.tag = TAG, .version = VERSION, .offset = offsetof(TYPE, MEMBER), .len = sizeof(((TYPE *)0)->MEMBER)}
+
+static const Config_Field previous_fields [] = {
+	FIELD(Previous, 0x01, 1, name),
+	FIELD(Previous, 0x02, 1, sensors),
+	FIELD(Previous, 0x03, 1, comm),
+	FIELD(Previous, 0x04, 1, removed)
+};
+
+static const Config_Field current_fields [] = {
+	FIELD(Current, 0x05, 1, added),
+	FIELD(Current, 0x03, 2, comm), // reordered members
+	FIELD(Current, 0x02, 1, sensors),
+	FIELD(Current, 0x01, 1, name),
+	FIELD(Current, 0x06, 1, guard)
+};
+
+#define N(FIELDS) (sizeof(FIELDS) / sizeof(Config_Field))
+
+static const Current defaults = {
+	.added = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12},
+	.comm = {.port = 3333, .ip = {192, 168, 1, 177}},
+	.sensors = {.rate = 2000, .idle_rate = 100},
+	.name = "dflt",
+	.guard = {0xaa, 0xbb, 0xcc, 0xdd}
+};
+
+typedef struct _Baseline Baseline;
+
+// raw Config of firmware 0.14.0, sections unchanged since refer to the current headers
+struct _Baseline {
+	Firmware_Version version;
+	char name [NAME_LENGTH];
+	struct _comm comm;
+	struct _dump dump;
+	struct _tuio2 tuio2;
+	struct _tuio1 tuio1;
+	struct _scsynth scsynth;
+	struct {
+		uint8_t enabled;
+		uint8_t multi;
+		uint8_t format;
+		uint8_t mpe;
+		char path [64];
+	} oscmidi;
+	struct _dummy dummy;
+	struct {
+		uint8_t enabled;
+		struct {
+			uint8_t dest; // enum
+			char path [64];
+			char fmt [12];
+			struct {
+				uint8_t inst [32]; // enum
+				float val [32];
+			} vm;
+		} items [8];
+	} custom;
+	struct _output output;
+	struct _config config;
+	struct _ptp ptp;
+	struct _sntp sntp;
+	struct _debug debug;
+	struct _ipv4ll ipv4ll;
+	struct _mdns mdns;
+	struct _dhcpc dhcpc;
+	struct {
+		uint8_t movingaverage_bitshift;
+		uint8_t interpolation_mode;
+		uint8_t velocity_stiffness;
+		uint16_t rate;
+	} sensors;
+	CMC_Group groups [GROUP_MAX];
+	SCSynth_Group scsynth_groups [GROUP_MAX];
+	OSC_MIDI_Group oscmidi_groups [GROUP_MAX];
+};
+
+static const Config_Field baseline_fields [] = {
+	FIELD(Baseline, 0x01, 1, name),
+	FIELD(Baseline, 0x02, 1, comm),
+	FIELD(Baseline, 0x03, 1, dump),
+	FIELD(Baseline, 0x04, 1, tuio2),
+	FIELD(Baseline, 0x05, 1, tuio1),
+	FIELD(Baseline, 0x06, 1, scsynth),
+	FIELD(Baseline, 0x07, 1, oscmidi),
+	FIELD(Baseline, 0x08, 1, dummy),
+	FIELD(Baseline, 0x09, 1, custom),
+	FIELD(Baseline, 0x0a, 1, output),
+	FIELD(Baseline, 0x0b, 1, config),
+	FIELD(Baseline, 0x0c, 1, ptp),
+	FIELD(Baseline, 0x0d, 1, sntp),
+	FIELD(Baseline, 0x0e, 1, debug),
+	FIELD(Baseline, 0x0f, 1, ipv4ll),
+	FIELD(Baseline, 0x10, 1, mdns),
+	FIELD(Baseline, 0x11, 1, dhcpc),
+	{.tag = 0x12, .version = 1, .offset = offsetof(Baseline, sensors), // members in front of rate
+		.len = offsetof(Baseline, sensors.velocity_stiffness) + 1 - offsetof(Baseline, sensors)},
+	FIELD(Baseline, 0x13, 1, groups),
+	FIELD(Baseline, 0x14, 1, scsynth_groups),
+	FIELD(Baseline, 0x15, 1, oscmidi_groups)
+};
+
+static uint8_t mem [STORAGE_SIZE];
+static uint16_t ptr;
+static uint32_t now;
+static unsigned failures = 0;
+
+int32_t
+i2c_master_xfer(i2c_dev *dev, i2c_msg *msgs, uint16_t num, uint32_t timeout)
+{
+	(void)dev;
+	(void)timeout;
+
+	for(uint16_t m=0; m<num; m++)
+	{
+		i2c_msg *msg = &msgs[m];
+
+		if(msg->flags & I2C_MSG_READ)
+			for(uint16_t i=0; i<msg->length; i++)
+				msg->data[i] = mem[ptr++ % STORAGE_SIZE];
+		else
+		{
+			ptr = ( (msg->data[0] << 8) | msg->data[1] ) % STORAGE_SIZE;
+			for(uint16_t i=2; i<msg->length; i++)
+				mem[(ptr + i - 2) % STORAGE_SIZE] = msg->data[i];
+		}
+	}
+
+	return 0;
+}
+
+void
+i2c_master_enable(i2c_dev *dev, uint32_t flags)
+{
+	(void)dev;
+	(void)flags;
+}
+
+void
+i2c_disable(i2c_dev *dev)
+{
+	(void)dev;
+}
+
+void
+delay_us(uint32_t us)
+{
+	now += us;
+}
+
+uint32_t
+systick_uptime(void)
+{
+	return now++;
+}
+
+static void
+_check(const char *what, uint_fast8_t ok)
+{
+	printf("%-48s %s\n", what, ok ? "ok" : "FAIL");
+	if(!ok)
+		failures++;
+}
+
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	const Previous previous = {
+		.name = "stored",
+		.sensors = {.rate = 555},
+		.comm = {.ip = {10, 0, 0, 2}, .port = 4444},
+		.removed = {0xee, 0xee, 0xee, 0xee, 0xee, 0xee}
+	};
+	Config_Field stored [N(previous_fields) + 1];
+	Current current;
+
+	eeprom_init(NULL);
+	eeprom_slave_init(eeprom_24LC64, NULL, 0);
+
+	// same layout
+	memcpy(&current, &defaults, sizeof(Current));
+	current.sensors.rate = 1234;
+	memcpy(&mem[DATA_OFFSET], &current, sizeof(Current));
+	memcpy(&current, &defaults, sizeof(Current));
+	schema_import(eeprom_24LC64, DATA_OFFSET, DATA_SIZE, current_fields, N(current_fields),
+		current_fields, N(current_fields), (uint8_t *)&current);
+	_check("same layout imports all sections", current.sensors.rate == 1234
+		&& !memcmp(current.added, defaults.added, sizeof(current.added)) );
+
+	// previous layout plus a section out of bounds
+	memcpy(&mem[DATA_OFFSET], &previous, sizeof(Previous));
+	memcpy(stored, previous_fields, sizeof(previous_fields));
+	stored[N(previous_fields)] = (Config_Field){.tag = 0x06, .version = 1, .offset = DATA_SIZE - 2, .len = 4};
+	memcpy(&current, &defaults, sizeof(Current));
+	schema_import(eeprom_24LC64, DATA_OFFSET, DATA_SIZE, stored, N(stored),
+		current_fields, N(current_fields), (uint8_t *)&current);
+
+	_check("section of same version imported", current.sensors.rate == 555);
+	_check("appended member keeps default", current.sensors.idle_rate == defaults.sensors.idle_rate);
+	_check("section of other version keeps defaults", !memcmp(&current.comm, &defaults.comm, sizeof(current.comm)) );
+	_check("new section keeps defaults", !memcmp(current.added, defaults.added, sizeof(current.added)) );
+	_check("shrunk section truncated", !memcmp(current.name, "stored", sizeof(current.name)) );
+	_check("section out of bounds skipped", !memcmp(current.guard, defaults.guard, sizeof(current.guard)) );
+	_check("lookup of unknown tag", !schema_field(current_fields, N(current_fields), 0x04) );
+
+	// raw Config of firmware 0.14.0
+	static Baseline baseline;
+	static Config config;
+
+	memset(&baseline, 0x11, sizeof(Baseline));
+	strcpy(baseline.name, "baseline");
+	baseline.comm.ip[3] = 177;
+	strcpy(baseline.oscmidi.path, "/midi");
+	baseline.output.offset = 0x123456789abcdef0ULL;
+	baseline.sensors.velocity_stiffness = 5;
+	baseline.sensors.rate = 1000;
+	baseline.groups[GROUP_MAX-1].pid = 0x80;
+	baseline.oscmidi_groups[GROUP_MAX-1].range = 48.f;
+	memcpy(&mem[EEPROM_CONFIG_OFFSET], &baseline, sizeof(Baseline));
+	memset(&config, 0x5a, sizeof(Config)); // defaults
+	schema_import(eeprom_24LC64, EEPROM_CONFIG_OFFSET, CONFIG_LEGACY_SIZE,
+		config_legacy_fields, N(config_legacy_fields), config_fields, N(config_fields), (uint8_t *)&config);
+
+	_check("legacy size matches 0.14.0 layout", sizeof(Baseline) == CONFIG_LEGACY_SIZE);
+	_check("legacy sections match 0.14.0 layout", (N(config_legacy_fields) == N(baseline_fields))
+		&& !memcmp(config_legacy_fields, baseline_fields, sizeof(baseline_fields)) );
+	_check("legacy sections imported", !strcmp(config.name, "baseline")
+		&& (config.comm.ip[3] == 177) && !strcmp(config.oscmidi.path, "/midi")
+		&& (config.output.offset == baseline.output.offset)
+		&& (config.groups[GROUP_MAX-1].pid == 0x80)
+		&& (config.oscmidi_groups[GROUP_MAX-1].range == 48.f) );
+	_check("legacy appended members keep defaults", (config.oscmidi.coalesce == 0x5a)
+		&& (config.sensors.sample_time == 0x5a) && (config.sensors.idle_timeout == 0x5a5a) );
+	_check("legacy moved member keeps default", (config.sensors.velocity_stiffness == 5)
+		&& (config.sensors.rate == 0x5a5a) );
+	_check("legacy re-encoded and new sections keep defaults", (config.custom.enabled == 0x5a)
+		&& (config.rtpmidi.socket.enabled == 0x5a) );
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <libmaple/adc.h>
+#include <libmaple/systick.h>
+
+#include <chimaera.h>
+#include <config.h>
+#include <sensors.h>
+#include <sntp.h>
+#include <calibration.h>
+
+#include "tuner_private.h"
+
+// globals
+uint_fast8_t tuning = 0;
+
+// locals
+static const uint8_t sample_times [TUNER_SAMPLE_TIME_N] = {
+	ADC_SMPR_1_5,
+	ADC_SMPR_2_5,
+	ADC_SMPR_4_5,
+	ADC_SMPR_7_5,
+	ADC_SMPR_19_5,
+	ADC_SMPR_61_5,
+	ADC_SMPR_181_5,
+	ADC_SMPR_601_5
+};
+
+static const float sample_cycles [TUNER_SAMPLE_TIME_N] = {
+	1.5f, 2.5f, 4.5f, 7.5f, 19.5f, 61.5f, 181.5f, 601.5f
+};
+
+static const uint8_t mux_settles [TUNER_MUX_SETTLE_N] = {0, 1, 2, 5}; // us
+
+static Tuner_State state = TUNER_STATE_IDLE;
+static Tuner_Result results [TUNER_SETTING_N];
+static int_fast8_t best = -1;
+
+static float target; // maximal tolerated noise
+static uint8_t apply; // apply best setting after the sweep?
+static uint8_t orig_sample_time;
+static uint8_t orig_mux_settle;
+
+static uint_fast8_t setting;
+static uint_fast16_t frame;
+static uint32_t t0;
+static uint32_t sum [SENSOR_N];
+static uint32_t sum2 [SENSOR_N];
+
+static void
+_tuner_setting_set(uint_fast8_t i)
+{
+	Tuner_Result *res = &results[i];
+
+	res->sample_time = sample_times[i / TUNER_MUX_SETTLE_N];
+	res->mux_settle = mux_settles[i % TUNER_MUX_SETTLE_N];
+	res->noise = 0.f;
+	res->rate = 0.f;
+
+	config.sensors.sample_time = res->sample_time;
+	config.sensors.mux_settle = res->mux_settle;
+	sensors_adc_dirty = 1; // applied by main loop after current conversion
+
+	frame = 0;
+	memset(sum, 0, sizeof(sum));
+	memset(sum2, 0, sizeof(sum2));
+}
+
+static void
+_tuner_evaluate(Tuner_Result *res, uint32_t ticks)
+{
+	uint64_t max_var = 0;
+	uint_fast8_t i;
+
+	// N^2*variance = N*sum2 - sum^2, exact in integers, float would cancel out
+	for(i=0; i<SENSOR_N; i++)
+	{
+		uint64_t var = (uint64_t)TUNER_FRAMES*sum2[i] - (uint64_t)sum[i]*sum[i];
+
+		if(var > max_var)
+			max_var = var;
+	}
+
+	res->noise = sqrtf(max_var) / TUNER_FRAMES;
+	res->rate = ticks ? (float)TUNER_FRAMES * SNTP_SYSTICK_RATE / ticks : 0.f;
+}
+
+static void
+_tuner_finish(void)
+{
+	uint_fast8_t i;
+
+	// fastest setting that keeps noise under target
+	best = -1;
+	for(i=0; i<TUNER_SETTING_N; i++)
+		if( (results[i].noise <= target) && ( (best < 0) || (results[i].rate > results[best].rate) ) )
+			best = i;
+
+	if(apply && (best >= 0) )
+	{
+		config.sensors.sample_time = results[best].sample_time;
+		config.sensors.mux_settle = results[best].mux_settle;
+	}
+	else // restore previous setting
+	{
+		config.sensors.sample_time = orig_sample_time;
+		config.sensors.mux_settle = orig_mux_settle;
+	}
+	sensors_adc_dirty = 1;
+
+	state = TUNER_STATE_DONE;
+	tuning = 0;
+}
+
+void
+tuner_step(int16_t *raw12, int16_t *raw3, uint8_t *order12, uint8_t *order3)
+{
+	uint_fast8_t i;
+
+	if(frame < TUNER_WARMUP) // skip frames sampled with previous setting
+	{
+		if(++frame == TUNER_WARMUP)
+			t0 = systick_uptime();
+		return;
+	}
+
+	// accumulate raw sensor values, the noise floor is independent of the quiescent offset
+#if(ADC_DUAL_LENGTH > 0)
+	for(i=0; i<MUX_MAX*ADC_DUAL_LENGTH*2; i++)
+	{
+		uint_fast8_t pos = order12[i];
+		uint32_t val = raw12[i];
+		sum[pos] += val;
+		sum2[pos] += val*val;
+	}
+#else
+	(void)raw12;
+	(void)order12;
+#endif
+
+#if(ADC_SING_LENGTH > 0)
+	for(i=0; i<MUX_MAX*ADC_SING_LENGTH; i++)
+	{
+		uint_fast8_t pos = order3[i];
+		uint32_t val = raw3[i];
+		sum[pos] += val;
+		sum2[pos] += val*val;
+	}
+#else
+	(void)raw3;
+	(void)order3;
+#endif
+
+	if(++frame < TUNER_WARMUP + TUNER_FRAMES)
+		return;
+
+	_tuner_evaluate(&results[setting], systick_uptime() - t0);
+
+	if(++setting < TUNER_SETTING_N)
+		_tuner_setting_set(setting);
+	else
+		_tuner_finish();
+}
+
+/*
+ * Config
+ */
+
+static uint_fast8_t
+_tuner_start(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+	int32_t i;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(argc < 3) // query, there is nothing to read back
+	{
+		size = CONFIG_FAIL("iss", uuid, path, "noise target and apply flag expected");
+		CONFIG_SEND(size);
+		return 1;
+	}
+
+	buf_ptr = osc_get_float(buf_ptr, &target);
+	buf_ptr = osc_get_int32(buf_ptr, &i);
+	apply = i != 0 ? 1 : 0;
+
+	if(calibrating)
+		size = CONFIG_FAIL("iss", uuid, path, "not available in calibration mode");
+	else if(tuning)
+		size = CONFIG_FAIL("iss", uuid, path, "tuner already running");
+	else
+	{
+		orig_sample_time = config.sensors.sample_time;
+		orig_mux_settle = config.sensors.mux_settle;
+
+		best = -1;
+		setting = 0;
+		_tuner_setting_set(setting);
+
+		state = TUNER_STATE_RUNNING;
+		tuning = 1;
+
+		size = CONFIG_SUCCESS("is", uuid, path);
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_tuner_state(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	switch(state)
+	{
+		case TUNER_STATE_IDLE:
+			size = CONFIG_SUCCESS("iss", uuid, path, "idle");
+			break;
+		case TUNER_STATE_RUNNING:
+			size = CONFIG_SUCCESS("iss", uuid, path, "running");
+			break;
+		case TUNER_STATE_DONE:
+		default:
+			size = CONFIG_SUCCESS("iss", uuid, path, "done");
+			break;
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_tuner_result(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf, int_fast8_t i)
+{
+	(void)fmt;
+	(void)argc;
+	osc_data_t *buf_ptr = buf;
+	uint16_t size;
+	int32_t uuid;
+
+	buf_ptr = osc_get_int32(buf_ptr, &uuid);
+
+	if(state != TUNER_STATE_DONE)
+		size = CONFIG_FAIL("iss", uuid, path, "no tuning results available");
+	else if(i < 0)
+		size = CONFIG_FAIL("iss", uuid, path, "no setting meets noise target");
+	else
+	{
+		Tuner_Result *res = &results[i];
+		float cycles = sample_cycles[i / TUNER_MUX_SETTLE_N];
+
+		size = CONFIG_SUCCESS("isfiff", uuid, path, cycles, res->mux_settle, res->noise, res->rate);
+	}
+
+	CONFIG_SEND(size);
+
+	return 1;
+}
+
+static uint_fast8_t
+_tuner_best(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	return _tuner_result(path, fmt, argc, buf, best);
+}
+
+static uint_fast8_t
+_tuner_report(const char *path, const char *fmt, uint_fast8_t argc, osc_data_t *buf)
+{
+	uint16_t i = 0;
+	sscanf(path, "/sensors/tuner/report/%hu", &i);
+
+	return _tuner_result(path, fmt, argc, buf, i);
+}
+
+/*
+ * Query
+ */
+
+static const OSC_Query_Argument tuner_start_args [] = {
+	OSC_QUERY_ARGUMENT_FLOAT("Noise target", OSC_QUERY_MODE_W, 0.f, 100.f, 0.1f),
+	OSC_QUERY_ARGUMENT_BOOL("Apply", OSC_QUERY_MODE_W)
+};
+
+static const OSC_Query_Value tuner_state_args_values [] = {
+	{ .s = "idle" },
+	{ .s = "running" },
+	{ .s = "done" }
+};
+
+static const OSC_Query_Argument tuner_state_args [] = {
+	OSC_QUERY_ARGUMENT_STRING_VALUES("State", OSC_QUERY_MODE_R, tuner_state_args_values)
+};
+
+static const OSC_Query_Argument tuner_result_args [] = {
+	OSC_QUERY_ARGUMENT_FLOAT("Sample time cycles", OSC_QUERY_MODE_R, 1.5f, 601.5f, 0.f),
+	OSC_QUERY_ARGUMENT_INT32("Mux settle us", OSC_QUERY_MODE_R, 0, 255, 1),
+	OSC_QUERY_ARGUMENT_FLOAT("Noise", OSC_QUERY_MODE_R, 0.f, 2048.f, 0.f),
+	OSC_QUERY_ARGUMENT_FLOAT("Hz", OSC_QUERY_MODE_R, 0.f, 100000.f, 0.f)
+};
+
+static const OSC_Query_Item tuner_report_array [] = {
+	OSC_QUERY_ITEM_METHOD("%i", "Setting", _tuner_report, tuner_result_args)
+};
+
+const OSC_Query_Item tuner_tree [] = {
+	OSC_QUERY_ITEM_METHOD("start", "Sweep sample times and mux settle delays", _tuner_start, tuner_start_args),
+
+	// read-only
+	OSC_QUERY_ITEM_METHOD("state", "Tuner state", _tuner_state, tuner_state_args),
+	OSC_QUERY_ITEM_METHOD("best", "Fastest setting under noise target", _tuner_best, tuner_result_args),
+	OSC_QUERY_ITEM_ARRAY("report/", "Per setting noise and rate", tuner_report_array, TUNER_SETTING_N)
+};
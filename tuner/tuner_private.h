@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _TUNER_PRIVATE_H_
+#define _TUNER_PRIVATE_H_
+
+#include <tuner.h>
+
+#define TUNER_WARMUP 16 // frames to skip after changing the setting
+#define TUNER_FRAMES 128 // frames to measure per setting, 128*4095^2 fits into 32 bits
+#define TUNER_SAMPLE_TIME_N 8
+#define TUNER_MUX_SETTLE_N 4
+#define TUNER_SETTING_N (TUNER_SAMPLE_TIME_N * TUNER_MUX_SETTLE_N)
+
+typedef enum _Tuner_State Tuner_State;
+typedef struct _Tuner_Result Tuner_Result;
+
+enum _Tuner_State {
+	TUNER_STATE_IDLE,
+	TUNER_STATE_RUNNING,
+	TUNER_STATE_DONE
+};
+
+struct _Tuner_Result {
+	uint8_t sample_time;
+	uint8_t mux_settle;
+	float noise; // standard deviation of noisiest sensor
+	float rate; // achieved loop rate
+};
+
+#endif // _TUNER_PRIVATE_H_